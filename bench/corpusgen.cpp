@@ -0,0 +1,75 @@
+// Генератор синтетического набора снимков для замеров и ручной проверки.
+//
+//   geophoto-corpus [--count N] [--depth D] [--fanout F] [--gps 0..1]
+//                   [--png 0..1] [--layouts le,be,far,thumb] [--seed S] каталог
+
+#include "corpusgenerator.h"
+
+#include <QCommandLineOption>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QGuiApplication>
+#include <cstdio>
+
+int main(int argc, char *argv[])
+{
+    // Кодеки изображений - плагины QtGui, окна не нужны
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    QGuiApplication app(argc, argv);
+
+    const CorpusGenerator::Options defaults;
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Generate a deterministic synthetic photo tree."));
+    parser.addHelpOption();
+    const QCommandLineOption countOption(QStringLiteral("count"), QStringLiteral("Number of photos."),
+                                         QStringLiteral("N"), QString::number(defaults.count));
+    const QCommandLineOption depthOption(QStringLiteral("depth"), QStringLiteral("Folder depth."),
+                                         QStringLiteral("D"), QString::number(defaults.depth));
+    const QCommandLineOption fanoutOption(QStringLiteral("fanout"), QStringLiteral("Subfolders per folder."),
+                                          QStringLiteral("F"), QString::number(defaults.fanout));
+    const QCommandLineOption gpsOption(QStringLiteral("gps"), QStringLiteral("Fraction of photos with GPS."),
+                                       QStringLiteral("fraction"), QString::number(defaults.gpsFraction));
+    const QCommandLineOption pngOption(QStringLiteral("png"), QStringLiteral("Fraction of PNG files."),
+                                       QStringLiteral("fraction"), QString::number(defaults.pngFraction));
+    const QCommandLineOption layoutsOption(QStringLiteral("layouts"),
+                                           QStringLiteral("EXIF layouts to cycle through: le, be, far, thumb."),
+                                           QStringLiteral("list"), defaults.layouts.join(QLatin1Char(',')));
+    const QCommandLineOption seedOption(QStringLiteral("seed"), QStringLiteral("Random seed."),
+                                        QStringLiteral("S"), QString::number(defaults.seed));
+    for (const QCommandLineOption &option : {countOption, depthOption, fanoutOption, gpsOption,
+                                             pngOption, layoutsOption, seedOption})
+        parser.addOption(option);
+    parser.addPositionalArgument(QStringLiteral("root"), QStringLiteral("Output folder."));
+    parser.process(app);
+
+    if (parser.positionalArguments().size() != 1)
+        parser.showHelp(1);
+
+    CorpusGenerator::Options options;
+    options.count = parser.value(countOption).toInt();
+    options.depth = parser.value(depthOption).toInt();
+    options.fanout = parser.value(fanoutOption).toInt();
+    options.gpsFraction = parser.value(gpsOption).toDouble();
+    options.pngFraction = parser.value(pngOption).toDouble();
+    options.layouts = parser.value(layoutsOption).split(QLatin1Char(','), Qt::SkipEmptyParts);
+    options.seed = parser.value(seedOption).toUInt();
+    for (const QString &layout : std::as_const(options.layouts)) {
+        if (!CorpusGenerator::knownLayouts().contains(layout)) {
+            std::fprintf(stderr, "Unknown EXIF layout: %s\n", qPrintable(layout));
+            return 1;
+        }
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    QString error;
+    CorpusGenerator generator(options);
+    if (!generator.generate(parser.positionalArguments().first(), &error)) {
+        std::fprintf(stderr, "%s\n", qPrintable(error));
+        return 1;
+    }
+    std::fprintf(stderr, "Generated %d photos in %.1f s\n", options.count,
+                 double(timer.elapsed()) / 1000.0);
+    return 0;
+}
@@ -0,0 +1,568 @@
+#include "corpusgenerator.h"
+#include "photoscanner.h"
+
+#include <QBuffer>
+#include <QColor>
+#include <QDir>
+#include <QFile>
+#include <QImage>
+#include <QtGlobal>
+#include <cmath>
+
+namespace {
+
+enum : quint16 {
+    TypeAscii = 2,
+    TypeShort = 3,
+    TypeLong = 4,
+    TypeRational = 5
+};
+
+constexpr int FarPadding = 12 * 1024;
+constexpr qint64 TripGapSecs = 24 * 60 * 60;
+// Секунды от 1904-01-01 (эпоха QuickTime) до 1970-01-01
+constexpr qint64 QuickTimeEpochOffset = 2082844800;
+
+// splitmix64: независимое псевдослучайное значение для каждого индекса
+quint64 mix(quint64 x)
+{
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+double unit(quint64 x)
+{
+    return double(x >> 11) / double(1ULL << 53);
+}
+
+// Запись TIFF с выбранным порядком байт; смещения - от начала блока
+class TiffWriter
+{
+public:
+    explicit TiffWriter(bool littleEndian) : m_le(littleEndian) {}
+
+    int pos() const { return int(m_data.size()); }
+    QByteArray data() const { return m_data; }
+
+    void u16(quint16 v)
+    {
+        const char b[2] = {char(m_le ? v : v >> 8), char(m_le ? v >> 8 : v)};
+        m_data.append(b, 2);
+    }
+
+    void u32(quint32 v)
+    {
+        m_data.append(QByteArray(4, '\0'));
+        patch32(pos() - 4, v);
+    }
+
+    void patch32(int at, quint32 v)
+    {
+        for (int i = 0; i < 4; ++i) {
+            const int shift = m_le ? 8 * i : 8 * (3 - i);
+            m_data[at + i] = char((v >> shift) & 0xFF);
+        }
+    }
+
+    void bytes(const QByteArray &b) { m_data.append(b); }
+    void setByte(int at, char c) { m_data[at] = c; }
+
+    // Запись IFD; возвращает позицию поля значения для последующей правки
+    int entry(quint16 tag, quint16 type, quint32 count)
+    {
+        u16(tag);
+        u16(type);
+        u32(count);
+        const int at = pos();
+        u32(0);
+        return at;
+    }
+
+    void rationals(double degrees)
+    {
+        const double value = std::fabs(degrees);
+        const quint32 d = quint32(value);
+        const double minutes = (value - d) * 60.0;
+        const quint32 m = quint32(minutes);
+        const quint32 s = quint32(std::lround((minutes - m) * 60.0 * 1000.0));
+        u32(d);
+        u32(1);
+        u32(m);
+        u32(1);
+        u32(s);
+        u32(1000);
+    }
+
+private:
+    QByteArray m_data;
+    bool m_le;
+};
+
+// Exif IFD со временем съёмки и GPS IFD (если есть координаты) с текущей
+// позиции; padding - пустое место между ними
+void writeExifIfds(TiffWriter &w, const PhotoInfo &info, int exifPointer, int gpsPointer, int padding)
+{
+    w.patch32(exifPointer, quint32(w.pos()));
+    w.u16(1);
+    const int dateValue = w.entry(0x9003, TypeAscii, 20);
+    w.u32(0);
+    w.patch32(dateValue, quint32(w.pos()));
+    w.bytes(info.timestamp.toString(QStringLiteral("yyyy:MM:dd HH:mm:ss")).toLatin1() + '\0');
+
+    w.bytes(QByteArray(padding, '\0'));
+
+    if (info.hasGps) {
+        w.patch32(gpsPointer, quint32(w.pos()));
+        w.u16(4);
+        const int latRef = w.entry(0x0001, TypeAscii, 2);
+        const int lat = w.entry(0x0002, TypeRational, 3);
+        const int lngRef = w.entry(0x0003, TypeAscii, 2);
+        const int lng = w.entry(0x0004, TypeRational, 3);
+        w.u32(0);
+        // Короткие строки лежат прямо в поле значения
+        w.setByte(latRef, info.latitude < 0 ? 'S' : 'N');
+        w.setByte(lngRef, info.longitude < 0 ? 'W' : 'E');
+        w.patch32(lat, quint32(w.pos()));
+        w.rationals(info.latitude);
+        w.patch32(lng, quint32(w.pos()));
+        w.rationals(info.longitude);
+    }
+}
+
+// Поля и боксы ISO-BMFF (big-endian)
+void appendBigEndian(QByteArray &out, quint64 value, int bytes)
+{
+    for (int shift = 8 * (bytes - 1); shift >= 0; shift -= 8)
+        out.append(char((value >> shift) & 0xFF));
+}
+
+QByteArray bigEndian(quint64 value, int bytes)
+{
+    QByteArray out;
+    appendBigEndian(out, value, bytes);
+    return out;
+}
+
+QByteArray box(const char *type, const QByteArray &payload)
+{
+    QByteArray out;
+    out.reserve(int(payload.size()) + 8);
+    appendBigEndian(out, quint64(payload.size()) + 8, 4);
+    out.append(type, 4);
+    out.append(payload);
+    return out;
+}
+
+QByteArray fullBox(const char *type, int version, const QByteArray &payload)
+{
+    return box(type, bigEndian(quint64(version) << 24, 4) + payload);
+}
+
+// meta HEIF: основное изображение 1 (hvc1) и его Exif 2, оба в mdat
+QByteArray heifMeta(qint64 exifOffset, int exifLength, qint64 frameOffset, int frameLength)
+{
+    const QByteArray terminator(1, '\0');
+    const QByteArray iinf = fullBox("iinf", 0, bigEndian(2, 2)
+            + fullBox("infe", 2, bigEndian(1, 2) + bigEndian(0, 2) + "hvc1" + terminator)
+            + fullBox("infe", 2, bigEndian(2, 2) + bigEndian(0, 2) + "Exif" + terminator));
+    // Версия 1: смещения и длины по 4 байта, без base_offset
+    QByteArray locations = QByteArray(1, char(0x44)) + QByteArray(1, '\0') + bigEndian(2, 2);
+    const qint64 places[2][2] = {{frameOffset, frameLength}, {exifOffset, exifLength}};
+    for (int id = 1; id <= 2; ++id) {
+        locations += bigEndian(quint64(id), 2) + bigEndian(0, 2) + bigEndian(0, 2) + bigEndian(1, 2)
+                + bigEndian(quint64(places[id - 1][0]), 4) + bigEndian(quint64(places[id - 1][1]), 4);
+    }
+    return fullBox("meta", 0,
+                   fullBox("hdlr", 0, bigEndian(0, 4) + "pict" + QByteArray(13, '\0'))
+                   + fullBox("pitm", 0, bigEndian(1, 2))
+                   + iinf
+                   + fullBox("iloc", 1, locations)
+                   + fullBox("iref", 0, box("cdsc", bigEndian(2, 2) + bigEndian(1, 2) + bigEndian(1, 2))));
+}
+
+quint32 crc32(const QByteArray &data)
+{
+    static quint32 table[256];
+    static bool ready = false;
+    if (!ready) {
+        for (quint32 n = 0; n < 256; ++n) {
+            quint32 c = n;
+            for (int k = 0; k < 8; ++k)
+                c = (c & 1) ? 0xEDB88320U ^ (c >> 1) : c >> 1;
+            table[n] = c;
+        }
+        ready = true;
+    }
+    quint32 crc = 0xFFFFFFFFU;
+    for (const char ch : data)
+        crc = table[(crc ^ uchar(ch)) & 0xFF] ^ (crc >> 8);
+    return crc ^ 0xFFFFFFFFU;
+}
+
+QByteArray encode(const QImage &image, const char *format)
+{
+    QByteArray bytes;
+    QBuffer buffer(&bytes);
+    buffer.open(QIODevice::WriteOnly);
+    image.save(&buffer, format, 85);
+    return bytes;
+}
+
+} // namespace
+
+CorpusGenerator::CorpusGenerator(const Options &options)
+    : m_options(options)
+{
+    m_options.count = qMax(0, m_options.count);
+    m_options.depth = qMax(0, m_options.depth);
+    m_options.fanout = qMax(1, m_options.fanout);
+    m_options.cities = qMax(1, m_options.cities);
+    m_options.tripLength = qMax(0, m_options.tripLength);
+    if (m_options.layouts.isEmpty())
+        m_options.layouts = knownLayouts();
+}
+
+QStringList CorpusGenerator::knownLayouts()
+{
+    return {QStringLiteral("le"), QStringLiteral("be"), QStringLiteral("far"), QStringLiteral("thumb")};
+}
+
+QString CorpusGenerator::relativeDir(int index) const
+{
+    int leaves = 1;
+    for (int level = 0; level < m_options.depth; ++level)
+        leaves *= m_options.fanout;
+
+    int leaf = index % leaves;
+    QStringList parts;
+    for (int level = 0; level < m_options.depth; ++level) {
+        parts.append(QStringLiteral("d%1").arg(leaf % m_options.fanout, 2, 10, QLatin1Char('0')));
+        leaf /= m_options.fanout;
+    }
+    return parts.join(QLatin1Char('/'));
+}
+
+bool CorpusGenerator::isPng(int index) const
+{
+    return unit(mix(quint64(m_options.seed) * 7919 + quint64(index) * 3 + 2)) < m_options.pngFraction;
+}
+
+QString CorpusGenerator::layoutAt(int index) const
+{
+    return m_options.layouts[index % m_options.layouts.size()];
+}
+
+PhotoInfo CorpusGenerator::photoAt(const QString &root, int index) const
+{
+    const quint64 seed = quint64(m_options.seed) * 7919;
+    const quint64 r = mix(seed + quint64(index) * 3);
+    const quint64 jitter = mix(seed + quint64(index) * 3 + 1);
+
+    PhotoInfo info;
+    const QString dir = relativeDir(index);
+    info.filePath = root + (dir.isEmpty() ? QString() : QLatin1Char('/') + dir)
+            + QStringLiteral("/IMG_%1.%2").arg(index, 7, 10, QLatin1Char('0'))
+                                          .arg(isPng(index) ? QStringLiteral("png") : QStringLiteral("jpg"));
+    info.locationName = dir.isEmpty() ? QDir(root).dirName() : dir.section(QLatin1Char('/'), -1);
+
+    // Съёмка сериями: в среднем снимок в минуту, с разбросом
+    const QDateTime base(QDate(2015, 1, 1), QTime(8, 0), Qt::UTC);
+    info.timestamp = base.addSecs(qint64(index) * 60 + qint64(jitter % 45));
+
+    if (unit(r) < m_options.gpsFraction) {
+        double cityLat = 0.0;
+        double cityLng = 0.0;
+        cityCenter(int(r % quint64(m_options.cities)), cityLat, cityLng);
+        // Равномерно по прямоугольнику города или сгущаясь к его центру
+        const double spread = m_options.clustered ? unit(mix(r + 2)) : 1.0;
+        info.latitude = qBound(-89.9, cityLat + (unit(mix(r)) - 0.5) * 0.6 * spread, 89.9);
+        info.longitude = qBound(-179.9, cityLng + (unit(mix(r + 1)) - 0.5) * 0.8 * spread, 179.9);
+        info.hasGps = true;
+    }
+
+    if (m_options.hashes) {
+        info.hasHash = true;
+        info.hash = hashAt(index);
+    }
+    return info;
+}
+
+quint64 CorpusGenerator::hashAt(int index) const
+{
+    // Почти копия ссылается на более ранний снимок, тот - возможно, на ещё
+    // более ранний; изменённые биты накапливаются по цепочке
+    const quint64 seed = quint64(m_options.seed) * 7919;
+    quint64 flips = 0;
+    while (index > 0) {
+        const quint64 d = mix(~(seed + quint64(index) * 5));
+        if (unit(d) >= m_options.duplicateFraction)
+            break;
+        const quint64 bits = mix(d);
+        for (int k = int(bits % 4); k > 0; --k)
+            flips ^= quint64(1) << ((bits >> (8 * k)) & 63);
+        index = int(mix(d + 1) % quint64(index));
+    }
+    return mix(seed ^ mix(quint64(index) + 0x51ED)) ^ flips;
+}
+
+void CorpusGenerator::walkTrip(int index, double &latitude, double &longitude,
+                               PhotoInfo &info) const
+{
+    const quint64 seed = quint64(m_options.seed) * 7919;
+    const int trip = index / m_options.tripLength;
+    if (index % m_options.tripLength == 0) {
+        const quint64 start = mix(~seed ^ quint64(trip));
+        latitude = -60.0 + unit(start) * 120.0;
+        longitude = -180.0 + unit(mix(start)) * 360.0;
+    }
+    const quint64 step = mix(seed ^ ~(quint64(index) * 11));
+    latitude = qBound(-80.0, latitude + (unit(step) - 0.5) * 0.002, 80.0);
+    longitude = qBound(-179.9, longitude + (unit(mix(step)) - 0.5) * 0.002, 179.9);
+
+    info.latitude = latitude;
+    info.longitude = longitude;
+    info.hasGps = true;
+    info.timestamp = info.timestamp.addSecs(qint64(trip) * TripGapSecs);
+}
+
+void CorpusGenerator::cityCenter(int city, double &latitude, double &longitude) const
+{
+    const quint64 c = mix(quint64(m_options.seed) * 7919 ^ quint64(city));
+    latitude = -55.0 + unit(c) * 120.0;
+    longitude = -180.0 + unit(mix(c)) * 360.0;
+}
+
+QVector<PhotoInfo> CorpusGenerator::photos(const QString &root) const
+{
+    QVector<PhotoInfo> result;
+    result.reserve(m_options.count);
+    double tripLat = 0.0;
+    double tripLng = 0.0;
+    for (int i = 0; i < m_options.count; ++i) {
+        PhotoInfo info = photoAt(root, i);
+        if (m_options.tripLength > 0)
+            walkTrip(i, tripLat, tripLng, info);
+        info.fileSize = 60000 + (i % 4096);
+        info.modified = info.timestamp.toMSecsSinceEpoch();
+        PhotoScanner::assignFallbackCoords(info, i);
+        result.append(info);
+    }
+    return result;
+}
+
+QByteArray CorpusGenerator::exifBlock(const PhotoInfo &info, const QString &layout) const
+{
+    TiffWriter w(layout != QLatin1String("be"));
+    w.bytes(layout == QLatin1String("be") ? QByteArrayLiteral("MM") : QByteArrayLiteral("II"));
+    w.u16(42);
+    w.u32(8);
+
+    // IFD0: ссылки на Exif IFD и GPS IFD
+    w.u16(info.hasGps ? 2 : 1);
+    const int exifPointer = w.entry(0x8769, TypeLong, 1);
+    const int gpsPointer = info.hasGps ? w.entry(0x8825, TypeLong, 1) : -1;
+    const int nextIfd = w.pos();
+    w.u32(0);
+
+    writeExifIfds(w, info, exifPointer, gpsPointer, layout == QLatin1String("far") ? FarPadding : 0);
+
+    if (layout == QLatin1String("thumb") && !m_thumbnail.isEmpty()) {
+        w.patch32(nextIfd, quint32(w.pos()));
+        w.u16(2);
+        const int offset = w.entry(0x0201, TypeLong, 1);
+        const int length = w.entry(0x0202, TypeLong, 1);
+        w.u32(0);
+        w.patch32(offset, quint32(w.pos()));
+        w.patch32(length, quint32(m_thumbnail.size()));
+        w.bytes(m_thumbnail);
+    }
+    return w.data();
+}
+
+QStringList CorpusGenerator::knownContainers()
+{
+    return {QStringLiteral("heic"), QStringLiteral("cr3"), QStringLiteral("dng"), QStringLiteral("mp4")};
+}
+
+QByteArray CorpusGenerator::containerFile(const PhotoInfo &info, const QString &format, int payload) const
+{
+    const QByteArray frame(qMax(0, payload), '\0');
+
+    if (format == QLatin1String("heic")) {
+        // ftyp, meta, mdat: Exif-элемент, за ним кадр
+        const QByteArray ftyp = box("ftyp", QByteArrayLiteral("heic") + bigEndian(0, 4) + "mif1heic");
+        const QByteArray exif = bigEndian(6, 4) + QByteArray("Exif\0\0", 6) + exifBlock(info, QStringLiteral("le"));
+        const int metaSize = int(heifMeta(0, 0, 0, 0).size());
+        const qint64 exifOffset = ftyp.size() + metaSize + 8;
+        const qint64 frameOffset = exifOffset + exif.size();
+        return ftyp + heifMeta(exifOffset, int(exif.size()), frameOffset, int(frame.size()))
+                + box("mdat", exif + frame);
+    }
+
+    if (format == QLatin1String("cr3")) {
+        // moov/uuid с CMT1 и превью THMB, кадр в mdat
+        static const char metadataUuid[] = "\x85\xc0\xb6\x87\x82\x0f\x11\xe0\x81\x11\xf4\xce\x46\x2b\x6a\x48";
+        QByteArray items = box("CMT1", exifBlock(info, QStringLiteral("le")));
+        if (!m_thumbnail.isEmpty()) {
+            items += box("THMB", bigEndian(0, 4) + bigEndian(160, 2) + bigEndian(120, 2)
+                                 + bigEndian(quint64(m_thumbnail.size()), 4) + bigEndian(1, 2)
+                                 + bigEndian(0, 2) + m_thumbnail);
+        }
+        return box("ftyp", QByteArrayLiteral("crx ") + bigEndian(1, 4) + "crx isom")
+                + box("moov", box("uuid", QByteArray(metadataUuid, 16) + items))
+                + box("mdat", frame);
+    }
+
+    if (format == QLatin1String("dng")) {
+        // IFD0 - превью (JPEG-полоса), SubIFD - сырой кадр; Exif и GPS
+        // за кадром, дальше первой порции ExifReader
+        TiffWriter w(true);
+        w.bytes(QByteArrayLiteral("II"));
+        w.u16(42);
+        w.u32(8);
+        w.u16(info.hasGps ? 8 : 7);
+        w.patch32(w.entry(0x00FE, TypeLong, 1), 1);
+        w.patch32(w.entry(0x0103, TypeShort, 1), 7);
+        w.patch32(w.entry(0x0106, TypeShort, 1), 6);
+        const int previewOffset = w.entry(0x0111, TypeLong, 1);
+        w.patch32(w.entry(0x0117, TypeLong, 1), quint32(m_thumbnail.size()));
+        const int subIfd = w.entry(0x014A, TypeLong, 1);
+        const int exifPointer = w.entry(0x8769, TypeLong, 1);
+        const int gpsPointer = info.hasGps ? w.entry(0x8825, TypeLong, 1) : -1;
+        w.u32(0);
+
+        w.patch32(subIfd, quint32(w.pos()));
+        w.u16(5);
+        w.patch32(w.entry(0x00FE, TypeLong, 1), 0);
+        w.patch32(w.entry(0x0103, TypeShort, 1), 7);
+        w.patch32(w.entry(0x0106, TypeShort, 1), 32803);
+        const int frameOffset = w.entry(0x0111, TypeLong, 1);
+        w.patch32(w.entry(0x0117, TypeLong, 1), quint32(frame.size()));
+        w.u32(0);
+
+        w.patch32(previewOffset, quint32(w.pos()));
+        w.bytes(m_thumbnail);
+        w.patch32(frameOffset, quint32(w.pos()));
+        w.bytes(frame);
+        writeExifIfds(w, info, exifPointer, gpsPointer, 0);
+        return w.data();
+    }
+
+    if (format == QLatin1String("mp4")) {
+        // Кадры (mdat) впереди, moov в конце, как пишут камеры и телефоны
+        const qint64 created = info.timestamp.toSecsSinceEpoch() + QuickTimeEpochOffset;
+        const QByteArray mvhd = fullBox("mvhd", 0, bigEndian(quint64(created), 4) + bigEndian(quint64(created), 4)
+                                        + bigEndian(1000, 4) + bigEndian(0, 4) + QByteArray(80, '\0'));
+        QByteArray udta;
+        if (info.hasGps) {
+            const QByteArray location = QString::asprintf("%+08.4f%+09.4f/", info.latitude, info.longitude).toLatin1();
+            udta = box("udta", box("\251xyz", bigEndian(quint64(location.size()), 2) + bigEndian(0x15C7, 2) + location));
+        }
+        return box("ftyp", QByteArrayLiteral("isom") + bigEndian(0x200, 4) + "isomiso2mp41")
+                + box("mdat", frame) + box("moov", mvhd + udta);
+    }
+    return QByteArray();
+}
+
+void CorpusGenerator::prepareImages()
+{
+    if (!m_jpeg.isEmpty())
+        return;
+
+    // Плавный градиент с шумом: JPEG получается обычного для фото размера
+    QImage image(qMax(16, m_options.imageWidth), qMax(16, m_options.imageHeight), QImage::Format_RGB32);
+    quint64 noise = mix(m_options.seed);
+    for (int y = 0; y < image.height(); ++y) {
+        QRgb *line = reinterpret_cast<QRgb *>(image.scanLine(y));
+        for (int x = 0; x < image.width(); ++x) {
+            noise = mix(noise);
+            const int n = int(noise & 0x1F);
+            line[x] = qRgb((x * 255 / image.width() + n) & 0xFF,
+                           (y * 255 / image.height() + n) & 0xFF,
+                           (128 + n) & 0xFF);
+        }
+    }
+    m_jpeg = encode(image, "JPG");
+    m_png = encode(image, "PNG");
+    m_thumbnail = encode(image.scaled(160, 120), "JPG");
+}
+
+QByteArray CorpusGenerator::jpegFile(const QByteArray &tiff) const
+{
+    // APP1 вставляется после SOI и APP0 (JFIF), если он есть
+    int insertAt = 2;
+    if (m_jpeg.size() > 6 && uchar(m_jpeg[2]) == 0xFF && uchar(m_jpeg[3]) == 0xE0)
+        insertAt = 4 + ((uchar(m_jpeg[4]) << 8) | uchar(m_jpeg[5]));
+
+    const int length = 2 + 6 + int(tiff.size());
+    QByteArray segment;
+    segment.reserve(length + 2);
+    segment.append(char(0xFF));
+    segment.append(char(0xE1));
+    segment.append(char(length >> 8));
+    segment.append(char(length & 0xFF));
+    segment.append("Exif\0\0", 6);
+    segment.append(tiff);
+
+    QByteArray file = m_jpeg;
+    file.insert(insertAt, segment);
+    return file;
+}
+
+QByteArray CorpusGenerator::pngFile(const QByteArray &tiff) const
+{
+    // Чанк eXIf - сразу после IHDR (сигнатура 8 байт + IHDR 25 байт)
+    const QByteArray typeAndData = QByteArrayLiteral("eXIf") + tiff;
+    const quint32 crc = crc32(typeAndData);
+    const quint32 length = quint32(tiff.size());
+
+    QByteArray chunk;
+    chunk.reserve(int(typeAndData.size()) + 8);
+    for (int shift = 24; shift >= 0; shift -= 8)
+        chunk.append(char((length >> shift) & 0xFF));
+    chunk.append(typeAndData);
+    for (int shift = 24; shift >= 0; shift -= 8)
+        chunk.append(char((crc >> shift) & 0xFF));
+
+    QByteArray file = m_png;
+    file.insert(33, chunk);
+    return file;
+}
+
+bool CorpusGenerator::generate(const QString &root, QString *error)
+{
+    prepareImages();
+    if (m_jpeg.isEmpty() || m_png.isEmpty()) {
+        if (error)
+            *error = QStringLiteral("JPEG/PNG image plugins are not available");
+        return false;
+    }
+
+    double tripLat = 0.0;
+    double tripLng = 0.0;
+    for (int i = 0; i < m_options.count; ++i) {
+        PhotoInfo info = photoAt(root, i);
+        if (m_options.tripLength > 0)
+            walkTrip(i, tripLat, tripLng, info);
+        const QString layout = layoutAt(i);
+        const QByteArray tiff = exifBlock(info, isPng(i) ? QStringLiteral("le") : layout);
+
+        const QString dir = info.filePath.left(info.filePath.lastIndexOf(QLatin1Char('/')));
+        if (!QDir().mkpath(dir)) {
+            if (error)
+                *error = QStringLiteral("Cannot create %1").arg(dir);
+            return false;
+        }
+
+        QFile file(info.filePath);
+        const QByteArray bytes = isPng(i) ? pngFile(tiff) : jpegFile(tiff);
+        if (!file.open(QIODevice::WriteOnly) || file.write(bytes) != bytes.size()) {
+            if (error)
+                *error = QStringLiteral("Cannot write %1").arg(info.filePath);
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,89 @@
+#ifndef CORPUSGENERATOR_H
+#define CORPUSGENERATOR_H
+
+#include "photoinfo.h"
+
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+// Детерминированный генератор синтетических снимков для замеров.
+// Дерево папок глубиной depth с fanout подпапками на уровне, файлы
+// раскладываются по листьям по кругу. Часть снимков (gpsFraction) получает
+// координаты вокруг cities "городов" (с clustered плотность растёт к центру,
+// как у настоящих скоплений), часть сохраняется как PNG с eXIf.
+// EXIF собирается вручную в одной из раскладок:
+//   le    - Intel, GPS IFD сразу за Exif IFD
+//   be    - Motorola, то же
+//   far   - GPS IFD за 12 КБ "MakerNote", дальше первой порции ExifReader
+//   thumb - Intel со встроенным превью 160x120 в IFD1
+// С tripLength > 0 снимки идут поездками по tripLength штук: случайное
+// блуждание с шагом около сотни метров от случайной точки, между поездками сутки.
+// С hashes у снимков есть перцептивный хеш; доля duplicateFraction из них -
+// почти копии более ранних (до трёх изменённых бит), как у пересохранённых фото.
+// Для замеров ExifReader на контейнерах есть и синтетические HEIC, CR3,
+// DNG и MP4 с кадром заданного размера - читаться должны только заголовки.
+// При одинаковых параметрах и seed результат побайтно совпадает.
+class CorpusGenerator
+{
+public:
+    struct Options
+    {
+        int count = 1000;
+        int depth = 2;
+        int fanout = 8;
+        double gpsFraction = 0.8;
+        int cities = 32;
+        bool clustered = false;
+        int tripLength = 0;
+        double pngFraction = 0.1;
+        QStringList layouts = {QStringLiteral("le"), QStringLiteral("be"),
+                               QStringLiteral("far"), QStringLiteral("thumb")};
+        bool hashes = false;
+        double duplicateFraction = 0.1;
+        int imageWidth = 640;
+        int imageHeight = 480;
+        quint32 seed = 1;
+    };
+
+    explicit CorpusGenerator(const Options &options);
+
+    static QStringList knownLayouts();
+
+    // Файлы в root; при ошибке записи - false и текст в error
+    bool generate(const QString &root, QString *error = nullptr);
+
+    // То же распределение путей, времени и координат без файлов -
+    // для замеров структур в памяти на 10^6 фото
+    QVector<PhotoInfo> photos(const QString &root) const;
+    // Центр города city (0..cities-1), вокруг которого лежат снимки с GPS
+    void cityCenter(int city, double &latitude, double &longitude) const;
+
+    // TIFF-блок EXIF (без заголовка "Exif\0\0") для фото и раскладки
+    QByteArray exifBlock(const PhotoInfo &info, const QString &layout) const;
+
+    static QStringList knownContainers();
+    // Файл формата из knownContainers() с метаданными фото и payload байт кадра
+    QByteArray containerFile(const PhotoInfo &info, const QString &format, int payload) const;
+
+private:
+    PhotoInfo photoAt(const QString &root, int index) const;
+    QString relativeDir(int index) const;
+    bool isPng(int index) const;
+    QString layoutAt(int index) const;
+    quint64 hashAt(int index) const;
+    // Следующий шаг поездки; latitude и longitude - состояние между вызовами
+    void walkTrip(int index, double &latitude, double &longitude, PhotoInfo &info) const;
+
+    QByteArray jpegFile(const QByteArray &tiff) const;
+    QByteArray pngFile(const QByteArray &tiff) const;
+    void prepareImages();
+
+    Options m_options;
+    QByteArray m_jpeg;        // базовая картинка без EXIF
+    QByteArray m_png;
+    QByteArray m_thumbnail;   // JPEG 160x120 для раскладки thumb
+};
+
+#endif // CORPUSGENERATOR_H
@@ -0,0 +1,805 @@
+// Набор замеров горячих путей GeoPhotoMap.
+// Файловые замеры (сканирование, EXIF, миниатюры) идут на синтетическом
+// наборе из CorpusGenerator, структуры в памяти (хранилище, дерево, кластеры,
+// k-d дерево, экспорт, геокодер) - на 10^3..10^6 сгенерированных фото без файлов.
+// Каждый результат - строка JSON (JSON Lines): пропускная способность,
+// p50/p99 задержки одной операции и пиковый RSS процесса на момент замера.
+// Пиковый RSS не убывает, поэтому для изоляции размеры и замеры удобно
+// запускать отдельными процессами (--sizes, --only).
+//
+//   geophotobench [--sizes 1000,10000,...] [--files N] [--corpus каталог]
+//                 [--only scan,exif,...] [-o результат.jsonl]
+
+#include "corpusgenerator.h"
+#include "duplicateindex.h"
+#include "exifreader.h"
+#include "heatmaprenderer.h"
+#include "markerclusterer.h"
+#include "perceptualhash.h"
+#include "photocatalog.h"
+#include "photoexporter.h"
+#include "photoscanner.h"
+#include "photostore.h"
+#include "reversegeocoder.h"
+#include "routeindex.h"
+#include "searchindex.h"
+#include "sortindex.h"
+#include "phototreemodel.h"
+#include "spatialindex.h"
+#include "thumbnailcache.h"
+#include "timeindex.h"
+#include "tracklog.h"
+
+#include <QCommandLineOption>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QFileInfo>
+#include <QGuiApplication>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QPointF>
+#include <QRandomGenerator>
+#include <QStandardPaths>
+#include <QTemporaryDir>
+#include <QVector>
+#include <algorithm>
+#include <cstdio>
+#include <functional>
+#include <limits>
+
+#if defined(Q_OS_UNIX)
+#include <sys/resource.h>
+#elif defined(Q_OS_WIN)
+#include <windows.h>
+#include <psapi.h>
+#endif
+
+namespace {
+
+constexpr int QueryCount = 1000;
+
+qint64 peakRssKb()
+{
+#if defined(Q_OS_UNIX)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return -1;
+#ifdef Q_OS_MACOS
+    return qint64(usage.ru_maxrss) / 1024;   // в macOS - байты
+#else
+    return qint64(usage.ru_maxrss);
+#endif
+#elif defined(Q_OS_WIN)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return -1;
+    return qint64(counters.PeakWorkingSetSize) / 1024;
+#else
+    return -1;
+#endif
+}
+
+// Устройство, которое всё принимает и ничего не хранит
+class NullDevice : public QIODevice
+{
+protected:
+    qint64 readData(char *, qint64) override { return -1; }
+    qint64 writeData(const char *, qint64 length) override { return length; }
+};
+
+class Reporter
+{
+public:
+    Reporter(FILE *out, const QStringList &only) : m_out(out), m_only(only) {}
+
+    bool selected(const QString &name) const
+    {
+        if (m_only.isEmpty())
+            return true;
+        for (const QString &prefix : m_only) {
+            if (name.startsWith(prefix))
+                return true;
+        }
+        return false;
+    }
+
+    // Нужна ли хоть одна операция из группы (например, "scan")
+    bool wants(const QString &group) const
+    {
+        if (m_only.isEmpty())
+            return true;
+        for (const QString &prefix : m_only) {
+            if (prefix.startsWith(group) || group.startsWith(prefix))
+                return true;
+        }
+        return false;
+    }
+
+    // samples - наносекунды на одну операцию (unit), seconds - общее время
+    void add(const QString &name, int n, qint64 ops, double seconds, QVector<qint64> samples,
+             const char *unit)
+    {
+        std::sort(samples.begin(), samples.end());
+        auto percentile = [&](double p) {
+            if (samples.isEmpty())
+                return 0.0;
+            return double(samples[qMin(int(samples.size()) - 1, int(p * samples.size()))]) / 1000.0;
+        };
+        const double throughput = seconds > 0 ? double(ops) / seconds : 0.0;
+        std::fprintf(m_out,
+                     "{\"bench\":\"%s\",\"n\":%d,\"ops\":%lld,\"unit\":\"%s\",\"seconds\":%.6f,"
+                     "\"throughput\":%.1f,\"p50_us\":%.3f,\"p99_us\":%.3f,\"peak_rss_kb\":%lld}\n",
+                     qPrintable(name), n, static_cast<long long>(ops), unit, seconds, throughput,
+                     percentile(0.50), percentile(0.99), static_cast<long long>(peakRssKb()));
+        std::fflush(m_out);
+        std::fprintf(stderr, "%-26s n=%-8d %12.1f %s/s  p50=%9.3f us  p99=%9.3f us\n",
+                     qPrintable(name), n, throughput, unit, percentile(0.50), percentile(0.99));
+    }
+
+    // Каждая операция замеряется отдельно
+    void measure(const QString &name, int n, int ops, const char *unit,
+                 const std::function<void(int)> &op)
+    {
+        if (!selected(name))
+            return;
+        QVector<qint64> samples;
+        samples.reserve(ops);
+        QElapsedTimer total;
+        total.start();
+        QElapsedTimer timer;
+        for (int i = 0; i < ops; ++i) {
+            timer.start();
+            op(i);
+            samples.append(timer.nsecsElapsed());
+        }
+        add(name, n, ops, double(total.nsecsElapsed()) / 1e9, samples, unit);
+    }
+
+    // Быстрые операции - порциями по chunk, чтобы не мерить сам таймер
+    void measureChunked(const QString &name, int n, int ops, int chunk, const char *unit,
+                        const std::function<void(int)> &op)
+    {
+        if (!selected(name))
+            return;
+        QVector<qint64> samples;
+        QElapsedTimer total;
+        total.start();
+        QElapsedTimer timer;
+        for (int first = 0; first < ops; first += chunk) {
+            const int last = qMin(ops, first + chunk);
+            timer.start();
+            for (int i = first; i < last; ++i)
+                op(i);
+            samples.append(timer.nsecsElapsed() / (last - first));
+        }
+        add(name, n, ops, double(total.nsecsElapsed()) / 1e9, samples, unit);
+    }
+
+private:
+    FILE *m_out;
+    QStringList m_only;
+};
+
+QStringList listFiles(const QString &root)
+{
+    QStringList files;
+    QDirIterator it(root, PhotoScanner::nameFilters(), QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext())
+        files.append(it.next());
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+// Полное сканирование; задержка - интервал между готовыми пачками
+void benchScan(Reporter &reporter, const QString &name, const QString &root, int files,
+               bool catalog)
+{
+    if (!reporter.selected(name))
+        return;
+
+    PhotoScanner scanner;
+    scanner.setCatalogEnabled(catalog);
+    QMutex mutex;
+    QVector<qint64> samples;
+    QElapsedTimer timer;
+    qint64 previous = 0;
+
+    QObject::connect(&scanner, &PhotoScanner::batchReady, &scanner,
+                     [&](int, const QVector<PhotoInfo> &photos) {
+                         QMutexLocker locker(&mutex);
+                         const qint64 now = timer.nsecsElapsed();
+                         samples.append((now - previous) / qMax(1, int(photos.size())));
+                         previous = now;
+                     }, Qt::DirectConnection);
+    QEventLoop loop;
+    QObject::connect(&scanner, &PhotoScanner::finished, &loop, &QEventLoop::quit);
+
+    timer.start();
+    scanner.start(root);
+    loop.exec();
+    reporter.add(name, files, scanner.processedCount(), double(timer.nsecsElapsed()) / 1e9,
+                 samples, "photo");
+    const QString io = scanner.ioSummary();
+    if (!io.isEmpty())
+        std::fprintf(stderr, "%s io: %s\n", qPrintable(name), qPrintable(io));
+}
+
+// ExifReader на контейнерах с кадром в 4 МБ: время не должно зависеть
+// от размера кадра, как и у заголовка JPEG
+void benchContainers(Reporter &reporter, const CorpusGenerator &generator, const QVector<PhotoInfo> &sample)
+{
+    constexpr int ContainerFiles = 32;
+    constexpr int FramePayload = 4 * 1024 * 1024;
+    QTemporaryDir temp;
+    for (const QString &format : CorpusGenerator::knownContainers()) {
+        const QString name = QStringLiteral("exif.read.") + format;
+        if (!reporter.wants(name))
+            continue;
+        QStringList paths;
+        for (int i = 0; i < qMin(int(sample.size()), ContainerFiles); ++i) {
+            const QString path = temp.filePath(QStringLiteral("IMG_%1.%2").arg(i).arg(format));
+            const QByteArray bytes = generator.containerFile(sample[i], format, FramePayload);
+            QFile file(path);
+            if (!temp.isValid() || !file.open(QIODevice::WriteOnly) || file.write(bytes) != bytes.size()) {
+                std::fprintf(stderr, "Cannot write %s\n", qPrintable(path));
+                return;
+            }
+            paths.append(path);
+        }
+        const int n = int(paths.size());
+        if (n == 0)
+            continue;
+        reporter.measure(name, n, n * 16, "file", [&](int i) {
+            ExifData exif;
+            ExifReader::read(paths[i % n], exif);
+        });
+    }
+}
+
+void benchFiles(Reporter &reporter, const QString &root, const CorpusGenerator &generator)
+{
+    const QStringList files = listFiles(root);
+    const int n = int(files.size());
+    std::fprintf(stderr, "corpus: %d files in %s\n", n, qPrintable(root));
+
+    // Каталог и кэш миниатюр - в тестовом CacheLocation, начинаем с пустых
+    QFile::remove(PhotoCatalog::catalogPathFor(root));
+    benchScan(reporter, QStringLiteral("scan.nocatalog"), root, n, false);
+    benchScan(reporter, QStringLiteral("scan.catalog.cold"), root, n, true);
+    benchScan(reporter, QStringLiteral("scan.catalog.warm"), root, n, true);
+
+    reporter.measure(QStringLiteral("exif.read"), n, n, "file", [&](int i) {
+        ExifData exif;
+        ExifReader::read(files[i], exif);
+    });
+
+    reporter.measure(QStringLiteral("dup.hash"), n, n, "file", [&](int i) {
+        quint64 hash = 0;
+        PerceptualHash::ofFile(files[i], hash);
+    });
+
+    // Разбор TIFF в памяти - по каждой раскладке отдельно
+    const QVector<PhotoInfo> sample = generator.photos(root);
+    for (const QString &layout : CorpusGenerator::knownLayouts()) {
+        QVector<QByteArray> blocks;
+        for (int i = 0; i < qMin(int(sample.size()), QueryCount); ++i)
+            blocks.append(generator.exifBlock(sample[i], layout));
+        if (blocks.isEmpty())
+            continue;
+        reporter.measureChunked(QStringLiteral("exif.parseTiff.") + layout, int(blocks.size()),
+                                int(blocks.size()) * 16, 64, "block", [&](int i) {
+            const QByteArray &block = blocks[i % blocks.size()];
+            ExifData exif;
+            ExifReader::parseTiff(reinterpret_cast<const uchar *>(block.constData()),
+                                  int(block.size()), 0, exif);
+        });
+    }
+    benchContainers(reporter, generator, sample);
+
+    const QSize iconSize(96, 72);
+    {
+        ThumbnailCache cache;
+        QDir(cache.diskCacheDir()).removeRecursively();
+        reporter.measure(QStringLiteral("thumb.cold"), n, n, "file", [&](int i) {
+            cache.thumbnail(files[i], iconSize);
+        });
+        reporter.measure(QStringLiteral("thumb.memory"), n, n, "file", [&](int i) {
+            cache.thumbnail(files[i], iconSize);
+        });
+    }
+    {
+        ThumbnailCache cache;
+        reporter.measure(QStringLiteral("thumb.disk"), n, n, "file", [&](int i) {
+            cache.thumbnail(files[i], iconSize);
+        });
+    }
+}
+
+void benchMemory(Reporter &reporter, int n, quint32 seed)
+{
+    if (!reporter.wants(QStringLiteral("store")) && !reporter.wants(QStringLiteral("sort"))
+            && !reporter.wants(QStringLiteral("tree")) && !reporter.wants(QStringLiteral("time"))
+            && !reporter.wants(QStringLiteral("map")) && !reporter.wants(QStringLiteral("spatial"))
+            && !reporter.wants(QStringLiteral("export")))
+        return;
+
+    CorpusGenerator::Options options;
+    options.count = n;
+    options.depth = 3;
+    options.fanout = 12;
+    options.seed = seed;
+    const QString root = QStringLiteral("/bench");
+    QRandomGenerator random(seed);
+
+    // Хранилище заполняется пачками, как из сканера; исходные PhotoInfo
+    // после этого не нужны и не занимают память в остальных замерах
+    PhotoStore photos;
+    {
+        const QVector<PhotoInfo> infos = CorpusGenerator(options).photos(root);
+        reporter.measureChunked(QStringLiteral("store.append"), n, n, PhotoScanner::BatchSize,
+                                "photo", [&](int i) {
+            photos.append(infos[i]);
+        });
+        // Замер мог быть отключён через --only, а хранилище нужно остальным
+        if (photos.size() != n) {
+            for (int i = photos.size(); i < n; ++i)
+                photos.append(infos[i]);
+        }
+        reporter.measure(QStringLiteral("store.indexOf"), n, QueryCount, "lookup", [&](int) {
+            photos.indexOf(infos[int(random.bounded(n))].filePath);
+        });
+    }
+    std::fprintf(stderr, "store: %.1f bytes/photo (%d folders, %d places)\n",
+                 double(photos.memoryUsage()) / n, photos.dirCount(), photos.locationCount());
+
+    // Сортировка по времени, как в MainWindow::populateTree
+    QVector<int> order(n);
+    reporter.measure(QStringLiteral("tree.sort"), n, 1, "sort", [&](int) {
+        for (int i = 0; i < n; ++i)
+            order[i] = i;
+        std::sort(order.begin(), order.end(), [&](int a, int b) {
+            return photos.taken(a) < photos.taken(b);
+        });
+    });
+    for (int i = 0; i < n; ++i)
+        order[i] = i;
+
+    // Модель дерева: перестройка и раскладка пути до фото (раскрытие папок)
+    ThumbnailCache cache;
+    PhotoTreeModel model(&photos, &cache);
+    reporter.measure(QStringLiteral("tree.setOrder"), n, 1, "rebuild", [&](int) {
+        model.setOrder(root, QStringLiteral("bench"), order);
+    });
+    reporter.measure(QStringLiteral("tree.indexForPhoto"), n, QueryCount, "lookup", [&](int) {
+        model.indexForPhoto(int(random.bounded(n)));
+    });
+
+    // Перестановки для всех порядков и смена порядка в уже раскрытом дереве
+    SortIndex sortIndex;
+    reporter.measure(QStringLiteral("sort.build"), n, 1, "build", [&](int) {
+        sortIndex.build(photos);
+    });
+    if (!sortIndex.isEmpty()) {
+        reporter.measure(QStringLiteral("tree.resort"), n, SortIndex::KeyCount * 4, "switch", [&](int i) {
+            model.reorder(sortIndex.order(SortIndex::Key(i % SortIndex::KeyCount)));
+        });
+    }
+
+    // Индекс дат: пополнение по мере сканирования и выборка месяца для шкалы времени
+    TimeIndex timeIndex;
+    reporter.measureChunked(QStringLiteral("time.insert"), n, n, PhotoScanner::BatchSize,
+                            "photo", [&](int i) {
+        timeIndex.insert(i, photos.taken(i));
+    });
+    const int days = timeIndex.bucketCount(TimeIndex::Day);
+    if (days > 0) {
+        reporter.measure(QStringLiteral("time.range"), n, QueryCount, "query", [&](int) {
+            const int first = int(random.bounded(days));
+            const int last = qMin(days - 1, first + 30);
+            timeIndex.photosBetween(timeIndex.bucketFirstDay(TimeIndex::Day, first),
+                                    timeIndex.bucketLastDay(TimeIndex::Day, last));
+        });
+    }
+
+    // Кластеры маркеров карты (то, что раньше собиралось в buildMapHtml)
+    MarkerClusterer clusterer;
+    reporter.measureChunked(QStringLiteral("map.cluster.insert"), n, n, 1024, "marker", [&](int i) {
+        clusterer.insert(i, photos.latitude(i), photos.longitude(i));
+    });
+    if (clusterer.size() == n) {
+        QVector<MarkerClusterer::Cluster> clusters;
+        QVector<int> points;
+        reporter.measure(QStringLiteral("map.cluster.query"), n, QueryCount, "viewport", [&](int) {
+            const int zoom = 2 + int(random.bounded(15));
+            const double width = 360.0 / double(1 << zoom) * 4.0;
+            const double height = width * 0.6;
+            const double west = -180.0 + random.generateDouble() * 360.0;
+            const double south = -70.0 + random.generateDouble() * 130.0;
+            clusters.clear();
+            points.clear();
+            clusterer.query(west, south, west + width, south + height, zoom, clusters, points);
+        });
+    }
+
+    // k-d дерево: построение и окно карты
+    SpatialIndex spatial;
+    reporter.measure(QStringLiteral("spatial.build"), n, 1, "build", [&](int) {
+        spatial.build(photos);
+    });
+    reporter.measure(QStringLiteral("spatial.within"), n, QueryCount, "viewport", [&](int) {
+        const double west = -180.0 + random.generateDouble() * 350.0;
+        const double south = -60.0 + random.generateDouble() * 110.0;
+        spatial.within(west, south, west + 5.0, south + 3.0);
+    });
+
+    // Потоковый экспорт пачками, как из пула сканера
+    if (reporter.selected(QStringLiteral("export.geojson"))) {
+        NullDevice device;
+        device.open(QIODevice::WriteOnly);
+        PhotoExporter exporter(&device, PhotoExporter::GeoJson);
+        exporter.setIncludeWithoutGps(true);
+        exporter.begin();
+        const int batches = (n + PhotoScanner::BatchSize - 1) / PhotoScanner::BatchSize;
+        QVector<PhotoInfo> batch;
+        reporter.measure(QStringLiteral("export.geojson"), n, batches, "batch", [&](int b) {
+            batch.clear();
+            const int first = b * PhotoScanner::BatchSize;
+            for (int i = first; i < qMin(n, first + PhotoScanner::BatchSize); ++i)
+                batch.append(photos.photo(i));
+            exporter.write(batch);
+        });
+        exporter.finish();
+    }
+}
+
+// Группировка похожих: хеши из CorpusGenerator, каждый десятый снимок -
+// копия одного из предыдущих в другой папке с несколькими изменёнными битами
+void benchDuplicates(Reporter &reporter, int n, quint32 seed)
+{
+    if (!reporter.wants(QStringLiteral("dup.build")))
+        return;
+
+    CorpusGenerator::Options options;
+    options.count = n;
+    options.depth = 1;
+    options.fanout = 97;
+    options.hashes = true;
+    options.duplicateFraction = 0.1;
+    options.seed = seed;
+    PhotoStore photos;
+    photos.reserve(n);
+    for (const PhotoInfo &info : CorpusGenerator(options).photos(QStringLiteral("/bench")))
+        photos.append(info);
+
+    DuplicateIndex duplicates;
+    reporter.measure(QStringLiteral("dup.build"), n, 1, "build", [&](int) {
+        duplicates.build(photos);
+    });
+    std::fprintf(stderr, "dup: %d groups, %d hidden\n",
+                 duplicates.groupCount(), duplicates.hiddenCount());
+}
+
+// Тепловая карта: n фото скоплениями вокруг 8 городов из CorpusGenerator;
+// тайлы над центром города на разных зумах (на мелких в тайл попадают все фото)
+void benchHeatmap(Reporter &reporter, int n, quint32 seed)
+{
+    if (!reporter.wants(QStringLiteral("heat")))
+        return;
+
+    CorpusGenerator::Options options;
+    options.count = n;
+    options.gpsFraction = 1.0;
+    options.cities = 8;
+    options.clustered = true;
+    options.seed = seed;
+    const CorpusGenerator generator(options);
+    PhotoStore photos;
+    photos.reserve(n);
+    QVector<int> ids(n);
+    for (const PhotoInfo &info : generator.photos(QStringLiteral("/bench"))) {
+        ids[photos.size()] = photos.size();
+        photos.append(info);
+    }
+
+    HeatmapRenderer heatmap;
+    reporter.measure(QStringLiteral("heat.build"), n, 1, "build", [&](int) {
+        heatmap.build(photos, ids);
+    });
+
+    QVector<quint32> pixels;
+    double centerLat = 0.0;
+    double centerLng = 0.0;
+    generator.cityCenter(0, centerLat, centerLng);
+    for (int z : {3, 8, 12}) {
+        const int tiles = 1 << z;
+        const int x = int(MarkerClusterer::lngToX(centerLng) * tiles);
+        const int y = int(MarkerClusterer::latToY(centerLat) * tiles);
+        reporter.measure(QStringLiteral("heat.render.z%1").arg(z), n, 20, "tile", [&](int) {
+            heatmap.render(z, x, y, pixels);
+        });
+    }
+}
+
+// Поиск: пути и места из CorpusGenerator (3 уровня по 12 папок);
+// запросы - избирательное имя, короткое слово без триграмм, папка через '/'
+// и одни фильтры, как при наборе в строке поиска
+void benchSearch(Reporter &reporter, int n, quint32 seed)
+{
+    if (!reporter.wants(QStringLiteral("search")))
+        return;
+
+    CorpusGenerator::Options options;
+    options.count = n;
+    options.depth = 3;
+    options.fanout = 12;
+    options.seed = seed;
+    PhotoStore photos;
+    photos.reserve(n);
+    for (const PhotoInfo &info : CorpusGenerator(options).photos(QStringLiteral("/bench")))
+        photos.append(info);
+
+    SearchIndex search;
+    reporter.measure(QStringLiteral("search.build"), n, 1, "build", [&](int) {
+        search.build(photos);
+    });
+    std::fprintf(stderr, "search: %.1f bytes/photo\n", double(search.memoryUsage()) / n);
+
+    const QStringList queries = {
+        QStringLiteral("img_00012"),
+        QStringLiteral("_1"),
+        QStringLiteral("d07/d03/img"),
+        QStringLiteral("gps:yes ext:jpg date:2015-02..2015-06 size:>62k"),
+        QStringLiteral("d05 img_0 gps:no")
+    };
+    const char *names[] = {"name", "short", "dir", "filters", "mixed"};
+    for (int q = 0; q < queries.size(); ++q) {
+        SearchQuery query;
+        SearchQuery::parse(queries[q], query);
+        int found = 0;
+        reporter.measure(QStringLiteral("search.find.%1").arg(QLatin1String(names[q])), n, 20, "query",
+                         [&](int) {
+            found = search.find(photos, query).size();
+        });
+        std::fprintf(stderr, "search: \"%s\" -> %d\n", qPrintable(queries[q]), found);
+    }
+}
+
+// Маршруты: n фото поездками CorpusGenerator по 500 снимков, случайное
+// блуждание с шагом в сотню метров; запросы - весь мир и окно города
+void benchRoutes(Reporter &reporter, int n, quint32 seed)
+{
+    if (!reporter.wants(QStringLiteral("route")))
+        return;
+
+    CorpusGenerator::Options options;
+    options.count = n;
+    options.tripLength = 500;
+    options.seed = seed;
+    PhotoStore photos;
+    photos.reserve(n);
+    for (const PhotoInfo &info : CorpusGenerator(options).photos(QStringLiteral("/bench")))
+        photos.append(info);
+    // Окно города - вокруг конца последней поездки
+    const double lat = n > 0 ? photos.latitude(n - 1) : 0.0;
+    const double lng = n > 0 ? photos.longitude(n - 1) : 0.0;
+
+    RouteIndex routes;
+    reporter.measure(QStringLiteral("route.build"), n, 1, "build", [&](int) {
+        routes.build(photos);
+    });
+    std::fprintf(stderr, "route: %d trips, vertices z3=%d z10=%d z16=%d of %d\n",
+                 routes.tripCount(), routes.levelVertexCount(3), routes.levelVertexCount(10),
+                 routes.levelVertexCount(16), routes.vertexCount());
+
+    QVector<float> coords;
+    QVector<int> lengths;
+    constexpr qint64 Any = std::numeric_limits<qint64>::max();
+    reporter.measure(QStringLiteral("route.query.world"), n, 20, "query", [&](int) {
+        routes.query(-180.0, -85.0, 180.0, 85.0, 3, -Any, Any, coords, lengths);
+    });
+    reporter.measure(QStringLiteral("route.query.city"), n, 200, "query", [&](int i) {
+        const double west = lng - 0.05 + (i % 10) * 0.002;
+        routes.query(west, lat - 0.03, west + 0.1, lat + 0.03, 13, -Any, Any, coords, lengths);
+    });
+}
+
+// Привязка по треку: GPX с точкой раз в 5 с на n * 10 точек (как у логгера)
+// и n фото, снятых в это время
+void benchTracks(Reporter &reporter, int n, quint32 seed)
+{
+    if (!reporter.wants(QStringLiteral("track")))
+        return;
+
+    constexpr qint64 StepMs = 5000;
+    const qint64 start = QDateTime(QDate(2023, 6, 1), QTime(0, 0), Qt::UTC).toMSecsSinceEpoch();
+    const int points = n * 10;
+    QTemporaryDir temp;
+    const QString gpx = temp.filePath(QStringLiteral("track.gpx"));
+    {
+        QFile file(gpx);
+        if (!temp.isValid() || !file.open(QIODevice::WriteOnly)) {
+            std::fprintf(stderr, "Cannot write %s\n", qPrintable(gpx));
+            return;
+        }
+        file.write("<?xml version=\"1.0\"?>\n<gpx version=\"1.1\"><trk><trkseg>\n");
+        for (int i = 0; i < points; ++i) {
+            const QDateTime time = QDateTime::fromMSecsSinceEpoch(start + i * StepMs, Qt::UTC);
+            file.write(QStringLiteral("<trkpt lat=\"%1\" lon=\"%2\"><time>%3</time></trkpt>\n")
+                           .arg(45.0 + i * 1e-5, 0, 'f', 6)
+                           .arg(7.0 + i * 1e-5, 0, 'f', 6)
+                           .arg(time.toString(Qt::ISODate))
+                           .toUtf8());
+        }
+        file.write("</trkseg></trk></gpx>\n");
+    }
+
+    TrackLog log;
+    if (reporter.selected(QStringLiteral("track.load"))) {
+        reporter.measure(QStringLiteral("track.load"), points, 1, "load", [&](int) {
+            log.clear();
+            log.load({gpx});
+        });
+    } else {
+        log.load({gpx});
+    }
+
+    // Снимки внутри трека; часы камеры точные, поправка нулевая
+    QRandomGenerator random(seed);
+    QVector<PhotoInfo> photos(n);
+    QVector<int> indexes(n);
+    for (int i = 0; i < n; ++i) {
+        const qint64 utc = start + qint64(random.bounded(points)) * StepMs + random.bounded(int(StepMs));
+        photos[i].timestamp = QDateTime::fromMSecsSinceEpoch(utc);
+        indexes[i] = i;
+    }
+    reporter.measureChunked(QStringLiteral("track.geotag"), n, n, PhotoScanner::BatchSize, "photo",
+                            [&](int i) {
+        if (i % PhotoScanner::BatchSize == 0)
+            log.geotag(photos, indexes.mid(i, qMin(PhotoScanner::BatchSize, n - i)));
+    });
+}
+
+void benchGeocoder(Reporter &reporter, int n, quint32 seed)
+{
+    if (!reporter.wants(QStringLiteral("geocode")))
+        return;
+
+    // Выгрузка в формате GeoNames размером с cities1000 (~150 тыс. мест)
+    constexpr int PlaceCount = 150000;
+    QTemporaryDir temp;
+    const QString dump = temp.filePath(QStringLiteral("cities.txt"));
+    const QString index = temp.filePath(QStringLiteral("gazetteer.gpg"));
+    QRandomGenerator random(seed);
+    {
+        QFile file(dump);
+        if (!temp.isValid() || !file.open(QIODevice::WriteOnly)) {
+            std::fprintf(stderr, "Cannot write %s\n", qPrintable(dump));
+            return;
+        }
+        for (int i = 0; i < PlaceCount; ++i) {
+            const double lat = -55.0 + random.generateDouble() * 125.0;
+            const double lng = -180.0 + random.generateDouble() * 360.0;
+            file.write(QStringLiteral("%1\tPlace %1\tPlace %1\t\t%2\t%3\tP\tPPL\tXX\t\t01\n")
+                           .arg(i).arg(lat, 0, 'f', 5).arg(lng, 0, 'f', 5).toUtf8());
+        }
+    }
+
+    if (reporter.selected(QStringLiteral("geocode.compile"))) {
+        reporter.measure(QStringLiteral("geocode.compile"), PlaceCount, 1, "build", [&](int) {
+            ReverseGeocoder::compile(dump, QString(), index);
+        });
+    } else {
+        ReverseGeocoder::compile(dump, QString(), index);
+    }
+    ReverseGeocoder geocoder;
+    if (!geocoder.open(index)) {
+        std::fprintf(stderr, "Cannot open %s\n", qPrintable(index));
+        return;
+    }
+
+    QVector<QPointF> points(n);
+    for (QPointF &p : points)
+        p = QPointF(-180.0 + random.generateDouble() * 360.0, -55.0 + random.generateDouble() * 125.0);
+    reporter.measure(QStringLiteral("geocode.nearest"), n, QueryCount, "lookup", [&](int i) {
+        const QPointF &p = points[i % n];
+        geocoder.nearest(p.y(), p.x());
+    });
+    // Все фото разом, как после сканирования
+    reporter.measure(QStringLiteral("geocode.batch"), n, 1, "batch", [&](int) {
+        geocoder.nearest(points);
+    });
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    QGuiApplication app(argc, argv);
+    QCoreApplication::setApplicationName(QStringLiteral("geophotobench"));
+    // Каталоги и миниатюры - в отдельном тестовом кэше, а не в кэше пользователя
+    QStandardPaths::setTestModeEnabled(true);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("GeoPhotoMap hot path benchmarks (JSON Lines)."));
+    parser.addHelpOption();
+    const QCommandLineOption sizesOption(QStringLiteral("sizes"),
+                                         QStringLiteral("Photo counts for in-memory benchmarks."),
+                                         QStringLiteral("list"),
+                                         QStringLiteral("1000,10000,100000,1000000"));
+    const QCommandLineOption filesOption(QStringLiteral("files"),
+                                         QStringLiteral("Size of the generated on-disk corpus."),
+                                         QStringLiteral("N"), QStringLiteral("2000"));
+    const QCommandLineOption corpusOption(QStringLiteral("corpus"),
+                                          QStringLiteral("Use an existing photo folder instead."),
+                                          QStringLiteral("dir"));
+    const QCommandLineOption onlyOption(QStringLiteral("only"),
+                                        QStringLiteral("Run only benchmarks with these name prefixes."),
+                                        QStringLiteral("list"));
+    const QCommandLineOption seedOption(QStringLiteral("seed"), QStringLiteral("Generator seed."),
+                                        QStringLiteral("S"), QStringLiteral("1"));
+    const QCommandLineOption outputOption({QStringLiteral("o"), QStringLiteral("output")},
+                                          QStringLiteral("Write JSON Lines here (default: stdout)."),
+                                          QStringLiteral("file"));
+    for (const QCommandLineOption &option : {sizesOption, filesOption, corpusOption, onlyOption,
+                                             seedOption, outputOption})
+        parser.addOption(option);
+    parser.process(app);
+
+    FILE *out = stdout;
+    if (parser.isSet(outputOption)) {
+        out = std::fopen(qPrintable(parser.value(outputOption)), "w");
+        if (!out) {
+            std::fprintf(stderr, "Cannot write %s\n", qPrintable(parser.value(outputOption)));
+            return 1;
+        }
+    }
+
+    Reporter reporter(out, parser.value(onlyOption).split(QLatin1Char(','), Qt::SkipEmptyParts));
+    const quint32 seed = parser.value(seedOption).toUInt();
+
+    const bool fileBenches = reporter.wants(QStringLiteral("scan"))
+            || reporter.wants(QStringLiteral("exif"))
+            || reporter.wants(QStringLiteral("thumb"))
+            || reporter.wants(QStringLiteral("dup.hash"));
+    if (fileBenches) {
+        CorpusGenerator::Options options;
+        options.count = parser.value(filesOption).toInt();
+        options.seed = seed;
+        CorpusGenerator generator(options);
+
+        QTemporaryDir temp;
+        QString root = parser.value(corpusOption);
+        if (root.isEmpty()) {
+            root = temp.path();
+            QString error;
+            if (!temp.isValid() || !generator.generate(root, &error)) {
+                std::fprintf(stderr, "Cannot generate corpus: %s\n", qPrintable(error));
+                return 1;
+            }
+        }
+        benchFiles(reporter, QDir::cleanPath(QFileInfo(root).absoluteFilePath()), generator);
+    }
+
+    for (const QString &size : parser.value(sizesOption).split(QLatin1Char(','), Qt::SkipEmptyParts)) {
+        const int n = size.toInt();
+        if (n > 0) {
+            benchMemory(reporter, n, seed);
+            benchGeocoder(reporter, n, seed);
+            benchDuplicates(reporter, n, seed);
+            benchTracks(reporter, n, seed);
+            benchRoutes(reporter, n, seed);
+            benchHeatmap(reporter, n, seed);
+            benchSearch(reporter, n, seed);
+        }
+    }
+
+    if (out != stdout)
+        std::fclose(out);
+    return 0;
+}
@@ -0,0 +1,144 @@
+// Замер задержки выдачи тайлов из TileStore на локальном подставном хранилище.
+// Хранилище заполняется синтетическими тайлами во временной папке, затем
+// меряются чтения с диска (через кэш страниц ОС), из горячего кэша в памяти
+// и параллельные чтения из пула потоков, как в MapSchemeHandler.
+//
+//   tilebench [число тайлов] [размер тайла, байт]
+
+#include "tilestore.h"
+
+#include <QAtomicInt>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QRandomGenerator>
+#include <QTemporaryDir>
+#include <QThread>
+#include <QThreadPool>
+#include <QVector>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+struct TileId
+{
+    int z;
+    int x;
+    int y;
+};
+
+void report(const char *name, QVector<qint64> &nanos)
+{
+    if (nanos.isEmpty())
+        return;
+    std::sort(nanos.begin(), nanos.end());
+    auto percentile = [&](double p) {
+        return double(nanos[qMin(int(nanos.size()) - 1, int(p * nanos.size()))]) / 1000.0;
+    };
+    double total = 0;
+    for (qint64 n : std::as_const(nanos))
+        total += double(n);
+    std::printf("%-8s n=%-7d mean=%8.2f us  p50=%8.2f us  p95=%8.2f us  p99=%8.2f us  max=%8.2f us\n",
+                name, int(nanos.size()), total / nanos.size() / 1000.0,
+                percentile(0.50), percentile(0.95), percentile(0.99),
+                double(nanos.last()) / 1000.0);
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    const QStringList args = app.arguments();
+    const int count = args.size() > 1 ? args[1].toInt() : 4096;
+    const int tileBytes = args.size() > 2 ? args[2].toInt() : 16 * 1024;
+
+    QTemporaryDir dir;
+    if (!dir.isValid()) {
+        std::fprintf(stderr, "cannot create temporary directory\n");
+        return 1;
+    }
+
+    // Тайлы zoom 12 вокруг одной точки - как при просмотре одного города
+    QVector<TileId> tiles;
+    tiles.reserve(count);
+    const int side = qMax(1, int(std::ceil(std::sqrt(double(count)))));
+    for (int i = 0; i < count; ++i)
+        tiles.append({12, 2000 + i % side, 1300 + i / side});
+
+    // Случайное содержимое не сжимается ФС; тайлы различаются номером после заголовка
+    QRandomGenerator rng(42);
+    QByteArray payload(qMax(tileBytes, 16), '\0');
+    for (int i = 0; i < payload.size(); ++i)
+        payload[i] = char(rng.bounded(256));
+    payload[0] = '\x89';
+    payload[1] = 'P';
+    payload[2] = 'N';
+    payload[3] = 'G';
+    {
+        TileStore writer(dir.path());
+        QElapsedTimer timer;
+        timer.start();
+        for (int i = 0; i < tiles.size(); ++i) {
+            const TileId &t = tiles[i];
+            std::memcpy(payload.data() + 8, &i, sizeof(i));
+            writer.write(t.z, t.x, t.y, payload);
+        }
+        std::printf("populated %d tiles of %d bytes in %lld ms\n",
+                    count, int(payload.size()), timer.elapsed());
+    }
+
+    std::shuffle(tiles.begin(), tiles.end(), rng);
+
+    // Новый экземпляр - пустой горячий кэш, каждое чтение идёт в файл
+    TileStore store(dir.path());
+    QVector<qint64> disk;
+    disk.reserve(count);
+    QByteArray data;
+    for (const TileId &t : std::as_const(tiles)) {
+        QElapsedTimer timer;
+        timer.start();
+        store.read(t.z, t.x, t.y, data);
+        disk.append(timer.nsecsElapsed());
+    }
+    report("disk", disk);
+
+    QVector<qint64> hot;
+    hot.reserve(count);
+    for (const TileId &t : std::as_const(tiles)) {
+        QElapsedTimer timer;
+        timer.start();
+        store.cached(t.z, t.x, t.y, data);
+        hot.append(timer.nsecsElapsed());
+    }
+    report("hot", hot);
+
+    // Параллельные промахи горячего кэша, как в пуле обработчика схемы
+    TileStore parallelStore(dir.path());
+    QThreadPool pool;
+    pool.setMaxThreadCount(8);
+    QAtomicInt next(0);
+    QElapsedTimer wall;
+    wall.start();
+    for (int w = 0; w < pool.maxThreadCount(); ++w) {
+        pool.start([&]() {
+            QByteArray tile;
+            for (int i = next.fetchAndAddRelaxed(1); i < tiles.size(); i = next.fetchAndAddRelaxed(1))
+                parallelStore.read(tiles[i].z, tiles[i].x, tiles[i].y, tile);
+        });
+    }
+    pool.waitForDone();
+    const double seconds = double(wall.nsecsElapsed()) / 1e9;
+    std::printf("parallel %d threads: %.0f tiles/s (%.1f MB/s)\n", pool.maxThreadCount(),
+                count / seconds, double(count) * payload.size() / seconds / (1024.0 * 1024.0));
+
+    const TileStore::Stats s = store.stats();
+    std::printf("stats: requests=%llu hot=%llu disk=%llu misses=%llu\n",
+                static_cast<unsigned long long>(s.requests),
+                static_cast<unsigned long long>(s.hotHits),
+                static_cast<unsigned long long>(s.diskHits),
+                static_cast<unsigned long long>(s.misses));
+    return 0;
+}
@@ -0,0 +1,257 @@
+#include "duplicateindex.h"
+#include "tracer.h"
+
+#include <QPair>
+#include <QThread>
+#include <QThreadPool>
+#include <algorithm>
+#include <vector>
+
+#if defined(Q_CC_MSVC)
+#include <intrin.h>
+#endif
+
+namespace {
+
+// Система непересекающихся множеств со сжатием путей и объединением по размеру
+class UnionFind
+{
+public:
+    explicit UnionFind(int size) : m_parent(size), m_size(size, 1)
+    {
+        for (int i = 0; i < size; ++i)
+            m_parent[i] = i;
+    }
+
+    int find(int x)
+    {
+        while (m_parent[x] != x) {
+            m_parent[x] = m_parent[m_parent[x]];
+            x = m_parent[x];
+        }
+        return x;
+    }
+
+    void unite(int a, int b)
+    {
+        a = find(a);
+        b = find(b);
+        if (a == b)
+            return;
+        if (m_size[a] < m_size[b])
+            std::swap(a, b);
+        m_parent[b] = a;
+        m_size[a] += m_size[b];
+    }
+
+private:
+    QVector<int> m_parent;
+    QVector<int> m_size;
+};
+
+quint64 blockMask(int block, int blocks)
+{
+    const int low = block * 64 / blocks;
+    const int high = (block + 1) * 64 / blocks;
+    const quint64 ones = high - low == 64 ? ~quint64(0) : (quint64(1) << (high - low)) - 1;
+    return ones << low;
+}
+
+// Расстояние Хэмминга - горячая операция перебора пар. GCC и Clang без
+// -mpopcnt превращают popcount в программный подсчёт, поэтому перебор
+// собирается в двух вариантах, и при загрузке выбирается вариант
+// с инструкцией POPCNT, если процессор её знает. MSVC проверяет CPUID сам.
+#if defined(__GNUC__) && defined(__x86_64__) && defined(__linux__)
+#define DUPLICATE_POPCNT_CLONES __attribute__((target_clones("popcnt", "default")))
+#else
+#define DUPLICATE_POPCNT_CLONES
+#endif
+
+#if defined(Q_CC_MSVC) && defined(Q_PROCESSOR_X86_64)
+const bool HasPopcnt = [] {
+    int info[4] = {};
+    __cpuid(info, 1);
+    return (info[2] & (1 << 23)) != 0;
+}();
+#endif
+
+inline int bitCount(quint64 x)
+{
+#if defined(__GNUC__)
+    return __builtin_popcountll(x);
+#elif defined(Q_CC_MSVC) && defined(Q_PROCESSOR_X86_64)
+    return HasPopcnt ? int(__popcnt64(x)) : qPopulationCount(x);
+#else
+    return qPopulationCount(x);
+#endif
+}
+
+// Пары среди хешей keys[start, end) с одинаковым значением блока b;
+// ключ - значение блока << 32 | номер хеша в distinct
+DUPLICATE_POPCNT_CLONES
+void probeRun(const quint64 *distinct, const quint64 *keys, int start, int end, int b, int blocks,
+              int maxDistance, QVector<QPair<int, int>> &found)
+{
+    for (int i = start; i < end; ++i) {
+        const int a = int(quint32(keys[i]));
+        for (int j = i + 1; j < end; ++j) {
+            const int c = int(quint32(keys[j]));
+            const quint64 diff = distinct[a] ^ distinct[c];
+            if (bitCount(diff) > maxDistance)
+                continue;
+            // Пара учитывается в первом совпавшем блоке
+            bool earlier = false;
+            for (int e = 0; e < b && !earlier; ++e)
+                earlier = (diff & blockMask(e, blocks)) == 0;
+            if (!earlier)
+                found.append(qMakePair(a, c));
+        }
+    }
+}
+
+} // namespace
+
+void DuplicateIndex::clear()
+{
+    m_groupOf.clear();
+    m_groupStart.clear();
+    m_members.clear();
+}
+
+QVector<int> DuplicateIndex::members(int group) const
+{
+    return m_members.mid(m_groupStart[group], groupSize(group));
+}
+
+void DuplicateIndex::build(const PhotoStore &photos, int maxDistance)
+{
+    TraceSpan span("dup.build");
+    clear();
+    maxDistance = qBound(0, maxDistance, 31);
+
+    struct Entry
+    {
+        quint64 hash;
+        int id;
+    };
+    std::vector<Entry> entries;
+    entries.reserve(size_t(photos.liveCount()));
+    for (int id = 0; id < photos.size(); ++id) {
+        if (!photos.isRemoved(id) && photos.hasHash(id))
+            entries.push_back({photos.hash(id), id});
+    }
+    span.setValue(qint64(entries.size()));
+
+    UnionFind sets(photos.size());
+
+    // Одинаковые хеши (точные копии) сливаются сразу; дальше у каждого
+    // различного хеша один представитель, и серии одинаковых блоков не раздуваются
+    std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) {
+        return a.hash < b.hash || (a.hash == b.hash && a.id < b.id);
+    });
+    QVector<quint64> hashes;
+    QVector<int> heads;
+    for (const Entry &e : entries) {
+        if (!hashes.isEmpty() && hashes.last() == e.hash) {
+            sets.unite(heads.last(), e.id);
+            continue;
+        }
+        hashes.append(e.hash);
+        heads.append(e.id);
+    }
+
+    // Multi-index hashing; при maxDistance == 0 хватает точных совпадений
+    const int blocks = maxDistance + 1;
+    if (maxDistance > 0 && hashes.size() > 1) {
+        QVector<QVector<QPair<int, int>>> pairs(blocks);
+        const QVector<quint64> &distinct = hashes;   // потоки только читают
+        QThreadPool pool;
+        pool.setMaxThreadCount(qMax(1, QThread::idealThreadCount()));
+        for (int b = 0; b < blocks; ++b) {
+            pool.start([&distinct, &pairs, b, blocks, maxDistance]() {
+                const quint64 mask = blockMask(b, blocks);
+                const int shift = b * 64 / blocks;
+                const int count = int(distinct.size());
+                // Ключ - значение блока (не длиннее 32 бит) и номер хеша
+                std::vector<quint64> keys(size_t(count), 0);
+                for (int i = 0; i < count; ++i)
+                    keys[size_t(i)] = (((distinct[i] & mask) >> shift) << 32) | quint32(i);
+                std::sort(keys.begin(), keys.end());
+
+                QVector<QPair<int, int>> &found = pairs[b];
+                for (int start = 0; start < count;) {
+                    int end = start + 1;
+                    while (end < count && (keys[size_t(end)] >> 32) == (keys[size_t(start)] >> 32))
+                        ++end;
+                    if (end - start > 1)
+                        probeRun(distinct.constData(), keys.data(), start, end, b, blocks,
+                                 maxDistance, found);
+                    start = end;
+                }
+            });
+        }
+        pool.waitForDone();
+        for (const auto &found : std::as_const(pairs)) {
+            for (const auto &pair : found)
+                sets.unite(heads[pair.first], heads[pair.second]);
+        }
+    }
+
+    // Серии кадров: соседи по времени съёмки в той же папке
+    std::sort(entries.begin(), entries.end(), [&photos](const Entry &a, const Entry &b) {
+        return photos.taken(a.id) < photos.taken(b.id);
+    });
+    for (size_t i = 0; i < entries.size(); ++i) {
+        const qint64 taken = photos.taken(entries[i].id);
+        if (taken == PhotoStore::NoTime)
+            continue;
+        for (size_t j = i + 1; j < entries.size(); ++j) {
+            if (photos.taken(entries[j].id) - taken > BurstWindowMs)
+                break;
+            if (photos.dirOf(entries[j].id) == photos.dirOf(entries[i].id)
+                    && distance(entries[i].hash, entries[j].hash) <= BurstDistance)
+                sets.unite(entries[i].id, entries[j].id);
+        }
+    }
+
+    // Группы из двух и более фото, раскладка по группам подсчётом
+    QVector<int> rootSize(photos.size(), 0);
+    for (const Entry &e : entries)
+        ++rootSize[sets.find(e.id)];
+    QVector<int> rootGroup(photos.size(), -1);
+    m_groupStart.append(0);
+    for (const Entry &e : entries) {
+        const int root = sets.find(e.id);
+        if (rootSize[root] < 2 || rootGroup[root] >= 0)
+            continue;
+        rootGroup[root] = int(m_groupStart.size()) - 1;
+        m_groupStart.append(m_groupStart.last() + rootSize[root]);
+    }
+    if (m_groupStart.size() == 1) {
+        m_groupStart.clear();
+        return;
+    }
+
+    m_groupOf.fill(-1, photos.size());
+    m_members.resize(m_groupStart.last());
+    QVector<int> fill = m_groupStart;
+    for (const Entry &e : entries) {
+        const int group = rootGroup[sets.find(e.id)];
+        if (group < 0)
+            continue;
+        m_groupOf[e.id] = group;
+        m_members[fill[group]++] = e.id;
+    }
+
+    // Представитель - самый крупный файл, при равенстве - с меньшим id
+    for (int g = 0; g < groupCount(); ++g) {
+        const auto first = m_members.begin() + m_groupStart[g];
+        const auto last = m_members.begin() + m_groupStart[g + 1];
+        const auto best = std::min_element(first, last, [&photos](int a, int b) {
+            const qint64 sa = photos.fileSize(a);
+            const qint64 sb = photos.fileSize(b);
+            return sa > sb || (sa == sb && a < b);
+        });
+        std::iter_swap(first, best);
+    }
+}
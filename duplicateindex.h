@@ -0,0 +1,57 @@
+#ifndef DUPLICATEINDEX_H
+#define DUPLICATEINDEX_H
+
+#include "photostore.h"
+
+#include <QVector>
+#include <QtAlgorithms>
+
+// Группы почти одинаковых снимков: копии в разных папках, пересжатые
+// и уменьшенные версии, серии кадров.
+// У каждого фото - 64-битный перцептивный хеш (PerceptualHash, считается
+// при сканировании и хранится в каталоге). Похожие снимки отличаются
+// в немногих битах, расстояние - popcount(a ^ b).
+// Поиск пар без перебора всех со всеми (multi-index hashing): хеш режется
+// на maxDistance + 1 блоков, и у пары на расстоянии <= maxDistance хотя бы
+// один блок совпадает целиком. Для каждого блока хеши сортируются по нему,
+// сравниваются только хеши внутри серий с одинаковым блоком; блоки
+// обрабатываются параллельно. Серии кадров - соседи по времени съёмки
+// (в пределах BurstWindowMs) в одной папке с более мягким порогом.
+// Пары сливаются в группы системой непересекающихся множеств; представитель
+// группы - самый крупный файл.
+class DuplicateIndex
+{
+public:
+    static constexpr int MaxDistance = 4;         // бит из 64 для копий
+    static constexpr int BurstDistance = 12;      // для кадров одной серии
+    static constexpr qint64 BurstWindowMs = 3000;
+
+    static int distance(quint64 a, quint64 b) { return qPopulationCount(a ^ b); }
+
+    // Учитываются неудалённые фото с хешем
+    void build(const PhotoStore &photos, int maxDistance = MaxDistance);
+    void clear();
+    bool isEmpty() const { return m_groupStart.size() <= 1; }
+
+    int groupCount() const { return qMax(0, int(m_groupStart.size()) - 1); }
+    // -1 - у фото нет похожих
+    int groupOf(int id) const { return id < m_groupOf.size() ? m_groupOf[id] : -1; }
+    int groupSize(int group) const { return m_groupStart[group + 1] - m_groupStart[group]; }
+    int representative(int group) const { return m_members[m_groupStart[group]]; }
+    // Представитель первым
+    QVector<int> members(int group) const;
+    // Фото в группе, но не её представитель: при свёртке не показывается
+    bool isHidden(int id) const
+    {
+        const int group = groupOf(id);
+        return group >= 0 && representative(group) != id;
+    }
+    int hiddenCount() const { return int(m_members.size()) - groupCount(); }
+
+private:
+    QVector<int> m_groupOf;
+    QVector<int> m_groupStart;   // groupCount() + 1 начал в m_members
+    QVector<int> m_members;
+};
+
+#endif // DUPLICATEINDEX_H
@@ -0,0 +1,1383 @@
+#include "exifreader.h"
+#include "tracer.h"
+
+#include <QFile>
+#include <QByteArray>
+#include <QDate>
+#include <QHash>
+#include <QTime>
+#include <QVector>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// Первая порция APP1: в типичном снимке IFD0, Exif IFD и GPS IFD
+// укладываются в неё, а встроенное превью идёт следом.
+constexpr int InitialChunk = 8 * 1024;
+constexpr int MaxJpegSegments = 32;
+constexpr int MaxContainerChunks = 64;
+// IFD дальше MaxSegmentSize от начала блока (у RAW Exif IFD и превью
+// бывают в мегабайтах от заголовка) читается отдельным окном
+constexpr int IfdWindow = 4 * 1024;
+constexpr int MaxIfdChain = 8;
+constexpr int MaxSubIfds = 8;
+// Бокс meta у HEIF (список элементов и их мест) и udta/meta у видео
+// читаются целиком; больше - значит, это не заголовок
+constexpr int MaxMetaSize = 256 * 1024;
+constexpr int MaxMovieKeys = 256;
+// Секунды от 1904-01-01 (эпоха QuickTime) до 1970-01-01
+constexpr qint64 QuickTimeEpochOffset = 2082844800;
+
+TraceCounter bytesRead("exif.bytesRead");
+
+// Чтение ровно size байт; прочитанное попадает в счётчик трассы
+bool readFully(QFile &file, void *data, qint64 size)
+{
+    const qint64 got = file.read(static_cast<char *>(data), size);
+    if (got > 0)
+        bytesRead.add(got);
+    return got == size;
+}
+
+enum : quint16 {
+    TagJpgFromRaw = 0x002E,
+    TagNewSubfileType = 0x00FE,
+    TagCompression = 0x0103,
+    TagPhotometric = 0x0106,
+    TagStripOffsets = 0x0111,
+    TagStripByteCounts = 0x0117,
+    TagDateTime = 0x0132,
+    TagSubIfds = 0x014A,
+    TagThumbnailOffset = 0x0201,
+    TagThumbnailLength = 0x0202,
+    TagExifIfd = 0x8769,
+    TagGpsIfd = 0x8825,
+    TagDateTimeOriginal = 0x9003,
+
+    TagGpsLatitudeRef = 0x0001,
+    TagGpsLatitude = 0x0002,
+    TagGpsLongitudeRef = 0x0003,
+    TagGpsLongitude = 0x0004
+};
+
+enum : quint16 {
+    TypeByte = 1,
+    TypeAscii = 2,
+    TypeShort = 3,
+    TypeLong = 4,
+    TypeRational = 5,
+    TypeUndefined = 7,
+    TypeSLong = 9,
+    TypeSRational = 10,
+    TypeIfd = 13
+};
+
+// Сигнатуры TIFF: обычная, ORF (Olympus) и RW2 (Panasonic)
+enum : quint16 {
+    MagicTiff = 42,
+    MagicOrf = 0x4F52,
+    MagicOrfSp = 0x5352,
+    MagicRw2 = 0x0055
+};
+
+enum : quint32 {
+    CompressionOldJpeg = 6,
+    CompressionJpeg = 7,
+    PhotometricCfa = 32803,
+    PhotometricLinearRaw = 34892
+};
+
+int typeSize(quint16 type)
+{
+    switch (type) {
+    case TypeByte:
+    case TypeAscii:
+    case TypeUndefined:
+        return 1;
+    case TypeShort:
+        return 2;
+    case TypeLong:
+    case TypeSLong:
+    case TypeIfd:
+        return 4;
+    case TypeRational:
+    case TypeSRational:
+        return 8;
+    default:
+        return 0;
+    }
+}
+
+quint32 readBigEndian32(const uchar *p)
+{
+    return (quint32(p[0]) << 24) | (quint32(p[1]) << 16) | (quint32(p[2]) << 8) | quint32(p[3]);
+}
+
+quint32 readLittleEndian32(const uchar *p)
+{
+    return quint32(p[0]) | (quint32(p[1]) << 8) | (quint32(p[2]) << 16) | (quint32(p[3]) << 24);
+}
+
+constexpr quint32 fourCc(const char (&name)[5])
+{
+    return (quint32(uchar(name[0])) << 24) | (quint32(uchar(name[1])) << 16)
+            | (quint32(uchar(name[2])) << 8) | quint32(uchar(name[3]));
+}
+
+// "©xyz" и "©day" - теги QuickTime с байтом 0xA9 вместо первой буквы
+constexpr quint32 BoxLocation = 0xA978797A;
+constexpr quint32 BoxDay = 0xA9646179;
+
+// Доступ к части TIFF-блока с учётом порядка байт и проверкой границ.
+// Прочитаны байты [origin, origin + available), full - размер блока в файле.
+struct TiffView
+{
+    const uchar *data = nullptr;
+    qint64 origin = 0;
+    qint64 available = 0;
+    qint64 full = 0;
+    bool littleEndian = true;
+    mutable bool truncated = false; // ссылка ведёт за пределы прочитанного
+
+    bool covers(qint64 offset, qint64 length) const
+    {
+        return offset >= origin && length >= 0 && offset + length <= origin + available;
+    }
+
+    bool inRange(qint64 offset, qint64 length) const
+    {
+        if (offset < 0 || length < 0 || offset + length > full)
+            return false;
+        if (!covers(offset, length)) {
+            truncated = true;
+            return false;
+        }
+        return true;
+    }
+
+    const uchar *at(qint64 offset) const { return data + (offset - origin); }
+
+    quint16 u16(qint64 offset) const
+    {
+        const uchar *p = at(offset);
+        return littleEndian ? quint16(p[0] | (p[1] << 8))
+                            : quint16((p[0] << 8) | p[1]);
+    }
+
+    quint32 u32(qint64 offset) const
+    {
+        const uchar *p = at(offset);
+        return littleEndian ? readLittleEndian32(p) : readBigEndian32(p);
+    }
+};
+
+struct IfdEntry
+{
+    quint16 tag = 0;
+    quint16 type = 0;
+    quint32 count = 0;
+    qint64 valueOffset = 0; // где лежат данные (внутри записи или по ссылке)
+    bool loaded = false;    // данные прочитаны (у UNDEFINED может быть только место)
+};
+
+bool entryAt(const TiffView &v, qint64 entryOffset, IfdEntry &e)
+{
+    e.tag = v.u16(entryOffset);
+    e.type = v.u16(entryOffset + 2);
+    e.count = v.u32(entryOffset + 4);
+    const int unit = typeSize(e.type);
+    if (unit == 0)
+        return false;
+    const qint64 bytes = qint64(unit) * e.count;
+    e.valueOffset = bytes <= 4 ? entryOffset + 8 : qint64(v.u32(entryOffset + 8));
+    if (e.valueOffset + bytes > v.full)
+        return false;
+    // Непрозрачные данные (JpgFromRaw, MakerNote) не дочитываются - нужно только их место
+    if (e.type == TypeUndefined) {
+        e.loaded = v.covers(e.valueOffset, bytes);
+        return true;
+    }
+    e.loaded = v.inRange(e.valueOffset, bytes);
+    return e.loaded;
+}
+
+// Обходит записи IFD; возвращает смещение следующего IFD (0, если его нет)
+template <typename Fn>
+quint32 walkIfd(const TiffView &v, quint32 ifdOffset, Fn &&fn)
+{
+    if (ifdOffset == 0 || !v.inRange(ifdOffset, 2))
+        return 0;
+    const quint16 count = v.u16(ifdOffset);
+    const qint64 entries = qint64(ifdOffset) + 2;
+    if (!v.inRange(entries, qint64(count) * 12 + 4))
+        return 0;
+
+    for (int i = 0; i < count; ++i) {
+        IfdEntry e;
+        if (entryAt(v, entries + qint64(i) * 12, e))
+            fn(v, e);
+    }
+    return v.u32(entries + qint64(count) * 12);
+}
+
+quint32 entryUInt(const TiffView &v, const IfdEntry &e)
+{
+    if (e.type == TypeShort)
+        return v.u16(e.valueOffset);
+    if (e.type == TypeLong || e.type == TypeSLong || e.type == TypeIfd)
+        return v.u32(e.valueOffset);
+    return 0;
+}
+
+// Градусы, минуты, секунды в виде трёх рациональных чисел
+bool entryCoord(const TiffView &v, const IfdEntry &e, double &result)
+{
+    if ((e.type != TypeRational && e.type != TypeSRational) || e.count < 2)
+        return false;
+
+    double parts[3] = {0.0, 0.0, 0.0};
+    const int n = qMin<quint32>(e.count, 3);
+    for (int i = 0; i < n; ++i) {
+        const qint64 off = e.valueOffset + qint64(i) * 8;
+        const quint32 num = v.u32(off);
+        const quint32 den = v.u32(off + 4);
+        if (den == 0) {
+            if (num == 0 && i > 0)
+                continue;
+            return false;
+        }
+        parts[i] = e.type == TypeSRational
+                ? double(qint32(num)) / double(qint32(den))
+                : double(num) / double(den);
+    }
+    result = parts[0] + parts[1] / 60.0 + parts[2] / 3600.0;
+    return true;
+}
+
+char entryRef(const TiffView &v, const IfdEntry &e)
+{
+    if (e.type != TypeAscii || e.count == 0)
+        return 0;
+    return char(*v.at(e.valueOffset));
+}
+
+QDateTime entryDateTime(const TiffView &v, const IfdEntry &e)
+{
+    if (e.type != TypeAscii)
+        return QDateTime();
+    return ExifReader::parseExifDateTime(reinterpret_cast<const char *>(v.at(e.valueOffset)),
+                                         int(e.count));
+}
+
+// Смещения SubIFD (у RAW там превью и сами снимки)
+QVector<quint32> entryOffsets(const TiffView &v, const IfdEntry &e)
+{
+    QVector<quint32> offsets;
+    if (e.type != TypeLong && e.type != TypeIfd)
+        return offsets;
+    for (quint32 i = 0; i < qMin<quint32>(e.count, MaxSubIfds); ++i)
+        offsets.append(v.u32(e.valueOffset + qint64(i) * 4));
+    return offsets;
+}
+
+// Встроенный JPEG; смещение от начала файла
+struct Preview
+{
+    qint64 offset = -1;
+    qint64 length = 0;
+    bool verified = false;    // JPEG по определению тега, проверять заголовок не нужно
+    bool embedsExif = false;  // JPEG с собственным EXIF (RW2, RAF)
+};
+
+// Начинается ли с offset JPEG, который декодирует Qt. Полосы RAW с
+// компрессией JPEG бывают и lossless (SOF3) - это сами сырые данные.
+bool isDecodableJpeg(QFile &file, qint64 offset)
+{
+    uchar hdr[4];
+    if (!file.seek(offset) || !readFully(file, hdr, 2) || hdr[0] != 0xFF || hdr[1] != 0xD8)
+        return false;
+    qint64 pos = offset + 2;
+    for (int i = 0; i < MaxJpegSegments; ++i) {
+        if (!file.seek(pos) || !readFully(file, hdr, 4) || hdr[0] != 0xFF)
+            return false;
+        const uchar marker = hdr[1];
+        if (marker == 0xFF) {
+            ++pos;
+            continue;
+        }
+        // SOF0..SOF15, кроме DHT, JPG и DAC
+        if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC)
+            return marker <= 0xC2;
+        if (marker == 0xDA || marker == 0xD9)
+            return false;
+        pos += 2 + ((hdr[2] << 8) | hdr[3]);
+    }
+    return false;
+}
+
+// Самое маленькое превью - для иконок, самое крупное - для просмотра
+void choosePreviews(QFile *file, QVector<Preview> previews, ExifData &out)
+{
+    std::sort(previews.begin(), previews.end(),
+              [](const Preview &a, const Preview &b) { return a.length < b.length; });
+    const auto usable = [file](const Preview &preview) {
+        return preview.verified || (file && isDecodableJpeg(*file, preview.offset));
+    };
+
+    int thumbnail = -1;
+    for (int i = 0; i < previews.size() && thumbnail < 0; ++i) {
+        if (usable(previews[i]))
+            thumbnail = i;
+    }
+    if (thumbnail < 0)
+        return;
+    out.thumbnailOffset = previews[thumbnail].offset;
+    out.thumbnailLength = previews[thumbnail].length;
+    for (int i = previews.size() - 1; i > thumbnail; --i) {
+        if (previews[i].offset != out.thumbnailOffset && usable(previews[i])) {
+            out.previewOffset = previews[i].offset;
+            out.previewLength = previews[i].length;
+            return;
+        }
+    }
+}
+
+// TIFF-блок в файле (или в памяти). Сначала читается небольшая порция;
+// если ссылки ведут дальше - блок до MaxSegmentSize, а IFD за ним
+// читаются окнами по IfdWindow, так что RAW целиком не читается.
+class TiffBlock
+{
+public:
+    TiffBlock(QFile &file, qint64 offset, qint64 size)
+        : m_file(&file), m_offset(offset), m_size(size) {}
+    TiffBlock(const uchar *data, qint64 size, qint64 offset)
+        : m_offset(offset), m_size(size)
+    {
+        m_head.data = data;
+        m_head.available = size;
+        m_head.full = size;
+    }
+
+    bool open();
+    qint64 offset() const { return m_offset; }
+    qint64 size() const { return m_size; }
+    bool isRw2() const { return m_magic == MagicRw2; }
+    quint32 firstIfd() const { return m_head.u32(4); }
+
+    // Если значения лежат за первой порцией, она дочитывается и обход
+    // повторяется - fn должна быть готова увидеть записи дважды
+    template <typename Fn>
+    quint32 walk(quint32 ifdOffset, Fn &&fn);
+
+private:
+    bool load(QByteArray &buffer, TiffView &view, qint64 origin, qint64 length);
+    bool extendHead();
+    static bool coversIfd(const TiffView &view, quint32 ifdOffset);
+    const TiffView *viewOf(quint32 ifdOffset);
+
+    QFile *m_file = nullptr;
+    qint64 m_offset = 0;
+    qint64 m_size = 0;
+    quint16 m_magic = 0;
+    QByteArray m_headData;
+    QByteArray m_windowData;
+    TiffView m_head;
+    TiffView m_window;
+};
+
+bool TiffBlock::open()
+{
+    if (m_size < 8)
+        return false;
+    if (m_file && !load(m_headData, m_head, 0, qMin<qint64>(m_size, InitialChunk)))
+        return false;
+    if (m_head.available < 8)
+        return false;
+    if (m_head.data[0] == 'I' && m_head.data[1] == 'I')
+        m_head.littleEndian = true;
+    else if (m_head.data[0] == 'M' && m_head.data[1] == 'M')
+        m_head.littleEndian = false;
+    else
+        return false;
+    m_magic = m_head.u16(2);
+    if (m_magic != MagicTiff && m_magic != MagicOrf && m_magic != MagicOrfSp && m_magic != MagicRw2)
+        return false;
+    m_window.littleEndian = m_head.littleEndian;
+    return true;
+}
+
+bool TiffBlock::load(QByteArray &buffer, TiffView &view, qint64 origin, qint64 length)
+{
+    buffer.resize(int(length));
+    if (!m_file->seek(m_offset + origin) || !readFully(*m_file, buffer.data(), length))
+        return false;
+    view.data = reinterpret_cast<const uchar *>(buffer.constData());
+    view.origin = origin;
+    view.available = length;
+    view.full = m_size;
+    view.truncated = false;
+    return true;
+}
+
+bool TiffBlock::extendHead()
+{
+    const qint64 have = m_head.available;
+    const qint64 limit = qMin<qint64>(m_size, ExifReader::MaxSegmentSize);
+    if (!m_file || have >= limit)
+        return false;
+    m_headData.resize(int(limit));
+    const bool ok = m_file->seek(m_offset + have)
+            && readFully(*m_file, m_headData.data() + have, limit - have);
+    if (!ok)
+        m_headData.resize(int(have));
+    m_head.data = reinterpret_cast<const uchar *>(m_headData.constData());
+    m_head.available = m_headData.size();
+    return ok;
+}
+
+bool TiffBlock::coversIfd(const TiffView &view, quint32 ifdOffset)
+{
+    return view.covers(ifdOffset, 2)
+            && view.covers(qint64(ifdOffset) + 2, qint64(view.u16(ifdOffset)) * 12 + 4);
+}
+
+const TiffView *TiffBlock::viewOf(quint32 ifdOffset)
+{
+    if (ifdOffset == 0 || qint64(ifdOffset) + 2 > m_size)
+        return nullptr;
+    if (coversIfd(m_head, ifdOffset))
+        return &m_head;
+    if (ifdOffset < ExifReader::MaxSegmentSize && extendHead() && coversIfd(m_head, ifdOffset))
+        return &m_head;
+    if (coversIfd(m_window, ifdOffset))
+        return &m_window;
+    if (m_file && load(m_windowData, m_window, ifdOffset, qMin<qint64>(IfdWindow, m_size - ifdOffset))
+            && coversIfd(m_window, ifdOffset))
+        return &m_window;
+    return nullptr;
+}
+
+template <typename Fn>
+quint32 TiffBlock::walk(quint32 ifdOffset, Fn &&fn)
+{
+    const TiffView *view = viewOf(ifdOffset);
+    if (!view)
+        return 0;
+    view->truncated = false;
+    quint32 next = walkIfd(*view, ifdOffset, fn);
+    if (view == &m_head && m_head.truncated && extendHead()) {
+        m_head.truncated = false;
+        next = walkIfd(m_head, ifdOffset, fn);
+    }
+    return next;
+}
+
+// Что лежит в IFD0 блока: у CR3 Exif IFD и GPS IFD - отдельные TIFF-блоки
+enum class Ifd0 { Primary, Exif, Gps };
+
+// Теги IFD, описывающие встроенное изображение
+struct ImageIfd
+{
+    quint32 subfileType = 0;
+    quint32 compression = 0;
+    quint32 photometric = 0;
+    qint64 stripOffset = 0;     // только у изображения из одной полосы
+    qint64 stripLength = 0;
+    qint64 jpegOffset = 0;      // JPEGInterchangeFormat или JpgFromRaw
+    qint64 jpegLength = 0;
+    bool embedsExif = false;
+
+    void take(const TiffView &v, const IfdEntry &e)
+    {
+        switch (e.tag) {
+        case TagNewSubfileType:
+            subfileType = entryUInt(v, e);
+            break;
+        case TagCompression:
+            compression = entryUInt(v, e);
+            break;
+        case TagPhotometric:
+            photometric = entryUInt(v, e);
+            break;
+        case TagStripOffsets:
+            if (e.count == 1)
+                stripOffset = entryUInt(v, e);
+            break;
+        case TagStripByteCounts:
+            if (e.count == 1)
+                stripLength = entryUInt(v, e);
+            break;
+        case TagThumbnailOffset:
+            jpegOffset = entryUInt(v, e);
+            break;
+        case TagThumbnailLength:
+            jpegLength = entryUInt(v, e);
+            break;
+        default:
+            break;
+        }
+    }
+
+    // Полоса JPEG, не похожая на сырые данные сенсора (CFA, LinearRaw);
+    // lossless-полосы отсеет isDecodableJpeg
+    void addTo(const TiffBlock &block, QVector<Preview> &previews) const
+    {
+        Preview preview;
+        if (jpegOffset > 0 && jpegLength > 0) {
+            preview.offset = jpegOffset;
+            preview.length = jpegLength;
+            preview.verified = true;
+            preview.embedsExif = embedsExif;
+        } else if (stripOffset > 0 && stripLength > 0
+                   && (compression == CompressionOldJpeg || compression == CompressionJpeg)
+                   && photometric != PhotometricCfa && photometric != PhotometricLinearRaw) {
+            preview.offset = stripOffset;
+            preview.length = stripLength;
+        } else {
+            return;
+        }
+        if (preview.offset + preview.length > block.size())
+            return;
+        preview.offset += block.offset();
+        previews.append(preview);
+    }
+};
+
+bool parseTiffBlock(TiffBlock &block, Ifd0 kind, ExifData &out, QVector<Preview> &previews)
+{
+    quint32 exifIfd = kind == Ifd0::Exif ? block.firstIfd() : 0;
+    quint32 gpsIfd = kind == Ifd0::Gps ? block.firstIfd() : 0;
+    QDateTime modified;
+    const int previewCount = previews.size();
+
+    if (kind == Ifd0::Primary) {
+        // IFD0 и цепочка за ним (IFD1 - превью EXIF); у RAW превью ещё в SubIFD
+        QVector<quint32> subIfds;
+        quint32 next = block.firstIfd();
+        for (int index = 0; next != 0 && index < MaxIfdChain; ++index) {
+            ImageIfd image;
+            next = block.walk(next, [&](const TiffView &v, const IfdEntry &e) {
+                switch (e.tag) {
+                case TagExifIfd:
+                    exifIfd = entryUInt(v, e);
+                    break;
+                case TagGpsIfd:
+                    gpsIfd = entryUInt(v, e);
+                    break;
+                case TagDateTime:
+                    modified = entryDateTime(v, e);
+                    break;
+                case TagSubIfds:
+                    subIfds = entryOffsets(v, e);
+                    break;
+                case TagJpgFromRaw:
+                    if (block.isRw2() && e.type == TypeUndefined) {
+                        image.jpegOffset = e.valueOffset;
+                        image.jpegLength = e.count;
+                        image.embedsExif = true;
+                    }
+                    break;
+                default:
+                    image.take(v, e);
+                    break;
+                }
+            });
+            image.addTo(block, previews);
+        }
+        for (quint32 subIfd : std::as_const(subIfds)) {
+            ImageIfd image;
+            block.walk(subIfd, [&image](const TiffView &v, const IfdEntry &e) { image.take(v, e); });
+            image.addTo(block, previews);
+        }
+    }
+
+    block.walk(exifIfd, [&](const TiffView &v, const IfdEntry &e) {
+        if (e.tag == TagDateTimeOriginal)
+            out.dateTimeOriginal = entryDateTime(v, e);
+    });
+    if (!out.dateTimeOriginal.isValid())
+        out.dateTimeOriginal = modified;
+
+    char latRef = 'N', lngRef = 'E';
+    double lat = 0.0, lng = 0.0;
+    bool haveLat = false, haveLng = false;
+    block.walk(gpsIfd, [&](const TiffView &v, const IfdEntry &e) {
+        switch (e.tag) {
+        case TagGpsLatitudeRef:
+            if (const char c = entryRef(v, e))
+                latRef = c;
+            break;
+        case TagGpsLatitude:
+            haveLat = entryCoord(v, e, lat);
+            break;
+        case TagGpsLongitudeRef:
+            if (const char c = entryRef(v, e))
+                lngRef = c;
+            break;
+        case TagGpsLongitude:
+            haveLng = entryCoord(v, e, lng);
+            break;
+        default:
+            break;
+        }
+    });
+
+    if (haveLat && haveLng) {
+        if (latRef == 'S' || latRef == 's')
+            lat = -lat;
+        if (lngRef == 'W' || lngRef == 'w')
+            lng = -lng;
+        if (lat >= -90.0 && lat <= 90.0 && lng >= -180.0 && lng <= 180.0) {
+            out.hasGps = true;
+            out.latitude = lat;
+            out.longitude = lng;
+        }
+    }
+
+    return out.hasGps || out.dateTimeOriginal.isValid() || previews.size() > previewCount;
+}
+
+// TIFF-блок длиной blockSize с позиции offset; превью - в previews
+bool readTiffAt(QFile &file, qint64 offset, qint64 blockSize, Ifd0 kind,
+                ExifData &out, QVector<Preview> &previews)
+{
+    TiffBlock block(file, offset, blockSize);
+    return block.open() && parseTiffBlock(block, kind, out, previews);
+}
+
+// Сегменты JPEG, начиная с маркера SOI по смещению start
+bool readJpeg(QFile &file, qint64 start, ExifData &out, QVector<Preview> &previews)
+{
+    qint64 pos = start + 2;
+    for (int i = 0; i < MaxJpegSegments; ++i) {
+        uchar hdr[10];
+        if (!file.seek(pos) || !readFully(file, hdr, 4))
+            return false;
+        if (hdr[0] != 0xFF)
+            return false;
+
+        const uchar marker = hdr[1];
+        if (marker == 0xFF) { // заполняющие байты перед маркером
+            ++pos;
+            continue;
+        }
+        if (marker == 0xDA || marker == 0xD9) // начало скана / конец файла
+            return false;
+
+        const int length = (hdr[2] << 8) | hdr[3];
+        if (length < 2)
+            return false;
+
+        if (marker == 0xE1 && length > 8) {
+            if (!readFully(file, hdr + 4, 6))
+                return false;
+            if (std::memcmp(hdr + 4, "Exif\0\0", 6) == 0)
+                return readTiffAt(file, pos + 10, length - 8, Ifd0::Primary, out, previews);
+            // иначе это XMP или другой APP1 - идём дальше
+        }
+        pos += 2 + length;
+    }
+    return false;
+}
+
+bool readPng(QFile &file, ExifData &out, QVector<Preview> &previews)
+{
+    qint64 pos = 8;
+    for (int i = 0; i < MaxContainerChunks; ++i) {
+        uchar hdr[8];
+        if (!file.seek(pos) || !readFully(file, hdr, 8))
+            return false;
+        const quint32 length = readBigEndian32(hdr);
+        if (std::memcmp(hdr + 4, "eXIf", 4) == 0)
+            return readTiffAt(file, pos + 8, length, Ifd0::Primary, out, previews);
+        if (std::memcmp(hdr + 4, "IDAT", 4) == 0 || std::memcmp(hdr + 4, "IEND", 4) == 0)
+            return false;
+        pos += 12 + qint64(length);
+    }
+    return false;
+}
+
+bool readWebp(QFile &file, ExifData &out, QVector<Preview> &previews)
+{
+    qint64 pos = 12;
+    for (int i = 0; i < MaxContainerChunks; ++i) {
+        uchar hdr[14];
+        if (!file.seek(pos) || !readFully(file, hdr, 8))
+            return false;
+        const quint32 length = readLittleEndian32(hdr + 4);
+        if (std::memcmp(hdr, "EXIF", 4) == 0) {
+            // Часть кодировщиков добавляет заголовок "Exif\0\0", как в JPEG
+            if (length > 6 && readFully(file, hdr + 8, 6)
+                    && std::memcmp(hdr + 8, "Exif\0\0", 6) == 0)
+                return readTiffAt(file, pos + 14, length - 6, Ifd0::Primary, out, previews);
+            return readTiffAt(file, pos + 8, length, Ifd0::Primary, out, previews);
+        }
+        pos += 8 + qint64(length) + (length & 1);
+    }
+    return false;
+}
+
+bool isTiffHeader(const uchar *head)
+{
+    if (head[0] == 'I' && head[1] == 'I')
+        return (head[2] == 0x2A && head[3] == 0) || (head[2] == 'R' && (head[3] == 'O' || head[3] == 'S'))
+                || (head[2] == 'U' && head[3] == 0);
+    if (head[0] == 'M' && head[1] == 'M')
+        return (head[2] == 0 && head[3] == 0x2A) || (head[2] == 'O' && head[3] == 'R');
+    return false;
+}
+
+// RAW на основе TIFF (DNG, CR2, NEF, ARW, ORF, RW2, PEF, SRW)
+bool readRaw(QFile &file, ExifData &out, QVector<Preview> &previews)
+{
+    TiffBlock block(file, 0, file.size());
+    if (!block.open())
+        return false;
+    bool ok = parseTiffBlock(block, Ifd0::Primary, out, previews);
+    // RW2 хранит EXIF во встроенном JPEG (JpgFromRaw), а не в IFD0
+    if (!out.hasGps && !out.dateTimeOriginal.isValid()) {
+        for (int i = 0; i < previews.size(); ++i) {
+            if (previews[i].embedsExif) {
+                const qint64 offset = previews[i].offset;
+                ok = readJpeg(file, offset, out, previews) || ok;
+                break;
+            }
+        }
+    }
+    return ok;
+}
+
+// Fujifilm RAF: в заголовке - место встроенного JPEG, EXIF - внутри него
+bool readRaf(QFile &file, ExifData &out, QVector<Preview> &previews)
+{
+    uchar hdr[8];
+    if (!file.seek(84) || !readFully(file, hdr, 8))
+        return false;
+    Preview preview;
+    preview.offset = readBigEndian32(hdr);
+    preview.length = readBigEndian32(hdr + 4);
+    if (preview.offset <= 0 || preview.length <= 0 || preview.offset + preview.length > file.size()
+            || !file.seek(preview.offset) || !readFully(file, hdr, 2) || hdr[0] != 0xFF || hdr[1] != 0xD8)
+        return false;
+    preview.verified = true;
+    previews.append(preview);
+    readJpeg(file, preview.offset, out, previews);
+    return true;
+}
+
+// Бокс ISO-BMFF (HEIF, CR3, MP4, MOV): содержимое - [start, end)
+struct Box
+{
+    quint32 type = 0;
+    qint64 start = 0;
+    qint64 end = 0;
+};
+
+// Заголовок бокса в файле с позиции pos; false - конец списка или битый размер.
+// Содержимое не читается: mdat с кадрами просто перешагивается.
+bool readBox(QFile &file, qint64 pos, qint64 limit, Box &box)
+{
+    uchar hdr[16];
+    if (pos + 8 > limit || !file.seek(pos) || !readFully(file, hdr, 8))
+        return false;
+    quint64 size = readBigEndian32(hdr);
+    box.type = readBigEndian32(hdr + 4);
+    box.start = pos + 8;
+    if (size == 1) {
+        if (pos + 16 > limit || !readFully(file, hdr + 8, 8))
+            return false;
+        size = (quint64(readBigEndian32(hdr + 8)) << 32) | readBigEndian32(hdr + 12);
+        box.start = pos + 16;
+    } else if (size == 0) {
+        size = quint64(limit - pos); // до конца контейнера
+    }
+    if (size < quint64(box.start - pos) || size > quint64(limit - pos))
+        return false;
+    box.end = pos + qint64(size);
+    return true;
+}
+
+// Первый бокс типа type в [begin, end)
+bool findBox(QFile &file, qint64 begin, qint64 end, quint32 type, Box &box)
+{
+    qint64 pos = begin;
+    for (int i = 0; i < MaxContainerChunks && readBox(file, pos, end, box); ++i) {
+        if (box.type == type)
+            return true;
+        pos = box.end;
+    }
+    return false;
+}
+
+bool readContent(QFile &file, const Box &box, QByteArray &buffer)
+{
+    const qint64 size = box.end - box.start;
+    if (size > MaxMetaSize || !file.seek(box.start))
+        return false;
+    buffer.resize(int(size));
+    return readFully(file, buffer.data(), size);
+}
+
+// Поля big-endian в прочитанном боксе; за границей - нули и ok = false
+struct Cursor
+{
+    const uchar *data = nullptr;
+    qint64 pos = 0;
+    qint64 end = 0;
+    bool ok = true;
+
+    bool need(qint64 bytes)
+    {
+        if (bytes < 0 || pos + bytes > end) {
+            ok = false;
+            pos = end;
+        }
+        return ok;
+    }
+
+    quint64 uint(int bytes)
+    {
+        if (!need(bytes))
+            return 0;
+        quint64 value = 0;
+        for (int i = 0; i < bytes; ++i)
+            value = (value << 8) | data[pos + i];
+        pos += bytes;
+        return value;
+    }
+
+    quint32 u8() { return quint32(uint(1)); }
+    quint32 u16() { return quint32(uint(2)); }
+    quint32 u32() { return quint32(uint(4)); }
+
+    void skip(qint64 bytes)
+    {
+        if (need(bytes))
+            pos += bytes;
+    }
+
+    // Следующий дочерний бокс; смещения - от начала data
+    bool next(Box &box)
+    {
+        const qint64 at = pos;
+        quint64 size = u32();
+        box.type = u32();
+        if (size == 1)
+            size = uint(8);
+        else if (size == 0)
+            size = quint64(end - at);
+        box.start = pos;
+        if (!ok || size < quint64(box.start - at) || size > quint64(end - at))
+            return false;
+        box.end = at + qint64(size);
+        pos = box.end;
+        return true;
+    }
+};
+
+bool isHeifBrand(quint32 brand)
+{
+    switch (brand) {
+    case fourCc("heic"):
+    case fourCc("heix"):
+    case fourCc("heim"):
+    case fourCc("heis"):
+    case fourCc("mif1"):
+    case fourCc("msf1"):
+    case fourCc("avif"):
+    case fourCc("avis"):
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Элемент HEIF: тип из iinf и первый экстент из iloc
+struct HeifItem
+{
+    quint32 type = 0;
+    int method = 0;         // 0 - в файле, 1 - в idat
+    int extents = 0;
+    qint64 offset = 0;
+    qint64 length = 0;
+};
+
+// HEIF/AVIF: всё нужное - в боксе meta верхнего уровня. Exif - отдельный
+// элемент (4 байта смещения до TIFF и сам блок), превью - элемент со ссылкой
+// thmb на основной; годится только JPEG (HEVC/AV1 Qt без плагинов не декодирует).
+bool readHeif(QFile &file, ExifData &out, QVector<Preview> &previews)
+{
+    const qint64 fileSize = file.size();
+    Box meta;
+    QByteArray buffer;
+    if (!findBox(file, 0, fileSize, fourCc("meta"), meta) || !readContent(file, meta, buffer))
+        return false;
+    const uchar *data = reinterpret_cast<const uchar *>(buffer.constData());
+
+    quint32 primary = 0;
+    qint64 idat = -1;
+    QHash<quint32, HeifItem> items;
+    QHash<quint32, quint32> thumbnailOf;   // превью -> изображение
+    QHash<quint32, quint32> describes;     // Exif -> изображение
+
+    Cursor top{data, 4, buffer.size()};    // meta - FullBox: версия и флаги
+    Box box;
+    while (top.next(box)) {
+        Cursor c{data, box.start, box.end};
+        const int version = int(c.u8());
+        switch (box.type) {
+        case fourCc("pitm"):
+            c.skip(3);
+            primary = quint32(c.uint(version == 0 ? 2 : 4));
+            break;
+        case fourCc("iinf"): {
+            c.skip(3);
+            c.skip(version == 0 ? 2 : 4);
+            Box entry;
+            while (c.next(entry)) {
+                if (entry.type != fourCc("infe"))
+                    continue;
+                Cursor e{data, entry.start, entry.end};
+                const int entryVersion = int(e.u8());
+                e.skip(3);
+                if (entryVersion < 2)
+                    continue;
+                const quint32 id = quint32(e.uint(entryVersion == 2 ? 2 : 4));
+                e.skip(2); // item_protection_index
+                const quint32 type = e.u32();
+                if (e.ok)
+                    items[id].type = type;
+            }
+            break;
+        }
+        case fourCc("iloc"): {
+            c.skip(3);
+            const int sizes = int(c.u8());
+            const int packed = int(c.u8());
+            const int offsetSize = sizes >> 4;
+            const int lengthSize = sizes & 15;
+            const int baseSize = packed >> 4;
+            const int indexSize = version >= 1 ? packed & 15 : 0;
+            const quint32 count = quint32(c.uint(version < 2 ? 2 : 4));
+            for (quint32 i = 0; i < count && c.ok; ++i) {
+                const quint32 id = quint32(c.uint(version < 2 ? 2 : 4));
+                const int method = version >= 1 ? int(c.u16() & 15) : 0;
+                c.skip(2); // data_reference_index
+                const qint64 base = qint64(c.uint(baseSize));
+                const int extents = int(c.u16());
+                for (int k = 0; k < extents && c.ok; ++k) {
+                    c.skip(indexSize);
+                    const qint64 offset = qint64(c.uint(offsetSize));
+                    const qint64 length = qint64(c.uint(lengthSize));
+                    if (k == 0 && c.ok) {
+                        HeifItem &item = items[id];
+                        item.method = method;
+                        item.extents = extents;
+                        item.offset = base + offset;
+                        item.length = length;
+                    }
+                }
+            }
+            break;
+        }
+        case fourCc("iref"): {
+            c.skip(3);
+            const int idSize = version == 0 ? 2 : 4;
+            Box reference;
+            while (c.next(reference)) {
+                Cursor r{data, reference.start, reference.end};
+                const quint32 from = quint32(r.uint(idSize));
+                const int count = int(r.u16());
+                for (int k = 0; k < count && r.ok; ++k) {
+                    const quint32 to = quint32(r.uint(idSize));
+                    if (reference.type == fourCc("thmb"))
+                        thumbnailOf.insert(from, to);
+                    else if (reference.type == fourCc("cdsc"))
+                        describes.insert(from, to);
+                }
+            }
+            break;
+        }
+        case fourCc("idat"):
+            idat = meta.start + box.start;
+            break;
+        default:
+            break;
+        }
+    }
+
+    // Место элемента в файле; элементы из нескольких экстентов не нужны
+    const auto place = [&](const HeifItem &item, qint64 &offset) {
+        if (item.extents != 1 || item.length <= 0)
+            return false;
+        if (item.method == 0)
+            offset = item.offset;
+        else if (item.method == 1 && idat >= 0)
+            offset = idat + item.offset;
+        else
+            return false;
+        return offset >= 0 && offset + item.length <= fileSize;
+    };
+
+    // Exif основного изображения, если связь указана, иначе любой
+    quint32 exifId = 0;
+    for (auto it = items.cbegin(); it != items.cend(); ++it) {
+        if (it->type == fourCc("Exif") && (exifId == 0 || describes.value(it.key()) == primary))
+            exifId = it.key();
+    }
+
+    bool ok = false;
+    qint64 offset = 0;
+    const HeifItem exif = items.value(exifId);
+    if (exifId != 0 && place(exif, offset) && exif.length > 10) {
+        uchar hdr[10];
+        if (file.seek(offset) && readFully(file, hdr, sizeof(hdr))) {
+            qint64 skip = 4 + qint64(readBigEndian32(hdr));
+            // Часть кодировщиков оставляет "Exif\0\0" и при нулевом смещении
+            if (skip == 4 && std::memcmp(hdr + 4, "Exif\0\0", 6) == 0)
+                skip += 6;
+            if (skip < exif.length)
+                ok = readTiffAt(file, offset + skip, exif.length - skip, Ifd0::Primary, out, previews);
+        }
+    }
+
+    for (auto it = items.cbegin(); it != items.cend(); ++it) {
+        const bool isPreview = it.key() == primary || thumbnailOf.value(it.key()) == primary;
+        if (isPreview && it->type == fourCc("jpeg") && place(*it, offset)) {
+            Preview preview;
+            preview.offset = offset;
+            preview.length = it->length;
+            previews.append(preview);
+        }
+    }
+    return ok || !previews.isEmpty();
+}
+
+const uchar Cr3MetadataUuid[16] = {0x85, 0xc0, 0xb6, 0x87, 0x82, 0x0f, 0x11, 0xe0,
+                                   0x81, 0x11, 0xf4, 0xce, 0x46, 0x2b, 0x6a, 0x48};
+const uchar Cr3PreviewUuid[16] = {0xea, 0xf4, 0x2b, 0x5e, 0x1c, 0x98, 0x4b, 0x88,
+                                  0xb9, 0xfb, 0xb7, 0xdc, 0x40, 0x6e, 0x4d, 0x16};
+
+bool isUuidBox(QFile &file, const Box &box, const uchar *uuid)
+{
+    uchar id[16];
+    return box.type == fourCc("uuid") && box.end - box.start >= 16
+            && file.seek(box.start) && readFully(file, id, 16) && std::memcmp(id, uuid, 16) == 0;
+}
+
+// JPEG внутри THMB и PRVW: длина по смещению lengthAt от начала содержимого, данные - с 16-го байта
+void addInlineJpeg(QFile &file, const Box &box, qint64 lengthAt, QVector<Preview> &previews)
+{
+    uchar hdr[4];
+    if (!file.seek(box.start + lengthAt) || !readFully(file, hdr, 4))
+        return;
+    Preview preview;
+    preview.offset = box.start + 16;
+    preview.length = readBigEndian32(hdr);
+    if (preview.length > 0 && preview.offset + preview.length <= box.end)
+        previews.append(preview);
+}
+
+// Canon CR3: в moov - uuid с TIFF-блоками CMT1 (IFD0), CMT2 (Exif IFD),
+// CMT4 (GPS IFD) и превью THMB 160x120; крупное превью PRVW - в отдельном
+// uuid перед mdat. Сами кадры (trak, mdat) не читаются.
+bool readCr3(QFile &file, ExifData &out, QVector<Preview> &previews)
+{
+    const qint64 fileSize = file.size();
+    bool ok = false;
+    Box top;
+    qint64 pos = 0;
+    for (int i = 0; i < MaxContainerChunks && readBox(file, pos, fileSize, top); ++i, pos = top.end) {
+        if (top.type == fourCc("mdat"))
+            break;
+        if (top.type == fourCc("moov")) {
+            Box box;
+            qint64 at = top.start;
+            for (int j = 0; j < MaxContainerChunks && readBox(file, at, top.end, box); ++j, at = box.end) {
+                if (!isUuidBox(file, box, Cr3MetadataUuid))
+                    continue;
+                Box item;
+                qint64 itemAt = box.start + 16;
+                for (int k = 0; k < MaxContainerChunks && readBox(file, itemAt, box.end, item);
+                     ++k, itemAt = item.end) {
+                    const qint64 size = item.end - item.start;
+                    switch (item.type) {
+                    case fourCc("CMT1"):
+                        ok = readTiffAt(file, item.start, size, Ifd0::Primary, out, previews) || ok;
+                        break;
+                    case fourCc("CMT2"):
+                        ok = readTiffAt(file, item.start, size, Ifd0::Exif, out, previews) || ok;
+                        break;
+                    case fourCc("CMT4"):
+                        ok = readTiffAt(file, item.start, size, Ifd0::Gps, out, previews) || ok;
+                        break;
+                    case fourCc("THMB"):
+                        addInlineJpeg(file, item, 8, previews);
+                        break;
+                    default:
+                        break;
+                    }
+                }
+            }
+        } else if (isUuidBox(file, top, Cr3PreviewUuid)) {
+            Box prvw;
+            if (readBox(file, top.start + 24, top.end, prvw) && prvw.type == fourCc("PRVW"))
+                addInlineJpeg(file, prvw, 12, previews);
+        }
+    }
+    return ok || !previews.isEmpty();
+}
+
+// ISO 6709: "+37.7858-122.4064+012.345/" - широта, долгота (и высота) в градусах
+bool parseIso6709(const QByteArray &text, double &latitude, double &longitude)
+{
+    double values[2] = {0.0, 0.0};
+    int pos = 0;
+    for (double &value : values) {
+        if (pos >= text.size() || (text[pos] != '+' && text[pos] != '-'))
+            return false;
+        int end = pos + 1;
+        while (end < text.size() && ((text[end] >= '0' && text[end] <= '9') || text[end] == '.'))
+            ++end;
+        bool ok = false;
+        value = text.mid(pos, end - pos).toDouble(&ok);
+        if (!ok)
+            return false;
+        pos = end;
+    }
+    if (values[0] < -90.0 || values[0] > 90.0 || values[1] < -180.0 || values[1] > 180.0)
+        return false;
+    latitude = values[0];
+    longitude = values[1];
+    return true;
+}
+
+// Значение тега места (BoxLocation) или времени съёмки (BoxDay)
+void applyMovieValue(quint32 kind, const QByteArray &value, ExifData &out)
+{
+    if (kind == BoxLocation) {
+        double latitude = 0.0, longitude = 0.0;
+        if (parseIso6709(value.trimmed(), latitude, longitude)) {
+            out.hasGps = true;
+            out.latitude = latitude;
+            out.longitude = longitude;
+        }
+        return;
+    }
+    // "2023-05-01T12:34:56+0200": пояс без двоеточия приводится к ISO 8601
+    QString text = QString::fromLatin1(value).trimmed();
+    const int sign = text.size() - 5;
+    if (sign > 0 && (text[sign] == '+' || text[sign] == '-')) {
+        bool digits = true;
+        for (int i = sign + 1; i < text.size(); ++i)
+            digits = digits && text[i].isDigit();
+        if (digits)
+            text.insert(sign + 3, QLatin1Char(':'));
+    }
+    const QDateTime time = QDateTime::fromString(text, Qt::ISODate);
+    if (time.isValid())
+        out.dateTimeOriginal = time;
+}
+
+// meta видео: ключи keys + значения ilst (mdta, iPhone) или теги
+// ©xyz/©day прямо в ilst (mdir)
+void parseMovieMeta(const uchar *data, qint64 begin, qint64 end, ExifData &out)
+{
+    // У QuickTime meta - обычный бокс, у MP4 - FullBox с версией и флагами
+    Cursor probe{data, begin + 4, end};
+    if (probe.u32() != fourCc("hdlr"))
+        begin += 4;
+
+    QVector<quint32> keys;   // что означает ключ с номером i + 1
+    Cursor c{data, begin, end};
+    Box box;
+    while (c.next(box)) {
+        if (box.type == fourCc("keys")) {
+            Cursor k{data, box.start + 4, box.end};
+            const quint32 count = k.u32();
+            for (quint32 i = 0; i < count && i < MaxMovieKeys && k.ok; ++i) {
+                const qint64 at = k.pos;
+                const quint32 size = k.u32();
+                k.skip(4); // пространство имён, "mdta"
+                if (size < 8 || !k.need(size - 8))
+                    break;
+                const QByteArray name(reinterpret_cast<const char *>(data + k.pos), int(size - 8));
+                keys.append(name == "com.apple.quicktime.location.ISO6709" ? BoxLocation
+                            : name == "com.apple.quicktime.creationdate" ? BoxDay : 0);
+                k.pos = at + size;
+            }
+        } else if (box.type == fourCc("ilst")) {
+            Cursor list{data, box.start, box.end};
+            Box item;
+            while (list.next(item)) {
+                // Тип элемента - номер ключа (с 1) или сам тег
+                quint32 kind = item.type;
+                if (item.type >= 1 && item.type <= quint32(keys.size()))
+                    kind = keys[int(item.type) - 1];
+                if (kind != BoxLocation && kind != BoxDay)
+                    continue;
+                Cursor v{data, item.start, item.end};
+                Box value;
+                // data: тип значения и локаль, потом сам текст
+                if (v.next(value) && value.type == fourCc("data") && value.end - value.start > 8)
+                    applyMovieValue(kind, QByteArray(reinterpret_cast<const char *>(data + value.start + 8),
+                                                     int(value.end - value.start - 8)), out);
+            }
+        }
+    }
+}
+
+// udta: строки QuickTime ©xyz/©day (длина, язык, текст) и вложенный meta
+void parseUserData(const uchar *data, qint64 begin, qint64 end, ExifData &out)
+{
+    Cursor c{data, begin, end};
+    Box box;
+    while (c.next(box)) {
+        if (box.type == BoxLocation || box.type == BoxDay) {
+            Cursor s{data, box.start, box.end};
+            const int length = int(s.u16());
+            s.skip(2);
+            if (s.need(length))
+                applyMovieValue(box.type, QByteArray(reinterpret_cast<const char *>(data + s.pos), length), out);
+        } else if (box.type == fourCc("meta")) {
+            parseMovieMeta(data, box.start, box.end, out);
+        }
+    }
+}
+
+// MP4/MOV: из moov читаются только mvhd (время создания, UTC), udta и meta.
+// Превью у видео нет - кадр пришлось бы декодировать.
+bool readMovie(QFile &file, ExifData &out)
+{
+    Box moov;
+    if (!findBox(file, 0, file.size(), fourCc("moov"), moov))
+        return false;
+
+    QDateTime created;
+    Box box;
+    qint64 pos = moov.start;
+    for (int i = 0; i < MaxContainerChunks && readBox(file, pos, moov.end, box); ++i, pos = box.end) {
+        if (box.type == fourCc("mvhd")) {
+            // Версия 1 - 64-битные времена, 0 - 32-битные; секунды от 1904 года
+            uchar hdr[12];
+            if (file.seek(box.start) && readFully(file, hdr, sizeof(hdr))) {
+                const qint64 seconds = hdr[0] == 1
+                        ? qint64((quint64(readBigEndian32(hdr + 4)) << 32) | readBigEndian32(hdr + 8))
+                        : qint64(readBigEndian32(hdr + 4));
+                if (seconds > QuickTimeEpochOffset)
+                    created = QDateTime::fromSecsSinceEpoch(seconds - QuickTimeEpochOffset);
+            }
+        } else if (box.type == fourCc("udta") || box.type == fourCc("meta")) {
+            QByteArray buffer;
+            if (!readContent(file, box, buffer))
+                continue;
+            const uchar *data = reinterpret_cast<const uchar *>(buffer.constData());
+            if (box.type == fourCc("udta"))
+                parseUserData(data, 0, buffer.size(), out);
+            else
+                parseMovieMeta(data, 0, buffer.size(), out);
+        }
+    }
+    // Время из метаданных камеры - с поясом съёмки; mvhd у многих камер пуст
+    if (!out.dateTimeOriginal.isValid() && created.isValid())
+        out.dateTimeOriginal = created;
+    return out.hasGps || out.dateTimeOriginal.isValid();
+}
+
+// Видео QuickTime без ftyp начинается сразу с одного из этих боксов
+bool isQuickTimeBox(quint32 type)
+{
+    switch (type) {
+    case fourCc("moov"):
+    case fourCc("mdat"):
+    case fourCc("wide"):
+    case fourCc("free"):
+    case fourCc("skip"):
+    case fourCc("pnot"):
+        return true;
+    default:
+        return false;
+    }
+}
+
+} // namespace
+
+bool ExifReader::read(const QString &path, ExifData &out)
+{
+    TraceSpan span("exif.read");
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    uchar head[12];
+    if (!readFully(file, head, sizeof(head)))
+        return false;
+
+    QVector<Preview> previews;
+    bool ok = false;
+    if (head[0] == 0xFF && head[1] == 0xD8) {
+        ok = readJpeg(file, 0, out, previews);
+    } else if (std::memcmp(head, "\x89PNG\r\n\x1a\n", 8) == 0) {
+        ok = readPng(file, out, previews);
+    } else if (std::memcmp(head, "RIFF", 4) == 0 && std::memcmp(head + 8, "WEBP", 4) == 0) {
+        ok = readWebp(file, out, previews);
+    } else if (isTiffHeader(head)) {
+        ok = readRaw(file, out, previews);
+    } else if (std::memcmp(head, "FUJIFILM", 8) == 0) {
+        ok = readRaf(file, out, previews);
+    } else if (std::memcmp(head + 4, "ftyp", 4) == 0) {
+        const quint32 brand = readBigEndian32(head + 8);
+        if (isHeifBrand(brand))
+            ok = readHeif(file, out, previews);
+        else if (brand == fourCc("crx "))
+            ok = readCr3(file, out, previews);
+        else
+            ok = readMovie(file, out);
+    } else if (isQuickTimeBox(readBigEndian32(head + 4))) {
+        ok = readMovie(file, out);
+    } else {
+        return false;
+    }
+
+    choosePreviews(&file, previews, out);
+    return ok;
+}
+
+bool ExifReader::parseTiff(const uchar *data, int size, qint64 baseOffset, ExifData &out)
+{
+    TiffBlock block(data, size, baseOffset);
+    QVector<Preview> previews;
+    if (!block.open() || !parseTiffBlock(block, Ifd0::Primary, out, previews))
+        return false;
+    choosePreviews(nullptr, previews, out);
+    return true;
+}
+
+QDateTime ExifReader::parseExifDateTime(const char *text, int length)
+{
+    if (!text || length < 19)
+        return QDateTime();
+
+    auto number = [text](int pos, int digits, int &value) {
+        value = 0;
+        for (int i = 0; i < digits; ++i) {
+            const char c = text[pos + i];
+            if (c < '0' || c > '9')
+                return false;
+            value = value * 10 + (c - '0');
+        }
+        return true;
+    };
+
+    int year, month, day, hour, minute, second;
+    if (!number(0, 4, year) || !number(5, 2, month) || !number(8, 2, day)
+            || !number(11, 2, hour) || !number(14, 2, minute) || !number(17, 2, second))
+        return QDateTime();
+
+    const QDate date(year, month, day);
+    const QTime time(hour, minute, second);
+    if (!date.isValid() || !time.isValid())
+        return QDateTime();
+    return QDateTime(date, time);
+}
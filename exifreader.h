@@ -0,0 +1,47 @@
+#ifndef EXIFREADER_H
+#define EXIFREADER_H
+
+#include <QString>
+#include <QDateTime>
+#include <QtGlobal>
+
+// Метаданные, извлечённые из заголовка файла
+struct ExifData
+{
+    bool hasGps = false;
+    double latitude = 0.0;       // широта  (-90..90)
+    double longitude = 0.0;      // долгота (-180..180)
+    QDateTime dateTimeOriginal;  // время съёмки (невалидно, если тега нет)
+    qint64 thumbnailOffset = -1; // смещение встроенного JPEG-превью от начала файла
+    qint64 thumbnailLength = 0;
+    qint64 previewOffset = -1;   // крупное JPEG-превью RAW/HEIF/CR3, если есть
+    qint64 previewLength = 0;
+};
+
+// Самостоятельный разборщик EXIF/TIFF без зависимостей от плагинов Qt.
+// Читает только заголовочные сегменты файла ограниченными порциями
+// (JPEG APP1, PNG eXIf, WebP EXIF) и декодирует теги GPS в бинарном виде.
+// RAW на основе TIFF (DNG, CR2, NEF, ARW, ORF, RW2, PEF, SRW) и RAF читаются
+// так же - по IFD, с превью из IFD1 и SubIFD. У контейнеров ISO-BMFF обходятся
+// только заголовки боксов: HEIF/AVIF - бокс meta (элемент Exif и JPEG-превью),
+// CR3 - TIFF-блоки CMT* и превью THMB/PRVW, MP4/MOV - mvhd, udta и meta
+// (время и ISO 6709). Кадры (mdat) не читаются, поэтому файл любого размера
+// обходится за несколько коротких чтений, как заголовок JPEG.
+class ExifReader
+{
+public:
+    // Максимальный объём, который читается из одного файла
+    static constexpr int MaxSegmentSize = 64 * 1024;
+
+    static bool read(const QString &path, ExifData &out);
+
+    // Разбор TIFF-блока (начинается с "II*\0" или "MM\0*") целиком в памяти.
+    // baseOffset - смещение блока в файле, чтобы вернуть абсолютное
+    // положение встроенного превью.
+    static bool parseTiff(const uchar *data, int size, qint64 baseOffset, ExifData &out);
+
+    // "YYYY:MM:DD HH:MM:SS" без промежуточного QString
+    static QDateTime parseExifDateTime(const char *text, int length);
+};
+
+#endif // EXIFREADER_H
@@ -0,0 +1,218 @@
+#include "folderwatcher.h"
+#include "photoscanner.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QMetaObject>
+#include <QThread>
+
+FolderWatcher::FolderWatcher(QObject *parent)
+    : QObject(parent)
+{
+    m_debounce.setSingleShot(true);
+    m_debounce.setInterval(DebounceMs);
+    connect(&m_debounce, &QTimer::timeout, this, &FolderWatcher::processPending);
+}
+
+FolderWatcher::~FolderWatcher()
+{
+    stop();
+}
+
+void FolderWatcher::watch(const QString &root, const PhotoStore &photos)
+{
+    stop();
+    m_root = root;
+    m_cancel = false;
+    const int generation = ++m_generation;
+
+    // Снимок берётся из результатов сканирования - повторный stat не нужен
+    for (int id = 0; id < photos.size(); ++id) {
+        if (photos.isRemoved(id))
+            continue;
+        Stamp stamp;
+        stamp.size = photos.fileSize(id);
+        stamp.modified = photos.modified(id);
+        m_files[photos.dirPath(photos.dirOf(id))].insert(photos.fileName(id).toString(), stamp);
+    }
+
+    m_watcher = new QFileSystemWatcher(this);
+    connect(m_watcher, &QFileSystemWatcher::directoryChanged,
+            this, &FolderWatcher::onDirectoryChanged);
+
+    // Список папок (в том числе без фото) собирается в фоне
+    m_walker = QThread::create([this, root, generation]() {
+        QStringList dirs;
+        dirs.append(root);
+        QDirIterator it(root, QDir::Dirs | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+        while (!m_cancel && it.hasNext())
+            dirs.append(it.next());
+        if (m_cancel)
+            return;
+        QMetaObject::invokeMethod(this, [this, generation, dirs]() {
+            onDirectoriesListed(generation, dirs);
+        }, Qt::QueuedConnection);
+    });
+    m_walker->start();
+}
+
+void FolderWatcher::stop()
+{
+    m_cancel = true;
+    if (m_walker) {
+        m_walker->wait();
+        delete m_walker;
+        m_walker = nullptr;
+    }
+    ++m_generation;
+
+    delete m_watcher;
+    m_watcher = nullptr;
+    m_debounce.stop();
+    m_root.clear();
+    m_files.clear();
+    m_dirs.clear();
+    m_dirty.clear();
+}
+
+void FolderWatcher::onDirectoriesListed(int generation, const QStringList &dirs)
+{
+    if (generation != m_generation || !m_watcher)
+        return;
+
+    for (const QString &dir : dirs)
+        m_dirs.insert(dir);
+    const QStringList failed = m_watcher->addPaths(dirs);
+    if (!failed.isEmpty()) {
+        // Обычно это предел fs.inotify.max_user_watches
+        qWarning() << "FolderWatcher: cannot watch" << failed.size() << "of" << dirs.size()
+                   << "directories";
+    }
+}
+
+void FolderWatcher::onDirectoryChanged(const QString &dir)
+{
+    if (!isWatching())
+        return;
+
+    if (!m_debounce.isActive())
+        m_firstDirty.start();
+    m_dirty.insert(dir);
+    // Пока идёт копирование, уведомления продлевают паузу, но не дольше MaxDelayMs
+    if (!m_debounce.isActive() || m_firstDirty.elapsed() < MaxDelayMs)
+        m_debounce.start();
+}
+
+void FolderWatcher::processPending()
+{
+    QStringList added;
+    QStringList modified;
+    QStringList removed;
+
+    const QSet<QString> dirty = m_dirty;
+    m_dirty.clear();
+    for (const QString &dir : dirty) {
+        if (!m_dirs.contains(dir))
+            continue;   // уже удалена вместе с родителем
+        if (QFileInfo(dir).isDir())
+            rescanDirectory(dir, added, modified, removed);
+        else
+            removeDirectory(dir, removed);
+    }
+
+    if (!added.isEmpty() || !modified.isEmpty() || !removed.isEmpty())
+        emit changed(added, modified, removed);
+}
+
+void FolderWatcher::rescanDirectory(const QString &dir, QStringList &added, QStringList &modified,
+                                    QStringList &removed)
+{
+    const QDir directory(dir);
+    DirSnapshot &snapshot = m_files[dir];
+    DirSnapshot current;
+
+    const QFileInfoList files = directory.entryInfoList(PhotoScanner::nameFilters(), QDir::Files);
+    for (const QFileInfo &fi : files) {
+        Stamp stamp;
+        stamp.size = fi.size();
+        stamp.modified = fi.lastModified().toMSecsSinceEpoch();
+        current.insert(fi.fileName(), stamp);
+
+        auto it = snapshot.constFind(fi.fileName());
+        if (it == snapshot.constEnd())
+            added.append(fi.filePath());
+        else if (it->size != stamp.size || it->modified / 1000 != stamp.modified / 1000)
+            modified.append(fi.filePath());
+    }
+    for (auto it = snapshot.constBegin(); it != snapshot.constEnd(); ++it) {
+        if (!current.contains(it.key()))
+            removed.append(dir + QLatin1Char('/') + it.key());
+    }
+    snapshot = current;
+
+    // Новые подпапки (например, скопированные с карты целиком) и пропавшие
+    const QStringList subdirs = directory.entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+    QSet<QString> present;
+    for (const QString &name : subdirs) {
+        const QString path = dir + QLatin1Char('/') + name;
+        present.insert(path);
+        if (!m_dirs.contains(path))
+            addDirectory(path, added);
+    }
+
+    QStringList gone;
+    for (const QString &watched : std::as_const(m_dirs)) {
+        if (watched.size() > dir.size() && watched.startsWith(dir)
+                && watched.at(dir.size()) == QLatin1Char('/')
+                && watched.indexOf(QLatin1Char('/'), dir.size() + 1) < 0
+                && !present.contains(watched))
+            gone.append(watched);
+    }
+    for (const QString &child : std::as_const(gone))
+        removeDirectory(child, removed);
+}
+
+void FolderWatcher::addDirectory(const QString &dir, QStringList &added)
+{
+    QStringList dirs;
+    dirs.append(dir);
+    QDirIterator it(dir, QDir::Dirs | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+    while (it.hasNext())
+        dirs.append(it.next());
+
+    for (const QString &path : std::as_const(dirs)) {
+        m_dirs.insert(path);
+        DirSnapshot &snapshot = m_files[path];
+        const QFileInfoList files = QDir(path).entryInfoList(PhotoScanner::nameFilters(), QDir::Files);
+        for (const QFileInfo &fi : files) {
+            Stamp stamp;
+            stamp.size = fi.size();
+            stamp.modified = fi.lastModified().toMSecsSinceEpoch();
+            snapshot.insert(fi.fileName(), stamp);
+            added.append(fi.filePath());
+        }
+    }
+    m_watcher->addPaths(dirs);
+}
+
+void FolderWatcher::removeDirectory(const QString &dir, QStringList &removed)
+{
+    const QString prefix = dir + QLatin1Char('/');
+    QStringList gone;
+    for (const QString &watched : std::as_const(m_dirs)) {
+        if (watched == dir || watched.startsWith(prefix))
+            gone.append(watched);
+    }
+
+    for (const QString &path : std::as_const(gone)) {
+        const DirSnapshot snapshot = m_files.take(path);
+        for (auto it = snapshot.constBegin(); it != snapshot.constEnd(); ++it)
+            removed.append(path + QLatin1Char('/') + it.key());
+        m_dirs.remove(path);
+    }
+    // Удалённые папки inotify снимает сам, перемещённые нужно снять явно
+    if (!gone.isEmpty())
+        m_watcher->removePaths(gone);
+}
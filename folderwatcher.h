@@ -0,0 +1,76 @@
+#ifndef FOLDERWATCHER_H
+#define FOLDERWATCHER_H
+
+#include "photostore.h"
+
+#include <QElapsedTimer>
+#include <QFileSystemWatcher>
+#include <QHash>
+#include <QObject>
+#include <QSet>
+#include <QStringList>
+#include <QTimer>
+#include <QVector>
+#include <atomic>
+
+class QThread;
+
+// Слежение за загруженным корнем через QFileSystemWatcher (inotify в Linux).
+// Наблюдаются только папки; для каждой хранится снимок "имя -> размер, mtime",
+// собранный из результатов сканирования. Уведомления копятся и разбираются
+// пачкой после паузы DebounceMs (но не позже MaxDelayMs при непрерывном
+// копировании): перечитываются только изменившиеся папки, наружу уходят
+// списки созданных, изменённых и удалённых файлов. Переименование
+// приходит как удаление старого пути и создание нового.
+class FolderWatcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    static constexpr int DebounceMs = 500;
+    static constexpr int MaxDelayMs = 3000;
+
+    explicit FolderWatcher(QObject *parent = nullptr);
+    ~FolderWatcher() override;
+
+    // Начать слежение; photos - результат полного сканирования root
+    void watch(const QString &root, const PhotoStore &photos);
+    void stop();
+    bool isWatching() const { return !m_root.isEmpty(); }
+    int watchedDirectories() const { return int(m_dirs.size()); }
+
+signals:
+    void changed(const QStringList &added, const QStringList &modified, const QStringList &removed);
+
+private slots:
+    void onDirectoryChanged(const QString &dir);
+    void onDirectoriesListed(int generation, const QStringList &dirs);
+    void processPending();
+
+private:
+    struct Stamp
+    {
+        qint64 size = 0;
+        qint64 modified = 0;
+    };
+    typedef QHash<QString, Stamp> DirSnapshot;   // имя файла -> отметка
+
+    void addDirectory(const QString &dir, QStringList &added);
+    void removeDirectory(const QString &dir, QStringList &removed);
+    void rescanDirectory(const QString &dir, QStringList &added, QStringList &modified,
+                         QStringList &removed);
+
+    QFileSystemWatcher *m_watcher = nullptr;
+    QString m_root;
+    QHash<QString, DirSnapshot> m_files;   // папка -> файлы в ней
+    QSet<QString> m_dirs;                  // наблюдаемые папки
+    QSet<QString> m_dirty;                 // папки с уведомлениями
+    QTimer m_debounce;
+    QElapsedTimer m_firstDirty;
+
+    QThread *m_walker = nullptr;
+    std::atomic<bool> m_cancel{false};
+    int m_generation = 0;
+};
+
+#endif // FOLDERWATCHER_H
@@ -0,0 +1,247 @@
+// geophoto-index: индексация фото без GUI (серверы, NAS, узлы рендера).
+// Корни сканируются параллельно, каталоги обновляются, результат
+// потоком пишется в GeoJSON, CSV или KML - в памяти держится только
+// ограниченная очередь пачек сканера, а не весь список фото; новая версия
+// каталога копится на диске отсортированными пачками (PhotoCatalog::RunRecords).
+//
+//   geophoto-index [-f geojson|csv|kml] [-o файл] [--all] [--no-catalog] [-j N]
+//                  [--gazetteer индекс] [--track трек.gpx]... [--clock-offset сек] корень...
+//   geophoto-index --build-gazetteer cities1000.txt [--admin1 admin1CodesASCII.txt]
+//                  [--gazetteer индекс]
+//
+// Индекс мест собирается из выгрузки GeoNames один раз и дальше
+// используется и здесь, и в GUI (тот же путь по умолчанию).
+// Фото без GPS привязываются по журналам треков (GPX, NMEA), если они заданы;
+// привязка сохраняется в каталоге.
+
+#include "photoexporter.h"
+#include "photoscanner.h"
+#include "reversegeocoder.h"
+#include "tracer.h"
+#include "tracklog.h"
+
+#include <QCommandLineOption>
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QVector>
+#include <atomic>
+#include <cstdio>
+#include <memory>
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    // Имя как у GUI: каталоги лежат в его CacheLocation и используются совместно
+    QCoreApplication::setApplicationName(QStringLiteral("GeoPhotoMap"));
+    QCoreApplication::setApplicationVersion(QStringLiteral("0.1"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(
+        QStringLiteral("Scan photo folders, update their catalogs and export geotags."));
+    parser.addHelpOption();
+    parser.addVersionOption();
+    const QCommandLineOption formatOption({QStringLiteral("f"), QStringLiteral("format")},
+                                          QStringLiteral("Output format: geojson, csv or kml."),
+                                          QStringLiteral("format"), QStringLiteral("geojson"));
+    const QCommandLineOption outputOption({QStringLiteral("o"), QStringLiteral("output")},
+                                          QStringLiteral("Output file (default: stdout)."),
+                                          QStringLiteral("file"));
+    const QCommandLineOption allOption(QStringLiteral("all"),
+                                       QStringLiteral("Also export photos without GPS (no geometry)."));
+    const QCommandLineOption noCatalogOption(QStringLiteral("no-catalog"),
+                                             QStringLiteral("Neither read nor write the metadata catalogs."));
+    const QCommandLineOption jobsOption({QStringLiteral("j"), QStringLiteral("jobs")},
+                                        QStringLiteral("Total number of worker threads "
+                                                       "(default: chosen per device type)."),
+                                        QStringLiteral("N"), QStringLiteral("0"));
+    const QCommandLineOption quietOption({QStringLiteral("q"), QStringLiteral("quiet")},
+                                         QStringLiteral("Do not print the per-root summary."));
+    const QCommandLineOption gazetteerOption(QStringLiteral("gazetteer"),
+                                             QStringLiteral("Place index for reverse geocoding."),
+                                             QStringLiteral("file"), ReverseGeocoder::defaultPath());
+    const QCommandLineOption buildGazetteerOption(QStringLiteral("build-gazetteer"),
+                                                  QStringLiteral("Compile a GeoNames dump into the place index."),
+                                                  QStringLiteral("geonames.txt"));
+    const QCommandLineOption admin1Option(QStringLiteral("admin1"),
+                                          QStringLiteral("GeoNames admin1CodesASCII.txt for region names."),
+                                          QStringLiteral("file"));
+    const QCommandLineOption trackOption(QStringLiteral("track"),
+                                         QStringLiteral("GPX or NMEA track log for photos without GPS (repeatable)."),
+                                         QStringLiteral("file"));
+    const QCommandLineOption clockOffsetOption(QStringLiteral("clock-offset"),
+                                               QStringLiteral("Seconds to add to photo times to match the tracks."),
+                                               QStringLiteral("seconds"), QStringLiteral("0"));
+    parser.addOptions({formatOption, outputOption, allOption, noCatalogOption, jobsOption, quietOption,
+                       gazetteerOption, buildGazetteerOption, admin1Option, trackOption,
+                       clockOffsetOption});
+    parser.addPositionalArgument(QStringLiteral("roots"), QStringLiteral("Folders to index."),
+                                 QStringLiteral("root..."));
+    parser.process(app);
+
+    if (parser.isSet(buildGazetteerOption)) {
+        QElapsedTimer timer;
+        timer.start();
+        const QString indexPath = parser.value(gazetteerOption);
+        QString error;
+        if (!ReverseGeocoder::compile(parser.value(buildGazetteerOption), parser.value(admin1Option),
+                                      indexPath, &error)) {
+            std::fprintf(stderr, "%s\n", qPrintable(error));
+            return 1;
+        }
+        ReverseGeocoder geocoder;
+        if (!geocoder.open(indexPath)) {
+            std::fprintf(stderr, "Cannot open %s\n", qPrintable(indexPath));
+            return 1;
+        }
+        if (!parser.isSet(quietOption)) {
+            std::fprintf(stderr, "%s: %d places in %.1f s\n", qPrintable(QDir::toNativeSeparators(indexPath)),
+                         geocoder.placeCount(), double(timer.elapsed()) / 1000.0);
+        }
+        if (parser.positionalArguments().isEmpty())
+            return 0;
+    }
+
+    // Ключ каталога - очищенный абсолютный путь, как у корня из диалога GUI
+    QStringList roots;
+    for (const QString &arg : parser.positionalArguments())
+        roots.append(QDir::cleanPath(QFileInfo(arg).absoluteFilePath()));
+    if (roots.isEmpty())
+        parser.showHelp(1);
+
+    PhotoExporter::Format format;
+    if (!PhotoExporter::parseFormat(parser.value(formatOption), format)) {
+        std::fprintf(stderr, "Unknown format: %s\n", qPrintable(parser.value(formatOption)));
+        return 1;
+    }
+    for (const QString &root : roots) {
+        if (!QFileInfo(root).isDir()) {
+            std::fprintf(stderr, "Not a directory: %s\n", qPrintable(root));
+            return 1;
+        }
+    }
+
+    // В файл - через QSaveFile, чтобы при ошибке не оставить обрывок
+    std::unique_ptr<QFile> stdoutFile;
+    std::unique_ptr<QSaveFile> saveFile;
+    QIODevice *out = nullptr;
+    if (parser.isSet(outputOption)) {
+        saveFile = std::make_unique<QSaveFile>(parser.value(outputOption));
+        if (!saveFile->open(QIODevice::WriteOnly)) {
+            std::fprintf(stderr, "Cannot write %s: %s\n", qPrintable(parser.value(outputOption)),
+                         qPrintable(saveFile->errorString()));
+            return 1;
+        }
+        out = saveFile.get();
+    } else {
+        stdoutFile = std::make_unique<QFile>();
+        if (!stdoutFile->open(stdout, QIODevice::WriteOnly)) {
+            std::fprintf(stderr, "Cannot write to stdout\n");
+            return 1;
+        }
+        out = stdoutFile.get();
+    }
+
+    std::shared_ptr<TrackLog> trackLog;
+    if (parser.isSet(trackOption)) {
+        QElapsedTimer timer;
+        timer.start();
+        trackLog = std::make_shared<TrackLog>();
+        trackLog->setClockOffset(qint64(parser.value(clockOffsetOption).toDouble() * 1000.0));
+        QString error;
+        if (!trackLog->load(parser.values(trackOption), &error)) {
+            std::fprintf(stderr, "%s\n", qPrintable(error));
+            return 1;
+        }
+        if (!parser.isSet(quietOption)) {
+            std::fprintf(stderr, "tracks: %d segments, %lld points in %.1f s\n", trackLog->segmentCount(),
+                         static_cast<long long>(trackLog->pointCount()), double(timer.elapsed()) / 1000.0);
+        }
+    }
+
+    PhotoExporter exporter(out, format);
+    exporter.setIncludeWithoutGps(parser.isSet(allOption));
+    exporter.begin();
+
+    // Обход каждого корня идёт в своём потоке, так что медленные сетевые тома
+    // не задерживают остальные. Потоки на устройство выбирает сканер по его
+    // типу; заданный -j делится между корнями поровну и ограничивает их
+    const int jobs = qMax(0, parser.value(jobsOption).toInt());
+    const int threadsPerRoot = jobs > 0 ? qMax(1, jobs / int(roots.size())) : 0;
+    const bool quiet = parser.isSet(quietOption);
+
+    QElapsedTimer timer;
+    timer.start();
+    std::atomic<bool> writeFailed{false};
+    int remaining = int(roots.size());
+    QVector<PhotoScanner*> scanners;
+
+    for (const QString &root : roots) {
+        auto *scanner = new PhotoScanner(&app);
+        if (threadsPerRoot > 0)
+            scanner->setMaxThreadCount(threadsPerRoot);
+        scanner->setCatalogEnabled(!parser.isSet(noCatalogOption));
+        scanner->setGazetteerPath(parser.value(gazetteerOption));
+        scanner->setTrackLog(trackLog);
+        scanners.append(scanner);
+
+        // Пачка пишется прямо в потоке пула: очередь событий не растёт,
+        // а при медленном выводе сканер сам притормаживает
+        QObject::connect(scanner, &PhotoScanner::batchReady, scanner,
+                         [&exporter, &writeFailed](int, const QVector<PhotoInfo> &photos) {
+                             if (!exporter.write(photos))
+                                 writeFailed = true;
+                         }, Qt::DirectConnection);
+
+        QObject::connect(scanner, &PhotoScanner::finished, &app,
+                         [&, scanner, root](int, bool) {
+                             if (!quiet) {
+                                 std::fprintf(stderr, "%s: %d photos, %d from catalog\n",
+                                              qPrintable(QDir::toNativeSeparators(root)),
+                                              scanner->processedCount(), scanner->reusedCount());
+                                 const QString io = scanner->ioSummary();
+                                 if (!io.isEmpty())
+                                     std::fprintf(stderr, "  %s\n", qPrintable(io.split(QLatin1Char('\n'))
+                                                                           .join(QStringLiteral("\n  "))));
+                             }
+                             if (--remaining == 0)
+                                 app.quit();
+                         });
+    }
+
+    // GEOPHOTO_TRACE=файл: трасса сканирования в формате Chrome/Perfetto
+    const QString tracePath = Tracer::environmentPath();
+    if (!tracePath.isEmpty())
+        Tracer::instance().setEnabled(true);
+
+    for (int i = 0; i < roots.size(); ++i)
+        scanners[i]->start(roots[i]);
+    app.exec();
+
+    if (!tracePath.isEmpty()) {
+        QString error;
+        if (!Tracer::instance().writeChromeJson(tracePath, &error))
+            std::fprintf(stderr, "Cannot write trace %s: %s\n", qPrintable(tracePath), qPrintable(error));
+    }
+
+    bool finished = exporter.finish() && !writeFailed;
+    if (saveFile) {
+        if (finished)
+            finished = saveFile->commit();
+        else
+            saveFile->cancelWriting();
+    }
+    if (!quiet) {
+        std::fprintf(stderr, "Exported %d photos in %.1f s\n",
+                     exporter.written(), double(timer.elapsed()) / 1000.0);
+    }
+    if (!finished) {
+        std::fprintf(stderr, "Write error\n");
+        return 2;
+    }
+    return 0;
+}
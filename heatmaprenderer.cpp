@@ -0,0 +1,225 @@
+#include "heatmaprenderer.h"
+#include "markerclusterer.h"
+#include "tracer.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+constexpr int BufferSize = HeatmapRenderer::TileSize + 2 * HeatmapRenderer::Padding;
+// Меньше этой доли вершины ядра одной точки - прозрачно
+constexpr float MinValue = 0.05f;
+
+// Вершина ядра от одной точки после всех проходов (по обеим осям):
+// плотность делится на неё, и одиночное фото даёт 1
+double kernelPeak()
+{
+    QVector<double> kernel{1.0};
+    for (int pass = 0; pass < HeatmapRenderer::Passes; ++pass) {
+        QVector<double> next(kernel.size() + 2 * HeatmapRenderer::BoxRadius, 0.0);
+        for (int i = 0; i < kernel.size(); ++i) {
+            for (int k = 0; k <= 2 * HeatmapRenderer::BoxRadius; ++k)
+                next[i + k] += kernel[i];
+        }
+        kernel = next;
+    }
+    const double peak = kernel[kernel.size() / 2];
+    return peak * peak;
+}
+
+// 256 цветов ARGB32 premultiplied: голубой -> жёлтый -> красный, прозрачность убывает
+QVector<quint32> makePalette()
+{
+    struct Stop
+    {
+        double r, g, b;
+    };
+    const Stop low{59, 169, 255};
+    const Stop middle{255, 214, 10};
+    const Stop high{255, 69, 58};
+
+    QVector<quint32> palette(256);
+    for (int i = 0; i < 256; ++i) {
+        const double t = i / 255.0;
+        const Stop &from = t < 0.5 ? low : middle;
+        const Stop &to = t < 0.5 ? middle : high;
+        const double f = t < 0.5 ? t * 2.0 : (t - 0.5) * 2.0;
+        const double alpha = 0.35 + 0.5 * t;
+        const auto channel = [alpha, f](double a, double b) {
+            return quint32(std::lround((a + (b - a) * f) * alpha));
+        };
+        palette[i] = (quint32(std::lround(alpha * 255.0)) << 24)
+                | (channel(from.r, to.r) << 16)
+                | (channel(from.g, to.g) << 8)
+                | channel(from.b, to.b);
+    }
+    return palette;
+}
+
+// Скользящая сумма по строке: окно [x - r, x + r], за краем - нули
+void boxRows(const float *in, float *out, int size, int r)
+{
+    for (int y = 0; y < size; ++y) {
+        const float *src = in + y * size;
+        float *dst = out + y * size;
+        float sum = 0.0f;
+        for (int x = 0; x < r && x < size; ++x)
+            sum += src[x];
+        for (int x = 0; x < size; ++x) {
+            if (x + r < size)
+                sum += src[x + r];
+            dst[x] = sum;
+            if (x - r >= 0)
+                sum -= src[x - r];
+        }
+    }
+}
+
+// То же по столбцам, но строками целиком: внутренние циклы идут
+// по непрерывным float и векторизуются
+void boxColumns(const float *in, float *out, float *acc, int size, int r)
+{
+    std::fill(acc, acc + size, 0.0f);
+    for (int y = 0; y < r && y < size; ++y) {
+        const float *row = in + y * size;
+        for (int x = 0; x < size; ++x)
+            acc[x] += row[x];
+    }
+    for (int y = 0; y < size; ++y) {
+        if (y + r < size) {
+            const float *row = in + (y + r) * size;
+            for (int x = 0; x < size; ++x)
+                acc[x] += row[x];
+        }
+        float *dst = out + y * size;
+        for (int x = 0; x < size; ++x)
+            dst[x] = acc[x];
+        if (y - r >= 0) {
+            const float *row = in + (y - r) * size;
+            for (int x = 0; x < size; ++x)
+                acc[x] -= row[x];
+        }
+    }
+}
+
+int binIndex(double v)
+{
+    return qBound(0, int(std::floor(v * HeatmapRenderer::BinCells)), HeatmapRenderer::BinCells - 1);
+}
+
+} // namespace
+
+void HeatmapRenderer::clear()
+{
+    m_x.clear();
+    m_y.clear();
+    m_binStart.clear();
+}
+
+void HeatmapRenderer::build(const PhotoStore &photos, const QVector<int> &ids)
+{
+    TraceSpan span("heat.build");
+    clear();
+
+    QVector<float> xs;
+    QVector<float> ys;
+    QVector<int> bins;
+    xs.reserve(ids.size());
+    ys.reserve(ids.size());
+    bins.reserve(ids.size());
+    for (int id : ids) {
+        if (id < 0 || id >= photos.size() || photos.isRemoved(id))
+            continue;
+        const double x = MarkerClusterer::lngToX(photos.longitude(id));
+        const double y = MarkerClusterer::latToY(photos.latitude(id));
+        xs.append(float(x));
+        ys.append(float(y));
+        bins.append(binIndex(y) * BinCells + binIndex(x));
+    }
+    span.setValue(xs.size());
+
+    // Раскладка по корзинам подсчётом, за два прохода
+    m_binStart.fill(0, BinCells * BinCells + 1);
+    for (int bin : std::as_const(bins))
+        ++m_binStart[bin + 1];
+    for (int i = 1; i < m_binStart.size(); ++i)
+        m_binStart[i] += m_binStart[i - 1];
+    QVector<int> fill = m_binStart;
+    m_x.resize(xs.size());
+    m_y.resize(ys.size());
+    for (int i = 0; i < bins.size(); ++i) {
+        const int slot = fill[bins[i]]++;
+        m_x[slot] = xs[i];
+        m_y[slot] = ys[i];
+    }
+}
+
+bool HeatmapRenderer::render(int z, int x, int y, QVector<quint32> &pixels) const
+{
+    // Float-координат хватает с запасом до MaxZoom; глубже тайлы не просят
+    if (m_x.isEmpty() || z < 0 || z > 24)
+        return false;
+    TraceSpan span("heat.render", z);
+
+    const double worldPixels = double(TileSize) * double(1 << z);
+    const double originX = double(x) * TileSize - Padding;
+    const double originY = double(y) * TileSize - Padding;
+
+    QVector<float> density(BufferSize * BufferSize, 0.0f);
+    float *out = density.data();
+    int count = 0;
+    const int rowFirst = binIndex(originY / worldPixels);
+    const int rowLast = binIndex((originY + BufferSize) / worldPixels);
+    // Поля у края мира заходят на соседнюю копию
+    for (int shift = -1; shift <= 1; ++shift) {
+        const double left = originX / worldPixels - shift;
+        const double right = (originX + BufferSize) / worldPixels - shift;
+        if (right < 0.0 || left >= 1.0)
+            continue;
+        const int columnFirst = binIndex(left);
+        const int columnLast = binIndex(right);
+        const double offsetX = originX - shift * worldPixels;
+        for (int row = rowFirst; row <= rowLast; ++row) {
+            const int begin = m_binStart[row * BinCells + columnFirst];
+            const int end = m_binStart[row * BinCells + columnLast + 1];
+            for (int i = begin; i < end; ++i) {
+                const int px = int(std::floor(m_x[i] * worldPixels - offsetX));
+                const int py = int(std::floor(m_y[i] * worldPixels - originY));
+                if (px < 0 || px >= BufferSize || py < 0 || py >= BufferSize)
+                    continue;
+                out[py * BufferSize + px] += 1.0f;
+                ++count;
+            }
+        }
+    }
+    span.setValue(count);
+    if (count == 0)
+        return false;
+
+    QVector<float> temp(BufferSize * BufferSize);
+    QVector<float> acc(BufferSize);
+    for (int pass = 0; pass < Passes; ++pass) {
+        boxRows(out, temp.data(), BufferSize, BoxRadius);
+        boxColumns(temp.constData(), out, acc.data(), BufferSize, BoxRadius);
+    }
+
+    static const float norm = float(1.0 / kernelPeak());
+    static const float logSaturation = float(std::log1p(Saturation));
+    static const QVector<quint32> palette = makePalette();
+    pixels.resize(TileSize * TileSize);
+    quint32 *dst = pixels.data();
+    for (int ty = 0; ty < TileSize; ++ty) {
+        const float *src = out + (ty + Padding) * BufferSize + Padding;
+        for (int tx = 0; tx < TileSize; ++tx) {
+            const float value = src[tx] * norm;
+            if (value < MinValue) {
+                dst[ty * TileSize + tx] = 0;
+                continue;
+            }
+            const float t = std::log1p(value) / logSaturation;
+            dst[ty * TileSize + tx] = palette[qMin(255, int(t * 255.0f))];
+        }
+    }
+    return true;
+}
@@ -0,0 +1,46 @@
+#ifndef HEATMAPRENDERER_H
+#define HEATMAPRENDERER_H
+
+#include "photostore.h"
+
+#include <QVector>
+
+// Тепловая карта плотности фото, тайлы растрируются на стороне C++.
+// Точки хранятся в нормированной проекции Web Mercator (как в MarkerClusterer)
+// и заранее разложены по сетке BinCells x BinCells подсчётом: точки одной
+// строки сетки лежат подряд, и тайл перебирает только корзины, которые
+// задевает он сам с запасом на радиус ядра.
+// Плотность - гистограмма точек в буфере тайла с полями, размытая
+// Passes проходами box-фильтра (приближение гауссиана, сигма около
+// sqrt(Passes * r * (r + 1) / 3) пикселей). Проходы не зависят от числа
+// точек; вертикальный идёт целыми строками float и векторизуется компилятором.
+// Цвет - логарифмическая шкала, одинаковая для всех тайлов, чтобы не было швов.
+// После build() объект только читается: тайлы рисуются из нескольких потоков.
+class HeatmapRenderer
+{
+public:
+    static constexpr int TileSize = 256;
+    static constexpr int BoxRadius = 5;       // пикселей, на проход
+    static constexpr int Passes = 3;
+    static constexpr int Padding = BoxRadius * Passes;
+    static constexpr int BinLevel = 9;        // сетка корзин - тайлы уровня 9
+    static constexpr int BinCells = 1 << BinLevel;
+    static constexpr int MaxZoom = 12;        // крупнее - отдельные маркеры
+    static constexpr double Saturation = 200.0;  // столько фото под ядром - полный цвет
+
+    // ids - фото на карте; удалённые пропускаются
+    void build(const PhotoStore &photos, const QVector<int> &ids);
+    void clear();
+    int size() const { return int(m_x.size()); }
+
+    // Тайл z/x/y в ARGB32 с premultiplied alpha, TileSize * TileSize пикселей.
+    // false - в тайле нет точек (pixels не заполняется)
+    bool render(int z, int x, int y, QVector<quint32> &pixels) const;
+
+private:
+    QVector<float> m_x;               // точки по корзинам, строка за строкой
+    QVector<float> m_y;
+    QVector<int> m_binStart;          // BinCells * BinCells + 1 начал в m_x
+};
+
+#endif // HEATMAPRENDERER_H
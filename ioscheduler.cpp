@@ -0,0 +1,273 @@
+#include "ioscheduler.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QThread>
+#include <algorithm>
+
+#ifdef Q_OS_UNIX
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#ifdef Q_OS_LINUX
+#include <sys/statfs.h>
+#include <sys/sysmacros.h>
+#endif
+
+namespace {
+
+#ifdef Q_OS_LINUX
+// Сетевые и пользовательские (FUSE) файловые системы, statfs::f_type
+bool isNetworkFs(long type)
+{
+    switch (quint32(type)) {
+    case 0x6969:        // NFS
+    case 0x517B:        // SMB
+    case 0xFF534D42:    // CIFS
+    case 0xFE534D42:    // SMB2
+    case 0x65735546:    // FUSE (sshfs, rclone, ...)
+    case 0x01021997:    // 9P
+    case 0x00C36400:    // Ceph
+    case 0x47504653:    // GPFS
+        return true;
+    default:
+        return false;
+    }
+}
+
+// queue/rotational у диска; у раздела очередь на уровень выше
+int readRotational(unsigned deviceMajor, unsigned deviceMinor)
+{
+    const QString node = QFileInfo(QStringLiteral("/sys/dev/block/%1:%2").arg(deviceMajor).arg(deviceMinor))
+            .canonicalFilePath();
+    if (node.isEmpty())
+        return -1;
+    for (const QString &dir : {node, QFileInfo(node).path()}) {
+        QFile file(dir + QStringLiteral("/queue/rotational"));
+        if (file.open(QIODevice::ReadOnly))
+            return file.readAll().trimmed() == "1" ? 1 : 0;
+    }
+    return -1;
+}
+#endif
+
+} // namespace
+
+IoScheduler::IoScheduler() = default;
+
+IoScheduler::~IoScheduler()
+{
+    waitForDone();
+}
+
+void IoScheduler::reset()
+{
+    waitForDone();
+    QMutexLocker locker(&m_mutex);
+    m_devices.clear();
+    m_byId.clear();
+    m_byDir.clear();
+}
+
+void IoScheduler::waitForDone()
+{
+    // Ждём вне блокировки: задачи берут её в recordRead()
+    QVector<QThreadPool*> pools;
+    {
+        QMutexLocker locker(&m_mutex);
+        for (const auto &d : m_devices)
+            pools.append(&d->pool);
+    }
+    for (QThreadPool *pool : std::as_const(pools))
+        pool->waitForDone();
+}
+
+IoScheduler::Kind IoScheduler::detectKind(const QString &dirPath)
+{
+#ifdef Q_OS_LINUX
+    const QByteArray path = QFile::encodeName(dirPath);
+    struct statfs fs;
+    if (::statfs(path.constData(), &fs) == 0 && isNetworkFs(long(fs.f_type)))
+        return Network;
+    struct stat st;
+    if (::stat(path.constData(), &st) != 0)
+        return Unknown;
+    switch (readRotational(major(st.st_dev), minor(st.st_dev))) {
+    case 0:
+        return Solid;
+    case 1:
+        return Rotational;
+    default:
+        return Unknown;   // tmpfs, overlayfs, btrfs с анонимным st_dev
+    }
+#else
+    Q_UNUSED(dirPath);
+    return Unknown;
+#endif
+}
+
+int IoScheduler::concurrencyFor(Kind kind) const
+{
+    int count = qMax(1, QThread::idealThreadCount());
+    if (kind == Rotational)
+        count = RotationalConcurrency;
+    else if (kind == Network)
+        count = NetworkConcurrency;
+    return m_maxConcurrency > 0 ? qMin(count, m_maxConcurrency) : count;
+}
+
+int IoScheduler::deviceOf(const QString &dirPath)
+{
+    const auto cached = m_byDir.constFind(dirPath);
+    if (cached != m_byDir.cend())
+        return *cached;
+
+    quint64 id = 0;
+#ifdef Q_OS_UNIX
+    struct stat st;
+    if (::stat(QFile::encodeName(dirPath).constData(), &st) == 0)
+        id = quint64(st.st_dev);
+#endif
+    QMutexLocker locker(&m_mutex);
+    int index = m_byId.value(id, -1);
+    if (index < 0) {
+        auto d = std::make_unique<Device>();
+        d->id = id;
+        d->path = dirPath;
+        d->kind = detectKind(dirPath);
+        d->concurrency = concurrencyFor(d->kind);
+        d->pool.setMaxThreadCount(d->concurrency);
+        index = int(m_devices.size());
+        m_devices.push_back(std::move(d));
+        m_byId.insert(id, index);
+    }
+    m_byDir.insert(dirPath, index);
+    return index;
+}
+
+IoScheduler::Device *IoScheduler::device(int index) const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_devices[size_t(index)].get();
+}
+
+IoScheduler::Kind IoScheduler::kind(int index) const
+{
+    return device(index)->kind;
+}
+
+void IoScheduler::start(int index, std::function<void()> task)
+{
+    device(index)->pool.start(std::move(task));
+}
+
+bool IoScheduler::wantsReadahead(int index) const
+{
+    // Подсказке нужен свой open/close, а на сетевом томе это два обращения к серверу
+    return kind(index) == Rotational;
+}
+
+void IoScheduler::order(int index, const QStringList &paths, QVector<int> &indexes) const
+{
+#ifdef Q_OS_UNIX
+    // На SSD порядок не важен, а у сетевого тома inode ничего не говорит о диске
+    if (kind(index) != Rotational || indexes.size() < 2)
+        return;
+    QHash<int, quint64> inodes;
+    inodes.reserve(indexes.size());
+    for (int i : std::as_const(indexes)) {
+        struct stat st;
+        const bool ok = ::stat(QFile::encodeName(paths[i]).constData(), &st) == 0;
+        inodes.insert(i, ok ? quint64(st.st_ino) : 0);
+    }
+    std::stable_sort(indexes.begin(), indexes.end(), [&inodes](int a, int b) {
+        return inodes.value(a) < inodes.value(b);
+    });
+#else
+    Q_UNUSED(index);
+    Q_UNUSED(paths);
+    Q_UNUSED(indexes);
+#endif
+}
+
+void IoScheduler::willNeed(const QString &path, qint64 length)
+{
+#ifdef Q_OS_LINUX
+    // Подсказка асинхронна: ядро ставит чтение в очередь и сразу возвращает
+    // управление; страницы остаются в кэше и после закрытия файла
+    const int fd = ::open(QFile::encodeName(path).constData(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+    ::posix_fadvise(fd, 0, off_t(length), POSIX_FADV_WILLNEED);
+    ::close(fd);
+#else
+    Q_UNUSED(path);
+    Q_UNUSED(length);
+#endif
+}
+
+void IoScheduler::recordRead(int index, int files, qint64 start, qint64 end)
+{
+    if (files <= 0)
+        return;
+    Device *d = device(index);
+    d->files += files;
+    d->busy += end - start;
+    qint64 first = d->first.load();
+    while (start < first && !d->first.compare_exchange_weak(first, start)) {
+    }
+    qint64 last = d->last.load();
+    while (end > last && !d->last.compare_exchange_weak(last, end)) {
+    }
+}
+
+QVector<IoScheduler::Stats> IoScheduler::stats() const
+{
+    QMutexLocker locker(&m_mutex);
+    QVector<Stats> result;
+    for (const auto &d : m_devices) {
+        Stats s;
+        s.path = d->path;
+        s.kind = d->kind;
+        s.concurrency = d->concurrency;
+        s.files = d->files.load();
+        if (s.files > 0) {
+            s.seconds = double(d->last.load() - d->first.load()) / 1e9;
+            s.busySeconds = double(d->busy.load()) / 1e9;
+        }
+        result.append(s);
+    }
+    return result;
+}
+
+QString IoScheduler::summary() const
+{
+    QStringList lines;
+    for (const Stats &s : stats()) {
+        if (s.files == 0)
+            continue;
+        lines.append(QStringLiteral("%1 (%2): %3 files, %4/%5 threads busy, %6 files/s")
+                         .arg(s.path, kindName(s.kind))
+                         .arg(s.files)
+                         .arg(s.effectiveConcurrency(), 0, 'f', 1)
+                         .arg(s.concurrency)
+                         .arg(s.filesPerSecond(), 0, 'f', 0));
+    }
+    return lines.join(QLatin1Char('\n'));
+}
+
+QString IoScheduler::kindName(Kind kind)
+{
+    switch (kind) {
+    case Solid:
+        return QStringLiteral("ssd");
+    case Rotational:
+        return QStringLiteral("hdd");
+    case Network:
+        return QStringLiteral("network");
+    case Unknown:
+        break;
+    }
+    return QStringLiteral("unknown");
+}
@@ -0,0 +1,105 @@
+#ifndef IOSCHEDULER_H
+#define IOSCHEDULER_H
+
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QStringList>
+#include <QThreadPool>
+#include <QVector>
+#include <atomic>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <vector>
+
+// Планировщик чтения для сканера: файлы раскладываются по устройствам
+// (st_dev каталога), и у каждого устройства свой пул задач с пределом
+// параллельности по его типу. SSD/NVMe нагружаются по числу ядер,
+// диски с головками - парой потоков (больше - только лишние перемещения
+// головок), сетевые тома (NFS, SMB, FUSE) - большим числом запросов в полёте,
+// чтобы скрыть задержку каждого обращения.
+// Внутри пачки на дисках с головками заголовки читаются по возрастанию
+// inode (приближение физического порядка), и ядру заранее подсказывается
+// (posix_fadvise WILLNEED) ReadaheadWindow следующих файлов. На сетевых
+// томах подсказки нет: лишние open/close на SMB/NFS - это лишние обращения
+// к серверу, а задержку там скрывают запросы в полёте.
+// Тип устройства определяется в Linux по statfs и
+// /sys/dev/block/*/queue/rotational; в остальных системах - Unknown.
+// Для каждого устройства считается время чтения заголовков: по нему
+// видны действующая параллельность и пропускная способность.
+class IoScheduler
+{
+public:
+    enum Kind { Unknown, Solid, Rotational, Network };
+
+    static constexpr int RotationalConcurrency = 2;
+    static constexpr int NetworkConcurrency = 8;
+    static constexpr int ReadaheadWindow = 8;
+
+    struct Stats
+    {
+        QString path;                // первый каталог, встреченный на устройстве
+        Kind kind = Unknown;
+        int concurrency = 0;         // предел потоков
+        int files = 0;               // прочитано заголовков
+        double seconds = 0.0;        // от первого чтения до последнего
+        double busySeconds = 0.0;    // сумма по потокам
+
+        double effectiveConcurrency() const { return seconds > 0.0 ? busySeconds / seconds : 0.0; }
+        double filesPerSecond() const { return seconds > 0.0 ? files / seconds : 0.0; }
+    };
+
+    IoScheduler();
+    ~IoScheduler();
+
+    // 0 - по типу устройства, иначе ещё и не больше count потоков на устройство
+    void setMaxConcurrency(int count) { m_maxConcurrency = qMax(0, count); }
+    // Перед новым запуском, когда задачи закончились: устройства и статистика сбрасываются
+    void reset();
+    void waitForDone();
+
+    // Номер устройства каталога; вызывается из потока обхода
+    int deviceOf(const QString &dirPath);
+    Kind kind(int device) const;
+    void start(int device, std::function<void()> task);
+
+    // Порядок чтения indexes (номера в paths) под устройство
+    void order(int device, const QStringList &paths, QVector<int> &indexes) const;
+    bool wantsReadahead(int device) const;
+    // Попросить ядро подгрузить начало файла, не дожидаясь чтения
+    static void willNeed(const QString &path, qint64 length);
+    // Чтение files заголовков с start по end (Tracer::now(), нс)
+    void recordRead(int device, int files, qint64 start, qint64 end);
+
+    QVector<Stats> stats() const;
+    // Одна строка на устройство; пусто, если ничего не читалось
+    QString summary() const;
+    static QString kindName(Kind kind);
+    static Kind detectKind(const QString &dirPath);
+
+private:
+    struct Device
+    {
+        quint64 id = 0;
+        QString path;
+        Kind kind = Unknown;
+        int concurrency = 1;
+        QThreadPool pool;
+        std::atomic<int> files{0};
+        std::atomic<qint64> busy{0};
+        std::atomic<qint64> first{std::numeric_limits<qint64>::max()};
+        std::atomic<qint64> last{0};
+    };
+
+    Device *device(int index) const;
+    int concurrencyFor(Kind kind) const;
+
+    mutable QMutex m_mutex;                        // список растёт при обходе
+    std::vector<std::unique_ptr<Device>> m_devices;
+    QHash<quint64, int> m_byId;
+    QHash<QString, int> m_byDir;                   // только поток обхода
+    int m_maxConcurrency = 0;
+};
+
+#endif // IOSCHEDULER_H
@@ -1,18 +1,25 @@
 #include "mainwindow.h"
+#include "mapschemehandler.h"
+#include "tracer.h"
 #include <QApplication>
 #include <QCoreApplication>
-#if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
-#include <QtWebEngine/QtWebEngine>
-#else
 #include <QtWebEngineCore/QtWebEngineCore>
-#endif
 
 int main(int argc, char *argv[])
 {
     QCoreApplication::setAttribute(Qt::AA_ShareOpenGLContexts);
+    // Схема карты должна быть зарегистрирована до создания приложения
+    MapSchemeHandler::registerScheme();
     QApplication a(argc, argv);
+    // GEOPHOTO_TRACE=файл: трасса пишется с запуска и сохраняется при выходе
+    const QString tracePath = Tracer::environmentPath();
+    if (!tracePath.isEmpty())
+        Tracer::instance().setEnabled(true);
     //QtWebEngine::initialize();
     MainWindow w;
     w.show();
-    return a.exec();
+    const int code = a.exec();
+    if (!tracePath.isEmpty())
+        Tracer::instance().writeChromeJson(tracePath);
+    return code;
 }
@@ -1,4 +1,22 @@
 #include "mainwindow.h"
+#include "folderwatcher.h"
+#include "mapbridge.h"
+#include "mapschemehandler.h"
+#include "photoscanner.h"
+#include "perceptualhash.h"
+#include "phototreemodel.h"
+#include "thumbnailloader.h"
+#include "timelinewidget.h"
+#include "tracer.h"
+#include "tracklog.h"
+
+#include <QAction>
+#include <QCheckBox>
+#include <QLineEdit>
+#include <QMenu>
+#include <QMenuBar>
+#include <QSet>
+#include <QTimer>
 
 #include <QApplication>
 #include <QPainter>
@@ -14,24 +32,35 @@
 #include <QDir>
 #include <QCoreApplication>
 #include <QFileDialog>
+#include <QInputDialog>
+#include <QThread>
 #include <QDirIterator>
 #include <QFileInfo>
 #include <QHBoxLayout>
 #include <QVBoxLayout>
 #include <QLabel>
-#include <QTreeWidgetItem>
+#include <QTreeView>
+#include <QItemSelectionModel>
 #include <QPushButton>
 #include <QStatusBar>
+#include <QProgressBar>
 #include <QtMath>
 #include <QWebEngineView>
-#include <QJsonDocument>
-#include <QJsonArray>
-#include <QJsonObject>
+#include <QWebEnginePage>
+#include <QWebEngineProfile>
+#include <QWebChannel>
 #include <QByteArray>
-#include <QRegularExpression>
 #include <QtGlobal>
 #include <algorithm>
 #include <cmath>
+#include <limits>
+
+namespace {
+
+const QSize PreviewSize(520, 320);
+constexpr int PreviewPrefetch = 2;    // соседей выше и ниже выбранной строки
+
+} // namespace
 
 // ---------------------------
 // Реализация MainWindow
@@ -51,6 +80,20 @@ MainWindow::MainWindow(QWidget *parent)
         );
 }
 
+MainWindow::~MainWindow()
+{
+    // Загрузчик миниатюр модели работает в своих потоках с m_thumbnails,
+    // а дочерние объекты удаляются уже после членов класса
+    delete m_model;
+    m_model = nullptr;
+    delete m_previewLoader;
+    m_previewLoader = nullptr;
+    if (m_trackLoader) {
+        m_trackLoader->wait();
+        delete m_trackLoader;
+    }
+}
+
 void MainWindow::applyDarkTheme()
 {
     QPalette palette;
@@ -71,10 +114,10 @@ void MainWindow::applyDarkTheme()
     const QString css = QStringLiteral(
         "QWidget { background-color: #12151c; color: #e9ecf2; }"
         "QToolTip { color: #e9ecf2; background-color: #20242c; border: 1px solid #3ba9ff; }"
-        "QTreeWidget { background-color: #141821; border: 1px solid #2b303d; }"
-        "QTreeWidget::item { padding: 6px; }"
-        "QTreeWidget::item:selected { background-color: #243245; }"
-        "QComboBox, QAbstractItemView { background-color: #1c2029; border: 1px solid #303544; padding: 4px; }"
+        "QTreeView { background-color: #141821; border: 1px solid #2b303d; }"
+        "QTreeView::item { padding: 6px; }"
+        "QTreeView::item:selected { background-color: #243245; }"
+        "QComboBox, QLineEdit, QAbstractItemView { background-color: #1c2029; border: 1px solid #303544; padding: 4px; }"
         "QLabel#PreviewFrame { background-color: #0f131b; border: 1px solid #2e3442; border-radius: 8px; }"
         "QLabel#PreviewCaption { color: #b6bdc9; }"
         "QWebEngineView { background: #0f131b; border: 1px solid #1f2532; }"
@@ -102,25 +145,78 @@ void MainWindow::setupUi()
     m_openButton->setCursor(Qt::PointingHandCursor);
     m_openButton->setStyleSheet("font-weight: 600;");
 
+    m_stopButton = new QPushButton(tr("Стоп"), central);
+    m_stopButton->setCursor(Qt::PointingHandCursor);
+    m_stopButton->setVisible(false);
+
     auto *sortLabel = new QLabel(tr("Сортировка:"), central);
     m_sortCombo = new QComboBox(central);
-    m_sortCombo->addItem(tr("По времени"));
-    m_sortCombo->addItem(tr("По месту (название)"));
+    m_sortCombo->addItem(tr("По времени"), SortIndex::ByTime);
+    m_sortCombo->addItem(tr("По месту (название)"), SortIndex::ByLocation);
+    m_sortCombo->addItem(tr("По пути"), SortIndex::ByPath);
+    m_sortCombo->addItem(tr("По широте (с севера)"), SortIndex::ByLatitude);
+    m_sortCombo->addItem(tr("По размеру"), SortIndex::BySize);
 
     controlsLayout->addWidget(m_openButton);
+    controlsLayout->addWidget(m_stopButton);
     controlsLayout->addWidget(sortLabel);
     controlsLayout->addWidget(m_sortCombo);
     controlsLayout->addStretch();
 
-    m_tree = new QTreeWidget(central);
+    m_searchEdit = new QLineEdit(central);
+    m_searchEdit->setPlaceholderText(tr("Поиск: папка, имя файла, место"));
+    m_searchEdit->setClearButtonEnabled(true);
+    m_searchEdit->setToolTip(tr("Слова ищутся в пути и названии места, нужны все сразу;\n"
+                                "\"в кавычках\" - фраза с пробелами. Фильтры:\n"
+                                "date:2023, date:2023-05, date:2023-05-01..2023-06-15, date:..2019\n"
+                                "gps:yes, gps:no\n"
+                                "ext:heic,jpg\n"
+                                "size:>5mb, size:<500k, size:1m..20m\n"
+                                "bbox:запад,юг,восток,север (в градусах)"));
+    // Запрос применяется, когда пауза в наборе дольше интервала
+    m_searchTimer = new QTimer(this);
+    m_searchTimer->setSingleShot(true);
+    m_searchTimer->setInterval(80);
+
+    m_viewportFilter = new QCheckBox(tr("Только в области карты"), central);
+    m_viewportFilter->setCursor(Qt::PointingHandCursor);
+    m_duplicateFilter = new QCheckBox(tr("Свернуть похожие снимки"), central);
+    m_duplicateFilter->setCursor(Qt::PointingHandCursor);
+    m_duplicateFilter->setToolTip(tr("Копии, пересжатые версии и серии кадров показываются одним снимком"));
+    m_routeMode = new QCheckBox(tr("Маршруты поездок"), central);
+    m_routeMode->setCursor(Qt::PointingHandCursor);
+    m_routeMode->setToolTip(tr("Снимки с GPS соединяются линиями в порядке съёмки;\n"
+                               "долгие паузы и перелёты разделяют поездки"));
+    m_heatmapMode = new QCheckBox(tr("Тепловая карта"), central);
+    m_heatmapMode->setCursor(Qt::PointingHandCursor);
+    m_heatmapMode->setToolTip(tr("На мелких масштабах вместо маркеров - плотность снимков"));
+    // Пан карты порождает серию событий - дерево перестраивается один раз в конце
+    m_filterTimer = new QTimer(this);
+    m_filterTimer->setSingleShot(true);
+    m_filterTimer->setInterval(150);
+
+    m_tree = new QTreeView(central);
     m_tree->setHeaderHidden(true);
     m_tree->setSelectionMode(QAbstractItemView::SingleSelection);
     m_tree->setIconSize(QSize(96, 72));
     m_tree->setMinimumWidth(340);
     m_tree->setExpandsOnDoubleClick(true);
     m_tree->setAnimated(true);
+    // Одинаковая высота строк: представлению не нужно опрашивать
+    // все элементы, чтобы посчитать полосу прокрутки
+    m_tree->setUniformRowHeights(true);
+
+    m_model = new PhotoTreeModel(&m_photos, &m_thumbnails, this);
+    m_model->setIconSize(m_tree->iconSize());
+    m_model->setPlaceholder(placeholderThumbnail(m_tree->iconSize(), tr("...")));
+    m_tree->setModel(m_model);
 
     leftLayout->addLayout(controlsLayout);
+    leftLayout->addWidget(m_searchEdit);
+    leftLayout->addWidget(m_viewportFilter);
+    leftLayout->addWidget(m_duplicateFilter);
+    leftLayout->addWidget(m_routeMode);
+    leftLayout->addWidget(m_heatmapMode);
     leftLayout->addWidget(m_tree, 1);
 
     auto *previewTitle = new QLabel(tr("Предпросмотр"), central);
@@ -137,6 +233,11 @@ void MainWindow::setupUi()
     m_previewCaption->setAlignment(Qt::AlignLeft | Qt::AlignTop);
     m_previewCaption->setWordWrap(true);
 
+    // Два потока: выбранное фото и предзагрузка соседей не ждут друг друга
+    m_previewLoader = new ThumbnailLoader(&m_thumbnails, this, 2);
+    connect(m_previewLoader, &ThumbnailLoader::loaded,
+            this, &MainWindow::onPreviewLoaded);
+
     leftLayout->addWidget(previewTitle);
     leftLayout->addWidget(m_previewImage);
     leftLayout->addWidget(m_previewCaption);
@@ -147,19 +248,125 @@ void MainWindow::setupUi()
     m_mapView->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
     m_mapView->setZoomFactor(1.0);
 
+    // Страница карты загружается один раз, дальше только изменения через мост
+    m_mapBridge = new MapBridge(&m_photos, this);
+    auto *channel = new QWebChannel(this);
+    channel->registerObject(QStringLiteral("bridge"), m_mapBridge);
+    m_mapView->page()->setWebChannel(channel);
+
+    // Страница, Leaflet и тайлы отдаются через схему gpm: - карта работает без сети.
+    // Недостающие тайлы докачиваются из GEOPHOTO_TILE_SOURCE (пусто - не качать).
+    m_mapScheme = new MapSchemeHandler(TileStore::defaultRoot(), this);
+    m_mapScheme->setUpstream(qEnvironmentVariable(
+        "GEOPHOTO_TILE_SOURCE", QStringLiteral("https://tile.openstreetmap.org/{z}/{x}/{y}.png")));
+    m_mapView->page()->profile()->installUrlSchemeHandler(MapSchemeHandler::SchemeName, m_mapScheme);
+
+    // Под картой - гистограмма по датам съёмки; протяжка по ней фильтрует и список, и карту
+    m_timeline = new TimelineWidget(&m_timeIndex, central);
+    m_timelineResolution = new QComboBox(central);
+    m_timelineResolution->addItem(tr("По дням"), TimeIndex::Day);
+    m_timelineResolution->addItem(tr("По месяцам"), TimeIndex::Month);
+    m_timelineResolution->addItem(tr("По годам"), TimeIndex::Year);
+    m_timelineResolution->setCurrentIndex(m_timelineResolution->findData(m_timeline->resolution()));
+    m_timelineResolution->setToolTip(tr("Протяните по гистограмме, чтобы выбрать период;\n"
+                                        "двойной щелчок снимает фильтр"));
+
+    auto *timelineLayout = new QHBoxLayout;
+    timelineLayout->setSpacing(8);
+    timelineLayout->addWidget(m_timelineResolution, 0, Qt::AlignTop);
+    timelineLayout->addWidget(m_timeline, 1);
+
+    auto *rightLayout = new QVBoxLayout;
+    rightLayout->setSpacing(8);
+    rightLayout->addWidget(m_mapView, 1);
+    rightLayout->addLayout(timelineLayout);
+
     mainLayout->addLayout(leftLayout, 0);
-    mainLayout->addWidget(m_mapView, 1);
+    mainLayout->addLayout(rightLayout, 1);
     mainLayout->setStretch(0, 1);
     mainLayout->setStretch(1, 3);
 
     setCentralWidget(central);
     setWindowTitle(tr("GeoPhotoMap - карта снимков"));
 
+    QMenu *photosMenu = menuBar()->addMenu(tr("Снимки"));
+    QAction *tracksAction = photosMenu->addAction(tr("Привязать к GPS-трекам..."));
+    connect(tracksAction, &QAction::triggered, this, &MainWindow::importTracks);
+
+    // Запись трассы горячих путей; при запуске её включает GEOPHOTO_TRACE
+    QMenu *debugMenu = menuBar()->addMenu(tr("Отладка"));
+    QAction *traceAction = debugMenu->addAction(tr("Записывать трассу"));
+    traceAction->setCheckable(true);
+    traceAction->setChecked(Tracer::isEnabled());
+    connect(traceAction, &QAction::toggled, this, [](bool enabled) {
+        Tracer::instance().setEnabled(enabled);
+    });
+    QAction *saveTraceAction = debugMenu->addAction(tr("Сохранить трассу..."));
+    connect(saveTraceAction, &QAction::triggered, this, &MainWindow::saveTrace);
+
+    m_scanProgress = new QProgressBar(this);
+    m_scanProgress->setMaximumWidth(220);
+    m_scanProgress->setTextVisible(false);
+    m_scanProgress->setVisible(false);
+    statusBar()->addPermanentWidget(m_scanProgress);
+
+    m_cacheLabel = new QLabel(this);
+    m_cacheLabel->setObjectName("PreviewCaption");
+    statusBar()->addPermanentWidget(m_cacheLabel);
+
+    m_scanner = new PhotoScanner(this);
+    connect(m_scanner, &PhotoScanner::batchReady,
+            this, &MainWindow::onScanBatch);
+    connect(m_scanner, &PhotoScanner::progress,
+            this, &MainWindow::onScanProgress);
+    connect(m_scanner, &PhotoScanner::finished,
+            this, &MainWindow::onScanFinished);
+
+    // После полного сканирования корень отслеживается, и дальше
+    // перечитываются только созданные, изменённые и удалённые файлы
+    m_watcher = new FolderWatcher(this);
+    connect(m_watcher, &FolderWatcher::changed,
+            this, &MainWindow::onFolderChanged);
+
     connect(m_openButton, &QPushButton::clicked,
             this, &MainWindow::openDirectory);
+    connect(m_stopButton, &QPushButton::clicked,
+            this, &MainWindow::cancelScan);
+    connect(m_mapView, &QWebEngineView::loadStarted,
+            m_mapBridge, &MapBridge::pageReset);
+    connect(m_mapView, &QWebEngineView::loadFinished,
+            this, &MainWindow::onMapLoadFinished);
+    connect(m_mapBridge, &MapBridge::markerActivated,
+            this, &MainWindow::onMarkerActivated);
+    connect(m_mapBridge, &MapBridge::viewportChanged,
+            this, &MainWindow::onMapViewportChanged);
+    connect(m_searchEdit, &QLineEdit::textChanged,
+            m_searchTimer, qOverload<>(&QTimer::start));
+    connect(m_searchEdit, &QLineEdit::returnPressed,
+            this, &MainWindow::runSearch);
+    connect(m_searchTimer, &QTimer::timeout,
+            this, &MainWindow::runSearch);
+    connect(m_viewportFilter, &QCheckBox::toggled,
+            this, &MainWindow::applyFilters);
+    connect(m_duplicateFilter, &QCheckBox::toggled,
+            this, &MainWindow::onDuplicateFilterToggled);
+    connect(m_routeMode, &QCheckBox::toggled,
+            this, &MainWindow::onRouteModeToggled);
+    connect(m_heatmapMode, &QCheckBox::toggled,
+            m_mapBridge, &MapBridge::setHeatmapEnabled);
+    // Схема получает данные раньше страницы: та запросит тайлы новой версии позже
+    connect(m_mapBridge, &MapBridge::heatmapChanged, this, [this](int version) {
+        m_mapScheme->setHeatmap(m_mapBridge->heatmap(), version);
+    });
+    connect(m_filterTimer, &QTimer::timeout,
+            this, &MainWindow::applyFilters);
     connect(m_sortCombo, &QComboBox::currentIndexChanged,
             this, &MainWindow::resortList);
-    connect(m_tree, &QTreeWidget::itemSelectionChanged,
+    connect(m_timeline, &TimelineWidget::rangeChanged,
+            this, &MainWindow::onTimeRangeChanged);
+    connect(m_timelineResolution, &QComboBox::currentIndexChanged,
+            this, &MainWindow::onTimelineResolutionChanged);
+    connect(m_tree->selectionModel(), &QItemSelectionModel::currentChanged,
             this, &MainWindow::onTreeSelectionChanged);
 }
 
@@ -168,8 +375,32 @@ void MainWindow::createMap()
     if (!m_mapView)
         return;
 
-    const QString html = buildMapHtml();
-    m_mapView->setHtml(html, QUrl("https://local.map/"));
+    {
+        TraceSpan span("map.html");
+        m_mapScheme->setPageHtml(buildMapHtml());
+    }
+    m_mapLoadStart = Tracer::now();
+    m_mapView->load(QUrl(MapSchemeHandler::pageUrl()));
+}
+
+void MainWindow::onMapLoadFinished(bool ok)
+{
+    Tracer::instance().complete("map.load", m_mapLoadStart, Tracer::now() - m_mapLoadStart, ok);
+    // Маркеры отправит сам мост, когда страница подключится к каналу
+    if (!ok)
+        statusBar()->showMessage(tr("Не удалось загрузить карту"), 4000);
+}
+
+void MainWindow::onMarkerActivated(int photoIndex)
+{
+    const QModelIndex index = m_model->indexForPhoto(photoIndex);
+    if (!index.isValid())
+        return;
+    m_tree->scrollTo(index);
+    if (m_tree->currentIndex() == index)
+        centerOnMarker(photoIndex);
+    else
+        m_tree->setCurrentIndex(index);
 }
 
 // Простейшие тестовые данные
@@ -181,49 +412,158 @@ void MainWindow::loadSampleData()
 
 void MainWindow::scanDirectory(const QString &path)
 {
-    QVector<PhotoInfo> loaded;
-
-    QDirIterator it(path,
-                    QStringList() << "*.jpg" << "*.jpeg" << "*.png" << "*.bmp" << "*.gif" << "*.webp",
-                    QDir::Files,
-                    QDirIterator::Subdirectories);
-
-    int counter = 0;
-    while (it.hasNext()) {
-        const QString file = it.next();
-        QFileInfo fi(file);
-        PhotoInfo info;
-        info.filePath = file;
-        info.timestamp = fi.lastModified();
-        info.locationName = fi.absoluteDir().dirName();
-        info.latitude = 0.0;
-        info.longitude = 0.0;
-
-        double lat = 0.0, lng = 0.0;
-        if (extractGpsFromExif(file, lat, lng)) {
-            info.latitude = lat;
-            info.longitude = lng;
+    // Дерево и карта заполняются по мере поступления пачек от сканера
+    m_watcher->stop();
+    m_updating = false;
+    m_hashPending = false;
+    m_changedPaths.clear();
+    m_removedPaths.clear();
+    m_updatedIds.clear();
+
+    // Хранилище очищается раньше модели: она ищет в нём папку нового корня
+    m_photos.clear();
+    m_currentRoot = path;
+    m_model->reset(m_currentRoot, rootTitle());
+    m_gpsCount = 0;
+    m_spatial.clear();
+    m_sortIndex.clear();
+    m_sortedOrder.clear();
+    m_timeIndex.clear();
+    m_duplicates.clear();
+    m_routes.clear();
+    m_search.clear();
+    m_searchResult.clear();
+    m_rangeFirst = QDate();
+    m_rangeLast = QDate();
+    m_timeline->clearRange();
+    m_mapBridge->clear();
+    m_mapBridge->setRouteRange(std::numeric_limits<qint64>::min(), std::numeric_limits<qint64>::max());
+    updateRoutes();
+    updatePreview(-1);
+
+    m_scanStart = Tracer::now();
+    m_scanner->setTrackLog(m_trackLog);
+    m_scanner->start(path);
+    m_stopButton->setVisible(true);
+    m_scanProgress->setRange(0, 0);
+    m_scanProgress->setVisible(true);
+    statusBar()->showMessage(tr("Сканирование \"%1\"...").arg(QDir(path).dirName()));
+}
+
+void MainWindow::cancelScan()
+{
+    if (m_scanner->isRunning())
+        m_scanner->cancel();
+}
+
+void MainWindow::onScanBatch(int generation, const QVector<PhotoInfo> &photos)
+{
+    if (generation != m_scanner->generation())
+        return;
+    TraceSpan span("ui.scanBatch", photos.size());
+    if (m_updating) {
+        applyUpdateBatch(photos);
+        return;
+    }
+
+    const int first = m_photos.size();
+    for (const PhotoInfo &info : photos) {
+        const int id = m_photos.append(info);
+        m_timeIndex.insert(id, m_photos.taken(id));
+        if (info.hasGps)
+            ++m_gpsCount;
+    }
+    const int last = int(m_photos.size()) - 1;
+    if (hasTimeRange()) {
+        // Период выбран ещё во время сканирования: пачка проходит через фильтр
+        QVector<int> ids;
+        for (int id = first; id <= last; ++id) {
+            if (!inTimeRange(id))
+                continue;
+            m_model->appendPhotos(id, id);
+            ids.append(id);
         }
+        m_mapBridge->show(ids);
+    } else {
+        m_model->appendPhotos(first, last);
+        m_mapBridge->showRange(first, last);
+    }
+    if (first == 0)
+        m_tree->expand(m_model->rootIndex());
+    m_timeline->refresh();
+}
+
+void MainWindow::onScanProgress(int generation, int processed, int found)
+{
+    if (generation != m_scanner->generation() || m_updating)
+        return;
+
+    m_scanProgress->setRange(0, qMax(found, processed));
+    m_scanProgress->setValue(processed);
+    statusBar()->showMessage(tr("Сканирование: обработано %1 из %2 (с GPS: %3)")
+                                 .arg(processed)
+                                 .arg(found)
+                                 .arg(m_gpsCount));
+}
 
-        assignFallbackCoords(info, counter);
-        loaded.append(info);
-        ++counter;
+void MainWindow::onScanFinished(int generation, bool cancelled)
+{
+    if (generation != m_scanner->generation())
+        return;
+    if (m_updating) {
+        finishUpdate(cancelled);
+        return;
     }
 
-    if (loaded.isEmpty()) {
-        statusBar()->showMessage(tr("В папке нет поддерживаемых изображений"), 4000);
+    m_stopButton->setVisible(false);
+    m_scanProgress->setVisible(false);
+    Tracer::instance().complete("scan", m_scanStart, Tracer::now() - m_scanStart, m_photos.size());
+
+    if (m_photos.isEmpty()) {
+        statusBar()->showMessage(cancelled
+                                 ? tr("Сканирование остановлено")
+                                 : tr("В папке нет поддерживаемых изображений"), 4000);
         return;
     }
 
-    m_currentRoot = path;
-    m_photos = loaded;
-    createMap();
+    // Пачки приходят в порядке готовности, поэтому в конце
+    // дерево перестраивается в выбранном порядке сортировки
+    m_spatial.build(m_photos);
+    m_sortIndex.build(m_photos);
+    m_duplicates.build(m_photos);
+    m_model->setDuplicates(collapseDuplicates() ? &m_duplicates : nullptr);
+    updateSearch();
+    if (collapseDuplicates() || hasSearch())
+        updateMapRange();
+    updateRoutes();
     populateTree();
+    if (!cancelled)
+        m_watcher->watch(m_currentRoot, m_photos);
+    if (m_hashPending) {
+        m_hashPending = false;
+        if (!cancelled)
+            hashMissingPhotos();
+    }
+
+    // Чтение по устройствам: видно, во что упирается сканирование
+    QStringList devices;
+    for (const IoScheduler::Stats &s : m_scanner->ioStats()) {
+        if (s.files > 0)
+            devices.append(tr("%1 %2 ф/с, занято потоков %3 из %4")
+                               .arg(IoScheduler::kindName(s.kind))
+                               .arg(s.filesPerSecond(), 0, 'f', 0)
+                               .arg(s.effectiveConcurrency(), 0, 'f', 1)
+                               .arg(s.concurrency));
+    }
     statusBar()->showMessage(
-        tr("Загружено %1 фото (с GPS: %2) из \"%3\"")
+        tr("%1 %2 фото (с GPS: %3, из каталога: %4, похожих: %5) из \"%6\"")
+            .arg(cancelled ? tr("Остановлено, загружено") : tr("Загружено"))
             .arg(m_photos.size())
-            .arg(std::count_if(m_photos.begin(), m_photos.end(), [](const PhotoInfo &p){ return p.latitude != 0.0 || p.longitude != 0.0; }))
-            .arg(QDir(path).dirName()),
+            .arg(m_gpsCount)
+            .arg(m_scanner->reusedCount())
+            .arg(m_duplicates.hiddenCount())
+            .arg(QDir(m_currentRoot).dirName())
+            + (devices.isEmpty() ? QString() : tr("; чтение: %1").arg(devices.join(QStringLiteral("; ")))),
         4000);
 }
 
@@ -243,132 +583,573 @@ void MainWindow::openDirectory()
     scanDirectory(dir);
 }
 
+QString MainWindow::rootTitle() const
+{
+    const QDir baseDir(m_currentRoot.isEmpty()
+                       ? QCoreApplication::applicationDirPath()
+                       : m_currentRoot);
+    return baseDir.dirName().isEmpty() ? tr("Фото") : baseDir.dirName();
+}
+
 void MainWindow::populateTree()
 {
     if (!m_tree)
         return;
-
-    m_tree->clear();
+    TraceSpan span("ui.populateTree");
 
     if (m_photos.isEmpty()) {
+        m_sortedOrder.clear();
+        m_model->setOrder(m_currentRoot, rootTitle(), QVector<int>());
         updatePreview(-1);
         return;
     }
 
-    QVector<int> indices;
-    indices.reserve(m_photos.size());
-    for (int i = 0; i < m_photos.size(); ++i)
-        indices.append(i);
+    m_sortedOrder = m_sortIndex.order(sortKey());
+    rebuildTree(true);
+}
+
+SortIndex::Key MainWindow::sortKey() const
+{
+    return SortIndex::Key(m_sortCombo->currentData().toInt());
+}
 
-    if (m_sortCombo->currentIndex() == 0) {
-        // Сортировка по времени
-        std::sort(indices.begin(), indices.end(),
-                  [&](int a, int b) {
-                      return m_photos[a].timestamp < m_photos[b].timestamp;
-                  });
-    } else {
-        // Сортировка по названию места
-        std::sort(indices.begin(), indices.end(),
-                  [&](int a, int b) {
-                      return QString::localeAwareCompare(
-                                 m_photos[a].locationName,
-                                 m_photos[b].locationName) < 0;
-                  });
-    }
-
-    const QString basePath = m_currentRoot.isEmpty()
-            ? QCoreApplication::applicationDirPath()
-            : m_currentRoot;
-    QDir baseDir(basePath);
-
-    auto *rootItem = new QTreeWidgetItem(QStringList(baseDir.dirName().isEmpty()
-                                                     ? tr("Фото")
-                                                     : baseDir.dirName()));
-    rootItem->setData(0, Qt::UserRole, QVariant());
-    m_tree->addTopLevelItem(rootItem);
-
-    QMap<QString, QTreeWidgetItem*> cache;
-    cache.insert(QString(), rootItem);
-    QTreeWidgetItem *firstPhotoItem = nullptr;
-
-    for (int idx : indices) {
-        const PhotoInfo &info = m_photos[idx];
-        const QString rel = baseDir.relativeFilePath(info.filePath);
-        const QStringList parts = rel.split(QDir::separator(), Qt::SkipEmptyParts);
-        QTreeWidgetItem *fileItem = ensureTreePath(parts, cache, rootItem, idx, QFileInfo(info.filePath).fileName());
-
-        if (!firstPhotoItem && fileItem) {
-            firstPhotoItem = fileItem;
+void MainWindow::onFolderChanged(const QStringList &added, const QStringList &modified,
+                                 const QStringList &removed)
+{
+    m_changedPaths += added;
+    m_changedPaths += modified;
+    m_removedPaths += removed;
+    // Во время обновления изменения копятся и применяются после него
+    if (!m_updating && !m_scanner->isRunning())
+        applyFolderChanges();
+}
+
+void MainWindow::applyFolderChanges()
+{
+    // Удаление: строка в m_photos остаётся надгробием (индексы не сдвигаются),
+    // а фото убирается из дерева, карты и индексов
+    // Путь, который пропал и снова появился, считается изменённым
+    const QSet<QString> changed(m_changedPaths.cbegin(), m_changedPaths.cend());
+    QSet<int> removedIds;
+    for (const QString &path : std::as_const(m_removedPaths)) {
+        const int id = m_photos.indexOf(path);
+        if (id < 0 || changed.contains(path))
+            continue;
+        removedIds.insert(id);
+    }
+    m_removedPaths.clear();
+
+    if (!removedIds.isEmpty()) {
+        QVector<int> ids;
+        ids.reserve(removedIds.size());
+        for (int id : std::as_const(removedIds)) {
+            m_model->removePhoto(id);
+            m_spatial.remove(id);
+            m_thumbnails.forget(m_photos.filePath(id));
+            if (m_photos.hasGps(id))
+                --m_gpsCount;
+            m_photos.remove(id);
+            m_timeIndex.remove(id);
+            ids.append(id);
+        }
+        m_mapBridge->hide(ids);
+        m_timeline->refresh();
+        m_sortIndex.update(m_photos, ids);
+        m_sortedOrder = m_sortIndex.order(sortKey());
+        updateDuplicates();
+        updateSearch();
+        updateRoutes();
+        statusBar()->showMessage(tr("Удалено фото: %1").arg(ids.size()), 4000);
+    }
+
+    if (m_changedPaths.isEmpty())
+        return;
+
+    // Новые и изменённые файлы перечитывает сканер; каталог записывается
+    // заново вместе с остальными фото корня
+    QStringList paths = m_changedPaths;
+    paths.removeDuplicates();
+    m_changedPaths.clear();
+    m_updating = true;
+    m_updatedIds.clear();
+    m_scanner->setTrackLog(m_trackLog);
+    m_scanner->update(m_currentRoot, paths, m_photos, int(m_photos.size()));
+}
+
+void MainWindow::applyUpdateBatch(const QVector<PhotoInfo> &photos)
+{
+    QVector<int> added;
+    QVector<int> moved;
+    for (const PhotoInfo &info : photos) {
+        int id = m_photos.indexOf(info.filePath);
+        if (id >= 0) {
+            // Изменённый файл: запись заменяется на месте
+            if (m_photos.hasGps(id))
+                --m_gpsCount;
+            m_photos.replace(id, info);
+            m_thumbnails.forget(info.filePath);
+            m_previewLoader->forget(id);
+            m_model->updatePhoto(id);
+            moved.append(id);
+        } else {
+            id = m_photos.append(info);
+            if (inTimeRange(id)) {
+                m_model->appendPhotos(id, id);
+                added.append(id);
+            }
         }
+        if (info.hasGps)
+            ++m_gpsCount;
+        m_spatial.insert(id, m_photos.latitude(id), m_photos.longitude(id));
+        m_timeIndex.insert(id, m_photos.taken(id));
+        m_updatedIds.append(id);
+    }
+    m_mapBridge->move(moved);
+    m_mapBridge->show(added);
+    m_timeline->refresh();
+}
+
+void MainWindow::finishUpdate(bool cancelled)
+{
+    m_updating = false;
+
+    // Обновлённые фото вливаются во все порядки слиянием,
+    // без полной пересортировки
+    if (!m_updatedIds.isEmpty()) {
+        m_sortIndex.update(m_photos, m_updatedIds);
+        m_sortedOrder = m_sortIndex.order(sortKey());
+        const QSet<int> updated(m_updatedIds.cbegin(), m_updatedIds.cend());
+        statusBar()->showMessage(tr("Обновлено фото: %1").arg(updated.size()), 4000);
     }
+    m_updatedIds.clear();
+
+    if (m_spatial.pendingChanges() > SpatialIndex::MaxPendingChanges)
+        m_spatial.build(m_photos);
+    updateDuplicates();
+    updateSearch();
+    updateRoutes();
+    // Новые фото добавлены в конец своих папок; с фильтром по карте
+    // дерево перестраивается, чтобы не показать фото вне области.
+    // Изменённое фото могло уйти из выбранного периода или найденных
+    // (при свёрнутых похожих карту уже обновил updateDuplicates)
+    if ((hasTimeRange() || hasSearch()) && !collapseDuplicates())
+        updateMapRange();
+    if (m_viewportFilter->isChecked() || hasTimeRange() || hasSearch())
+        m_filterTimer->start();
+
+    if (!cancelled && (!m_changedPaths.isEmpty() || !m_removedPaths.isEmpty()))
+        applyFolderChanges();
+}
 
-    m_tree->expandItem(rootItem);
-    if (firstPhotoItem) {
-        m_tree->setCurrentItem(firstPhotoItem);
+void MainWindow::applyFilters()
+{
+    rebuildTree(false);
+}
+
+void MainWindow::onTimeRangeChanged(const QDate &first, const QDate &last)
+{
+    m_rangeFirst = first;
+    m_rangeLast = last;
+    if (hasTimeRange()) {
+        m_rangeStart = first.startOfDay().toMSecsSinceEpoch();
+        m_rangeEnd = last.addDays(1).startOfDay().toMSecsSinceEpoch();
+        statusBar()->showMessage(tr("Период %1 - %2: фото %3")
+                                     .arg(first.toString("yyyy-MM-dd"), last.toString("yyyy-MM-dd"))
+                                     .arg(m_timeIndex.countBetween(first, last)),
+                                 4000);
     } else {
-        updatePreview(-1);
+        statusBar()->showMessage(tr("Фильтр по дате снят"), 2000);
     }
+    if (hasTimeRange())
+        m_mapBridge->setRouteRange(m_rangeStart, m_rangeEnd);
+    else
+        m_mapBridge->setRouteRange(std::numeric_limits<qint64>::min(), std::numeric_limits<qint64>::max());
+    updateMapRange();
+    rebuildTree(false);
 }
 
-void MainWindow::resortList()
+void MainWindow::importTracks()
 {
-    populateTree();
+    if (m_trackLoader) {
+        statusBar()->showMessage(tr("Треки ещё загружаются"), 3000);
+        return;
+    }
+    if (m_currentRoot.isEmpty() || (m_scanner->isRunning() && !m_updating)) {
+        statusBar()->showMessage(tr("Сначала дождитесь окончания сканирования папки"), 3000);
+        return;
+    }
+
+    const QStringList files = QFileDialog::getOpenFileNames(
+        this,
+        tr("Выберите GPS-треки"),
+        m_currentRoot,
+        tr("Треки GPX и NMEA (*.gpx *.nmea *.nma *.log *.txt);;Все файлы (*)"));
+    if (files.isEmpty())
+        return;
+
+    // EXIF хранит время без пояса, оно читается в поясе системы; поправка
+    // нужна, если часы камеры стояли в другом поясе или уходили
+    bool ok = false;
+    const int offset = QInputDialog::getInt(
+        this,
+        tr("Поправка часов камеры"),
+        tr("Сколько секунд прибавить к времени снимков, чтобы совпасть с треком:"),
+        0, -48 * 3600, 48 * 3600, 1, &ok);
+    if (!ok)
+        return;
+
+    // Журналы бывают в гигабайты: разбор в фоне, результат - в поток GUI
+    statusBar()->showMessage(tr("Загрузка треков..."));
+    m_trackLoader = QThread::create([this, files, offset]() {
+        auto log = std::make_shared<TrackLog>();
+        log->setClockOffset(qint64(offset) * 1000);
+        QString error;
+        log->load(files, &error);
+        QMetaObject::invokeMethod(this, [this, log, error]() {
+            onTracksLoaded(log, error);
+        }, Qt::QueuedConnection);
+    });
+    m_trackLoader->start();
+}
+
+void MainWindow::onTracksLoaded(const std::shared_ptr<const TrackLog> &log, const QString &error)
+{
+    m_trackLoader->wait();
+    delete m_trackLoader;
+    m_trackLoader = nullptr;
+
+    if (log->isEmpty()) {
+        statusBar()->showMessage(error.isEmpty() ? tr("В треках нет точек со временем")
+                                                 : tr("Не удалось загрузить треки: %1").arg(error),
+                                 6000);
+        return;
+    }
+    m_trackLog = log;
+
+    // Фото без GPS (и привязанные раньше) перечитываются обновлением, как
+    // изменённые файлы: сканер привяжет их, найдёт место и запишет каталог
+    for (int id = 0; id < m_photos.size(); ++id) {
+        if (!m_photos.isRemoved(id) && (!m_photos.hasGps(id) || m_photos.isGpsFromTrack(id)))
+            m_changedPaths.append(m_photos.filePath(id));
+    }
+    statusBar()->showMessage(tr("Треков: %1, точек: %2%3")
+                                 .arg(log->segmentCount())
+                                 .arg(log->pointCount())
+                                 .arg(error.isEmpty() ? QString() : tr("; ошибки: %1").arg(error)),
+                             6000);
+    if (!m_updating && !m_scanner->isRunning())
+        applyFolderChanges();
 }
 
-QTreeWidgetItem* MainWindow::ensureTreePath(const QStringList &parts,
-                                QMap<QString, QTreeWidgetItem*> &cache,
-                                QTreeWidgetItem *root,
-                                int photoIndex,
-                                const QString &fileName)
+void MainWindow::saveTrace()
 {
-    QTreeWidgetItem *parent = root;
-    QString currentKey;
-    QTreeWidgetItem *fileItem = nullptr;
+    const QString path = QFileDialog::getSaveFileName(
+        this,
+        tr("Сохранить трассу"),
+        QDir::home().filePath(QStringLiteral("geophotomap-trace.json")),
+        tr("Трасса Chrome/Perfetto (*.json)"));
+    if (path.isEmpty())
+        return;
 
-    if (parts.isEmpty())
-        return root;
+    QString error;
+    if (Tracer::instance().writeChromeJson(path, &error))
+        statusBar()->showMessage(tr("Трасса сохранена: событий %1").arg(Tracer::instance().eventCount()), 4000);
+    else
+        statusBar()->showMessage(tr("Не удалось сохранить трассу: %1").arg(error), 4000);
+}
 
-    for (int i = 0; i < parts.size(); ++i) {
-        const bool isLast = (i == parts.size() - 1);
-        const QString part = parts[i];
-        currentKey = currentKey.isEmpty() ? part : currentKey + "/" + part;
+void MainWindow::onTimelineResolutionChanged()
+{
+    m_timeline->setResolution(TimeIndex::Resolution(m_timelineResolution->currentData().toInt()));
+}
 
-        if (!isLast) {
-            if (!cache.contains(currentKey)) {
-                auto *dirItem = new QTreeWidgetItem(parent, QStringList(part));
-                dirItem->setData(0, Qt::UserRole, QVariant());
-                cache.insert(currentKey, dirItem);
-            }
-            parent = cache.value(currentKey);
+bool MainWindow::inTimeRange(int id) const
+{
+    if (!hasTimeRange())
+        return true;
+    const qint64 taken = m_photos.taken(id);
+    return taken != PhotoStore::NoTime && taken >= m_rangeStart && taken < m_rangeEnd;
+}
+
+bool MainWindow::collapseDuplicates() const
+{
+    return m_duplicateFilter->isChecked() && !m_duplicates.isEmpty();
+}
+
+void MainWindow::updateDuplicates()
+{
+    // Группировка идёт за секунды и на сотнях тысяч фото, поэтому после
+    // изменений в папке группы строятся заново, а не правятся точечно
+    const bool wasCollapsed = collapseDuplicates();
+    m_duplicates.build(m_photos);
+    m_model->setDuplicates(collapseDuplicates() ? &m_duplicates : nullptr);
+    if (wasCollapsed || collapseDuplicates()) {
+        updateMapRange();
+        m_filterTimer->start();
+    }
+}
+
+void MainWindow::onDuplicateFilterToggled(bool checked)
+{
+    // Хеш требует декодировать каждый новый файл, поэтому считается,
+    // только пока включено сворачивание похожих
+    m_scanner->setHasher(checked ? &PerceptualHash::ofFile : nullptr);
+    if (checked)
+        hashMissingPhotos();
+    m_model->setDuplicates(checked && !m_duplicates.isEmpty() ? &m_duplicates : nullptr);
+    if (checked && m_duplicates.isEmpty() && !m_scanner->isRunning())
+        statusBar()->showMessage(tr("Похожих снимков не найдено"), 3000);
+    updateMapRange();
+    rebuildTree(false);
+}
+
+void MainWindow::hashMissingPhotos()
+{
+    // Во время полного сканирования хранилище ещё не заполнено - после него
+    if (m_scanner->isRunning() && !m_updating) {
+        m_hashPending = true;
+        return;
+    }
+    // Фото без хеша перечитываются как изменённые: из каталога - без EXIF,
+    // с декодированием только ради хеша
+    for (int id = 0; id < m_photos.size(); ++id) {
+        if (!m_photos.isRemoved(id) && !m_photos.hasHash(id))
+            m_changedPaths.append(m_photos.filePath(id));
+    }
+    // Идущее обновление применит их, когда закончится
+    if (!m_updating && !m_changedPaths.isEmpty())
+        applyFolderChanges();
+}
+
+void MainWindow::updateRoutes()
+{
+    // Как и группы похожих, маршруты после изменений строятся заново
+    if (!m_routeMode->isChecked())
+        return;
+    m_routes.build(m_photos);
+    m_mapBridge->setRoutes(&m_routes);
+}
+
+void MainWindow::onRouteModeToggled(bool checked)
+{
+    if (!checked) {
+        m_mapBridge->setRoutes(nullptr);
+        m_routes.clear();
+        return;
+    }
+    updateRoutes();
+    if (m_routes.isEmpty() && !m_scanner->isRunning() && !m_photos.isEmpty())
+        statusBar()->showMessage(tr("Нет снимков с GPS и временем съёмки для маршрутов"), 3000);
+    else if (!m_routes.isEmpty())
+        statusBar()->showMessage(tr("Поездок: %1, точек: %2")
+                                     .arg(m_routes.tripCount())
+                                     .arg(m_routes.vertexCount()),
+                                 3000);
+}
+
+void MainWindow::updateSearch()
+{
+    // Как и группы похожих, индекс после изменений строится заново;
+    // без запроса он не нужен и строится при первом поиске
+    if (m_searchQuery.isEmpty()) {
+        m_search.clear();
+        m_searchResult.clear();
+        return;
+    }
+    m_search.build(m_photos);
+    m_searchResult = m_search.find(m_photos, m_searchQuery);
+}
+
+void MainWindow::runSearch()
+{
+    m_searchTimer->stop();
+    SearchQuery query;
+    QString error;
+    if (!SearchQuery::parse(m_searchEdit->text(), query, &error)) {
+        statusBar()->showMessage(tr("Непонятный запрос: %1").arg(error), 4000);
+        return;
+    }
+    const bool wasActive = hasSearch();
+    m_searchQuery = query;
+    if (query.isEmpty()) {
+        m_searchResult.clear();
+    } else if (m_scanner->isRunning() && !m_updating) {
+        // Как и фильтр по карте, поиск включается по окончании сканирования
+        statusBar()->showMessage(tr("Поиск заработает, когда закончится сканирование"), 3000);
+    } else {
+        const qint64 start = Tracer::now();
+        if (m_search.isEmpty())
+            m_search.build(m_photos);
+        m_searchResult = m_search.find(m_photos, m_searchQuery);
+        statusBar()->showMessage(tr("Найдено фото: %1 (%2 мс)")
+                                     .arg(m_searchResult.size())
+                                     .arg((Tracer::now() - start) / 1000000),
+                                 3000);
+    }
+    if (!wasActive && !hasSearch())
+        return;
+    updateMapRange();
+    rebuildTree(false);
+}
+
+void MainWindow::updateMapRange()
+{
+    const bool collapse = collapseDuplicates();
+    const bool search = hasSearch();
+    if (collapse || search) {
+        // Группа похожих - одна отметка (представитель группы);
+        // при поиске на карте только найденные
+        QVector<int> ids;
+        if (hasTimeRange()) {
+            ids = m_timeIndex.photosBetween(m_rangeFirst, m_rangeLast);
+        } else if (search) {
+            ids = m_searchResult.toVector();
         } else {
-            fileItem = new QTreeWidgetItem(parent, QStringList(part));
-            fileItem->setData(0, Qt::UserRole, photoIndex);
-
-            const PhotoInfo &info = m_photos[photoIndex];
-            QPixmap icon = loadThumbnail(info.filePath, m_tree->iconSize(), fileName);
-            fileItem->setIcon(0, QIcon(icon));
-            fileItem->setToolTip(0, tr("%1\n%2\nШирота: %3\nДолгота: %4")
-                                    .arg(info.locationName.isEmpty() ? part : info.locationName)
-                                    .arg(info.timestamp.toString("yyyy-MM-dd hh:mm"))
-                                    .arg(info.latitude, 0, 'f', 4)
-                                    .arg(info.longitude, 0, 'f', 4));
-
-            cache.insert(currentKey, fileItem);
+            ids.reserve(m_photos.size());
+            for (int id = 0; id < m_photos.size(); ++id)
+                ids.append(id);
         }
+        ids.removeIf([this, collapse, search](int id) {
+            return m_photos.isRemoved(id) || (collapse && m_duplicates.isHidden(id))
+                    || (search && !m_searchResult.contains(id));
+        });
+        m_mapBridge->showOnly(ids);
+        return;
     }
+    // Снятый фильтр возвращает все фото: show() пропускает уже показанные и удалённые
+    if (hasTimeRange())
+        m_mapBridge->showOnly(m_timeIndex.photosBetween(m_rangeFirst, m_rangeLast));
+    else
+        m_mapBridge->showRange(0, int(m_photos.size()) - 1);
+}
 
-    return fileItem;
+void MainWindow::onMapViewportChanged(double west, double south, double east, double north)
+{
+    m_viewWest = west;
+    m_viewSouth = south;
+    m_viewEast = east;
+    m_viewNorth = north;
+    if (m_viewportFilter->isChecked())
+        m_filterTimer->start();
+}
+
+QVector<int> MainWindow::visibleOrder() const
+{
+    // Индекс строится по окончании сканирования; до этого фильтр по карте не действует
+    const bool byView = m_viewportFilter->isChecked() && !m_spatial.isEmpty();
+    const bool collapse = collapseDuplicates();
+    const bool search = hasSearch();
+    if (!byView && !hasTimeRange() && !collapse && !search)
+        return m_sortedOrder;
+
+    QVector<bool> inView;
+    if (byView) {
+        inView.fill(false, m_photos.size());
+        for (int id : m_spatial.within(m_viewWest, m_viewSouth, m_viewEast, m_viewNorth))
+            inView[id] = true;
+    }
+
+    const auto hidden = [&](int id) {
+        return (byView && !inView[id]) || (collapse && m_duplicates.isHidden(id))
+                || (search && !m_searchResult.contains(id));
+    };
+    // Немного найденных дешевле отсортировать, чем пройти весь порядок
+    const bool fewFound = search && m_searchResult.size() < m_sortedOrder.size() / 8;
+    if (hasTimeRange() || fewFound) {
+        // Фото выбранных дней берутся из индекса дат (O(дней + результатов)),
+        // найденные - из результата поиска; раскладываются в текущем порядке сортировки
+        QVector<int> order = hasTimeRange() ? m_timeIndex.photosBetween(m_rangeFirst, m_rangeLast)
+                                            : m_searchResult.toVector();
+        order.removeIf(hidden);
+        m_sortIndex.sortSubset(sortKey(), order);
+        return order;
+    }
+
+    QVector<int> order;
+    order.reserve(m_sortedOrder.size());
+    for (int id : m_sortedOrder) {
+        if (!hidden(id))
+            order.append(id);
+    }
+    return order;
+}
+
+void MainWindow::rebuildTree(bool selectFirst)
+{
+    TraceSpan span("ui.rebuildTree");
+    m_filterTimer->stop();
+
+    const QVector<int> order = visibleOrder();
+
+    const QVariant selected = m_tree->currentIndex().data(Qt::UserRole);
+
+    // Модель раскладывает папки лениво, поэтому здесь только передаётся порядок
+    m_model->setOrder(m_currentRoot, rootTitle(), order);
+    m_tree->expand(m_model->rootIndex());
+    updateCacheStats();
+
+    if (order.isEmpty()) {
+        updatePreview(-1);
+        return;
+    }
+
+    if (!selectFirst) {
+        // Фильтр по карте не должен сдвигать карту: выбранное фото
+        // восстанавливается без центрирования, иначе пан вызывал бы новый пан
+        const QModelIndex previous = selected.isValid()
+                ? m_model->indexForPhoto(selected.toInt())
+                : QModelIndex();
+        if (previous.isValid()) {
+            m_restoringSelection = true;
+            m_tree->setCurrentIndex(previous);
+            m_restoringSelection = false;
+        }
+        return;
+    }
+
+    const QModelIndex firstPhoto = m_model->indexForPhoto(order.first());
+    if (firstPhoto.isValid()) {
+        m_tree->scrollTo(firstPhoto);
+        m_tree->setCurrentIndex(firstPhoto);
+    } else {
+        updatePreview(-1);
+    }
+}
+
+void MainWindow::resortList()
+{
+    if (m_photos.isEmpty())
+        return;
+
+    // Во время сканирования порядок строится по уже полученным фото,
+    // во время обновления - с учётом ещё не влитых изменений
+    if (m_scanner->isRunning() && !m_updating)
+        m_sortIndex.build(m_photos);
+    else if (m_updating)
+        m_sortIndex.update(m_photos, m_updatedIds);
+    m_sortedOrder = m_sortIndex.order(sortKey());
+
+    // Набор фото в дереве тот же: строки переставляются на месте, раскрытые
+    // папки, выделение и миниатюры остаются. Иначе (ждёт фильтр) - перестройка
+    if (!m_filterTimer->isActive() && m_model->reorder(visibleOrder())) {
+        m_tree->scrollTo(m_tree->currentIndex());
+        return;
+    }
+    rebuildTree(false);
 }
 
 void MainWindow::onTreeSelectionChanged()
 {
-    QTreeWidgetItem *item = m_tree->currentItem();
-    if (!item) {
+    if (m_restoringSelection)
+        return;
+
+    const QModelIndex current = m_tree->currentIndex();
+    if (!current.isValid()) {
         updatePreview(-1);
         return;
     }
 
-    QVariant data = item->data(0, Qt::UserRole);
+    QVariant data = current.data(Qt::UserRole);
     if (!data.isValid()) {
         updatePreview(-1);
         return;
@@ -377,6 +1158,7 @@ void MainWindow::onTreeSelectionChanged()
     const int photoIndex = data.toInt();
     centerOnMarker(photoIndex);
     updatePreview(photoIndex);
+    prefetchPreviews(current);
 }
 
 void MainWindow::updatePreview(int photoIndex)
@@ -385,40 +1167,115 @@ void MainWindow::updatePreview(int photoIndex)
         return;
     }
 
-    if (photoIndex < 0 || photoIndex >= m_photos.size()) {
-        m_previewImage->setPixmap(placeholderThumbnail(QSize(520, 320), tr("Нет фото")));
+    // Запросы прежнего выделения больше не нужны; уже начатые декодирования
+    // доработают в кэш, а их результат отсеется по поколению
+    m_previewLoader->clear();
+    m_previewPhoto = -1;
+
+    if (photoIndex < 0 || photoIndex >= m_photos.size() || m_photos.isRemoved(photoIndex)) {
+        m_previewImage->setPixmap(placeholderThumbnail(PreviewSize, tr("Нет фото")));
         m_previewCaption->setText(tr("Выберите снимок в списке слева, чтобы увидеть превью."));
         return;
     }
 
-    const PhotoInfo &info = m_photos[photoIndex];
-    const QString name = info.locationName.isEmpty()
+    const QString location = m_photos.locationName(photoIndex);
+    const QString name = location.isEmpty()
             ? tr("Без названия")
-            : info.locationName;
+            : location;
     const QString coords = tr("Широта: %1, Долгота: %2")
-                               .arg(info.latitude, 0, 'f', 4)
-                               .arg(info.longitude, 0, 'f', 4);
+                               .arg(m_photos.latitude(photoIndex), 0, 'f', 4)
+                               .arg(m_photos.longitude(photoIndex), 0, 'f', 4);
 
-    QPixmap pix = loadThumbnail(info.filePath, QSize(520, 320), name);
-    m_previewImage->setPixmap(pix);
     m_previewCaption->setText(QString("%1\n%2\n%3")
                                   .arg(name)
-                                  .arg(info.timestamp.toString("yyyy-MM-dd hh:mm"))
+                                  .arg(m_photos.timestamp(photoIndex).toString("yyyy-MM-dd hh:mm"))
                                   .arg(coords));
+
+    const QString path = m_photos.filePath(photoIndex);
+    const QImage ready = m_thumbnails.cached(path, PreviewSize);
+    if (!ready.isNull()) {
+        m_previewImage->setPixmap(QPixmap::fromImage(ready));
+        updateCacheStats();
+        return;
+    }
+
+    // Пока превью декодируется - растянутая миниатюра из списка, если она уже есть
+    const QImage icon = m_thumbnails.cached(path, m_tree->iconSize());
+    if (!icon.isNull())
+        m_previewImage->setPixmap(QPixmap::fromImage(
+            icon.scaled(PreviewSize, Qt::KeepAspectRatio, Qt::FastTransformation)));
+    else
+        m_previewImage->setPixmap(placeholderThumbnail(PreviewSize, tr("Загрузка...")));
+
+    m_previewPhoto = photoIndex;
+    m_previewLoader->request(photoIndex, path, PreviewSize, ThumbnailLoader::Visible);
 }
 
-QPixmap MainWindow::loadThumbnail(const QString &path, const QSize &size,
-                                  const QString &fallbackText) const
+void MainWindow::prefetchPreviews(const QModelIndex &current)
 {
-    const QSize target(qMax(64, size.width()), qMax(48, size.height()));
+    // Соседи в порядке дерева, то есть в текущей сортировке; папки пропускаются
+    QModelIndex below = current;
+    QModelIndex above = current;
+    int belowLeft = PreviewPrefetch;
+    int aboveLeft = PreviewPrefetch;
+    for (int step = 0; step < 4 * PreviewPrefetch && (belowLeft > 0 || aboveLeft > 0); ++step) {
+        if (belowLeft > 0 && (below = m_tree->indexBelow(below)).isValid()) {
+            const QVariant data = below.data(Qt::UserRole);
+            if (data.isValid()) {
+                m_previewLoader->request(data.toInt(), m_photos.filePath(data.toInt()),
+                                         PreviewSize, ThumbnailLoader::Prefetch);
+                --belowLeft;
+            }
+        } else {
+            belowLeft = 0;
+        }
+        if (aboveLeft > 0 && (above = m_tree->indexAbove(above)).isValid()) {
+            const QVariant data = above.data(Qt::UserRole);
+            if (data.isValid()) {
+                m_previewLoader->request(data.toInt(), m_photos.filePath(data.toInt()),
+                                         PreviewSize, ThumbnailLoader::Prefetch);
+                --aboveLeft;
+            }
+        } else {
+            aboveLeft = 0;
+        }
+    }
+}
 
-    QPixmap pixmap;
-    if (!path.isEmpty() && QFile::exists(path) && pixmap.load(path)) {
-        return pixmap.scaled(target, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+void MainWindow::onPreviewLoaded(int generation, int photoIndex, const QImage &image)
+{
+    // Предзагруженные соседи уже лежат в кэше; показывать их не нужно
+    if (generation != m_previewLoader->generation() || photoIndex != m_previewPhoto)
+        return;
+    m_previewPhoto = -1;
+
+    if (image.isNull()) {
+        const QString location = m_photos.locationName(photoIndex);
+        m_previewImage->setPixmap(placeholderThumbnail(
+            PreviewSize, location.isEmpty() ? tr("Без названия") : location));
+    } else {
+        m_previewImage->setPixmap(QPixmap::fromImage(image));
     }
+    updateCacheStats();
+}
 
-    const QString text = fallbackText.isEmpty() ? tr("Нет файла") : fallbackText;
-    return placeholderThumbnail(target, text);
+void MainWindow::updateCacheStats()
+{
+    const ThumbnailCache::Stats s = m_thumbnails.stats();
+    m_cacheLabel->setText(tr("Миниатюры: %1 МБ, попаданий %2%")
+                              .arg(double(s.memoryBytes) / (1024.0 * 1024.0), 0, 'f', 1)
+                              .arg(qRound(s.hitRate() * 100.0)));
+    m_cacheLabel->setToolTip(tr("В памяти: %1 из %2 МБ (%3 шт.)\n"
+                                "Из памяти: %4, с диска: %5\n"
+                                "Встроенное EXIF-превью: %6, декодировано: %7, ошибок: %8")
+                                 .arg(double(s.memoryBytes) / (1024.0 * 1024.0), 0, 'f', 1)
+                                 .arg(double(s.memoryLimit) / (1024.0 * 1024.0), 0, 'f', 0)
+                                 .arg(s.memoryEntries)
+                                 .arg(s.memoryHits)
+                                 .arg(s.diskHits)
+                                 .arg(s.exifHits)
+                                 .arg(s.decodes)
+                                 .arg(s.failures));
 }
 
 QPixmap MainWindow::placeholderThumbnail(const QSize &size, const QString &text) const
@@ -447,24 +1304,12 @@ QPixmap MainWindow::placeholderThumbnail(const QSize &size, const QString &text)
 
 QString MainWindow::buildMapHtml() const
 {
-    QJsonArray arr;
-    for (int i = 0; i < m_photos.size(); ++i) {
-        const PhotoInfo &info = m_photos[i];
-        QJsonObject obj;
-        obj["id"] = i;
-        obj["lat"] = info.latitude;
-        obj["lng"] = info.longitude;
-        obj["title"] = info.locationName.isEmpty()
-                ? QFileInfo(info.filePath).fileName()
-                : info.locationName;
-        obj["subtitle"] = info.timestamp.toString("yyyy-MM-dd hh:mm");
-        if (!info.filePath.isEmpty() && QFile::exists(info.filePath)) {
-            obj["image"] = QUrl::fromLocalFile(info.filePath).toString();
-        }
-        arr.append(obj);
-    }
-
-    const QString data = QString::fromUtf8(QJsonDocument(arr).toJson(QJsonDocument::Compact));
+    // qwebchannel.js встроен в модуль QtWebChannel; вставляем его в страницу,
+    // чтобы не зависеть от доступа к qrc: со страницы схемы gpm:
+    QFile channelJs(QStringLiteral(":/qtwebchannel/qwebchannel.js"));
+    const QString channelScript = channelJs.open(QIODevice::ReadOnly)
+            ? QString::fromUtf8(channelJs.readAll())
+            : QString();
 
     const QString html = QStringLiteral(R"(
 <!doctype html>
@@ -472,144 +1317,194 @@ QString MainWindow::buildMapHtml() const
 <head>
   <meta charset="utf-8">
   <title>GeoPhotoMap</title>
-  <link rel="stylesheet" href="https://unpkg.com/leaflet@1.9.4/dist/leaflet.css" />
+  <link rel="stylesheet" href="leaflet/leaflet.css" />
   <style>
     html, body, #map { margin: 0; padding: 0; width: 100%; height: 100%; background: #0f131b; }
     .leaflet-container { background: #0f131b; color: #e9ecf2; }
     .popup-img { max-width: 220px; border-radius: 8px; margin-top: 6px; }
     .leaflet-popup-content { color: #e9ecf2; }
     .leaflet-popup-content-wrapper { background: #161c26; color: #e9ecf2; border: 1px solid #2a3242; }
+    .cluster { display: flex; align-items: center; justify-content: center; border-radius: 50%;
+               background: rgba(59, 169, 255, 0.75); border: 2px solid #0f131b;
+               color: #0b1016; font: 600 12px 'Segoe UI', sans-serif; }
+    .photo-marker { border-radius: 50%; background: #3ba9ff; border: 2px solid #0f131b;
+                    box-shadow: 0 0 0 1px rgba(59, 169, 255, 0.5); }
   </style>
 </head>
 <body>
   <div id="map"></div>
-  <script src="https://unpkg.com/leaflet@1.9.4/dist/leaflet.js"></script>
+  <script src="leaflet/leaflet.js"></script>
+  <script>%1</script>
   <script>
     const map = L.map('map', { worldCopyJump: true }).setView([20, 0], 2);
-    L.tileLayer('https://{s}.tile.openstreetmap.org/{z}/{x}/{y}.png', {
+    L.tileLayer('%3', {
       maxZoom: 19,
       attribution: '&copy; OpenStreetMap'
     }).addTo(map);
 
-    const markersData = %1;
-    const markers = [];
+    // Маршруты рисуются на canvas: тысячи вершин без узлов SVG
+    const routeLayer = L.polyline([], {
+      renderer: L.canvas(), color: '#ff9f43', weight: 3, opacity: 0.8, interactive: false
+    }).addTo(map);
+    // Тайлы плотности рисует C++; {v} - версия данных, сбрасывает кэш браузера
+    const heatLayer = L.tileLayer('%4', { v: 0, maxZoom: %5, zIndex: 10 });
+    const layer = L.layerGroup().addTo(map);
+    const clusterLayer = L.layerGroup().addTo(map);
+    const markers = new Map();
+    let bridge = null;
+    let pendingPopup = -1;
+
+    // Пачки от C++: base64 с Int32 (id) и парами Float32 (lat, lng), little-endian
+    function decode(b64) {
+      const bin = atob(b64);
+      const bytes = new Uint8Array(bin.length);
+      for (let i = 0; i < bin.length; ++i) bytes[i] = bin.charCodeAt(i);
+      return new DataView(bytes.buffer);
+    }
 
-    markersData.forEach(m => {
-      if (typeof m.lat !== 'number' || typeof m.lng !== 'number') return;
-      const popupHtml = `<b>${m.title || 'Фото'}</b><br>${m.subtitle || ''}` +
-        (m.image ? `<br><img class="popup-img" src="${m.image}" />` : '');
-      const marker = L.marker([m.lat, m.lng]).addTo(map).bindPopup(popupHtml);
-      marker.photoId = m.id;
-      markers.push(marker);
-    });
+    function forEachMarker(ids, coords, fn) {
+      const idView = decode(ids);
+      const posView = coords ? decode(coords) : null;
+      const count = idView.byteLength / 4;
+      for (let i = 0; i < count; ++i) {
+        const id = idView.getInt32(i * 4, true);
+        if (posView)
+          fn(id, posView.getFloat32(i * 8, true), posView.getFloat32(i * 8 + 4, true));
+        else
+          fn(id);
+      }
+    }
+
+    // Свой значок вместо стандартного: картинки Leaflet в ресурсы не кладутся
+    const photoIcon = L.divIcon({ className: 'photo-marker', iconSize: [14, 14] });
+
+    function addMarker(id, lat, lng) {
+      const old = markers.get(id);
+      if (old) layer.removeLayer(old);
+      const marker = L.marker([lat, lng], { icon: photoIcon });
+      marker.photoId = id;
+      marker.on('click', () => { if (bridge) bridge.markerClicked(id); });
+      layer.addLayer(marker);
+      markers.set(id, marker);
+      if (id === pendingPopup) openPopup(id);
+    }
+
+    // Кластеры приходят целиком для текущего окна карты
+    function setClusters(coords, counts) {
+      clusterLayer.clearLayers();
+      const posView = decode(coords);
+      const countView = decode(counts);
+      const total = countView.byteLength / 4;
+      for (let i = 0; i < total; ++i) {
+        const count = countView.getInt32(i * 4, true);
+        const pos = [posView.getFloat32(i * 8, true), posView.getFloat32(i * 8 + 4, true)];
+        const size = Math.round(28 + 8 * Math.log10(count));
+        const icon = L.divIcon({
+          html: `<div class="cluster" style="width:${size}px;height:${size}px">${count}</div>`,
+          className: '', iconSize: [size, size]
+        });
+        L.marker(pos, { icon: icon })
+          .on('click', () => map.flyTo(pos, Math.min(map.getZoom() + 2, map.getMaxZoom())))
+          .addTo(clusterLayer);
+      }
+    }
+
+    // Линии целиком для текущего зума: Float32 (lat, lng) подряд и Int32 длины линий
+    function setRoutes(coords, lengths) {
+      const posView = decode(coords);
+      const lengthView = decode(lengths);
+      const lines = [];
+      let offset = 0;
+      for (let i = 0; i < lengthView.byteLength / 4; ++i) {
+        const count = lengthView.getInt32(i * 4, true);
+        const line = new Array(count);
+        for (let j = 0; j < count; ++j, offset += 8)
+          line[j] = [posView.getFloat32(offset, true), posView.getFloat32(offset + 4, true)];
+        lines.push(line);
+      }
+      routeLayer.setLatLngs(lines);
+    }
+
+    function setHeatmap(version) {
+      if (version < 0) {
+        heatLayer.remove();
+        return;
+      }
+      heatLayer.options.v = version;
+      if (map.hasLayer(heatLayer))
+        heatLayer.redraw();
+      else
+        heatLayer.addTo(map);
+    }
+
+    function reportViewport() {
+      const b = map.getBounds();
+      bridge.setViewport(b.getWest(), b.getSouth(), b.getEast(), b.getNorth(), map.getZoom());
+    }
 
-    window.centerOn = function(id) {
-      const marker = markers.find(m => m.photoId === id);
+    function removeMarker(id) {
+      const marker = markers.get(id);
       if (!marker) return;
-      const pos = marker.getLatLng();
-      map.flyTo(pos, Math.max(map.getZoom(), 5), { duration: 0.6 });
-      marker.openPopup();
-    };
+      layer.removeLayer(marker);
+      markers.delete(id);
+    }
+
+    // Выбранное фото может быть внутри кластера: приближаемся до уровня
+    // отдельных маркеров, подпись откроется, когда маркер придёт от C++
+    function centerOn(id, lat, lng) {
+      pendingPopup = id;
+      map.flyTo([lat, lng], Math.max(map.getZoom(), %2), { duration: 0.6 });
+      if (markers.has(id)) openPopup(id);
+    }
+
+    function openPopup(id) {
+      const marker = markers.get(id);
+      if (!marker) return;
+      pendingPopup = -1;
+      // Подпись запрашивается только для открываемого маркера
+      bridge.popup(id, (m) => {
+        if (markers.get(id) !== marker) return;
+        const popupHtml = `<b>${m.title || 'Фото'}</b><br>${m.subtitle || ''}` +
+          (m.image ? `<br><img class="popup-img" src="${m.image}" />` : '');
+        marker.bindPopup(popupHtml).openPopup();
+      });
+    }
+
+    new QWebChannel(qt.webChannelTransport, (channel) => {
+      bridge = channel.objects.bridge;
+      bridge.markersAdded.connect((ids, coords) => forEachMarker(ids, coords, addMarker));
+      bridge.markersMoved.connect((ids, coords) => forEachMarker(ids, coords, (id, lat, lng) => {
+        const marker = markers.get(id);
+        if (marker) marker.setLatLng([lat, lng]);
+      }));
+      bridge.markersRemoved.connect((ids) => forEachMarker(ids, null, removeMarker));
+      bridge.markersCleared.connect(() => {
+        layer.clearLayers();
+        clusterLayer.clearLayers();
+        markers.clear();
+      });
+      bridge.clustersChanged.connect(setClusters);
+      bridge.routesChanged.connect(setRoutes);
+      bridge.heatmapChanged.connect(setHeatmap);
+      bridge.selectionChanged.connect(centerOn);
+      map.on('moveend', reportViewport);
+      reportViewport();
+      bridge.pageReady();
+    });
   </script>
 </body>
 </html>
-)").arg(data);
+)").arg(channelScript, QString::number(MarkerClusterer::MaxClusterZoom + 1),
+           MapSchemeHandler::tileUrlTemplate(), MapSchemeHandler::heatTileUrlTemplate(),
+           QString::number(HeatmapRenderer::MaxZoom));
 
     return html;
 }
 
 void MainWindow::centerOnMarker(int index)
 {
-    if (!m_mapView || index < 0)
-        return;
-
-    m_mapView->page()->runJavaScript(QStringLiteral("centerOn(%1);").arg(index));
-}
-
-void MainWindow::assignFallbackCoords(PhotoInfo &info, int seed) const
-{
-    if (info.latitude != 0.0 || info.longitude != 0.0)
+    if (!m_mapBridge || index < 0)
         return;
 
-    // Детеминированное распределение по миру, чтобы отметки были видны даже без GPS
-    const quint32 h = qHash(info.filePath) ^ quint32(seed * 2654435761U);
-    const double lon = (double(h % 360000) / 1000.0) - 180.0;      // -180..180
-    const double lat = (double((h / 360000) % 160000) / 1000.0) - 80.0; // -80..80
-    info.latitude = lat;
-    info.longitude = lon;
-}
-
-bool MainWindow::parseExifCoord(const QString &value, const QString &ref, double &result)
-{
-    // value examples: "55/1 45/1 1234/100" или "55 45 12.34"
-    const QStringList tokens = value.split(QRegularExpression("[ ,]+"), Qt::SkipEmptyParts);
-    if (tokens.size() < 2)
-        return false;
-
-    auto toDouble = [](const QString &token) -> double {
-        const QStringList frac = token.split('/');
-        if (frac.size() == 2 && frac[1].toDouble() != 0.0)
-            return frac[0].toDouble() / frac[1].toDouble();
-        return token.toDouble();
-    };
-
-    const double deg = toDouble(tokens.value(0));
-    const double min = toDouble(tokens.value(1));
-    const double sec = toDouble(tokens.value(2, QStringLiteral("0")));
-
-    result = deg + (min / 60.0) + (sec / 3600.0);
-    const QString refUp = ref.trimmed().toUpper();
-    if (refUp == "S" || refUp == "W")
-        result = -result;
-    return true;
-}
-
-bool MainWindow::extractGpsFromExif(const QString &path, double &lat, double &lng) const
-{
-    try {
-        // 1. Через QImageReader::text (если Qt собран с Exiv2)
-        QImageReader reader(path);
-        const QStringList keys = reader.textKeys();
-        if (!keys.isEmpty()) {
-            auto findKey = [&](const QStringList &names) -> QString {
-                for (const QString &k : keys) {
-                    for (const QString &n : names) {
-                        if (k.compare(n, Qt::CaseInsensitive) == 0)
-                            return reader.text(k);
-                    }
-                }
-                return QString();
-            };
-
-            QString latRef = findKey({QStringLiteral("Exif.GPSInfo.GPSLatitudeRef"),
-                                      QStringLiteral("GPSLatitudeRef"),
-                                      QStringLiteral("Exif.GPSLatitudeRef")});
-            QString latVal = findKey({QStringLiteral("Exif.GPSInfo.GPSLatitude"),
-                                      QStringLiteral("GPSLatitude"),
-                                      QStringLiteral("Exif.GPSLatitude")});
-            QString lngRef = findKey({QStringLiteral("Exif.GPSInfo.GPSLongitudeRef"),
-                                      QStringLiteral("GPSLongitudeRef"),
-                                      QStringLiteral("Exif.GPSLongitudeRef")});
-            QString lngVal = findKey({QStringLiteral("Exif.GPSInfo.GPSLongitude"),
-                                      QStringLiteral("GPSLongitude"),
-                                      QStringLiteral("Exif.GPSLongitude")});
-
-            if (!latVal.isEmpty() && !lngVal.isEmpty()) {
-                if (latRef.isEmpty()) latRef = QStringLiteral("N");
-                if (lngRef.isEmpty()) lngRef = QStringLiteral("E");
-
-                double outLat = 0.0, outLng = 0.0;
-                if (parseExifCoord(latVal, latRef, outLat) && parseExifCoord(lngVal, lngRef, outLng)) {
-                    lat = outLat;
-                    lng = outLng;
-                    return true;
-                }
-            }
-        }
-
-        // 2. Безопасный выход: не удалось прочитать GPS
-        return false;
-    } catch (...) {
-        return false;
-    }
+    m_mapBridge->select(index);
 }
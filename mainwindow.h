@@ -3,25 +3,41 @@
 
 #include <QMainWindow>
 #include <QLabel>
-#include <QTreeWidget>
+#include <QTreeView>
 #include <QComboBox>
 #include <QPushButton>
-#include <QMap>
 #include <QVector>
+#include <QHash>
+#include <QStringList>
 #include <QDateTime>
 #include <QPixmap>
 #include <QWebEngineView>
 #include <QImageReader>
+#include <memory>
 
-// Информация об одной фотографии
-struct PhotoInfo
-{
-    QString filePath;      // путь к файлу фото (может быть пустой)
-    double latitude;       // широта  (-90..90)
-    double longitude;      // долгота (-180..180)
-    QDateTime timestamp;   // время съёмки
-    QString locationName;  // название места
-};
+#include "duplicateindex.h"
+#include "photoinfo.h"
+#include "photostore.h"
+#include "routeindex.h"
+#include "searchindex.h"
+#include "sortindex.h"
+#include "spatialindex.h"
+#include "timeindex.h"
+#include "thumbnailcache.h"
+
+class QProgressBar;
+class QCheckBox;
+class QLineEdit;
+class QTimer;
+class PhotoScanner;
+class FolderWatcher;
+class PhotoTreeModel;
+class MapBridge;
+class MapSchemeHandler;
+class TimelineWidget;
+class ThumbnailLoader;
+class TrackLog;
+class QThread;
 
 class MainWindow : public QMainWindow
 {
@@ -29,40 +45,120 @@ class MainWindow : public QMainWindow
 
 public:
     explicit MainWindow(QWidget *parent = nullptr);
+    ~MainWindow() override;
 
 private slots:
     void resortList();                 // пересортировать список (по времени/месту)
     void onTreeSelectionChanged();     // подсветить соответствующий маркер
     void openDirectory();              // выбрать директорию с фото
+    void cancelScan();                 // остановить текущее сканирование
+    void onScanBatch(int generation, const QVector<PhotoInfo> &photos);
+    void onScanProgress(int generation, int processed, int found);
+    void onScanFinished(int generation, bool cancelled);
+    void onMapLoadFinished(bool ok);
+    void onMarkerActivated(int photoIndex);   // клик по маркеру на карте
+    void onMapViewportChanged(double west, double south, double east, double north);
+    void applyFilters();                      // перестроить дерево с учётом фильтров
+    void onTimeRangeChanged(const QDate &first, const QDate &last);
+    void onTimelineResolutionChanged();
+    void onDuplicateFilterToggled(bool checked);
+    void onRouteModeToggled(bool checked);    // линии поездок на карте
+    void runSearch();                         // применить строку поиска к списку и карте
+    void importTracks();                      // привязка фото без GPS к GPX/NMEA-трекам
+    void onPreviewLoaded(int generation, int photoIndex, const QImage &image);
+    void saveTrace();                         // выгрузка трассы для chrome://tracing
+    void onFolderChanged(const QStringList &added, const QStringList &modified,
+                         const QStringList &removed);
 
 private:
     QWebEngineView *m_mapView = nullptr;
-    QTreeWidget *m_tree = nullptr;
+    MapBridge *m_mapBridge = nullptr;
+    MapSchemeHandler *m_mapScheme = nullptr;
+    QTreeView *m_tree = nullptr;
+    PhotoTreeModel *m_model = nullptr;
     QPushButton *m_openButton = nullptr;
+    QPushButton *m_stopButton = nullptr;
+    QProgressBar *m_scanProgress = nullptr;
+    QLabel *m_cacheLabel = nullptr;
     QComboBox *m_sortCombo = nullptr;
+    QLineEdit *m_searchEdit = nullptr;
+    QTimer *m_searchTimer = nullptr;
+    QCheckBox *m_viewportFilter = nullptr;
+    QCheckBox *m_duplicateFilter = nullptr;
+    QCheckBox *m_routeMode = nullptr;
+    QCheckBox *m_heatmapMode = nullptr;
+    QTimer *m_filterTimer = nullptr;
+    TimelineWidget *m_timeline = nullptr;
+    QComboBox *m_timelineResolution = nullptr;
     QLabel *m_previewImage = nullptr;
     QLabel *m_previewCaption = nullptr;
+    ThumbnailLoader *m_previewLoader = nullptr;   // превью декодируются в фоне
+    int m_previewPhoto = -1;          // фото, чьё превью ждём
     QString m_currentRoot;
+    qint64 m_mapLoadStart = 0;        // Tracer::now() начала загрузки страницы карты
+    qint64 m_scanStart = 0;
+
+    PhotoStore m_photos;
+    ThumbnailCache m_thumbnails;
+    int m_gpsCount = 0;
+    SpatialIndex m_spatial;           // строится после сканирования
+    SortIndex m_sortIndex;            // перестановки для всех порядков сортировки
+    TimeIndex m_timeIndex;            // фото по дням, пополняется по мере сканирования
+    DuplicateIndex m_duplicates;      // группы похожих снимков, после сканирования
+    RouteIndex m_routes;              // маршруты поездок, только в режиме маршрутов
+    SearchIndex m_search;             // строится при первом запросе, после сканирования
+    SearchQuery m_searchQuery;
+    PhotoSet m_searchResult;          // найденные фото, если запрос не пуст
+    QDate m_rangeFirst;               // фильтр по дате съёмки, недействителен - нет фильтра
+    QDate m_rangeLast;
+    qint64 m_rangeStart = 0;          // те же границы в мс: [начало first, начало last + 1)
+    qint64 m_rangeEnd = 0;
+    QVector<int> m_sortedOrder;       // все фото в текущем порядке сортировки
+    double m_viewWest = -180.0;       // текущее окно карты
+    double m_viewSouth = -90.0;
+    double m_viewEast = 180.0;
+    double m_viewNorth = 90.0;
+    bool m_restoringSelection = false;
 
-    QVector<PhotoInfo> m_photos;
+    PhotoScanner *m_scanner = nullptr;
+    FolderWatcher *m_watcher = nullptr;
+    bool m_updating = false;          // сканер перечитывает изменённые файлы
+    bool m_hashPending = false;       // досчитать хеши после текущего сканирования
+    QStringList m_changedPaths;       // изменения, ждущие конца текущего обновления
+    std::shared_ptr<const TrackLog> m_trackLog;   // передаётся сканеру перед каждым запуском
+    QThread *m_trackLoader = nullptr;
+    QStringList m_removedPaths;
+    QVector<int> m_updatedIds;        // новые и изменённые фото текущего обновления
 
     void setupUi();
     void applyDarkTheme();
     void loadSampleData();
     void createMap();
     void populateTree();
+    SortIndex::Key sortKey() const;
+    QVector<int> visibleOrder() const;
+    bool hasTimeRange() const { return m_rangeFirst.isValid(); }
+    bool inTimeRange(int id) const;
+    bool hasSearch() const { return !m_searchQuery.isEmpty() && !m_search.isEmpty(); }
+    void updateMapRange();
+    bool collapseDuplicates() const;
+    void updateDuplicates();
+    void hashMissingPhotos();
+    void updateRoutes();
+    void updateSearch();
+    void onTracksLoaded(const std::shared_ptr<const TrackLog> &log, const QString &error);
+    void applyFolderChanges();
+    void applyUpdateBatch(const QVector<PhotoInfo> &photos);
+    void finishUpdate(bool cancelled);
+    void rebuildTree(bool selectFirst);
+    QString rootTitle() const;
     void updatePreview(int photoIndex);
-    QPixmap loadThumbnail(const QString &path, const QSize &size,
-                          const QString &fallbackText = QString()) const;
+    void prefetchPreviews(const QModelIndex &current);
+    void updateCacheStats();
     QPixmap placeholderThumbnail(const QSize &size, const QString &text) const;
     void scanDirectory(const QString &path);
-    QTreeWidgetItem* ensureTreePath(const QStringList &parts, QMap<QString, QTreeWidgetItem*> &cache,
-                                    QTreeWidgetItem *root, int photoIndex, const QString &fileName);
     QString buildMapHtml() const;
     void centerOnMarker(int index);
-    void assignFallbackCoords(PhotoInfo &info, int seed) const;
-    bool extractGpsFromExif(const QString &path, double &lat, double &lng) const;
-    static bool parseExifCoord(const QString &value, const QString &ref, double &result);
 };
 
 #endif // MAINWINDOW_H
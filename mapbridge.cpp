@@ -0,0 +1,392 @@
+#include "mapbridge.h"
+#include "routeindex.h"
+#include "tracer.h"
+
+#include <QByteArray>
+#include <QFile>
+#include <QUrl>
+#include <QtEndian>
+#include <cstring>
+
+namespace {
+
+// Объём пачек, отправленных странице (символы base64)
+TraceCounter bytesSent("map.bytesSent");
+
+} // namespace
+
+MapBridge::MapBridge(const PhotoStore *photos, QObject *parent)
+    : QObject(parent)
+    , m_photos(photos)
+{
+    // Пачки сканера и изменения фильтров склеиваются в одно обновление
+    m_refreshTimer.setSingleShot(true);
+    m_refreshTimer.setInterval(RefreshDelayMs);
+    connect(&m_refreshTimer, &QTimer::timeout, this, &MapBridge::refresh);
+    // Во время сканирования данные пересобираются не чаще раза в HeatmapDelayMs
+    m_heatmapTimer.setSingleShot(true);
+    m_heatmapTimer.setInterval(HeatmapDelayMs);
+    connect(&m_heatmapTimer, &QTimer::timeout, this, &MapBridge::rebuildHeatmap);
+}
+
+void MapBridge::show(const QVector<int> &ids)
+{
+    bool changed = false;
+    for (int id : ids) {
+        if (id < 0 || id >= m_photos->size() || m_photos->isRemoved(id) || m_clusterer.contains(id))
+            continue;
+        m_clusterer.insert(id, m_photos->latitude(id), m_photos->longitude(id));
+        changed = true;
+    }
+    if (changed) {
+        scheduleRefresh();
+        scheduleHeatmap();
+    }
+}
+
+void MapBridge::showRange(int first, int last)
+{
+    QVector<int> ids;
+    ids.reserve(qMax(0, last - first + 1));
+    for (int id = first; id <= last; ++id)
+        ids.append(id);
+    show(ids);
+}
+
+void MapBridge::hide(const QVector<int> &ids)
+{
+    bool changed = false;
+    for (int id : ids) {
+        if (!m_clusterer.contains(id))
+            continue;
+        m_clusterer.remove(id);
+        changed = true;
+    }
+    if (changed) {
+        scheduleRefresh();
+        scheduleHeatmap();
+    }
+}
+
+void MapBridge::showOnly(const QVector<int> &ids)
+{
+    QBitArray wanted(int(m_photos->size()));
+    for (int id : ids) {
+        if (id >= 0 && id < wanted.size())
+            wanted.setBit(id);
+    }
+
+    QVector<int> removed;
+    QVector<int> added;
+    for (int id = 0; id < wanted.size(); ++id) {
+        const bool shown = m_clusterer.contains(id);
+        if (shown && !wanted.testBit(id))
+            removed.append(id);
+        else if (!shown && wanted.testBit(id))
+            added.append(id);
+    }
+    hide(removed);
+    show(added);
+}
+
+void MapBridge::move(const QVector<int> &ids)
+{
+    QVector<int> moved;
+    for (int id : ids) {
+        if (!m_clusterer.contains(id))
+            continue;
+        m_clusterer.insert(id, m_photos->latitude(id), m_photos->longitude(id));
+        if (isDisplayed(id))
+            moved.append(id);
+    }
+    if (m_ready && !moved.isEmpty()) {
+        const QString ids = encodeIds(moved);
+        const QString coords = encodeCoords(moved);
+        bytesSent.add(ids.size() + coords.size());
+        emit markersMoved(ids, coords);
+    }
+    if (!ids.isEmpty()) {
+        scheduleRefresh();
+        scheduleHeatmap();
+    }
+}
+
+void MapBridge::clear()
+{
+    m_refreshTimer.stop();
+    m_clusterer.clear();
+    m_displayed.clear();
+    m_selected = -1;
+    if (m_ready)
+        emit markersCleared();
+    scheduleHeatmap();
+}
+
+void MapBridge::select(int id)
+{
+    m_selected = id;
+    if (!m_ready || !m_clusterer.contains(id))
+        return;
+    // Фото может быть внутри кластера - странице нужны координаты,
+    // чтобы приблизиться до уровня отдельных маркеров
+    emit selectionChanged(id, m_photos->latitude(id), m_photos->longitude(id));
+}
+
+void MapBridge::setRoutes(const RouteIndex *routes)
+{
+    m_routes = routes;
+    scheduleRefresh();
+}
+
+void MapBridge::setHeatmapEnabled(bool enabled)
+{
+    if (enabled == m_heatmapEnabled)
+        return;
+    m_heatmapEnabled = enabled;
+    if (enabled) {
+        rebuildHeatmap();
+    } else {
+        m_heatmapTimer.stop();
+        m_heatmap.reset();
+        emit heatmapChanged(-1);
+    }
+    // Маркеры мелких масштабов уходят со страницы или возвращаются
+    scheduleRefresh();
+}
+
+void MapBridge::scheduleHeatmap()
+{
+    if (m_heatmapEnabled && !m_heatmapTimer.isActive())
+        m_heatmapTimer.start();
+}
+
+void MapBridge::rebuildHeatmap()
+{
+    m_heatmapTimer.stop();
+    QVector<int> ids;
+    ids.reserve(m_clusterer.size());
+    for (int id = 0; id < m_photos->size(); ++id) {
+        if (m_clusterer.contains(id))
+            ids.append(id);
+    }
+    auto heatmap = std::make_shared<HeatmapRenderer>();
+    heatmap->build(*m_photos, ids);
+    m_heatmap = heatmap;
+    emit heatmapChanged(++m_heatmapVersion);
+}
+
+void MapBridge::setRouteRange(qint64 start, qint64 end)
+{
+    if (start == m_routeStart && end == m_routeEnd)
+        return;
+    m_routeStart = start;
+    m_routeEnd = end;
+    if (m_routes)
+        scheduleRefresh();
+}
+
+void MapBridge::pageReset()
+{
+    m_ready = false;
+    m_displayed.clear();
+    m_sentRouteCoords.clear();
+    m_sentRouteLengths.clear();
+}
+
+void MapBridge::pageReady()
+{
+    TraceSpan span("bridge.pageReady");
+    // Новая страница пуста - всё видимое отправится первым обновлением
+    m_ready = true;
+    m_displayed.clear();
+    refresh();
+    select(m_selected);
+    if (m_heatmapEnabled)
+        emit heatmapChanged(m_heatmapVersion);
+}
+
+void MapBridge::setViewport(double west, double south, double east, double north, int zoom)
+{
+    TraceSpan span("bridge.setViewport", zoom);
+    m_west = west;
+    m_south = south;
+    m_east = east;
+    m_north = north;
+    m_zoom = zoom;
+    m_hasViewport = true;
+    // Пан и зум обрабатываются сразу, без задержки таймера
+    refresh();
+    emit viewportChanged(west, south, east, north, zoom);
+}
+
+void MapBridge::scheduleRefresh()
+{
+    if (m_ready && !m_refreshTimer.isActive())
+        m_refreshTimer.start();
+}
+
+void MapBridge::setDisplayed(int id, bool displayed)
+{
+    if (id >= m_displayed.size())
+        m_displayed.resize(qMax(id + 1, int(m_displayed.size()) * 2));
+    m_displayed.setBit(id, displayed);
+}
+
+void MapBridge::refresh()
+{
+    m_refreshTimer.stop();
+    if (!m_ready || !m_hasViewport)
+        return;
+
+    TraceSpan span("map.refresh");
+    QVector<MarkerClusterer::Cluster> clusters;
+    QVector<int> points;
+    // На мелких масштабах в режиме тепловой карты маркеров нет
+    if (!m_heatmapEnabled || m_zoom > HeatmapRenderer::MaxZoom) {
+        TraceSpan querySpan("map.cluster");
+        m_clusterer.query(m_west, m_south, m_east, m_north, m_zoom, clusters, points);
+    }
+    span.setValue(points.size() + clusters.size());
+
+    QBitArray wanted(int(m_photos->size()));
+    QVector<int> added;
+    for (int id : std::as_const(points)) {
+        wanted.setBit(id);
+        if (!isDisplayed(id)) {
+            setDisplayed(id, true);
+            added.append(id);
+        }
+    }
+    QVector<int> removed;
+    for (int id = 0; id < m_displayed.size(); ++id) {
+        if (m_displayed.testBit(id) && (id >= wanted.size() || !wanted.testBit(id))) {
+            setDisplayed(id, false);
+            removed.append(id);
+        }
+    }
+
+    // Кодирование пачек - аналог сборки JSON для страницы
+    TraceSpan encodeSpan("map.encode");
+    qint64 bytes = 0;
+    if (!removed.isEmpty()) {
+        const QString ids = encodeIds(removed);
+        bytes += ids.size();
+        emit markersRemoved(ids);
+    }
+    if (!added.isEmpty()) {
+        const QString ids = encodeIds(added);
+        const QString coords = encodeCoords(added);
+        bytes += ids.size() + coords.size();
+        emit markersAdded(ids, coords);
+    }
+    QString counts;
+    const QString coords = encodeClusters(clusters, counts);
+    bytes += coords.size() + counts.size();
+    emit clustersChanged(coords, counts);
+    bytes += refreshRoutes();
+    bytesSent.add(bytes);
+}
+
+qint64 MapBridge::refreshRoutes()
+{
+    QVector<float> coords;
+    QVector<int> lengths;
+    if (m_routes) {
+        TraceSpan span("map.routes", m_zoom);
+        m_routes->query(m_west, m_south, m_east, m_north, m_zoom,
+                        m_routeStart, m_routeEnd, coords, lengths);
+        span.setValue(coords.size() / 2);
+    }
+    // Пан внутри запаса окна и пачки маркеров не меняют линии
+    const QString encodedCoords = encodeFloats(coords);
+    const QString encodedLengths = encodeIds(lengths);
+    if (encodedCoords == m_sentRouteCoords && encodedLengths == m_sentRouteLengths)
+        return 0;
+    m_sentRouteCoords = encodedCoords;
+    m_sentRouteLengths = encodedLengths;
+    emit routesChanged(encodedCoords, encodedLengths);
+    return encodedCoords.size() + encodedLengths.size();
+}
+
+void MapBridge::markerClicked(int id)
+{
+    TraceSpan span("bridge.markerClicked", id);
+    if (id >= 0 && id < m_photos->size())
+        emit markerActivated(id);
+}
+
+QVariantMap MapBridge::popup(int id) const
+{
+    TraceSpan span("bridge.popup", id);
+    QVariantMap result;
+    if (id < 0 || id >= m_photos->size() || m_photos->isRemoved(id))
+        return result;
+
+    const QString location = m_photos->locationName(id);
+    result["title"] = location.isEmpty() ? m_photos->fileName(id).toString() : location;
+    result["subtitle"] = m_photos->timestamp(id).toString("yyyy-MM-dd hh:mm");
+    // Проверка существования файла - только для открываемого маркера,
+    // а не для каждого маркера в пачке
+    const QString filePath = m_photos->filePath(id);
+    if (QFile::exists(filePath))
+        result["image"] = QUrl::fromLocalFile(filePath).toString();
+    return result;
+}
+
+QString MapBridge::encodeIds(const QVector<int> &ids)
+{
+    QByteArray raw(int(ids.size()) * 4, Qt::Uninitialized);
+    uchar *out = reinterpret_cast<uchar*>(raw.data());
+    for (int i = 0; i < ids.size(); ++i)
+        qToLittleEndian<qint32>(ids[i], out + i * 4);
+    return QString::fromLatin1(raw.toBase64());
+}
+
+QString MapBridge::encodeFloats(const QVector<float> &values)
+{
+    QByteArray raw(int(values.size()) * 4, Qt::Uninitialized);
+    uchar *out = reinterpret_cast<uchar*>(raw.data());
+    for (int i = 0; i < values.size(); ++i) {
+        quint32 bits;
+        std::memcpy(&bits, &values[i], 4);
+        qToLittleEndian<quint32>(bits, out + i * 4);
+    }
+    return QString::fromLatin1(raw.toBase64());
+}
+
+QString MapBridge::encodeClusters(const QVector<MarkerClusterer::Cluster> &clusters, QString &counts)
+{
+    QByteArray rawCoords(int(clusters.size()) * 8, Qt::Uninitialized);
+    QByteArray rawCounts(int(clusters.size()) * 4, Qt::Uninitialized);
+    uchar *coordsOut = reinterpret_cast<uchar*>(rawCoords.data());
+    uchar *countsOut = reinterpret_cast<uchar*>(rawCounts.data());
+    for (int i = 0; i < clusters.size(); ++i) {
+        const float lat = float(clusters[i].latitude);
+        const float lng = float(clusters[i].longitude);
+        quint32 bits;
+        std::memcpy(&bits, &lat, 4);
+        qToLittleEndian<quint32>(bits, coordsOut + i * 8);
+        std::memcpy(&bits, &lng, 4);
+        qToLittleEndian<quint32>(bits, coordsOut + i * 8 + 4);
+        qToLittleEndian<qint32>(clusters[i].count, countsOut + i * 4);
+    }
+    counts = QString::fromLatin1(rawCounts.toBase64());
+    return QString::fromLatin1(rawCoords.toBase64());
+}
+
+QString MapBridge::encodeCoords(const QVector<int> &ids) const
+{
+    // Float32 даёт точность около метра - для маркера этого достаточно
+    QByteArray raw(int(ids.size()) * 8, Qt::Uninitialized);
+    uchar *out = reinterpret_cast<uchar*>(raw.data());
+    for (int i = 0; i < ids.size(); ++i) {
+        const float lat = float(m_photos->latitude(ids[i]));
+        const float lng = float(m_photos->longitude(ids[i]));
+        quint32 bits;
+        std::memcpy(&bits, &lat, 4);
+        qToLittleEndian<quint32>(bits, out + i * 8);
+        std::memcpy(&bits, &lng, 4);
+        qToLittleEndian<quint32>(bits, out + i * 8 + 4);
+    }
+    return QString::fromLatin1(raw.toBase64());
+}
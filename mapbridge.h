@@ -0,0 +1,126 @@
+#ifndef MAPBRIDGE_H
+#define MAPBRIDGE_H
+
+#include "heatmaprenderer.h"
+#include "markerclusterer.h"
+#include "photostore.h"
+
+#include <QBitArray>
+#include <QObject>
+#include <QString>
+#include <QTimer>
+#include <QVariantMap>
+#include <QVector>
+#include <limits>
+#include <memory>
+
+class RouteIndex;
+
+// Мост C++ <-> JS для страницы карты (регистрируется в QWebChannel как "bridge").
+// Страница загружается один раз; дальше передаются только изменения.
+// Набор фото на карте кластеризуется в MarkerClusterer, и странице уходит
+// только то, что видно в текущем окне: кластеры целиком (их немного),
+// отдельные маркеры - разницей с уже показанными. Пачки кодируются компактно:
+// id - Int32, координаты - пары Float32 (little-endian, в base64),
+// подписи маркеров страница запрашивает по клику.
+// Маршруты поездок (RouteIndex) уходят уровнем детализации текущего зума
+// и только при изменении - обычно это единицы тысяч вершин.
+// В режиме тепловой карты до HeatmapRenderer::MaxZoom маркеры и кластеры
+// не отправляются: страница берёт тайлы плотности у схемы gpm:, а мост
+// пересобирает данные для них с задержкой HeatmapDelayMs после изменений.
+class MapBridge : public QObject
+{
+    Q_OBJECT
+
+public:
+    static constexpr int RefreshDelayMs = 50;
+    static constexpr int HeatmapDelayMs = 1000;
+
+    explicit MapBridge(const PhotoStore *photos, QObject *parent = nullptr);
+
+    bool isReady() const { return m_ready; }
+    int shownCount() const { return m_clusterer.size(); }
+    bool isShown(int id) const { return m_clusterer.contains(id); }
+
+    // Изменения набора фото на карте (id - индекс в m_photos)
+    void show(const QVector<int> &ids);
+    void showRange(int first, int last);
+    void hide(const QVector<int> &ids);
+    // Оставить на карте ровно ids
+    void showOnly(const QVector<int> &ids);
+    // Координаты фото изменились
+    void move(const QVector<int> &ids);
+    void clear();
+    void select(int id);
+    // Маршруты поездок; nullptr - не показывать. Вызывается и после перестройки
+    void setRoutes(const RouteIndex *routes);
+    // Период для маршрутов, мс [start, end)
+    void setRouteRange(qint64 start, qint64 end);
+    void setHeatmapEnabled(bool enabled);
+    bool isHeatmapEnabled() const { return m_heatmapEnabled; }
+    // Данные для тайлов; nullptr - режим выключен
+    std::shared_ptr<const HeatmapRenderer> heatmap() const { return m_heatmap; }
+
+    // Вызываются страницей
+    Q_INVOKABLE void pageReady();
+    Q_INVOKABLE void setViewport(double west, double south, double east, double north, int zoom);
+    Q_INVOKABLE void markerClicked(int id);
+    Q_INVOKABLE QVariantMap popup(int id) const;
+
+public slots:
+    // Страница начала (пере)загружаться: до pageReady() ничего не отправляется
+    void pageReset();
+
+signals:
+    // -> JS
+    void markersAdded(const QString &ids, const QString &coords);
+    void markersMoved(const QString &ids, const QString &coords);
+    void markersRemoved(const QString &ids);
+    void markersCleared();
+    void clustersChanged(const QString &coords, const QString &counts);
+    void routesChanged(const QString &coords, const QString &lengths);
+    // Новая версия данных тепловой карты, -1 - режим выключен (и для C++)
+    void heatmapChanged(int version);
+    void selectionChanged(int id, double latitude, double longitude);
+    // -> C++
+    void markerActivated(int id);
+    void viewportChanged(double west, double south, double east, double north, int zoom);
+
+private:
+    void scheduleRefresh();
+    void refresh();
+    qint64 refreshRoutes();
+    void scheduleHeatmap();
+    void rebuildHeatmap();
+    void setDisplayed(int id, bool displayed);
+    bool isDisplayed(int id) const { return id >= 0 && id < m_displayed.size() && m_displayed.testBit(id); }
+    static QString encodeIds(const QVector<int> &ids);
+    QString encodeCoords(const QVector<int> &ids) const;
+    static QString encodeFloats(const QVector<float> &values);
+    static QString encodeClusters(const QVector<MarkerClusterer::Cluster> &clusters, QString &counts);
+
+    const PhotoStore *m_photos = nullptr;
+    MarkerClusterer m_clusterer;
+    QBitArray m_displayed;        // отдельные маркеры, которые сейчас на странице
+    QTimer m_refreshTimer;
+    const RouteIndex *m_routes = nullptr;
+    qint64 m_routeStart = std::numeric_limits<qint64>::min();
+    qint64 m_routeEnd = std::numeric_limits<qint64>::max();
+    QString m_sentRouteCoords;    // последние отправленные линии: повтор не шлётся
+    QString m_sentRouteLengths;
+    bool m_heatmapEnabled = false;
+    std::shared_ptr<const HeatmapRenderer> m_heatmap;
+    int m_heatmapVersion = 0;
+    QTimer m_heatmapTimer;
+
+    double m_west = -180.0;
+    double m_south = -85.0;
+    double m_east = 180.0;
+    double m_north = 85.0;
+    int m_zoom = 2;
+    bool m_hasViewport = false;
+    int m_selected = -1;
+    bool m_ready = false;
+};
+
+#endif // MAPBRIDGE_H
@@ -0,0 +1,251 @@
+#include "mapschemehandler.h"
+
+#include <QBuffer>
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QMetaObject>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QUrl>
+#include <QWebEngineUrlRequestJob>
+#include <QWebEngineUrlScheme>
+
+const QByteArray MapSchemeHandler::SchemeName = QByteArrayLiteral("gpm");
+
+void MapSchemeHandler::registerScheme()
+{
+    QWebEngineUrlScheme scheme(SchemeName);
+    scheme.setSyntax(QWebEngineUrlScheme::Syntax::Host);
+    scheme.setFlags(QWebEngineUrlScheme::SecureScheme
+                    | QWebEngineUrlScheme::LocalAccessAllowed
+                    | QWebEngineUrlScheme::CorsEnabled);
+    QWebEngineUrlScheme::registerScheme(scheme);
+}
+
+MapSchemeHandler::MapSchemeHandler(const QString &tileRoot, QObject *parent)
+    : QWebEngineUrlSchemeHandler(parent)
+    , m_store(tileRoot)
+    , m_network(new QNetworkAccessManager(this))
+    , m_heatCache(HeatCacheBytes)
+{
+    // Чтение тайлов - в основном ожидание диска, потоков можно больше, чем ядер
+    m_pool.setMaxThreadCount(8);
+}
+
+MapSchemeHandler::~MapSchemeHandler()
+{
+    // Задачи пула обращаются к m_store
+    m_pool.waitForDone();
+}
+
+void MapSchemeHandler::requestStarted(QWebEngineUrlRequestJob *job)
+{
+    const QUrl url = job->requestUrl();
+    const QString host = url.host();
+    const QString path = url.path();
+
+    if (host == QLatin1String("app")) {
+        serveAsset(job, path);
+        return;
+    }
+
+    if (host == QLatin1String("tiles")) {
+        const QStringList parts = path.split(QLatin1Char('/'), Qt::SkipEmptyParts);
+        if (parts.size() == 3) {
+            bool okZ = false, okX = false, okY = false;
+            const int z = parts[0].toInt(&okZ);
+            const int x = parts[1].toInt(&okX);
+            const int y = QFileInfo(parts[2]).completeBaseName().toInt(&okY);
+            if (okZ && okX && okY && TileStore::isValid(z, x, y)) {
+                serveTile(job, z, x, y);
+                return;
+            }
+        }
+    }
+
+    if (host == QLatin1String("heat")) {
+        // Версия в адресе только для кэша браузера: рисуются текущие данные
+        const QStringList parts = path.split(QLatin1Char('/'), Qt::SkipEmptyParts);
+        if (parts.size() == 4) {
+            bool okZ = false, okX = false, okY = false;
+            const int z = parts[1].toInt(&okZ);
+            const int x = parts[2].toInt(&okX);
+            const int y = QFileInfo(parts[3]).completeBaseName().toInt(&okY);
+            if (okZ && okX && okY && TileStore::isValid(z, x, y)) {
+                serveHeatTile(job, z, x, y);
+                return;
+            }
+        }
+    }
+
+    job->fail(QWebEngineUrlRequestJob::UrlNotFound);
+}
+
+void MapSchemeHandler::setHeatmap(const std::shared_ptr<const HeatmapRenderer> &heatmap, int version)
+{
+    m_heatmap = heatmap;
+    m_heatmapVersion = version;
+    m_heatCache.clear();
+}
+
+void MapSchemeHandler::serveHeatTile(QWebEngineUrlRequestJob *job, int z, int x, int y)
+{
+    const QString key = QStringLiteral("%1/%2/%3/%4").arg(m_heatmapVersion).arg(z).arg(x).arg(y);
+    if (const QByteArray *png = m_heatCache.object(key)) {
+        reply(job, QByteArrayLiteral("image/png"), *png);
+        return;
+    }
+    if (!m_heatmap) {
+        reply(job, QByteArrayLiteral("image/png"), emptyTile());
+        return;
+    }
+
+    // Снимок данных держится задачей: перестройка не ждёт отрисовки
+    QPointer<QWebEngineUrlRequestJob> guard(job);
+    const std::shared_ptr<const HeatmapRenderer> heatmap = m_heatmap;
+    const int version = m_heatmapVersion;
+    m_pool.start([this, guard, heatmap, version, key, z, x, y]() {
+        QVector<quint32> pixels;
+        QByteArray png;
+        if (heatmap->render(z, x, y, pixels)) {
+            const QImage image(reinterpret_cast<const uchar*>(pixels.constData()),
+                               HeatmapRenderer::TileSize, HeatmapRenderer::TileSize,
+                               QImage::Format_ARGB32_Premultiplied);
+            QBuffer buffer(&png);
+            buffer.open(QIODevice::WriteOnly);
+            image.save(&buffer, "PNG");
+        }
+        QMetaObject::invokeMethod(this, [this, guard, version, key, png]() {
+            // Пустой тайл (океан, нет фото) тоже кэшируется - он самый частый
+            const QByteArray data = png.isEmpty() ? emptyTile() : png;
+            if (version == m_heatmapVersion)
+                m_heatCache.insert(key, new QByteArray(data), qMax(1, int(data.size())));
+            if (guard)
+                reply(guard, QByteArrayLiteral("image/png"), data);
+        }, Qt::QueuedConnection);
+    });
+}
+
+QByteArray MapSchemeHandler::emptyTile()
+{
+    // Leaflet растягивает картинку до размера тайла, хватает одного пикселя
+    if (m_emptyTile.isEmpty()) {
+        QImage image(1, 1, QImage::Format_ARGB32_Premultiplied);
+        image.fill(Qt::transparent);
+        QBuffer buffer(&m_emptyTile);
+        buffer.open(QIODevice::WriteOnly);
+        image.save(&buffer, "PNG");
+    }
+    return m_emptyTile;
+}
+
+void MapSchemeHandler::serveAsset(QWebEngineUrlRequestJob *job, const QString &path)
+{
+    if (path == QLatin1String("/map.html")) {
+        reply(job, QByteArrayLiteral("text/html"), m_pageHtml);
+        return;
+    }
+
+    if (path.startsWith(QLatin1String("/leaflet/")) && !path.contains(QLatin1String(".."))) {
+        QFile file(QLatin1Char(':') + path);
+        if (file.open(QIODevice::ReadOnly)) {
+            QByteArray mime = QByteArrayLiteral("application/octet-stream");
+            if (path.endsWith(QLatin1String(".js")))
+                mime = QByteArrayLiteral("application/javascript");
+            else if (path.endsWith(QLatin1String(".css")))
+                mime = QByteArrayLiteral("text/css");
+            else if (path.endsWith(QLatin1String(".png")))
+                mime = QByteArrayLiteral("image/png");
+            reply(job, mime, file.readAll());
+            return;
+        }
+    }
+
+    job->fail(QWebEngineUrlRequestJob::UrlNotFound);
+}
+
+void MapSchemeHandler::serveTile(QWebEngineUrlRequestJob *job, int z, int x, int y)
+{
+    // Горячий тайл - ответ сразу, без переключения потоков
+    QByteArray data;
+    if (m_store.cached(z, x, y, data)) {
+        reply(job, tileMime(data), data);
+        return;
+    }
+
+    // Задание может быть отменено (тайл ушёл из окна), пока идёт чтение
+    QPointer<QWebEngineUrlRequestJob> guard(job);
+    m_pool.start([this, guard, z, x, y]() {
+        QByteArray tile;
+        const bool found = m_store.read(z, x, y, tile);
+        QMetaObject::invokeMethod(this, [this, guard, z, x, y, found, tile]() {
+            if (!guard)
+                return;
+            if (found)
+                reply(guard, tileMime(tile), tile);
+            else
+                fetchUpstream(guard, z, x, y);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void MapSchemeHandler::fetchUpstream(QPointer<QWebEngineUrlRequestJob> job, int z, int x, int y)
+{
+    if (m_upstream.isEmpty() || QDateTime::currentMSecsSinceEpoch() < m_upstreamRetryAt) {
+        job->fail(QWebEngineUrlRequestJob::UrlNotFound);
+        return;
+    }
+
+    QString url = m_upstream;
+    url.replace(QLatin1String("{z}"), QString::number(z));
+    url.replace(QLatin1String("{x}"), QString::number(x));
+    url.replace(QLatin1String("{y}"), QString::number(y));
+
+    QNetworkRequest request{QUrl(url)};
+    // Правила tile.openstreetmap.org требуют осмысленный User-Agent
+    request.setHeader(QNetworkRequest::UserAgentHeader, QByteArrayLiteral("GeoPhotoMap/0.1"));
+    QNetworkReply *networkReply = m_network->get(request);
+
+    connect(networkReply, &QNetworkReply::finished, this, [this, networkReply, job, z, x, y]() {
+        networkReply->deleteLater();
+        const QByteArray data = networkReply->readAll();
+        const bool ok = networkReply->error() == QNetworkReply::NoError && !data.isEmpty();
+
+        if (!ok) {
+            if (networkReply->error() != QNetworkReply::ContentNotFoundError)
+                m_upstreamRetryAt = QDateTime::currentMSecsSinceEpoch() + UpstreamRetryMs;
+            if (job)
+                job->fail(QWebEngineUrlRequestJob::UrlNotFound);
+            return;
+        }
+
+        if (job)
+            reply(job, tileMime(data), data);
+        m_pool.start([this, z, x, y, data]() {
+            m_store.write(z, x, y, data);
+        });
+    });
+}
+
+void MapSchemeHandler::reply(QWebEngineUrlRequestJob *job, const QByteArray &mime, const QByteArray &data)
+{
+    // Буфер принадлежит заданию и удаляется вместе с ним
+    auto *buffer = new QBuffer(job);
+    buffer->setData(data);
+    buffer->open(QIODevice::ReadOnly);
+    job->reply(mime, buffer);
+}
+
+QByteArray MapSchemeHandler::tileMime(const QByteArray &data)
+{
+    if (data.startsWith("\x89PNG"))
+        return QByteArrayLiteral("image/png");
+    if (data.startsWith("\xFF\xD8"))
+        return QByteArrayLiteral("image/jpeg");
+    if (data.size() >= 12 && data.startsWith("RIFF") && data.mid(8, 4) == "WEBP")
+        return QByteArrayLiteral("image/webp");
+    return QByteArrayLiteral("application/octet-stream");
+}
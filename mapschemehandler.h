@@ -0,0 +1,80 @@
+#ifndef MAPSCHEMEHANDLER_H
+#define MAPSCHEMEHANDLER_H
+
+#include "heatmaprenderer.h"
+#include "tilestore.h"
+
+#include <QByteArray>
+#include <QCache>
+#include <QPointer>
+#include <QString>
+#include <QThreadPool>
+#include <QWebEngineUrlSchemeHandler>
+#include <memory>
+
+class QNetworkAccessManager;
+class QWebEngineUrlRequestJob;
+
+// Обработчик схемы gpm:, через которую карта работает без сети:
+//   gpm://app/map.html           - страница карты
+//   gpm://app/leaflet/<файл>     - Leaflet из ресурсов (:/leaflet)
+//   gpm://tiles/<z>/<x>/<y>.png  - тайлы из TileStore
+//   gpm://heat/<v>/<z>/<x>/<y>.png - тепловая карта версии данных v
+// Горячие тайлы отдаются сразу, остальные читаются в пуле потоков.
+// Если задан внешний источник и он доступен, недостающие тайлы
+// скачиваются и сохраняются в хранилище (write-through).
+// Тайлы тепловой карты рисуются в том же пуле из снимка HeatmapRenderer
+// и кэшируются в памяти по версии данных и z/x/y; версия в адресе
+// не даёт браузеру показать тайл прежних данных.
+class MapSchemeHandler : public QWebEngineUrlSchemeHandler
+{
+    Q_OBJECT
+
+public:
+    static const QByteArray SchemeName;
+    // Пауза после сетевой ошибки, чтобы без сети не ждать таймаута на каждом тайле
+    static constexpr int UpstreamRetryMs = 60 * 1000;
+    static constexpr int HeatCacheBytes = 32 * 1024 * 1024;
+
+    // Вызывается до создания QApplication
+    static void registerScheme();
+    static QString pageUrl() { return QStringLiteral("gpm://app/map.html"); }
+    static QString tileUrlTemplate() { return QStringLiteral("gpm://tiles/{z}/{x}/{y}.png"); }
+    static QString heatTileUrlTemplate() { return QStringLiteral("gpm://heat/{v}/{z}/{x}/{y}.png"); }
+
+    explicit MapSchemeHandler(const QString &tileRoot = TileStore::defaultRoot(),
+                              QObject *parent = nullptr);
+    ~MapSchemeHandler() override;
+
+    TileStore *tileStore() { return &m_store; }
+
+    void setPageHtml(const QString &html) { m_pageHtml = html.toUtf8(); }
+    // Шаблон вида https://tile.openstreetmap.org/{z}/{x}/{y}.png; пусто - только локально
+    void setUpstream(const QString &urlTemplate) { m_upstream = urlTemplate; }
+    // Новые данные тепловой карты; nullptr - тайлы пустые
+    void setHeatmap(const std::shared_ptr<const HeatmapRenderer> &heatmap, int version);
+
+    void requestStarted(QWebEngineUrlRequestJob *job) override;
+
+private:
+    void serveAsset(QWebEngineUrlRequestJob *job, const QString &path);
+    void serveTile(QWebEngineUrlRequestJob *job, int z, int x, int y);
+    void fetchUpstream(QPointer<QWebEngineUrlRequestJob> job, int z, int x, int y);
+    void serveHeatTile(QWebEngineUrlRequestJob *job, int z, int x, int y);
+    QByteArray emptyTile();
+    static void reply(QWebEngineUrlRequestJob *job, const QByteArray &mime, const QByteArray &data);
+    static QByteArray tileMime(const QByteArray &data);
+
+    TileStore m_store;
+    QThreadPool m_pool;
+    QNetworkAccessManager *m_network = nullptr;
+    QString m_upstream;
+    QByteArray m_pageHtml;
+    qint64 m_upstreamRetryAt = 0;   // мс с эпохи; до этого момента сеть не трогаем
+    std::shared_ptr<const HeatmapRenderer> m_heatmap;
+    int m_heatmapVersion = 0;
+    QCache<QString, QByteArray> m_heatCache;   // PNG по "версия/z/x/y", цена - байты
+    QByteArray m_emptyTile;
+};
+
+#endif // MAPSCHEMEHANDLER_H
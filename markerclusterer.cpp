@@ -0,0 +1,200 @@
+#include "markerclusterer.h"
+
+#include <QtGlobal>
+#include <QtMath>
+#include <cmath>
+
+namespace {
+// Предел широты в Web Mercator
+constexpr double MaxLatitude = 85.05112878;
+}
+
+MarkerClusterer::MarkerClusterer()
+    : m_levels(MaxClusterZoom + 1)
+{
+}
+
+void MarkerClusterer::clear()
+{
+    for (auto &level : m_levels)
+        level.clear();
+    m_leaves.clear();
+    m_x.clear();
+    m_y.clear();
+    m_member.clear();
+    m_size = 0;
+}
+
+double MarkerClusterer::lngToX(double longitude)
+{
+    return (longitude + 180.0) / 360.0;
+}
+
+double MarkerClusterer::latToY(double latitude)
+{
+    const double lat = qDegreesToRadians(qBound(-MaxLatitude, latitude, MaxLatitude));
+    return (1.0 - std::log(std::tan(lat) + 1.0 / std::cos(lat)) / M_PI) / 2.0;
+}
+
+double MarkerClusterer::xToLng(double x)
+{
+    return x * 360.0 - 180.0;
+}
+
+double MarkerClusterer::yToLat(double y)
+{
+    return qRadiansToDegrees(std::atan(std::sinh(M_PI * (1.0 - 2.0 * y))));
+}
+
+int MarkerClusterer::cellIndex(double v, int n)
+{
+    return qBound(0, int(std::floor(v * n)), n - 1);
+}
+
+void MarkerClusterer::insert(int id, double latitude, double longitude)
+{
+    if (id < 0)
+        return;
+    if (contains(id))
+        remove(id);
+
+    if (id >= int(m_member.size())) {
+        m_x.resize(id + 1);
+        m_y.resize(id + 1);
+        m_member.resize(id + 1, false);
+    }
+    const double x = qBound(0.0, lngToX(longitude), 1.0);
+    const double y = latToY(latitude);
+    m_x[id] = x;
+    m_y[id] = y;
+    m_member[id] = true;
+    ++m_size;
+
+    for (int level = 0; level <= MaxClusterZoom; ++level) {
+        const int n = cellsPerAxis(level);
+        Cell &cell = m_levels[level][cellKey(cellIndex(x, n), cellIndex(y, n))];
+        ++cell.count;
+        cell.idXor ^= quint32(id);
+        cell.sumX += x;
+        cell.sumY += y;
+    }
+    const int n = cellsPerAxis(MaxClusterZoom);
+    m_leaves[cellKey(cellIndex(x, n), cellIndex(y, n))].append(id);
+}
+
+void MarkerClusterer::remove(int id)
+{
+    if (!contains(id))
+        return;
+
+    const double x = m_x[id];
+    const double y = m_y[id];
+    m_member[id] = false;
+    --m_size;
+
+    for (int level = 0; level <= MaxClusterZoom; ++level) {
+        const int n = cellsPerAxis(level);
+        const quint64 key = cellKey(cellIndex(x, n), cellIndex(y, n));
+        auto it = m_levels[level].find(key);
+        if (it == m_levels[level].end())
+            continue;
+        if (--it->count == 0) {
+            m_levels[level].erase(it);
+            continue;
+        }
+        it->idXor ^= quint32(id);
+        it->sumX -= x;
+        it->sumY -= y;
+    }
+
+    const int n = cellsPerAxis(MaxClusterZoom);
+    auto leaf = m_leaves.find(cellKey(cellIndex(x, n), cellIndex(y, n)));
+    if (leaf != m_leaves.end()) {
+        leaf->removeOne(id);
+        if (leaf->isEmpty())
+            m_leaves.erase(leaf);
+    }
+}
+
+MarkerClusterer::Cluster MarkerClusterer::clusterFor(const Cell &cell) const
+{
+    Cluster cluster;
+    cluster.count = cell.count;
+    cluster.longitude = xToLng(cell.sumX / cell.count);
+    cluster.latitude = yToLat(cell.sumY / cell.count);
+    return cluster;
+}
+
+void MarkerClusterer::expandCell(const QVector<int> &leaf, int limit, QVector<Cluster> &clusters,
+                                 QVector<int> &points) const
+{
+    const int shown = qMin(limit, int(leaf.size()));
+    for (int i = 0; i < shown; ++i)
+        points.append(leaf[i]);
+    if (shown == int(leaf.size()))
+        return;
+
+    // Не раскрытые точки - кластер в их собственном центре
+    double sumX = 0.0;
+    double sumY = 0.0;
+    for (int i = shown; i < int(leaf.size()); ++i) {
+        sumX += m_x[leaf[i]];
+        sumY += m_y[leaf[i]];
+    }
+    const int rest = int(leaf.size()) - shown;
+    Cluster cluster;
+    cluster.count = rest;
+    cluster.longitude = xToLng(sumX / rest);
+    cluster.latitude = yToLat(sumY / rest);
+    clusters.append(cluster);
+}
+
+void MarkerClusterer::query(double west, double south, double east, double north, int zoom,
+                            QVector<Cluster> &clusters, QVector<int> &points) const
+{
+    clusters.clear();
+    points.clear();
+    if (m_size == 0)
+        return;
+
+    zoom = qBound(0, zoom, MaxZoom);
+    const int level = qMin(zoom, MaxClusterZoom);
+    const int n = cellsPerAxis(level);
+    const QHash<quint64, Cell> &cells = m_levels[level];
+
+    // По долготе окно может выходить за край мира - индексы берём по модулю
+    int ix0 = int(std::floor(lngToX(west) * n));
+    int ix1 = int(std::floor(lngToX(east) * n));
+    if (ix1 < ix0)
+        std::swap(ix0, ix1);
+    if (ix1 - ix0 + 1 >= n) {
+        ix0 = 0;
+        ix1 = n - 1;
+    }
+    const int iy0 = cellIndex(latToY(north), n);
+    const int iy1 = cellIndex(latToY(south), n);
+
+    const bool expand = zoom > MaxClusterZoom;
+    for (int iy = iy0; iy <= iy1; ++iy) {
+        for (int ix = ix0; ix <= ix1; ++ix) {
+            const quint64 key = cellKey(((ix % n) + n) % n, iy);
+            auto it = cells.constFind(key);
+            if (it == cells.constEnd())
+                continue;
+
+            if (it->count == 1) {
+                points.append(int(it->idXor));
+                continue;
+            }
+            // Глубже MaxClusterZoom ячейки раскрываются в точки, кроме очень
+            // плотных (много снимков в одном месте) - те раскрываются у MaxZoom,
+            // но в пределах MaxExpandedPoints на ячейку и MaxQueryPoints на запрос
+            const int budget = MaxQueryPoints - int(points.size());
+            if (expand && budget > 0 && (it->count <= MaxPointsPerCell || zoom >= MaxZoom - 1)) {
+                expandCell(m_leaves.value(key), qMin(budget, MaxExpandedPoints), clusters, points);
+                continue;
+            }
+            clusters.append(clusterFor(*it));
+        }
+    }
+}
@@ -0,0 +1,76 @@
+#ifndef MARKERCLUSTERER_H
+#define MARKERCLUSTERER_H
+
+#include <QHash>
+#include <QVector>
+#include <vector>
+
+// Кластеризация маркеров на стороне C++ по сетке для каждого уровня зума.
+// Точки хранятся в нормированной проекции Web Mercator ([0,1] x [0,1]);
+// на уровне z мир делится на ячейки по CellPixels экранных пикселей.
+// Ячейка хранит число точек, сумму координат (центр кластера) и XOR id,
+// который при одной точке в ячейке равен её id. Вставка и удаление -
+// O(число уровней), запрос - O(число ячеек в окне), независимо от
+// общего числа фото.
+class MarkerClusterer
+{
+public:
+    static constexpr int CellPixels = 64;
+    static constexpr int MaxClusterZoom = 14;   // глубже - отдельные точки
+    static constexpr int MaxZoom = 19;
+    static constexpr int MaxPointsPerCell = 32; // плотные ячейки остаются кластерами
+    // У MaxZoom раскрываются и плотные ячейки, но не больше MaxExpandedPoints
+    // точек с ячейки и MaxQueryPoints на запрос; остаток - кластером
+    static constexpr int MaxExpandedPoints = 256;
+    static constexpr int MaxQueryPoints = 4096;
+
+    struct Cluster
+    {
+        double latitude = 0.0;
+        double longitude = 0.0;
+        int count = 0;
+    };
+
+    MarkerClusterer();
+
+    void clear();
+    void insert(int id, double latitude, double longitude);
+    void remove(int id);
+    bool contains(int id) const { return id >= 0 && id < int(m_member.size()) && m_member[id]; }
+    int size() const { return m_size; }
+
+    // Окно в градусах (долготы могут выходить за +-180 при прокрутке карты).
+    // Одиночные точки попадают в points, остальное - в clusters.
+    void query(double west, double south, double east, double north, int zoom,
+               QVector<Cluster> &clusters, QVector<int> &points) const;
+
+    static double lngToX(double longitude);
+    static double latToY(double latitude);
+    static double xToLng(double x);
+    static double yToLat(double y);
+
+private:
+    struct Cell
+    {
+        int count = 0;
+        quint32 idXor = 0;
+        double sumX = 0.0;
+        double sumY = 0.0;
+    };
+
+    static int cellsPerAxis(int level) { return 1 << (level + 2); }  // 256 / CellPixels = 4
+    static quint64 cellKey(int ix, int iy) { return (quint64(quint32(iy)) << 32) | quint32(ix); }
+    static int cellIndex(double v, int n);
+    Cluster clusterFor(const Cell &cell) const;
+    void expandCell(const QVector<int> &leaf, int limit, QVector<Cluster> &clusters,
+                    QVector<int> &points) const;
+
+    QVector<QHash<quint64, Cell>> m_levels;      // [0..MaxClusterZoom]
+    QHash<quint64, QVector<int>> m_leaves;       // точки ячеек уровня MaxClusterZoom
+    std::vector<double> m_x;
+    std::vector<double> m_y;
+    std::vector<bool> m_member;
+    int m_size = 0;
+};
+
+#endif // MARKERCLUSTERER_H
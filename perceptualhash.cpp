@@ -0,0 +1,67 @@
+#include "perceptualhash.h"
+#include "thumbnailcache.h"
+
+#include <QImageReader>
+
+namespace {
+
+constexpr int HashWidth = 9;    // 8 разностей в строке
+constexpr int HashHeight = 8;
+
+} // namespace
+
+quint64 PerceptualHash::ofImage(const QImage &image)
+{
+    if (image.isNull())
+        return 0;
+    QImage gray = image.convertToFormat(QImage::Format_Grayscale8);
+    if (gray.width() < HashWidth || gray.height() < HashHeight)
+        gray = gray.scaled(qMax(gray.width(), HashWidth), qMax(gray.height(), HashHeight),
+                           Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+
+    // Среднее по клеткам 9x8 (клетки могут различаться на пиксель)
+    const int w = gray.width();
+    const int h = gray.height();
+    qint64 sum[HashHeight][HashWidth] = {};
+    qint64 area[HashHeight][HashWidth] = {};
+    for (int y = 0; y < h; ++y) {
+        const uchar *line = gray.constScanLine(y);
+        const int cy = y * HashHeight / h;
+        for (int x = 0; x < w; ++x) {
+            const int cx = x * HashWidth / w;
+            sum[cy][cx] += line[x];
+            ++area[cy][cx];
+        }
+    }
+
+    quint64 hash = 0;
+    int bit = 0;
+    for (int cy = 0; cy < HashHeight; ++cy) {
+        for (int cx = 0; cx + 1 < HashWidth; ++cx, ++bit) {
+            // Сравнение средних без деления
+            if (sum[cy][cx] * area[cy][cx + 1] > sum[cy][cx + 1] * area[cy][cx])
+                hash |= quint64(1) << bit;
+        }
+    }
+    return hash;
+}
+
+bool PerceptualHash::ofFile(const QString &path, quint64 &hash)
+{
+    QImageReader reader(path);
+    const QSize full = reader.size();
+    if (full.isValid()) {
+        const QSize fit = full.scaled(DecodeSize, DecodeSize, Qt::KeepAspectRatio)
+                              .expandedTo(QSize(HashWidth, HashHeight));
+        if (fit.width() < full.width())
+            reader.setScaledSize(fit);
+    }
+    QImage image = reader.read();
+    // RAW и HEIF без плагина Qt: хеш по встроенному превью
+    if (image.isNull())
+        image = ThumbnailCache::embeddedPreview(path, QSize(DecodeSize, DecodeSize), true);
+    if (image.isNull())
+        return false;
+    hash = ofImage(image);
+    return true;
+}
@@ -0,0 +1,23 @@
+#ifndef PERCEPTUALHASH_H
+#define PERCEPTUALHASH_H
+
+#include <QImage>
+#include <QString>
+
+// Разностный хеш изображения (dHash) для DuplicateIndex: картинка сводится
+// к серой 9x8, бит - "левая клетка ярче правой". Устойчив к пересжатию,
+// уменьшению и небольшой цветокоррекции.
+// Требует QtGui, поэтому живёт в GUI-части; сканер получает его через
+// PhotoScanner::setHasher.
+class PerceptualHash
+{
+public:
+    static constexpr int DecodeSize = 64;   // декодирование с уменьшением до 64x64
+
+    // Изображение декодируется сразу уменьшенным (для JPEG - масштабированием
+    // DCT), поэтому полноразмерный кадр в память не попадает
+    static bool ofFile(const QString &path, quint64 &hash);
+    static quint64 ofImage(const QImage &image);
+};
+
+#endif // PERCEPTUALHASH_H
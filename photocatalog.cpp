@@ -0,0 +1,441 @@
+#include "photocatalog.h"
+
+#include <QBuffer>
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <limits>
+
+// Заголовок файла каталога (все числа в little-endian, как на целевых платформах)
+struct PhotoCatalog::Header
+{
+    char magic[4];        // "GPMC"
+    quint32 version;
+    quint32 headerSize;
+    quint32 recordSize;
+    quint64 recordCount;
+    quint64 stringsOffset;
+    quint64 stringsSize;
+    quint32 checksum;     // CRC-32 записей и пула строк
+    quint32 gazetteer;    // ReverseGeocoder::id() для названий мест, 0 - имена папок
+    quint32 reserved[4];
+};
+
+struct PhotoCatalog::Record
+{
+    quint32 pathOffset;   // относительный путь в пуле строк (UTF-8)
+    quint32 pathLength;
+    quint32 locationOffset;
+    quint32 locationLength;
+    qint64 fileSize;
+    qint64 modified;      // мс от эпохи
+    qint64 taken;         // мс от эпохи, InvalidTime - нет даты
+    double latitude;
+    double longitude;
+    quint64 hash;         // перцептивный хеш, если есть FlagHasHash
+    quint32 flags;
+    quint32 reserved;
+};
+
+namespace {
+
+constexpr char Magic[4] = {'G', 'P', 'M', 'C'};
+constexpr qint64 InvalidTime = std::numeric_limits<qint64>::min();
+
+enum RecordFlag : quint32 {
+    FlagHasGps = 1u << 0,
+    FlagHasHash = 1u << 1,
+    FlagTrackGps = 1u << 2      // координаты получены по треку, а не из EXIF
+};
+
+quint32 crc32(const char *data, qint64 size, quint32 crc = 0)
+{
+    static const auto table = [] {
+        std::array<quint32, 256> t{};
+        for (quint32 i = 0; i < 256; ++i) {
+            quint32 c = i;
+            for (int k = 0; k < 8; ++k)
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t[i] = c;
+        }
+        return t;
+    }();
+
+    crc = ~crc;
+    const uchar *p = reinterpret_cast<const uchar *>(data);
+    for (qint64 i = 0; i < size; ++i)
+        crc = table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+// Порядок путей в каталоге: побайтно по UTF-8, более короткий префикс раньше
+int comparePaths(const char *a, quint32 aLength, const char *b, quint32 bLength)
+{
+    const int c = std::memcmp(a, b, size_t(qMin(aLength, bLength)));
+    if (c != 0)
+        return c;
+    return aLength < bLength ? -1 : (aLength > bLength ? 1 : 0);
+}
+
+} // namespace
+
+PhotoCatalog::PhotoCatalog(const QString &root)
+    : m_root(QDir::cleanPath(root))
+{
+    static_assert(sizeof(Header) == 64, "catalog header layout");
+    static_assert(sizeof(Record) == 72, "catalog record layout");
+}
+
+PhotoCatalog::~PhotoCatalog()
+{
+    close();
+}
+
+QString PhotoCatalog::catalogPathFor(const QString &root)
+{
+    const QByteArray key = QCryptographicHash::hash(QDir::cleanPath(root).toUtf8(),
+                                                    QCryptographicHash::Sha1).toHex();
+    const QString dir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation)
+            + QStringLiteral("/catalogs");
+    return dir + QLatin1Char('/') + QString::fromLatin1(key) + QStringLiteral(".gpc");
+}
+
+bool PhotoCatalog::open()
+{
+    close();
+
+    m_file.setFileName(catalogPathFor(m_root));
+    if (!m_file.open(QIODevice::ReadOnly))
+        return false;
+
+    const qint64 fileSize = m_file.size();
+    if (fileSize < qint64(sizeof(Header))) {
+        close();
+        return false;
+    }
+
+    m_base = m_file.map(0, fileSize);
+    if (!m_base) {
+        close();
+        return false;
+    }
+    const uchar *base = m_base;
+
+    Header header;
+    std::memcpy(&header, base, sizeof(Header));
+    const quint64 recordsBytes = header.recordCount * sizeof(Record);
+    const bool valid = std::memcmp(header.magic, Magic, sizeof(Magic)) == 0
+            && header.version == Version
+            && header.headerSize == sizeof(Header)
+            && header.recordSize == sizeof(Record)
+            && header.stringsOffset == sizeof(Header) + recordsBytes
+            && header.stringsOffset + header.stringsSize == quint64(fileSize)
+            && crc32(reinterpret_cast<const char *>(base) + sizeof(Header),
+                     fileSize - qint64(sizeof(Header))) == header.checksum;
+    if (!valid) {
+        close();
+        return false;
+    }
+
+    m_records = reinterpret_cast<const Record *>(base + sizeof(Header));
+    m_strings = reinterpret_cast<const char *>(base + header.stringsOffset);
+    m_count = header.recordCount;
+    m_stringsSize = header.stringsSize;
+    m_gazetteerId = header.gazetteer;
+
+    // Структурная проверка ссылок в пул строк
+    for (quint64 i = 0; i < m_count; ++i) {
+        const Record &r = m_records[i];
+        if (quint64(r.pathOffset) + r.pathLength > m_stringsSize
+                || quint64(r.locationOffset) + r.locationLength > m_stringsSize) {
+            close();
+            return false;
+        }
+    }
+    return true;
+}
+
+void PhotoCatalog::close()
+{
+    if (m_base) {
+        m_file.unmap(m_base);
+        m_base = nullptr;
+    }
+    if (m_file.isOpen())
+        m_file.close();
+    m_records = nullptr;
+    m_strings = nullptr;
+    m_count = 0;
+    m_stringsSize = 0;
+    m_gazetteerId = 0;
+}
+
+QByteArray PhotoCatalog::relativeKey(const QString &filePath) const
+{
+    if (filePath.size() > m_root.size() && filePath.startsWith(m_root)
+            && filePath.at(m_root.size()) == QLatin1Char('/'))
+        return filePath.mid(m_root.size() + 1).toUtf8();
+    return filePath.toUtf8();
+}
+
+QString PhotoCatalog::stringAt(quint32 offset, quint32 length) const
+{
+    return QString::fromUtf8(m_strings + offset, int(length));
+}
+
+bool PhotoCatalog::lookup(const QString &filePath, qint64 fileSize, qint64 modified,
+                          PhotoInfo &out) const
+{
+    if (!m_records)
+        return false;
+
+    const QByteArray key = relativeKey(filePath);
+    const auto compare = [this, &key](const Record &r) {
+        const int common = qMin<int>(key.size(), int(r.pathLength));
+        const int c = std::memcmp(m_strings + r.pathOffset, key.constData(), size_t(common));
+        if (c != 0)
+            return c;
+        return int(r.pathLength) - int(key.size());
+    };
+
+    const Record *first = m_records;
+    const Record *last = m_records + m_count;
+    const Record *it = std::lower_bound(first, last, 0, [&](const Record &r, int) {
+        return compare(r) < 0;
+    });
+    if (it == last || compare(*it) != 0)
+        return false;
+    // Время изменения - с точностью до секунды, как в PhotoStore
+    if (it->fileSize != fileSize || it->modified / 1000 != modified / 1000)
+        return false;
+
+    out.filePath = filePath;
+    out.fileSize = it->fileSize;
+    out.modified = it->modified;
+    out.timestamp = it->taken == InvalidTime
+            ? QDateTime::fromMSecsSinceEpoch(it->modified)
+            : QDateTime::fromMSecsSinceEpoch(it->taken);
+    out.locationName = stringAt(it->locationOffset, it->locationLength);
+    out.hasGps = (it->flags & FlagHasGps) != 0;
+    out.gpsFromTrack = out.hasGps && (it->flags & FlagTrackGps) != 0;
+    out.latitude = out.hasGps ? it->latitude : 0.0;
+    out.longitude = out.hasGps ? it->longitude : 0.0;
+    out.hasHash = (it->flags & FlagHasHash) != 0;
+    out.hash = out.hasHash ? it->hash : 0;
+    return true;
+}
+
+void PhotoCatalog::beginUpdate(quint32 gazetteerId)
+{
+    QMutexLocker locker(&m_updateMutex);
+    resetUpdate();
+    m_newGazetteerId = gazetteerId;
+}
+
+void PhotoCatalog::resetUpdate()
+{
+    m_newRecords.clear();
+    m_newStrings.clear();
+    m_newLocations.clear();
+    m_runs.clear();
+    m_updateFailed = false;
+}
+
+void PhotoCatalog::add(const QVector<PhotoInfo> &photos)
+{
+    QMutexLocker locker(&m_updateMutex);
+    for (const PhotoInfo &info : photos) {
+        Record r = {};
+        const QByteArray path = relativeKey(info.filePath);
+        r.pathOffset = quint32(m_newStrings.size());
+        r.pathLength = quint32(path.size());
+        m_newStrings.append(path);
+
+        // Название места обычно повторяется у всей папки - храним один раз
+        const QByteArray name = info.locationName.toUtf8();
+        auto loc = m_newLocations.constFind(info.locationName);
+        if (loc == m_newLocations.constEnd()) {
+            loc = m_newLocations.insert(info.locationName, quint32(m_newStrings.size()));
+            m_newStrings.append(name);
+        }
+        r.locationOffset = loc.value();
+        r.locationLength = quint32(name.size());
+
+        r.fileSize = info.fileSize;
+        r.modified = info.modified;
+        r.taken = info.timestamp.isValid() ? info.timestamp.toMSecsSinceEpoch() : InvalidTime;
+        r.flags = (info.hasGps ? quint32(FlagHasGps) : 0u) | (info.hasHash ? quint32(FlagHasHash) : 0u)
+                | (info.hasGps && info.gpsFromTrack ? quint32(FlagTrackGps) : 0u);
+        r.hash = info.hasHash ? info.hash : 0;
+        r.latitude = info.hasGps ? info.latitude : 0.0;
+        r.longitude = info.hasGps ? info.longitude : 0.0;
+        m_newRecords.append(reinterpret_cast<const char *>(&r), sizeof(Record));
+
+        // Пачка заполнена - сортируем и сбрасываем на диск
+        if (m_newRecords.size() >= qsizetype(RunRecords * sizeof(Record))) {
+            auto run = std::make_unique<QTemporaryFile>();
+            if (run->open() && writeRun(run.get()))
+                m_runs.push_back(std::move(run));
+            else
+                m_updateFailed = true;
+            m_newRecords.clear();
+            m_newStrings.clear();
+            m_newLocations.clear();
+        }
+    }
+}
+
+// Пачка на диске - последовательность записей, отсортированных по пути;
+// за каждой записью идут её путь и название места
+bool PhotoCatalog::writeRun(QIODevice *device)
+{
+    const int count = int(m_newRecords.size() / qsizetype(sizeof(Record)));
+    const Record *records = reinterpret_cast<const Record *>(m_newRecords.constData());
+    const char *strings = m_newStrings.constData();
+
+    QVector<int> order(count);
+    for (int i = 0; i < count; ++i)
+        order[i] = i;
+    std::sort(order.begin(), order.end(), [&](int a, int b) {
+        const Record &ra = records[a];
+        const Record &rb = records[b];
+        return comparePaths(strings + ra.pathOffset, ra.pathLength,
+                            strings + rb.pathOffset, rb.pathLength) < 0;
+    });
+
+    for (int idx : order) {
+        const Record &r = records[idx];
+        if (device->write(reinterpret_cast<const char *>(&r), sizeof(Record)) != qint64(sizeof(Record))
+                || device->write(strings + r.pathOffset, r.pathLength) != qint64(r.pathLength)
+                || device->write(strings + r.locationOffset, r.locationLength) != qint64(r.locationLength))
+            return false;
+    }
+    return device->seek(0);
+}
+
+bool PhotoCatalog::commit()
+{
+    QMutexLocker locker(&m_updateMutex);
+
+    // Остаток последней пачки сливается вместе с пачками на диске
+    QByteArray tail;
+    QBuffer tailDevice(&tail);
+    tailDevice.open(QIODevice::ReadWrite);
+    if (m_updateFailed || !writeRun(&tailDevice)) {
+        resetUpdate();
+        return false;
+    }
+    m_newRecords.clear();
+    m_newStrings.clear();
+    m_newLocations.clear();
+
+    struct Source
+    {
+        QIODevice *device;
+        Record record;
+        QByteArray path;
+        QByteArray location;
+
+        bool next()
+        {
+            if (device->read(reinterpret_cast<char *>(&record), sizeof(Record)) != qint64(sizeof(Record)))
+                return false;
+            path = device->read(record.pathLength);
+            location = device->read(record.locationLength);
+            return path.size() == qsizetype(record.pathLength)
+                    && location.size() == qsizetype(record.locationLength);
+        }
+    };
+    std::vector<Source> sources;
+    for (const auto &run : m_runs)
+        sources.push_back({run.get(), {}, {}, {}});
+    sources.push_back({&tailDevice, {}, {}, {}});
+    std::vector<Source *> active;
+    for (Source &source : sources) {
+        if (source.next())
+            active.push_back(&source);
+    }
+
+    // Старое отображение снимаем до замены файла (иначе на Windows rename не пройдёт)
+    close();
+
+    const QString path = catalogPathFor(m_root);
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    QSaveFile out(path);
+    QTemporaryFile strings;
+    if (!out.open(QIODevice::WriteOnly) || !strings.open()) {
+        resetUpdate();
+        return false;
+    }
+
+    Header header = {};
+    out.write(reinterpret_cast<const char *>(&header), sizeof(Header));
+
+    // Слияние пачек: записи сразу пишутся в каталог, строки - во временный пул
+    quint64 count = 0;
+    quint64 stringsSize = 0;
+    quint32 crc = 0;
+    QHash<QByteArray, quint32> locations;
+    while (!active.empty()) {
+        size_t best = 0;
+        for (size_t i = 1; i < active.size(); ++i) {
+            const Source *a = active[i];
+            const Source *b = active[best];
+            if (comparePaths(a->path.constData(), quint32(a->path.size()),
+                             b->path.constData(), quint32(b->path.size())) < 0)
+                best = i;
+        }
+        Source *source = active[best];
+
+        Record r = source->record;
+        r.pathOffset = quint32(stringsSize);
+        strings.write(source->path);
+        stringsSize += quint64(source->path.size());
+
+        auto loc = locations.constFind(source->location);
+        if (loc == locations.constEnd()) {
+            loc = locations.insert(source->location, quint32(stringsSize));
+            strings.write(source->location);
+            stringsSize += quint64(source->location.size());
+        }
+        r.locationOffset = loc.value();
+
+        out.write(reinterpret_cast<const char *>(&r), sizeof(Record));
+        crc = crc32(reinterpret_cast<const char *>(&r), sizeof(Record), crc);
+        ++count;
+
+        if (!source->next())
+            active.erase(active.begin() + qsizetype(best));
+    }
+
+    strings.seek(0);
+    while (!strings.atEnd()) {
+        const QByteArray chunk = strings.read(1 << 20);
+        if (chunk.isEmpty())
+            break;
+        crc = crc32(chunk.constData(), chunk.size(), crc);
+        out.write(chunk);
+    }
+
+    std::memcpy(header.magic, Magic, sizeof(Magic));
+    header.version = Version;
+    header.headerSize = sizeof(Header);
+    header.recordSize = sizeof(Record);
+    header.recordCount = count;
+    header.stringsOffset = sizeof(Header) + count * sizeof(Record);
+    header.stringsSize = stringsSize;
+    header.gazetteer = m_newGazetteerId;
+    header.checksum = crc;
+    out.seek(0);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(Header));
+    const bool ok = stringsSize == quint64(strings.size()) && out.commit();
+
+    resetUpdate();
+    return ok;
+}
@@ -0,0 +1,82 @@
+#ifndef PHOTOCATALOG_H
+#define PHOTOCATALOG_H
+
+#include "photoinfo.h"
+
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QTemporaryFile>
+#include <QVector>
+#include <memory>
+#include <vector>
+
+// Постоянный каталог метаданных для одного корневого каталога.
+// Бинарный файл отображается в память целиком: заголовок, массив записей
+// фиксированного размера, отсортированный по относительному пути (UTF-8),
+// и пул строк. Записи сверяются по размеру и времени изменения файла,
+// поэтому при повторном открытии EXIF читается только у новых и изменённых.
+// Новая версия копится пачками по RunRecords записей: заполненная пачка
+// сортируется и уходит во временный файл, commit() сливает пачки в каталог,
+// так что в памяти во время сканирования держится не больше одной пачки.
+class PhotoCatalog
+{
+public:
+    static constexpr quint32 Version = 2;
+    static constexpr int RunRecords = 1 << 16;
+
+    explicit PhotoCatalog(const QString &root);
+    ~PhotoCatalog();
+
+    static QString catalogPathFor(const QString &root);
+
+    // Отображает файл и проверяет версию, структуру и контрольную сумму.
+    // При любой ошибке каталог считается пустым.
+    bool open();
+    void close();
+    bool isOpen() const { return m_records != nullptr; }
+    int size() const { return int(m_count); }
+    QString root() const { return m_root; }
+    // Отпечаток геокодера, которым получены названия мест (0 - без геокодера)
+    quint32 gazetteerId() const { return m_gazetteerId; }
+
+    // Потокобезопасно (только чтение отображённой памяти)
+    bool lookup(const QString &filePath, qint64 fileSize, qint64 modified, PhotoInfo &out) const;
+
+    // Накопление новой версии каталога во время сканирования
+    void beginUpdate(quint32 gazetteerId = 0);
+    void add(const QVector<PhotoInfo> &photos);
+    bool commit();
+
+private:
+    struct Header;
+    struct Record;
+
+    QByteArray relativeKey(const QString &filePath) const;
+    QString stringAt(quint32 offset, quint32 length) const;
+    bool writeRun(QIODevice *device);
+    void resetUpdate();
+
+    QString m_root;
+    QFile m_file;
+    uchar *m_base = nullptr;
+    const Record *m_records = nullptr;
+    const char *m_strings = nullptr;
+    quint64 m_count = 0;
+    quint64 m_stringsSize = 0;
+    quint32 m_gazetteerId = 0;
+
+    // Текущая пачка для записи: компактные записи + пул строк
+    QMutex m_updateMutex;
+    QByteArray m_newRecords;
+    QByteArray m_newStrings;
+    QHash<QString, quint32> m_newLocations;
+    quint32 m_newGazetteerId = 0;
+    // Отсортированные пачки, уже сброшенные на диск
+    std::vector<std::unique_ptr<QTemporaryFile>> m_runs;
+    bool m_updateFailed = false;
+};
+
+#endif // PHOTOCATALOG_H
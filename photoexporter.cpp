@@ -0,0 +1,248 @@
+#include "photoexporter.h"
+
+#include <QFileInfo>
+#include <QIODevice>
+#include <QMutexLocker>
+
+namespace {
+// 7 знаков после запятой - около сантиметра, больше EXIF не даёт
+QByteArray coordinate(double value)
+{
+    return QByteArray::number(value, 'f', 7);
+}
+}
+
+PhotoExporter::PhotoExporter(QIODevice *out, Format format)
+    : m_out(out)
+    , m_format(format)
+{
+    m_buffer.reserve(FlushBytes + 4096);
+}
+
+bool PhotoExporter::parseFormat(const QString &name, Format &format)
+{
+    const QString lower = name.toLower();
+    if (lower == QLatin1String("geojson") || lower == QLatin1String("json"))
+        format = GeoJson;
+    else if (lower == QLatin1String("csv"))
+        format = Csv;
+    else if (lower == QLatin1String("kml"))
+        format = Kml;
+    else
+        return false;
+    return true;
+}
+
+bool PhotoExporter::begin()
+{
+    QMutexLocker locker(&m_mutex);
+    switch (m_format) {
+    case GeoJson:
+        m_buffer += "{\"type\":\"FeatureCollection\",\"features\":[";
+        break;
+    case Csv:
+        m_buffer += "path,latitude,longitude,timestamp,location,size\r\n";
+        break;
+    case Kml:
+        m_buffer += "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                    "<kml xmlns=\"http://www.opengis.net/kml/2.2\">\n<Document>\n";
+        break;
+    }
+    return flush();
+}
+
+bool PhotoExporter::write(const QVector<PhotoInfo> &photos)
+{
+    QMutexLocker locker(&m_mutex);
+    for (const PhotoInfo &info : photos) {
+        if (!info.hasGps && (!m_includeWithoutGps || m_format == Kml))
+            continue;
+        switch (m_format) {
+        case GeoJson:
+            appendGeoJson(info);
+            break;
+        case Csv:
+            appendCsv(info);
+            break;
+        case Kml:
+            appendKml(info);
+            break;
+        }
+        ++m_written;
+        if (m_buffer.size() >= FlushBytes && !flush())
+            return false;
+    }
+    return m_ok;
+}
+
+bool PhotoExporter::finish()
+{
+    QMutexLocker locker(&m_mutex);
+    switch (m_format) {
+    case GeoJson:
+        m_buffer += "\n]}\n";
+        break;
+    case Csv:
+        break;
+    case Kml:
+        m_buffer += "</Document>\n</kml>\n";
+        break;
+    }
+    return flush();
+}
+
+bool PhotoExporter::flush()
+{
+    if (m_buffer.isEmpty())
+        return m_ok;
+    if (m_ok && m_out->write(m_buffer) != m_buffer.size())
+        m_ok = false;
+    m_buffer.clear();
+    return m_ok;
+}
+
+void PhotoExporter::appendGeoJson(const PhotoInfo &info)
+{
+    if (m_written > 0)
+        m_buffer += ',';
+    m_buffer += "\n{\"type\":\"Feature\",\"geometry\":";
+    if (info.hasGps) {
+        m_buffer += "{\"type\":\"Point\",\"coordinates\":[";
+        m_buffer += coordinate(info.longitude);
+        m_buffer += ',';
+        m_buffer += coordinate(info.latitude);
+        m_buffer += "]}";
+    } else {
+        m_buffer += "null";
+    }
+    m_buffer += ",\"properties\":{\"path\":";
+    appendJsonString(m_buffer, info.filePath);
+    m_buffer += ",\"timestamp\":";
+    appendJsonString(m_buffer, info.timestamp.toString(Qt::ISODate));
+    m_buffer += ",\"location\":";
+    appendJsonString(m_buffer, info.locationName);
+    m_buffer += ",\"size\":";
+    m_buffer += QByteArray::number(info.fileSize);
+    m_buffer += "}}";
+}
+
+void PhotoExporter::appendCsv(const PhotoInfo &info)
+{
+    appendCsvField(m_buffer, info.filePath);
+    m_buffer += ',';
+    if (info.hasGps) {
+        m_buffer += coordinate(info.latitude);
+        m_buffer += ',';
+        m_buffer += coordinate(info.longitude);
+    } else {
+        m_buffer += ',';
+    }
+    m_buffer += ',';
+    m_buffer += info.timestamp.toString(Qt::ISODate).toLatin1();
+    m_buffer += ',';
+    appendCsvField(m_buffer, info.locationName);
+    m_buffer += ',';
+    m_buffer += QByteArray::number(info.fileSize);
+    m_buffer += "\r\n";
+}
+
+void PhotoExporter::appendKml(const PhotoInfo &info)
+{
+    m_buffer += "<Placemark><name>";
+    appendXmlText(m_buffer, QFileInfo(info.filePath).fileName());
+    m_buffer += "</name>";
+    if (info.timestamp.isValid()) {
+        m_buffer += "<TimeStamp><when>";
+        m_buffer += info.timestamp.toString(Qt::ISODate).toLatin1();
+        m_buffer += "</when></TimeStamp>";
+    }
+    m_buffer += "<description>";
+    appendXmlText(m_buffer, info.filePath);
+    m_buffer += "</description><Point><coordinates>";
+    m_buffer += coordinate(info.longitude);
+    m_buffer += ',';
+    m_buffer += coordinate(info.latitude);
+    m_buffer += "</coordinates></Point></Placemark>\n";
+}
+
+void PhotoExporter::appendJsonString(QByteArray &out, const QString &text)
+{
+    static const char hex[] = "0123456789abcdef";
+    const QByteArray utf8 = text.toUtf8();
+    out += '"';
+    for (const char c : utf8) {
+        switch (c) {
+        case '"':
+            out += "\\\"";
+            break;
+        case '\\':
+            out += "\\\\";
+            break;
+        case '\n':
+            out += "\\n";
+            break;
+        case '\r':
+            out += "\\r";
+            break;
+        case '\t':
+            out += "\\t";
+            break;
+        default:
+            if (uchar(c) < 0x20) {
+                out += "\\u00";
+                out += hex[uchar(c) >> 4];
+                out += hex[uchar(c) & 0xF];
+            } else {
+                out += c;
+            }
+        }
+    }
+    out += '"';
+}
+
+void PhotoExporter::appendCsvField(QByteArray &out, const QString &text)
+{
+    // RFC 4180: поле в кавычках, если в нём есть разделитель, кавычка или перевод строки
+    const QByteArray utf8 = text.toUtf8();
+    bool quote = false;
+    for (const char c : utf8) {
+        if (c == ',' || c == '"' || c == '\n' || c == '\r') {
+            quote = true;
+            break;
+        }
+    }
+    if (!quote) {
+        out += utf8;
+        return;
+    }
+    out += '"';
+    for (const char c : utf8) {
+        if (c == '"')
+            out += '"';
+        out += c;
+    }
+    out += '"';
+}
+
+void PhotoExporter::appendXmlText(QByteArray &out, const QString &text)
+{
+    const QByteArray utf8 = text.toUtf8();
+    for (const char c : utf8) {
+        switch (c) {
+        case '&':
+            out += "&amp;";
+            break;
+        case '<':
+            out += "&lt;";
+            break;
+        case '>':
+            out += "&gt;";
+            break;
+        case '"':
+            out += "&quot;";
+            break;
+        default:
+            out += c;
+        }
+    }
+}
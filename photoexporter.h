@@ -0,0 +1,63 @@
+#ifndef PHOTOEXPORTER_H
+#define PHOTOEXPORTER_H
+
+#include "photoinfo.h"
+
+#include <QByteArray>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+
+class QIODevice;
+
+// Потоковая выгрузка фото в GeoJSON, CSV или KML.
+// Документ не собирается в памяти: каждая пачка сразу кодируется
+// в буфер, который сбрасывается в устройство по достижении FlushBytes.
+// write() потокобезопасен и может вызываться прямо из пула сканера -
+// пока один поток пишет, остальные ждут, и очередь пачек не растёт.
+class PhotoExporter
+{
+public:
+    enum Format
+    {
+        GeoJson,
+        Csv,
+        Kml
+    };
+
+    static constexpr int FlushBytes = 256 * 1024;
+
+    PhotoExporter(QIODevice *out, Format format);
+
+    // "geojson", "csv", "kml" (регистр не важен)
+    static bool parseFormat(const QString &name, Format &format);
+
+    // Фото без координат из EXIF: по умолчанию пропускаются; если включено -
+    // выгружаются без геометрии (null в GeoJSON, пустые поля в CSV, в KML всё равно пропускаются)
+    void setIncludeWithoutGps(bool include) { m_includeWithoutGps = include; }
+
+    bool begin();
+    bool write(const QVector<PhotoInfo> &photos);
+    bool finish();
+    int written() const { return m_written; }
+
+private:
+    void appendGeoJson(const PhotoInfo &info);
+    void appendCsv(const PhotoInfo &info);
+    void appendKml(const PhotoInfo &info);
+    bool flush();
+
+    static void appendJsonString(QByteArray &out, const QString &text);
+    static void appendCsvField(QByteArray &out, const QString &text);
+    static void appendXmlText(QByteArray &out, const QString &text);
+
+    QIODevice *m_out = nullptr;
+    Format m_format = GeoJson;
+    bool m_includeWithoutGps = false;
+    QMutex m_mutex;
+    QByteArray m_buffer;
+    int m_written = 0;
+    bool m_ok = true;
+};
+
+#endif // PHOTOEXPORTER_H
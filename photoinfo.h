@@ -0,0 +1,26 @@
+#ifndef PHOTOINFO_H
+#define PHOTOINFO_H
+
+#include <QString>
+#include <QDateTime>
+#include <QMetaType>
+
+// Информация об одной фотографии
+struct PhotoInfo
+{
+    QString filePath;      // путь к файлу фото (может быть пустой)
+    double latitude = 0.0; // широта  (-90..90)
+    double longitude = 0.0;// долгота (-180..180)
+    QDateTime timestamp;   // время съёмки
+    QString locationName;  // название места
+    bool hasGps = false;   // координаты взяты из EXIF или трека, а не сгенерированы
+    bool gpsFromTrack = false; // координаты интерполированы по GPS-треку (TrackLog)
+    qint64 fileSize = 0;   // размер файла в байтах
+    qint64 modified = 0;   // время изменения файла, мс от эпохи
+    quint64 hash = 0;      // перцептивный хеш изображения (PerceptualHash::ofFile)
+    bool hasHash = false;
+};
+
+Q_DECLARE_METATYPE(PhotoInfo)
+
+#endif // PHOTOINFO_H
@@ -0,0 +1,355 @@
+#include "photoscanner.h"
+#include "exifreader.h"
+#include "photocatalog.h"
+#include "reversegeocoder.h"
+#include "tracer.h"
+#include "tracklog.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QHash>
+#include <QSet>
+#include <QThread>
+#include <algorithm>
+#include <iterator>
+
+PhotoScanner::PhotoScanner(QObject *parent)
+    : QObject(parent)
+{
+    qRegisterMetaType<PhotoInfo>();
+    qRegisterMetaType<QVector<PhotoInfo>>();
+    m_gazetteerPath = ReverseGeocoder::defaultPath();
+}
+
+PhotoScanner::~PhotoScanner()
+{
+    cancel();
+}
+
+QStringList PhotoScanner::nameFilters()
+{
+    // Кроме картинок - HEIF/AVIF, RAW и видео: их время, GPS и превью
+    // ExifReader берёт из заголовков контейнера
+    return QStringList() << "*.jpg" << "*.jpeg" << "*.png" << "*.bmp" << "*.gif" << "*.webp"
+                         << "*.heic" << "*.heif" << "*.avif"
+                         << "*.dng" << "*.cr2" << "*.cr3" << "*.nef" << "*.arw" << "*.orf"
+                         << "*.rw2" << "*.raf" << "*.pef" << "*.srw"
+                         << "*.mp4" << "*.mov" << "*.m4v" << "*.3gp";
+}
+
+int PhotoScanner::begin(const QString &root)
+{
+    cancel();
+
+    m_cancel = false;
+    m_found = 0;
+    m_processed = 0;
+    m_reused = 0;
+    m_io.reset();
+    m_hasher = m_pendingHasher;
+    m_trackLog = m_pendingTrackLog;
+    m_catalog.reset(m_catalogEnabled ? new PhotoCatalog(root) : nullptr);
+    // Открытие проверяет весь индекс мест, поэтому открытый индекс живёт между
+    // запусками и переоткрывается, только если сменился путь или файл пересобрали
+    const QFileInfo gazetteer(m_gazetteerPath);
+    const qint64 stamp = gazetteer.exists() ? gazetteer.lastModified().toMSecsSinceEpoch() : -1;
+    const qint64 size = gazetteer.exists() ? gazetteer.size() : -1;
+    if (m_gazetteerPath != m_geocoderPath || stamp != m_geocoderStamp || size != m_geocoderSize) {
+        m_geocoderPath = m_gazetteerPath;
+        m_geocoderStamp = stamp;
+        m_geocoderSize = size;
+        m_geocoder.reset();
+        if (!m_gazetteerPath.isEmpty() && stamp >= 0) {
+            m_geocoder = std::make_unique<ReverseGeocoder>();
+            if (!m_geocoder->open(m_gazetteerPath))
+                m_geocoder.reset();
+        }
+    }
+    m_pending = 1; // обход каталога держит одну "задачу", пока не закончит
+    m_running = true;
+    return ++m_generation;
+}
+
+int PhotoScanner::start(const QString &root)
+{
+    const int generation = begin(root);
+    m_enumThread = QThread::create([this, root, generation]() {
+        enumerate(root, generation);
+    });
+    m_enumThread->start();
+    return generation;
+}
+
+int PhotoScanner::update(const QString &root, const QStringList &paths,
+                         const PhotoStore &keep, int firstSeed)
+{
+    const int generation = begin(root);
+    m_enumThread = QThread::create([this, paths, keep, firstSeed, generation]() {
+        enumerateList(paths, keep, firstSeed, generation);
+    });
+    m_enumThread->start();
+    return generation;
+}
+
+void PhotoScanner::cancel()
+{
+    m_cancel = true;
+    if (m_enumThread) {
+        m_enumThread->wait();
+        delete m_enumThread;
+        m_enumThread = nullptr;
+    }
+    m_io.waitForDone();
+}
+
+void PhotoScanner::enumerate(const QString &root, int generation)
+{
+    TraceSpan span("scan.walk");
+    // Проверка контрольной суммы каталога идёт здесь, а не в GUI;
+    // задачи пула появляются только после первой пачки путей
+    if (m_catalog) {
+        TraceSpan openSpan("catalog.open");
+        m_catalog->open();
+        m_catalog->beginUpdate(m_geocoder ? m_geocoder->id() : 0);
+    }
+
+    QDirIterator it(root, nameFilters(), QDir::Files, QDirIterator::Subdirectories);
+
+    QHash<int, Batch> pending;
+    int counter = 0;
+    while (!m_cancel && it.hasNext()) {
+        addPath(pending, it.next(), counter, generation);
+        m_found = ++counter;
+    }
+
+    m_found = counter;
+    if (!m_cancel)
+        flushBatches(pending, generation);
+    span.setValue(counter);
+
+    releaseTask(generation);
+}
+
+void PhotoScanner::enumerateList(const QStringList &paths, const PhotoStore &keep,
+                                 int firstSeed, int generation)
+{
+    // Каталог пишется целиком (он отсортирован), но EXIF читается
+    // только у переданных файлов
+    if (m_catalog) {
+        m_catalog->open();
+        m_catalog->beginUpdate(m_geocoder ? m_geocoder->id() : 0);
+
+        // Перечитываемые файлы и удалённые записи в каталог не переносятся;
+        // записи собираются пачками, чтобы не разворачивать хранилище целиком
+        const QSet<QString> fresh(paths.cbegin(), paths.cend());
+        QVector<PhotoInfo> kept;
+        kept.reserve(BatchSize);
+        for (int id = 0; id < keep.size() && !m_cancel; ++id) {
+            if (keep.isRemoved(id))
+                continue;
+            PhotoInfo info = keep.photo(id);
+            if (fresh.contains(info.filePath))
+                continue;
+            kept.append(info);
+            if (kept.size() == BatchSize) {
+                m_catalog->add(kept);
+                kept.clear();
+            }
+        }
+        m_catalog->add(kept);
+    }
+
+    m_found = int(paths.size());
+    QHash<int, Batch> pending;
+    for (int i = 0; i < paths.size() && !m_cancel; ++i)
+        addPath(pending, paths[i], firstSeed + i, generation);
+    if (!m_cancel)
+        flushBatches(pending, generation);
+
+    releaseTask(generation);
+}
+
+void PhotoScanner::addPath(QHash<int, Batch> &pending, const QString &path, int seed, int generation)
+{
+    // Обход идёт по каталогам: устройство каталога берётся из кэша планировщика
+    const int device = m_io.deviceOf(path.left(path.lastIndexOf(QLatin1Char('/'))));
+    Batch &batch = pending[device];
+    batch.paths.append(path);
+    batch.seeds.append(seed);
+    if (batch.paths.size() == BatchSize) {
+        submitBatch(batch, device, generation);
+        batch = Batch();
+    }
+}
+
+void PhotoScanner::flushBatches(QHash<int, Batch> &pending, int generation)
+{
+    for (auto it = pending.cbegin(); it != pending.cend(); ++it) {
+        if (!it->paths.isEmpty())
+            submitBatch(*it, it.key(), generation);
+    }
+    pending.clear();
+}
+
+void PhotoScanner::submitBatch(const Batch &batch, int device, int generation)
+{
+    // Ждём свободного места в очереди; слот освобождает сама задача
+    {
+        TraceSpan span("scan.queueWait");
+        m_queueSlots.acquire();
+    }
+    Tracer::instance().counter("scan.queue", MaxQueuedBatches - m_queueSlots.available());
+    ++m_pending;
+    // Пачки небольшие, поэтому свободные потоки пула устройства сами
+    // разбирают очередь и нагрузка выравнивается без явного распределения
+    m_io.start(device, [this, batch, device, generation,
+                        trackLog = m_trackLog, hasher = m_hasher]() {
+        const QStringList &paths = batch.paths;
+        TraceSpan span("scan.batch", paths.size());
+        // Названия из каталога годятся, только если их дал тот же индекс мест
+        const bool placesCached = m_catalog && m_geocoder
+                && m_catalog->gazetteerId() == m_geocoder->id();
+        QVector<PhotoInfo> photos(paths.size());
+        QVector<QFileInfo> files;
+        QVector<int> unresolved;
+        QVector<int> unread;
+        files.reserve(paths.size());
+        for (int i = 0; i < paths.size() && !m_cancel; ++i) {
+            files.append(QFileInfo(paths[i]));
+            if (!reusePhoto(files[i], batch.seeds[i], photos[i]))
+                unread.append(i);
+            else if (!placesCached)
+                unresolved.append(i);
+        }
+
+        // Заголовки читаются в порядке, удобном устройству; на дисках
+        // с головками ядро заранее подгружает следующие файлы
+        m_io.order(device, paths, unread);
+        const bool readahead = m_io.wantsReadahead(device);
+        const qint64 readStart = Tracer::now();
+        {
+            TraceSpan readSpan("scan.read", unread.size());
+            for (int k = 0; k < unread.size() && !m_cancel; ++k) {
+                if (readahead) {
+                    const int ahead = k + IoScheduler::ReadaheadWindow - 1;
+                    for (int j = k == 0 ? 0 : ahead; j <= ahead && j < unread.size(); ++j)
+                        IoScheduler::willNeed(paths[unread[j]], ExifReader::MaxSegmentSize);
+                }
+                const int i = unread[k];
+                photos[i] = readPhoto(files[i], batch.seeds[i]);
+            }
+        }
+        m_io.recordRead(device, int(unread.size()), readStart, Tracer::now());
+        if (m_cancel) {
+            m_queueSlots.release();
+            releaseTask(generation);
+            return;
+        }
+        unresolved += unread;
+        std::sort(unresolved.begin(), unresolved.end());
+        if (trackLog) {
+            QVector<int> untagged;
+            for (int i = 0; i < photos.size(); ++i) {
+                if (!photos[i].hasGps || photos[i].gpsFromTrack)
+                    untagged.append(i);
+            }
+            TraceSpan trackSpan("track.geotag", untagged.size());
+            // Новые координаты - новое название места
+            const QVector<int> tagged = trackLog->geotag(photos, untagged);
+            QVector<int> merged;
+            std::set_union(unresolved.cbegin(), unresolved.cend(), tagged.cbegin(), tagged.cend(),
+                           std::back_inserter(merged));
+            unresolved = merged;
+        }
+        if (m_geocoder) {
+            TraceSpan geocodeSpan("geocode.resolve", unresolved.size());
+            m_geocoder->resolve(photos, unresolved);
+        }
+        if (hasher) {
+            TraceSpan hashSpan("scan.hash");
+            int hashed = 0;
+            for (PhotoInfo &info : photos) {
+                if (info.hasHash || m_cancel)
+                    continue;
+                info.hasHash = hasher(info.filePath, info.hash);
+                ++hashed;
+            }
+            hashSpan.setValue(hashed);
+        }
+        if (m_catalog)
+            m_catalog->add(photos);
+
+        const int processed = (m_processed += int(photos.size()));
+        if (!m_cancel && !photos.isEmpty()) {
+            emit batchReady(generation, photos);
+            emit progress(generation, processed, m_found);
+        }
+        m_queueSlots.release();
+        releaseTask(generation);
+    });
+}
+
+void PhotoScanner::releaseTask(int generation)
+{
+    if (--m_pending == 0) {
+        // После отмены каталог неполон - оставляем прежнюю версию
+        if (m_catalog) {
+            TraceSpan span("catalog.commit");
+            if (!m_cancel)
+                m_catalog->commit();
+            m_catalog->close();
+        }
+        m_running = false;
+        emit finished(generation, m_cancel);
+    }
+}
+
+bool PhotoScanner::reusePhoto(const QFileInfo &fi, int seed, PhotoInfo &info)
+{
+    if (!m_catalog || !m_catalog->lookup(fi.filePath(), fi.size(),
+                                         fi.lastModified().toMSecsSinceEpoch(), info))
+        return false;
+    ++m_reused;
+    assignFallbackCoords(info, seed);
+    return true;
+}
+
+PhotoInfo PhotoScanner::readPhoto(const QFileInfo &fi, int seed)
+{
+    const QString path = fi.filePath();
+    PhotoInfo info;
+    info.filePath = path;
+    info.timestamp = fi.lastModified();
+    info.fileSize = fi.size();
+    info.modified = info.timestamp.toMSecsSinceEpoch();
+    info.locationName = fi.absoluteDir().dirName();
+
+    ExifData exif;
+    if (ExifReader::read(path, exif)) {
+        if (exif.hasGps) {
+            info.latitude = exif.latitude;
+            info.longitude = exif.longitude;
+            info.hasGps = true;
+        }
+        if (exif.dateTimeOriginal.isValid())
+            info.timestamp = exif.dateTimeOriginal;
+    }
+
+    assignFallbackCoords(info, seed);
+    return info;
+}
+
+void PhotoScanner::assignFallbackCoords(PhotoInfo &info, int seed)
+{
+    if (info.hasGps || info.latitude != 0.0 || info.longitude != 0.0)
+        return;
+
+    // Детеминированное распределение по миру, чтобы отметки были видны даже без GPS
+    const quint32 h = qHash(info.filePath) ^ quint32(seed * 2654435761U);
+    const double lon = (double(h % 360000) / 1000.0) - 180.0;      // -180..180
+    const double lat = (double((h / 360000) % 160000) / 1000.0) - 80.0; // -80..80
+    info.latitude = lat;
+    info.longitude = lon;
+}
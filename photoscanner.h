@@ -0,0 +1,135 @@
+#ifndef PHOTOSCANNER_H
+#define PHOTOSCANNER_H
+
+#include "ioscheduler.h"
+#include "photoinfo.h"
+#include "photostore.h"
+
+#include <QHash>
+#include <QObject>
+#include <QSemaphore>
+#include <QStringList>
+#include <QVector>
+#include <atomic>
+#include <memory>
+
+class QFileInfo;
+class QThread;
+class PhotoCatalog;
+class ReverseGeocoder;
+class TrackLog;
+
+// Фоновое сканирование каталога.
+// Поток обхода собирает пути пачками отдельно для каждого устройства,
+// пачки разбираются в пуле своего устройства (IoScheduler: по числу ядер
+// на SSD, меньше на дисках с головками, больше на сетевых томах),
+// готовые пачки PhotoInfo уходят в GUI сигналом batchReady.
+// Сначала по stat отсеиваются файлы из каталога, остальные читаются
+// в порядке, удобном устройству, с подсказками ядру наперёд.
+// Неизменившиеся файлы берутся из PhotoCatalog без чтения EXIF,
+// после полного прохода каталог перезаписывается.
+// Фото с GPS получают название места от ReverseGeocoder прямо в задаче пула,
+// пачкой; из каталога названия берутся, если их дал тот же индекс мест.
+// Фото без GPS в EXIF (и привязанные по треку раньше) привязываются
+// к журналам треков до поиска места, чтобы получить и название.
+// Если задана функция хеширования (PerceptualHash::ofFile), там же считается
+// перцептивный хеш у фото, для которых его нет в каталоге.
+// Очередь пула ограничена MaxQueuedBatches: обход ждёт, пока разбор
+// не догонит, поэтому память не зависит от числа файлов в корне.
+class PhotoScanner : public QObject
+{
+    Q_OBJECT
+
+public:
+    static constexpr int BatchSize = 256;
+    static constexpr int MaxQueuedBatches = 64;
+
+    explicit PhotoScanner(QObject *parent = nullptr);
+    ~PhotoScanner() override;
+
+    // Настройки применяются к следующему запуску
+    // Предел потоков на устройство (по умолчанию - по его типу)
+    void setMaxThreadCount(int count) { m_io.setMaxConcurrency(qMax(1, count)); }
+    // Без каталога файлы всегда читаются заново и каталог не перезаписывается
+    void setCatalogEnabled(bool enabled) { m_catalogEnabled = enabled; }
+    // Индекс мест (ReverseGeocoder::compile); пусто или нет файла - место по имени папки
+    void setGazetteerPath(const QString &path) { m_gazetteerPath = path; }
+    // Перцептивные хеши для поиска дубликатов: требуют декодирования каждого
+    // нового файла, поэтому по умолчанию не считаются. Функция вызывается
+    // из потоков пула
+    using Hasher = bool (*)(const QString &path, quint64 &hash);
+    void setHasher(Hasher hasher) { m_pendingHasher = hasher; }
+    // Журналы треков для привязки фото без GPS; nullptr - не привязывать
+    void setTrackLog(std::shared_ptr<const TrackLog> log) { m_pendingTrackLog = std::move(log); }
+
+    // Запускает новое сканирование; предыдущее отменяется.
+    // Возвращает номер поколения, которым помечаются сигналы.
+    int start(const QString &root);
+    // Повторная обработка отдельных файлов (новых и изменённых) без обхода.
+    // keep - текущие фото корня: вместе с перечитанными они записываются в каталог.
+    int update(const QString &root, const QStringList &paths,
+               const PhotoStore &keep, int firstSeed);
+    void cancel();
+    bool isRunning() const { return m_running.load(); }
+    int generation() const { return m_generation; }
+    int reusedCount() const { return m_reused.load(); }
+    int processedCount() const { return m_processed.load(); }
+    // Чтение по устройствам за последний запуск
+    QVector<IoScheduler::Stats> ioStats() const { return m_io.stats(); }
+    QString ioSummary() const { return m_io.summary(); }
+
+    static QStringList nameFilters();
+    // Полная обработка одного файла: stat, EXIF, запасные координаты
+    static PhotoInfo readPhoto(const QFileInfo &fi, int seed);
+    static void assignFallbackCoords(PhotoInfo &info, int seed);
+
+signals:
+    void batchReady(int generation, const QVector<PhotoInfo> &photos);
+    void progress(int generation, int processed, int found);
+    void finished(int generation, bool cancelled);
+
+private:
+    // Пути одного устройства, ждущие отправки; seed - номер файла в обходе
+    struct Batch
+    {
+        QStringList paths;
+        QVector<int> seeds;
+    };
+
+    int begin(const QString &root);
+    void enumerate(const QString &root, int generation);
+    void enumerateList(const QStringList &paths, const PhotoStore &keep,
+                       int firstSeed, int generation);
+    void addPath(QHash<int, Batch> &pending, const QString &path, int seed, int generation);
+    void flushBatches(QHash<int, Batch> &pending, int generation);
+    void submitBatch(const Batch &batch, int device, int generation);
+    void releaseTask(int generation);
+    bool reusePhoto(const QFileInfo &fi, int seed, PhotoInfo &info);
+
+    IoScheduler m_io;
+    QThread *m_enumThread = nullptr;
+    std::atomic<bool> m_cancel{false};
+    std::atomic<int> m_pending{0};   // незавершённые задачи + сам обход
+    std::atomic<int> m_found{0};
+    std::atomic<int> m_processed{0};
+    std::atomic<int> m_reused{0};
+    QSemaphore m_queueSlots{MaxQueuedBatches};
+    std::unique_ptr<PhotoCatalog> m_catalog;
+    bool m_catalogEnabled = true;
+    std::unique_ptr<ReverseGeocoder> m_geocoder;
+    QString m_gazetteerPath;
+    // Какой файл открыт в m_geocoder (путь, время изменения, размер)
+    QString m_geocoderPath;
+    qint64 m_geocoderStamp = -1;
+    qint64 m_geocoderSize = -1;
+    // Задачи пула получают копии при постановке; новые значения вступают
+    // в силу в begin(), когда задачи прошлого запуска уже закончились
+    Hasher m_hasher = nullptr;
+    Hasher m_pendingHasher = nullptr;
+    std::shared_ptr<const TrackLog> m_trackLog;
+    std::shared_ptr<const TrackLog> m_pendingTrackLog;
+    std::atomic<bool> m_running{false};
+    int m_generation = 0;
+};
+
+#endif // PHOTOSCANNER_H
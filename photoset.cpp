@@ -0,0 +1,289 @@
+#include "photoset.h"
+
+#include <algorithm>
+
+namespace {
+
+// Во сколько раз массив должен быть меньше другого, чтобы искать его
+// элементы двоичным поиском, а не сливать массивы
+constexpr int GallopRatio = 16;
+
+bool testBit(const QVector<quint64> &bits, quint16 low)
+{
+    return bits[low >> 6] & (quint64(1) << (low & 63));
+}
+
+} // namespace
+
+void PhotoSet::append(int id)
+{
+    Q_ASSERT(id >= 0);
+    const quint16 key = quint16(id >> 16);
+    const quint16 low = quint16(id & 0xFFFF);
+    Q_ASSERT(m_chunks.isEmpty() || m_chunks.last().key <= key);
+    if (m_chunks.isEmpty() || m_chunks.last().key != key) {
+        Chunk chunk;
+        chunk.key = key;
+        m_chunks.append(chunk);
+    }
+    Chunk &chunk = m_chunks.last();
+    if (chunk.bits.isEmpty()) {
+        if (!chunk.array.isEmpty() && chunk.array.last() >= low)
+            return;
+        if (chunk.count < ArrayLimit) {
+            chunk.array.append(low);
+            ++chunk.count;
+            return;
+        }
+        toBits(chunk);
+    }
+    quint64 &word = chunk.bits[low >> 6];
+    const quint64 mask = quint64(1) << (low & 63);
+    if (!(word & mask)) {
+        word |= mask;
+        ++chunk.count;
+    }
+}
+
+void PhotoSet::appendChunk(int key, const QVector<quint16> &lows)
+{
+    Q_ASSERT(m_chunks.isEmpty() || m_chunks.last().key < key);
+    if (lows.isEmpty())
+        return;
+    Chunk chunk;
+    chunk.key = quint16(key);
+    chunk.count = int(lows.size());
+    chunk.array = lows;
+    if (chunk.count > ArrayLimit)
+        toBits(chunk);
+    m_chunks.append(chunk);
+}
+
+int PhotoSet::size() const
+{
+    int count = 0;
+    for (const Chunk &chunk : m_chunks)
+        count += chunk.count;
+    return count;
+}
+
+const PhotoSet::Chunk *PhotoSet::find(int key) const
+{
+    const auto it = std::lower_bound(m_chunks.cbegin(), m_chunks.cend(), key,
+                                     [](const Chunk &chunk, int k) { return chunk.key < k; });
+    return it != m_chunks.cend() && it->key == key ? &*it : nullptr;
+}
+
+bool PhotoSet::contains(int id) const
+{
+    if (id < 0)
+        return false;
+    const Chunk *chunk = find(id >> 16);
+    if (!chunk)
+        return false;
+    const quint16 low = quint16(id & 0xFFFF);
+    if (!chunk->bits.isEmpty())
+        return testBit(chunk->bits, low);
+    return std::binary_search(chunk->array.cbegin(), chunk->array.cend(), low);
+}
+
+void PhotoSet::toBits(Chunk &chunk)
+{
+    QVector<quint64> bits(Words, 0);
+    for (quint16 low : std::as_const(chunk.array))
+        bits[low >> 6] |= quint64(1) << (low & 63);
+    chunk.bits = bits;
+    chunk.array.clear();
+}
+
+void PhotoSet::toArray(Chunk &chunk)
+{
+    QVector<quint16> array;
+    array.reserve(chunk.count);
+    for (int w = 0; w < Words; ++w) {
+        quint64 word = chunk.bits[w];
+        while (word) {
+            array.append(quint16((w << 6) | int(qCountTrailingZeroBits(word))));
+            word &= word - 1;
+        }
+    }
+    chunk.array = array;
+    chunk.bits.clear();
+}
+
+PhotoSet::Chunk PhotoSet::intersect(const Chunk &a, const Chunk &b)
+{
+    Chunk result;
+    result.key = a.key;
+    if (!a.bits.isEmpty() && !b.bits.isEmpty()) {
+        result.bits.resize(Words);
+        for (int w = 0; w < Words; ++w) {
+            result.bits[w] = a.bits[w] & b.bits[w];
+            result.count += qPopulationCount(result.bits[w]);
+        }
+        if (result.count <= ArrayLimit)
+            toArray(result);
+        return result;
+    }
+    if (a.bits.isEmpty() && b.bits.isEmpty()) {
+        const Chunk &small = a.count <= b.count ? a : b;
+        const Chunk &large = a.count <= b.count ? b : a;
+        if (small.count * GallopRatio < large.count) {
+            auto from = large.array.cbegin();
+            for (quint16 low : small.array) {
+                from = std::lower_bound(from, large.array.cend(), low);
+                if (from == large.array.cend())
+                    break;
+                if (*from == low)
+                    result.array.append(low);
+            }
+        } else {
+            std::set_intersection(a.array.cbegin(), a.array.cend(), b.array.cbegin(), b.array.cend(),
+                                  std::back_inserter(result.array));
+        }
+        result.count = int(result.array.size());
+        return result;
+    }
+    const Chunk &array = a.bits.isEmpty() ? a : b;
+    const Chunk &bitmap = a.bits.isEmpty() ? b : a;
+    for (quint16 low : array.array) {
+        if (testBit(bitmap.bits, low))
+            result.array.append(low);
+    }
+    result.count = int(result.array.size());
+    return result;
+}
+
+PhotoSet::Chunk PhotoSet::unite(const Chunk &a, const Chunk &b)
+{
+    Chunk result;
+    result.key = a.key;
+    if (a.bits.isEmpty() && b.bits.isEmpty()) {
+        result.array.reserve(a.count + b.count);
+        std::set_union(a.array.cbegin(), a.array.cend(), b.array.cbegin(), b.array.cend(),
+                       std::back_inserter(result.array));
+        result.count = int(result.array.size());
+        if (result.count > ArrayLimit)
+            toBits(result);
+        return result;
+    }
+    const Chunk &bitmap = a.bits.isEmpty() ? b : a;
+    const Chunk &other = a.bits.isEmpty() ? a : b;
+    result.bits = bitmap.bits;
+    if (!other.bits.isEmpty()) {
+        for (int w = 0; w < Words; ++w)
+            result.bits[w] |= other.bits[w];
+    } else {
+        for (quint16 low : other.array)
+            result.bits[low >> 6] |= quint64(1) << (low & 63);
+    }
+    for (int w = 0; w < Words; ++w)
+        result.count += qPopulationCount(result.bits[w]);
+    return result;
+}
+
+PhotoSet::Chunk PhotoSet::subtract(const Chunk &a, const Chunk &b)
+{
+    Chunk result;
+    result.key = a.key;
+    if (a.bits.isEmpty()) {
+        for (quint16 low : a.array) {
+            const bool inB = b.bits.isEmpty()
+                    ? std::binary_search(b.array.cbegin(), b.array.cend(), low)
+                    : testBit(b.bits, low);
+            if (!inB)
+                result.array.append(low);
+        }
+        result.count = int(result.array.size());
+        return result;
+    }
+    result.bits = a.bits;
+    if (b.bits.isEmpty()) {
+        for (quint16 low : b.array)
+            result.bits[low >> 6] &= ~(quint64(1) << (low & 63));
+    } else {
+        for (int w = 0; w < Words; ++w)
+            result.bits[w] &= ~b.bits[w];
+    }
+    for (int w = 0; w < Words; ++w)
+        result.count += qPopulationCount(result.bits[w]);
+    if (result.count <= ArrayLimit)
+        toArray(result);
+    return result;
+}
+
+PhotoSet PhotoSet::intersected(const PhotoSet &other) const
+{
+    PhotoSet result;
+    int i = 0;
+    int j = 0;
+    while (i < m_chunks.size() && j < other.m_chunks.size()) {
+        const Chunk &a = m_chunks[i];
+        const Chunk &b = other.m_chunks[j];
+        if (a.key < b.key) {
+            ++i;
+        } else if (b.key < a.key) {
+            ++j;
+        } else {
+            Chunk chunk = intersect(a, b);
+            if (chunk.count > 0)
+                result.m_chunks.append(chunk);
+            ++i;
+            ++j;
+        }
+    }
+    return result;
+}
+
+PhotoSet PhotoSet::united(const PhotoSet &other) const
+{
+    PhotoSet result;
+    result.m_chunks.reserve(m_chunks.size() + other.m_chunks.size());
+    int i = 0;
+    int j = 0;
+    while (i < m_chunks.size() || j < other.m_chunks.size()) {
+        if (j == other.m_chunks.size() || (i < m_chunks.size() && m_chunks[i].key < other.m_chunks[j].key)) {
+            result.m_chunks.append(m_chunks[i++]);
+        } else if (i == m_chunks.size() || other.m_chunks[j].key < m_chunks[i].key) {
+            result.m_chunks.append(other.m_chunks[j++]);
+        } else {
+            result.m_chunks.append(unite(m_chunks[i++], other.m_chunks[j++]));
+        }
+    }
+    return result;
+}
+
+PhotoSet PhotoSet::subtracted(const PhotoSet &other) const
+{
+    PhotoSet result;
+    int j = 0;
+    for (const Chunk &a : m_chunks) {
+        while (j < other.m_chunks.size() && other.m_chunks[j].key < a.key)
+            ++j;
+        if (j == other.m_chunks.size() || other.m_chunks[j].key != a.key) {
+            result.m_chunks.append(a);
+            continue;
+        }
+        Chunk chunk = subtract(a, other.m_chunks[j]);
+        if (chunk.count > 0)
+            result.m_chunks.append(chunk);
+    }
+    return result;
+}
+
+QVector<int> PhotoSet::toVector() const
+{
+    QVector<int> ids;
+    ids.reserve(size());
+    forEach([&ids](int id) { ids.append(id); });
+    return ids;
+}
+
+qint64 PhotoSet::memoryUsage() const
+{
+    qint64 bytes = qint64(m_chunks.capacity()) * sizeof(Chunk);
+    for (const Chunk &chunk : m_chunks)
+        bytes += qint64(chunk.array.capacity()) * sizeof(quint16)
+                + qint64(chunk.bits.capacity()) * sizeof(quint64);
+    return bytes;
+}
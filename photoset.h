@@ -0,0 +1,99 @@
+#ifndef PHOTOSET_H
+#define PHOTOSET_H
+
+#include <QVector>
+#include <QtAlgorithms>
+#include <QtGlobal>
+
+// Множество индексов фото по схеме roaring bitmap: индекс делится на
+// старшие 16 бит (ключ контейнера) и младшие. Контейнер, где не больше
+// ArrayLimit фото, - отсортированный массив quint16 (2 байта на фото),
+// более плотный - битовая карта на 65536 бит (8 КБ).
+// Пересечение идёт только по общим ключам: массив с массивом - слиянием
+// (или двоичным поиском, если один много меньше), массив с картой - проверкой
+// битов, карта с картой - AND по словам. Поредевший результат снова
+// становится массивом. Поэтому списки фото по триграммам и результаты
+// фильтров пересекаются за время порядка меньшего множества, а не числа фото.
+// Копирование дешёвое: контейнеры - неявно разделяемые QVector.
+class PhotoSet
+{
+public:
+    static constexpr int ArrayLimit = 4096;
+
+    // Индексы по возрастанию; повтор последнего пропускается
+    void append(int id);
+    // Целый контейнер: младшие 16 бит по возрастанию, key больше всех прежних
+    void appendChunk(int key, const QVector<quint16> &lows);
+    void clear() { m_chunks.clear(); }
+    bool isEmpty() const { return m_chunks.isEmpty(); }
+    int size() const;
+    bool contains(int id) const;
+
+    PhotoSet intersected(const PhotoSet &other) const;
+    PhotoSet united(const PhotoSet &other) const;
+    PhotoSet subtracted(const PhotoSet &other) const;
+    // Элементы, для которых predicate(id) истинно
+    template <typename Predicate>
+    PhotoSet filtered(Predicate predicate) const;
+
+    template <typename Function>
+    void forEach(Function function) const;
+    // По возрастанию
+    QVector<int> toVector() const;
+
+    qint64 memoryUsage() const;
+
+private:
+    static constexpr int Words = 65536 / 64;
+
+    struct Chunk
+    {
+        quint16 key = 0;
+        int count = 0;
+        QVector<quint16> array;   // count <= ArrayLimit
+        QVector<quint64> bits;    // иначе Words слов
+    };
+
+    const Chunk *find(int key) const;
+    static void toBits(Chunk &chunk);
+    static void toArray(Chunk &chunk);
+    static Chunk intersect(const Chunk &a, const Chunk &b);
+    static Chunk unite(const Chunk &a, const Chunk &b);
+    static Chunk subtract(const Chunk &a, const Chunk &b);
+
+    QVector<Chunk> m_chunks;   // по возрастанию key, пустых нет
+};
+
+template <typename Predicate>
+PhotoSet PhotoSet::filtered(Predicate predicate) const
+{
+    PhotoSet result;
+    forEach([&result, &predicate](int id) {
+        if (predicate(id))
+            result.append(id);
+    });
+    return result;
+}
+
+template <typename Function>
+void PhotoSet::forEach(Function function) const
+{
+    for (const Chunk &chunk : m_chunks) {
+        const int base = int(chunk.key) << 16;
+        if (chunk.bits.isEmpty()) {
+            for (quint16 low : chunk.array)
+                function(base | low);
+            continue;
+        }
+        const quint64 *bits = chunk.bits.constData();
+        for (int w = 0; w < Words; ++w) {
+            quint64 word = bits[w];
+            while (word) {
+                function(base | (w << 6) | int(qCountTrailingZeroBits(word)));
+                word &= word - 1;
+            }
+        }
+    }
+}
+
+#endif // PHOTOSET_H
@@ -0,0 +1,305 @@
+#include "photostore.h"
+
+#include <QtGlobal>
+#include <cmath>
+
+namespace {
+
+// Путь файла -> папка и имя; папка корня файловой системы - "/"
+void splitPath(const QString &path, QString &dir, QStringView &name)
+{
+    const int slash = int(path.lastIndexOf(QLatin1Char('/')));
+    if (slash < 0) {
+        dir.clear();
+        name = QStringView(path);
+        return;
+    }
+    dir = path.left(slash > 0 ? slash : 1);
+    name = QStringView(path).mid(slash + 1);
+}
+
+} // namespace
+
+void PhotoStore::clear()
+{
+    *this = PhotoStore();
+}
+
+void PhotoStore::reserve(int count)
+{
+    m_dir.reserve(count);
+    m_nameOffset.reserve(count + 1);
+    m_lat.reserve(count);
+    m_lng.reserve(count);
+    m_taken.reserve(count);
+    m_modified.reserve(count);
+    m_sizeFlags.reserve(count);
+    m_hash.reserve(count);
+}
+
+qint32 PhotoStore::toFixed(double degrees, double limit)
+{
+    if (!std::isfinite(degrees))
+        return 0;
+    return qint32(std::llround(qBound(-limit, degrees, limit) * CoordScale));
+}
+
+quint32 PhotoStore::internDir(const QString &path)
+{
+    const auto it = m_dirIds.constFind(path);
+    if (it != m_dirIds.constEnd())
+        return it.value();
+
+    // Родители заводятся раньше детей, поэтому глубина известна сразу
+    Dir dir;
+    dir.path = path;
+    dir.location = NoLocation;
+    const int slash = int(path.lastIndexOf(QLatin1Char('/')));
+    if (slash >= 0 && path.size() > 1) {
+        dir.parent = internDir(slash > 0 ? path.left(slash) : QStringLiteral("/"));
+        dir.depth = m_dirs[dir.parent].depth + 1;
+        dir.nameStart = slash + 1;
+    }
+
+    const quint32 id = quint32(m_dirs.size());
+    m_dirs.append(dir);
+    m_dirIds.insert(path, id);
+    return id;
+}
+
+quint32 PhotoStore::internLocation(const QString &name)
+{
+    const auto it = m_locationIds.constFind(name);
+    if (it != m_locationIds.constEnd())
+        return it.value();
+    const quint32 id = quint32(m_locations.size());
+    m_locations.append(name);
+    m_locationIds.insert(name, id);
+    return id;
+}
+
+int PhotoStore::append(const PhotoInfo &info)
+{
+    QString dirPath;
+    QStringView name;
+    splitPath(info.filePath, dirPath, name);
+
+    const int id = int(m_dir.size());
+    if (m_nameOffset.isEmpty())
+        m_nameOffset.append(0);
+    m_dir.append(internDir(dirPath));
+    m_names.append(name);
+    m_nameOffset.append(quint32(m_names.size()));
+    m_lat.append(0);
+    m_lng.append(0);
+    m_taken.append(NoTime);
+    m_modified.append(0);
+    m_sizeFlags.append(0);
+    m_hash.append(0);
+    ++m_live;
+
+    setMetadata(id, info);
+    insertSlot(id);
+    return id;
+}
+
+void PhotoStore::replace(int id, const PhotoInfo &info)
+{
+    if (isRemoved(id))
+        return;
+    setMetadata(id, info);
+}
+
+void PhotoStore::setMetadata(int id, const PhotoInfo &info)
+{
+    m_lat[id] = toFixed(info.latitude, 90.0);
+    m_lng[id] = toFixed(info.longitude, 180.0);
+    m_taken[id] = info.timestamp.isValid() ? info.timestamp.toMSecsSinceEpoch() : NoTime;
+    m_modified[id] = quint32(qBound<qint64>(0, info.modified / 1000, 0xFFFFFFFFll));
+    m_hash[id] = info.hasHash ? info.hash : 0;
+
+    quint32 sizeFlags = (info.hasGps ? quint32(FlagHasGps) : 0u)
+            | (info.hasHash ? quint32(FlagHasHash) : 0u)
+            | (info.hasGps && info.gpsFromTrack ? quint32(FlagTrackGps) : 0u);
+    if (info.fileSize >= 0 && info.fileSize < qint64(SizeMask)) {
+        sizeFlags |= quint32(info.fileSize);
+        m_largeSizes.remove(id);
+    } else {
+        sizeFlags |= SizeMask;
+        m_largeSizes.insert(id, info.fileSize);
+    }
+    m_sizeFlags[id] = sizeFlags;
+
+    // Место первого фото становится местом папки, остальные отличия - исключения
+    Dir &dir = m_dirs[m_dir[id]];
+    const quint32 location = internLocation(info.locationName);
+    if (dir.location == NoLocation)
+        dir.location = location;
+    if (location == dir.location)
+        m_locationOverrides.remove(id);
+    else
+        m_locationOverrides.insert(id, location);
+}
+
+void PhotoStore::remove(int id)
+{
+    if (isRemoved(id))
+        return;
+    // Ячейка в таблице поиска остаётся до её перестройки:
+    // надгробие не совпадает ни с одной папкой
+    m_dir[id] = NoDir;
+    m_largeSizes.remove(id);
+    m_locationOverrides.remove(id);
+    --m_live;
+}
+
+qint64 PhotoStore::fileSize(int id) const
+{
+    const quint32 size = m_sizeFlags[id] & SizeMask;
+    return size == SizeMask ? m_largeSizes.value(id) : qint64(size);
+}
+
+QDateTime PhotoStore::timestamp(int id) const
+{
+    return m_taken[id] == NoTime ? QDateTime() : QDateTime::fromMSecsSinceEpoch(m_taken[id]);
+}
+
+QStringView PhotoStore::fileName(int id) const
+{
+    const quint32 begin = m_nameOffset[id];
+    return QStringView(m_names).mid(begin, m_nameOffset[id + 1] - begin);
+}
+
+QString PhotoStore::filePath(int id) const
+{
+    if (isRemoved(id))
+        return QString();
+    const QString &dir = m_dirs[m_dir[id]].path;
+    if (dir.isEmpty())
+        return fileName(id).toString();
+    QString path;
+    const QStringView name = fileName(id);
+    path.reserve(dir.size() + 1 + name.size());
+    path += dir;
+    if (!dir.endsWith(QLatin1Char('/')))
+        path += QLatin1Char('/');
+    path += name;
+    return path;
+}
+
+quint32 PhotoStore::locationOf(int id) const
+{
+    if (isRemoved(id))
+        return NoLocation;
+    if (!m_locationOverrides.isEmpty()) {
+        const auto it = m_locationOverrides.constFind(id);
+        if (it != m_locationOverrides.constEnd())
+            return it.value();
+    }
+    return m_dirs[m_dir[id]].location;
+}
+
+QString PhotoStore::locationName(int id) const
+{
+    const quint32 location = locationOf(id);
+    return location == NoLocation ? QString() : m_locations[location];
+}
+
+QStringView PhotoStore::dirName(quint32 dir) const
+{
+    const Dir &d = m_dirs[dir];
+    return QStringView(d.path).mid(d.nameStart);
+}
+
+PhotoInfo PhotoStore::photo(int id) const
+{
+    PhotoInfo info;
+    if (isRemoved(id))
+        return info;
+    info.filePath = filePath(id);
+    info.latitude = latitude(id);
+    info.longitude = longitude(id);
+    info.timestamp = timestamp(id);
+    info.locationName = locationName(id);
+    info.hasGps = hasGps(id);
+    info.gpsFromTrack = isGpsFromTrack(id);
+    info.fileSize = fileSize(id);
+    info.modified = modified(id);
+    info.hasHash = hasHash(id);
+    info.hash = hash(id);
+    return info;
+}
+
+size_t PhotoStore::slotHash(quint32 dir, QStringView name)
+{
+    return qHash(name, size_t(dir) * 0x9E3779B97F4A7C15ull);
+}
+
+void PhotoStore::insertSlot(int id)
+{
+    // Заполнение не больше 3/4
+    if ((qint64(m_dir.size()) + 1) * 4 > qint64(m_slots.size()) * 3)
+        growSlots();
+    const size_t mask = size_t(m_slots.size()) - 1;
+    size_t slot = slotHash(m_dir[id], fileName(id)) & mask;
+    while (m_slots[slot] >= 0)
+        slot = (slot + 1) & mask;
+    m_slots[slot] = id;
+}
+
+void PhotoStore::growSlots()
+{
+    // Надгробия при перестройке выпадают из таблицы
+    int capacity = qMax(1024, int(m_slots.size()) * 2);
+    while (qint64(m_dir.size()) * 4 >= qint64(capacity) * 3)
+        capacity *= 2;
+    m_slots.fill(-1, capacity);
+    const size_t mask = size_t(capacity) - 1;
+    for (int id = 0; id < m_dir.size(); ++id) {
+        if (isRemoved(id))
+            continue;
+        size_t slot = slotHash(m_dir[id], fileName(id)) & mask;
+        while (m_slots[slot] >= 0)
+            slot = (slot + 1) & mask;
+        m_slots[slot] = id;
+    }
+}
+
+int PhotoStore::indexOf(const QString &filePath) const
+{
+    if (m_slots.isEmpty())
+        return -1;
+    QString dirPath;
+    QStringView name;
+    splitPath(filePath, dirPath, name);
+    const quint32 dir = findDir(dirPath);
+    if (dir == NoDir)
+        return -1;
+
+    const size_t mask = size_t(m_slots.size()) - 1;
+    for (size_t slot = slotHash(dir, name) & mask; m_slots[slot] >= 0; slot = (slot + 1) & mask) {
+        const int id = m_slots[slot];
+        if (m_dir[id] == dir && fileName(id) == name)
+            return id;
+    }
+    return -1;
+}
+
+qint64 PhotoStore::memoryUsage() const
+{
+    qint64 bytes = qint64(m_dir.capacity()) * sizeof(quint32)
+            + qint64(m_nameOffset.capacity()) * sizeof(quint32)
+            + qint64(m_lat.capacity() + m_lng.capacity()) * sizeof(qint32)
+            + qint64(m_taken.capacity()) * sizeof(qint64)
+            + qint64(m_modified.capacity() + m_sizeFlags.capacity()) * sizeof(quint32)
+            + qint64(m_hash.capacity()) * sizeof(quint64)
+            + qint64(m_slots.capacity()) * sizeof(qint32)
+            + qint64(m_names.capacity()) * sizeof(QChar);
+    // Хэш-таблицы Qt - примерно по два указателя на элемент сверх ключа и значения
+    for (const Dir &dir : m_dirs)
+        bytes += sizeof(Dir) + 2 * dir.path.size() * sizeof(QChar) + 2 * sizeof(void*);
+    for (const QString &location : m_locations)
+        bytes += 2 * (location.size() * sizeof(QChar) + sizeof(QString)) + 2 * sizeof(void*);
+    bytes += qint64(m_largeSizes.size() + m_locationOverrides.size()) * (16 + 2 * sizeof(void*));
+    return bytes;
+}
@@ -0,0 +1,140 @@
+#ifndef PHOTOSTORE_H
+#define PHOTOSTORE_H
+
+#include "photoinfo.h"
+
+#include <QDateTime>
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <QStringView>
+#include <QVector>
+#include <limits>
+
+// Хранилище фото по столбцам (structure of arrays).
+// Индекс фото - номер строки, он не меняется: удалённые фото остаются
+// "надгробиями" (dirOf() == NoDir), новые дописываются в конец.
+// На фото приходится 40 байт столбцов:
+//   папка (4) + смещение имени в пуле (4) + широта и долгота в 1e-7 градуса (8)
+//   + время съёмки в мс (8) + время изменения файла в секундах (4)
+//   + размер и флаги (4: 29 бит размера, 3 старших - флаги) + перцептивный хеш (8)
+// плюс 4-8 байт таблицы поиска по пути и сами имена в общем пуле.
+// Время изменения хранится с точностью до секунды, и файлы сверяются с ним
+// тоже по секундам (PhotoCatalog, FolderWatcher).
+// Папки образуют дерево (родитель, имя, глубина) и хранятся один раз;
+// место хранится у папки (её имя), отличающиеся места - в разреженной таблице.
+// Файлы от 512 МБ держат размер в отдельной таблице.
+// Копирование дешёвое (все столбцы - неявно разделяемые контейнеры Qt),
+// поэтому снимок можно отдать в другой поток.
+class PhotoStore
+{
+public:
+    static constexpr quint32 NoDir = 0xFFFFFFFFu;
+    static constexpr quint32 NoLocation = 0xFFFFFFFFu;
+    static constexpr double CoordScale = 1e7;   // 1e-7 градуса - около 1 см
+    static constexpr qint64 NoTime = std::numeric_limits<qint64>::min();
+
+    // Все строки, включая удалённые
+    int size() const { return int(m_dir.size()); }
+    bool isEmpty() const { return m_dir.isEmpty(); }
+    int liveCount() const { return m_live; }
+    void clear();
+    void reserve(int count);
+
+    // Возвращает индекс новой строки
+    int append(const PhotoInfo &info);
+    // Новые метаданные того же файла (путь не меняется)
+    void replace(int id, const PhotoInfo &info);
+    // Надгробие: строка остаётся, но в поиске и обходах не участвует
+    void remove(int id);
+    // -1, если такого файла нет
+    int indexOf(const QString &filePath) const;
+
+    bool isRemoved(int id) const { return m_dir[id] == NoDir; }
+    bool hasGps(int id) const { return m_sizeFlags[id] & FlagHasGps; }
+    bool isGpsFromTrack(int id) const { return m_sizeFlags[id] & FlagTrackGps; }
+    double latitude(int id) const { return m_lat[id] / CoordScale; }
+    double longitude(int id) const { return m_lng[id] / CoordScale; }
+    qint32 latitudeE7(int id) const { return m_lat[id]; }
+    qint32 longitudeE7(int id) const { return m_lng[id]; }
+    // Время съёмки, мс от эпохи; NoTime - неизвестно
+    qint64 taken(int id) const { return m_taken[id]; }
+    QDateTime timestamp(int id) const;
+    // Время изменения файла, мс от эпохи (кратно секунде)
+    qint64 modified(int id) const { return qint64(m_modified[id]) * 1000; }
+    qint64 fileSize(int id) const;
+    bool hasHash(int id) const { return m_sizeFlags[id] & FlagHasHash; }
+    quint64 hash(int id) const { return m_hash[id]; }
+
+    quint32 dirOf(int id) const { return m_dir[id]; }
+    QStringView fileName(int id) const;
+    QString filePath(int id) const;
+    // NoLocation у удалённых
+    quint32 locationOf(int id) const;
+    QString locationName(int id) const;
+    PhotoInfo photo(int id) const;
+
+    // Папки
+    int dirCount() const { return int(m_dirs.size()); }
+    quint32 findDir(const QString &path) const { return m_dirIds.value(path, NoDir); }
+    quint32 dirParent(quint32 dir) const { return m_dirs[dir].parent; }
+    int dirDepth(quint32 dir) const { return m_dirs[dir].depth; }
+    const QString &dirPath(quint32 dir) const { return m_dirs[dir].path; }
+    QStringView dirName(quint32 dir) const;
+
+    // Интернированные названия мест
+    int locationCount() const { return int(m_locations.size()); }
+    const QString &location(quint32 location) const { return m_locations[location]; }
+
+    // Оценка занятой памяти (столбцы, пулы, таблицы), байт
+    qint64 memoryUsage() const;
+
+private:
+    // Флаги занимают старшие биты столбца размера
+    enum Flag : quint32 {
+        FlagHasGps = 1u << 29,
+        FlagHasHash = 1u << 30,
+        FlagTrackGps = 1u << 31
+    };
+    static constexpr quint32 SizeMask = (1u << 29) - 1;   // размер SizeMask - см. m_largeSizes
+
+    struct Dir
+    {
+        QString path;
+        quint32 parent = NoDir;
+        quint32 location = 0;
+        int nameStart = 0;    // имя папки - хвост path
+        int depth = 0;        // число компонентов пути до неё
+    };
+
+    quint32 internDir(const QString &path);
+    quint32 internLocation(const QString &name);
+    void setMetadata(int id, const PhotoInfo &info);
+    static qint32 toFixed(double degrees, double limit);
+
+    // Открытая адресация по (папка, имя) -> индекс строки
+    static size_t slotHash(quint32 dir, QStringView name);
+    void insertSlot(int id);
+    void growSlots();
+
+    QVector<quint32> m_dir;
+    QVector<quint32> m_nameOffset;   // size() + 1 элементов, имя - [i, i + 1)
+    QVector<qint32> m_lat;
+    QVector<qint32> m_lng;
+    QVector<qint64> m_taken;
+    QVector<quint32> m_modified;     // секунды от эпохи
+    QVector<quint32> m_sizeFlags;    // размер & SizeMask | флаги
+    QVector<quint64> m_hash;
+    QString m_names;
+
+    QHash<int, qint64> m_largeSizes;
+    QHash<int, quint32> m_locationOverrides;
+    QVector<Dir> m_dirs;
+    QHash<QString, quint32> m_dirIds;
+    QStringList m_locations;
+    QHash<QString, quint32> m_locationIds;
+    QVector<qint32> m_slots;         // -1 - свободно
+    int m_live = 0;
+};
+
+#endif // PHOTOSTORE_H
@@ -0,0 +1,485 @@
+#include "phototreemodel.h"
+#include "duplicateindex.h"
+#include "thumbnailloader.h"
+#include "tracer.h"
+
+#include <QDir>
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+struct PhotoTreeModel::Node
+{
+    Node *parent = nullptr;
+    int row = 0;
+    int depth = 0;            // номер компонента относительного пути у детей
+    int photo = -1;           // >= 0 у файлов
+    quint32 dir = PhotoStore::NoDir;   // папка хранилища у узлов-папок
+    bool populated = false;
+    int position = 0;         // наименьшая позиция фото под узлом (для reorder)
+    QVector<int> pending;     // фото, ещё не разложенные по детям
+    QVector<Node*> children;
+    QHash<quint32, Node*> dirs;
+
+    ~Node() { qDeleteAll(children); }
+};
+
+PhotoTreeModel::PhotoTreeModel(const PhotoStore *photos, ThumbnailCache *cache,
+                               QObject *parent)
+    : QAbstractItemModel(parent)
+    , m_photos(photos)
+    , m_loader(new ThumbnailLoader(cache, this))
+    , m_icons(MaxCachedIcons)
+{
+    connect(m_loader, &ThumbnailLoader::loaded,
+            this, &PhotoTreeModel::onThumbnailLoaded);
+    rebuild(QString(), QVector<int>());
+}
+
+PhotoTreeModel::~PhotoTreeModel()
+{
+    delete m_root;
+}
+
+void PhotoTreeModel::rebuild(const QString &rootTitle, const QVector<int> &order)
+{
+    delete m_root;
+    m_fileNodes.clear();
+
+    m_root = new Node;
+    m_root->populated = true;
+    m_root->depth = -1;
+
+    m_rootTitle = rootTitle;
+    m_top = new Node;
+    m_top->parent = m_root;
+    m_top->pending = order;
+    m_root->children.append(m_top);
+}
+
+void PhotoTreeModel::setOrder(const QString &rootPath, const QString &rootTitle,
+                              const QVector<int> &order)
+{
+    TraceSpan span("tree.setOrder", order.size());
+    beginResetModel();
+    m_rootPath = QDir::cleanPath(rootPath);
+    m_rootDir = PhotoStore::NoDir;
+    rebuild(rootTitle, order);
+    endResetModel();
+}
+
+bool PhotoTreeModel::reorder(const QVector<int> &order)
+{
+    TraceSpan span("tree.reorder", order.size());
+    QVector<int> position(m_photos->size(), -1);
+    for (int i = 0; i < order.size(); ++i)
+        position[order[i]] = i;
+    int placed = 0;
+    if (!assignPositions(m_top, position, placed) || placed != order.size())
+        return false;
+
+    // Узлы остаются теми же - меняются только номера строк
+    emit layoutAboutToBeChanged();
+    const QModelIndexList before = persistentIndexList();
+    QVector<Node*> nodes;
+    nodes.reserve(before.size());
+    for (const QModelIndex &index : before)
+        nodes.append(nodeFor(index));
+    sortChildren(m_top, order, position);
+    QModelIndexList after;
+    after.reserve(before.size());
+    for (Node *node : std::as_const(nodes))
+        after.append(indexFor(node));
+    changePersistentIndexList(before, after);
+    emit layoutChanged();
+    return true;
+}
+
+bool PhotoTreeModel::assignPositions(Node *node, const QVector<int> &position, int &placed)
+{
+    // Папка встаёт туда, где в новом порядке встречается её первое фото
+    if (node->photo >= 0) {
+        node->position = position.value(node->photo, -1);
+        ++placed;
+        return node->position >= 0;
+    }
+    node->position = std::numeric_limits<int>::max();
+    for (int photo : std::as_const(node->pending)) {
+        const int p = position.value(photo, -1);
+        if (p < 0)
+            return false;
+        node->position = qMin(node->position, p);
+    }
+    placed += int(node->pending.size());
+    for (Node *child : std::as_const(node->children)) {
+        if (!assignPositions(child, position, placed))
+            return false;
+        node->position = qMin(node->position, child->position);
+    }
+    return true;
+}
+
+void PhotoTreeModel::sortChildren(Node *node, const QVector<int> &order, const QVector<int> &position)
+{
+    QVector<int> &pending = node->pending;
+    if (pending.size() > 1) {
+        // Большой список (нераскрытый корень) быстрее выбрать из order
+        // одним проходом, чем сортировать сравнениями
+        if (qint64(pending.size()) * 16 > order.size()) {
+            std::vector<bool> member(m_photos->size(), false);
+            for (int photo : std::as_const(pending))
+                member[photo] = true;
+            int out = 0;
+            for (int photo : order) {
+                if (member[photo])
+                    pending[out++] = photo;
+            }
+        } else {
+            std::sort(pending.begin(), pending.end(),
+                      [&position](int a, int b) { return position[a] < position[b]; });
+        }
+    }
+
+    std::sort(node->children.begin(), node->children.end(),
+              [](const Node *a, const Node *b) { return a->position < b->position; });
+    for (int row = 0; row < node->children.size(); ++row) {
+        Node *child = node->children[row];
+        child->row = row;
+        if (child->photo < 0)
+            sortChildren(child, order, position);
+    }
+}
+
+void PhotoTreeModel::reset(const QString &rootPath, const QString &rootTitle)
+{
+    m_loader->clear();
+    m_icons.clear();
+    setOrder(rootPath, rootTitle, QVector<int>());
+}
+
+void PhotoTreeModel::appendPhotos(int first, int last)
+{
+    TraceSpan span("tree.append", last - first + 1);
+    for (int photo = first; photo <= last; ++photo)
+        placePhoto(photo);
+}
+
+void PhotoTreeModel::removePhoto(int photo)
+{
+    m_icons.remove(photo);
+    m_loader->forget(photo);
+    if (Node *node = m_fileNodes.value(photo)) {
+        removeNode(node);
+        return;
+    }
+
+    // Фото ещё лежит в списке нераскрытой папки
+    Node *node = m_top;
+    while (node->populated) {
+        quint32 dir;
+        if (segment(photo, node->depth, dir))
+            return;
+        node = node->dirs.value(dir);
+        if (!node)
+            return;
+    }
+    node->pending.removeOne(photo);
+    if (node->pending.isEmpty())
+        removeNode(node);
+}
+
+void PhotoTreeModel::removeNode(Node *node)
+{
+    // Вместе с узлом уходят опустевшие родительские папки (кроме корневой)
+    while (node != m_top) {
+        Node *dir = node->parent;
+        const int row = node->row;
+
+        beginRemoveRows(indexFor(dir), row, row);
+        dir->children.remove(row);
+        for (int r = row; r < dir->children.size(); ++r)
+            dir->children[r]->row = r;
+        if (node->photo >= 0)
+            m_fileNodes.remove(node->photo);
+        else
+            dir->dirs.remove(node->dir);
+        endRemoveRows();
+        delete node;
+
+        if (!dir->children.isEmpty() || !dir->pending.isEmpty())
+            return;
+        node = dir;
+    }
+}
+
+void PhotoTreeModel::updatePhoto(int photo)
+{
+    m_icons.remove(photo);
+    m_loader->forget(photo);
+    if (Node *node = m_fileNodes.value(photo)) {
+        const QModelIndex idx = indexFor(node);
+        emit dataChanged(idx, idx);
+    }
+}
+
+PhotoTreeModel::Node *PhotoTreeModel::nodeFor(const QModelIndex &index) const
+{
+    return index.isValid() ? static_cast<Node*>(index.internalPointer()) : m_root;
+}
+
+QModelIndex PhotoTreeModel::indexFor(Node *node) const
+{
+    if (!node || node == m_root)
+        return QModelIndex();
+    return createIndex(node->row, 0, node);
+}
+
+QModelIndex PhotoTreeModel::rootIndex() const
+{
+    return indexFor(m_top);
+}
+
+int PhotoTreeModel::rootDepth() const
+{
+    // Корень попадает в хранилище вместе с первым фото под ним
+    if (m_rootDir == PhotoStore::NoDir && !m_rootPath.isEmpty())
+        m_rootDir = m_photos->findDir(m_rootPath);
+    return m_rootDir == PhotoStore::NoDir ? -1 : m_photos->dirDepth(m_rootDir);
+}
+
+bool PhotoTreeModel::segment(int photo, int depth, quint32 &dir) const
+{
+    // Папка на depth-м уровне под корнем на пути к фото и признак,
+    // что на этом уровне лежит уже сам файл
+    dir = m_photos->dirOf(photo);
+    if (dir == PhotoStore::NoDir)
+        return true;
+    const int below = m_photos->dirDepth(dir) - rootDepth();
+    if (depth >= below)
+        return true;
+    for (int d = below - 1; d > depth; --d)
+        dir = m_photos->dirParent(dir);
+    return false;
+}
+
+PhotoTreeModel::Node *PhotoTreeModel::addChild(Node *parent, quint32 dir, int photo, bool notify)
+{
+    auto *node = new Node;
+    node->parent = parent;
+    node->row = int(parent->children.size());
+    node->depth = parent->depth + 1;
+    node->photo = photo;
+    if (photo >= 0) {
+        node->populated = true;
+        m_fileNodes.insert(photo, node);
+    } else {
+        node->dir = dir;
+        parent->dirs.insert(dir, node);
+    }
+
+    if (notify)
+        beginInsertRows(indexFor(parent), node->row, node->row);
+    parent->children.append(node);
+    if (notify)
+        endInsertRows();
+    return node;
+}
+
+void PhotoTreeModel::placePhoto(int photo)
+{
+    Node *node = m_top;
+    while (node->populated) {
+        quint32 dir;
+        if (segment(photo, node->depth, dir)) {
+            addChild(node, dir, photo, true);
+            return;
+        }
+        Node *sub = node->dirs.value(dir);
+        if (!sub)
+            sub = addChild(node, dir, -1, true);
+        node = sub;
+    }
+    // Папка ещё не раскрывалась - фото будет разложено при fetchMore
+    node->pending.append(photo);
+}
+
+QModelIndex PhotoTreeModel::indexForPhoto(int photo)
+{
+    if (Node *node = m_fileNodes.value(photo))
+        return indexFor(node);
+
+    Node *node = m_top;
+    for (;;) {
+        if (!node->populated)
+            fetchMore(indexFor(node));
+        quint32 dir;
+        if (segment(photo, node->depth, dir)) {
+            Node *file = m_fileNodes.value(photo);
+            return file ? indexFor(file) : QModelIndex();
+        }
+        node = node->dirs.value(dir);
+        if (!node)
+            return QModelIndex();
+    }
+}
+
+QModelIndex PhotoTreeModel::index(int row, int column, const QModelIndex &parent) const
+{
+    if (column != 0 || row < 0)
+        return QModelIndex();
+    Node *node = nodeFor(parent);
+    if (!node->populated || row >= node->children.size())
+        return QModelIndex();
+    return createIndex(row, 0, node->children[row]);
+}
+
+QModelIndex PhotoTreeModel::parent(const QModelIndex &child) const
+{
+    if (!child.isValid())
+        return QModelIndex();
+    return indexFor(nodeFor(child)->parent);
+}
+
+int PhotoTreeModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.column() > 0)
+        return 0;
+    const Node *node = nodeFor(parent);
+    return node->populated ? int(node->children.size()) : 0;
+}
+
+int PhotoTreeModel::columnCount(const QModelIndex &) const
+{
+    return 1;
+}
+
+bool PhotoTreeModel::hasChildren(const QModelIndex &parent) const
+{
+    const Node *node = nodeFor(parent);
+    if (node->photo >= 0)
+        return false;
+    return node->populated ? !node->children.isEmpty() : !node->pending.isEmpty();
+}
+
+bool PhotoTreeModel::canFetchMore(const QModelIndex &parent) const
+{
+    const Node *node = nodeFor(parent);
+    return node->photo < 0 && !node->populated;
+}
+
+void PhotoTreeModel::fetchMore(const QModelIndex &parent)
+{
+    TraceSpan span("tree.fetchMore");
+    Node *dir = nodeFor(parent);
+    if (dir->photo >= 0 || dir->populated)
+        return;
+
+    // Раскладываем сразу целиком, чтобы вставить строки одним сигналом.
+    // Порядок детей - порядок первого появления в отсортированном списке.
+    QVector<Node*> created;
+    for (int photo : std::as_const(dir->pending)) {
+        quint32 folder;
+        if (segment(photo, dir->depth, folder)) {
+            Node *file = new Node;
+            file->parent = dir;
+            file->depth = dir->depth + 1;
+            file->photo = photo;
+            file->populated = true;
+            file->row = int(created.size());
+            created.append(file);
+            m_fileNodes.insert(photo, file);
+        } else {
+            Node *&sub = dir->dirs[folder];
+            if (!sub) {
+                sub = new Node;
+                sub->parent = dir;
+                sub->depth = dir->depth + 1;
+                sub->dir = folder;
+                sub->row = int(created.size());
+                created.append(sub);
+            }
+            sub->pending.append(photo);
+        }
+    }
+    dir->pending = QVector<int>();
+
+    if (created.isEmpty()) {
+        dir->populated = true;
+        return;
+    }
+    beginInsertRows(parent, 0, int(created.size()) - 1);
+    dir->children = created;
+    dir->populated = true;
+    endInsertRows();
+}
+
+QVariant PhotoTreeModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid())
+        return QVariant();
+    Node *node = nodeFor(index);
+
+    switch (role) {
+    case Qt::DisplayRole:
+        if (node == m_top)
+            return m_rootTitle;
+        if (node->photo < 0)
+            return m_photos->dirName(node->dir).toString();
+        if (m_duplicates) {
+            const int group = m_duplicates->groupOf(node->photo);
+            if (group >= 0 && m_duplicates->representative(group) == node->photo)
+                return tr("%1  (+%2 похожих)")
+                        .arg(m_photos->fileName(node->photo).toString())
+                        .arg(m_duplicates->groupSize(group) - 1);
+        }
+        return m_photos->fileName(node->photo).toString();
+    case Qt::UserRole:
+        return node->photo >= 0 ? QVariant(node->photo) : QVariant();
+    case Qt::DecorationRole:
+        return node->photo >= 0 ? icon(node) : QVariant();
+    case Qt::ToolTipRole: {
+        if (node->photo < 0)
+            return QVariant();
+        const QString location = m_photos->locationName(node->photo);
+        return tr("%1\n%2\nШирота: %3\nДолгота: %4")
+                .arg(location.isEmpty() ? m_photos->fileName(node->photo).toString() : location)
+                .arg(m_photos->timestamp(node->photo).toString("yyyy-MM-dd hh:mm"))
+                .arg(m_photos->latitude(node->photo), 0, 'f', 4)
+                .arg(m_photos->longitude(node->photo), 0, 'f', 4);
+    }
+    default:
+        return QVariant();
+    }
+}
+
+QVariant PhotoTreeModel::icon(Node *node) const
+{
+    if (const QPixmap *pix = m_icons.object(node->photo))
+        return *pix;
+
+    m_loader->request(node->photo, m_photos->filePath(node->photo), m_iconSize,
+                      ThumbnailLoader::Visible);
+
+    // Соседние строки ниже - с низким приоритетом, чтобы прокрутка не ждала
+    const Node *dir = node->parent;
+    const int end = qMin(int(dir->children.size()), node->row + 1 + PrefetchRows);
+    for (int r = node->row + 1; r < end; ++r) {
+        const Node *next = dir->children[r];
+        if (next->photo >= 0 && !m_icons.contains(next->photo))
+            m_loader->request(next->photo, m_photos->filePath(next->photo), m_iconSize,
+                              ThumbnailLoader::Prefetch);
+    }
+    return m_placeholder;
+}
+
+void PhotoTreeModel::onThumbnailLoaded(int generation, int photo, const QImage &image)
+{
+    if (generation != m_loader->generation() || photo < 0 || photo >= m_photos->size())
+        return;
+
+    m_icons.insert(photo, new QPixmap(image.isNull() ? m_placeholder : QPixmap::fromImage(image)));
+    if (Node *node = m_fileNodes.value(photo)) {
+        const QModelIndex idx = indexFor(node);
+        emit dataChanged(idx, idx, {Qt::DecorationRole});
+    }
+}
@@ -0,0 +1,102 @@
+#ifndef PHOTOTREEMODEL_H
+#define PHOTOTREEMODEL_H
+
+#include "photostore.h"
+
+#include <QAbstractItemModel>
+#include <QCache>
+#include <QHash>
+#include <QPixmap>
+#include <QSize>
+#include <QVector>
+
+class ThumbnailCache;
+class ThumbnailLoader;
+class DuplicateIndex;
+
+// Дерево папок поверх m_photos без предварительного создания элементов.
+// Папки узлов - это папки хранилища, так что путь к фото не разбирается
+// по строке, а поднимается по родителям от его папки.
+// Каждая папка хранит список ещё не разложенных фото (в порядке сортировки)
+// и раскладывает его на подпапки и файлы только при раскрытии (fetchMore).
+// Миниатюры запрашиваются асинхронно из data() - то есть только для строк,
+// которые представление действительно рисует.
+class PhotoTreeModel : public QAbstractItemModel
+{
+    Q_OBJECT
+
+public:
+    static constexpr int PrefetchRows = 8;
+    static constexpr int MaxCachedIcons = 4096;
+
+    PhotoTreeModel(const PhotoStore *photos, ThumbnailCache *cache,
+                   QObject *parent = nullptr);
+    ~PhotoTreeModel() override;
+
+    // Полная перестройка с новым порядком; миниатюры в памяти сохраняются
+    void setOrder(const QString &rootPath, const QString &rootTitle, const QVector<int> &order);
+    // Тот же набор фото в другом порядке: строки переставляются на месте,
+    // раскрытые папки и выделение остаются. false - набор другой, нужен setOrder
+    bool reorder(const QVector<int> &order);
+    // Новое сканирование: сбрасывает и порядок, и миниатюры
+    void reset(const QString &rootPath, const QString &rootTitle);
+    // Добавление фото [first, last] из m_photos в конец соответствующих папок
+    void appendPhotos(int first, int last);
+    // Удаление фото из дерева (вместе с опустевшими папками); вызывается
+    // до того, как фото будет удалено из m_photos
+    void removePhoto(int photo);
+    // Запись в m_photos изменилась на месте: сбросить миниатюру и перерисовать
+    void updatePhoto(int photo);
+
+    QModelIndex rootIndex() const;
+    // Раскладывает папки на пути к фото и возвращает его индекс
+    QModelIndex indexForPhoto(int photo);
+
+    void setIconSize(const QSize &size) { m_iconSize = size; }
+    void setPlaceholder(const QPixmap &pixmap) { m_placeholder = pixmap; }
+    // Свёрнутые похожие снимки: у представителя группы в подписи число скрытых;
+    // nullptr - без подписи
+    void setDuplicates(const DuplicateIndex *duplicates) { m_duplicates = duplicates; }
+
+    QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const override;
+    QModelIndex parent(const QModelIndex &child) const override;
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    bool hasChildren(const QModelIndex &parent = QModelIndex()) const override;
+    bool canFetchMore(const QModelIndex &parent) const override;
+    void fetchMore(const QModelIndex &parent) override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+
+private slots:
+    void onThumbnailLoaded(int generation, int photo, const QImage &image);
+
+private:
+    struct Node;
+
+    Node *nodeFor(const QModelIndex &index) const;
+    QModelIndex indexFor(Node *node) const;
+    int rootDepth() const;
+    bool segment(int photo, int depth, quint32 &dir) const;
+    Node *addChild(Node *parent, quint32 dir, int photo, bool notify);
+    void placePhoto(int photo);
+    void removeNode(Node *node);
+    bool assignPositions(Node *node, const QVector<int> &position, int &placed);
+    void sortChildren(Node *node, const QVector<int> &order, const QVector<int> &position);
+    QVariant icon(Node *node) const;
+    void rebuild(const QString &rootTitle, const QVector<int> &order);
+
+    const PhotoStore *m_photos = nullptr;
+    ThumbnailLoader *m_loader = nullptr;
+    Node *m_root = nullptr;   // невидимый корень модели
+    Node *m_top = nullptr;    // элемент с именем корневой папки
+    QString m_rootPath;
+    QString m_rootTitle;
+    mutable quint32 m_rootDir = PhotoStore::NoDir;   // находится, когда появятся фото
+    QHash<int, Node*> m_fileNodes;
+    const DuplicateIndex *m_duplicates = nullptr;
+    QSize m_iconSize = QSize(96, 72);
+    QPixmap m_placeholder;
+    mutable QCache<int, QPixmap> m_icons;
+};
+
+#endif // PHOTOTREEMODEL_H
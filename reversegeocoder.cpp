@@ -0,0 +1,409 @@
+#include "reversegeocoder.h"
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFileInfo>
+#include <QHash>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QThread>
+#include <QThreadPool>
+#include <QtMath>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <vector>
+
+struct ReverseGeocoder::Header
+{
+    char magic[4];          // "GPMG"
+    quint32 version;
+    quint32 headerSize;
+    quint32 placeSize;
+    quint32 cellsPerDegree;
+    quint32 id;             // первые 4 байта SHA-1 мест и пула строк
+    quint64 placeCount;
+    quint64 placesOffset;   // сразу за началами ячеек
+    quint64 stringsOffset;
+    quint64 stringsSize;
+    quint32 reserved[2];
+};
+
+struct ReverseGeocoder::Place
+{
+    qint32 latitude;        // 1e-7 градуса
+    qint32 longitude;
+    quint32 nameOffset;     // "Город, регион, страна" в пуле строк
+    quint32 nameLength;
+};
+
+namespace {
+
+constexpr char Magic[4] = {'G', 'P', 'M', 'G'};
+constexpr double KmPerDegree = 111.32;
+constexpr double Scale = 1e7;
+constexpr int BatchChunk = 4096;
+
+// Поля строки выгрузки GeoNames (табуляция)
+enum GeoNamesField {
+    FieldName = 1,
+    FieldLatitude = 4,
+    FieldLongitude = 5,
+    FieldClass = 6,
+    FieldCountry = 8,
+    FieldAdmin1 = 10,
+    FieldCount
+};
+
+} // namespace
+
+ReverseGeocoder::~ReverseGeocoder()
+{
+    close();
+}
+
+QString ReverseGeocoder::defaultPath()
+{
+    const QString path = qEnvironmentVariable("GEOPHOTO_GAZETTEER");
+    if (!path.isEmpty())
+        return path;
+    return QStandardPaths::writableLocation(QStandardPaths::AppDataLocation)
+            + QStringLiteral("/gazetteer.gpg");
+}
+
+bool ReverseGeocoder::compile(const QString &geonamesPath, const QString &admin1Path,
+                              const QString &indexPath, QString *error)
+{
+    const auto fail = [error](const QString &message) {
+        if (error)
+            *error = message;
+        return false;
+    };
+
+    // admin1CodesASCII.txt: "RU.48<TAB>Moscow<TAB>Moscow<TAB>524894"
+    QHash<QByteArray, QByteArray> regions;
+    if (!admin1Path.isEmpty()) {
+        QFile file(admin1Path);
+        if (!file.open(QIODevice::ReadOnly))
+            return fail(QStringLiteral("Cannot read %1: %2").arg(admin1Path, file.errorString()));
+        while (!file.atEnd()) {
+            const QList<QByteArray> fields = file.readLine().split('\t');
+            if (fields.size() >= 2)
+                regions.insert(fields[0], fields[1].trimmed());
+        }
+    }
+
+    QFile file(geonamesPath);
+    if (!file.open(QIODevice::ReadOnly))
+        return fail(QStringLiteral("Cannot read %1: %2").arg(geonamesPath, file.errorString()));
+
+    const int width = 360 * CellsPerDegree;
+    const int height = 180 * CellsPerDegree;
+    const auto cellOf = [width, height](double latitude, double longitude) {
+        const int x = qBound(0, int(std::floor((longitude + 180.0) * CellsPerDegree)), width - 1);
+        const int y = qBound(0, int(std::floor((latitude + 90.0) * CellsPerDegree)), height - 1);
+        return quint32(y) * quint32(width) + quint32(x);
+    };
+
+    // Одинаковые названия (соседние районы одного города) хранятся один раз
+    std::vector<Place> places;
+    std::vector<quint32> cells;
+    QByteArray strings;
+    QHash<QByteArray, quint32> nameOffsets;
+    while (!file.atEnd()) {
+        const QList<QByteArray> fields = file.readLine().split('\t');
+        if (fields.size() < FieldCount || fields[FieldClass] != "P")
+            continue;
+        bool latOk = false;
+        bool lngOk = false;
+        const double latitude = fields[FieldLatitude].toDouble(&latOk);
+        const double longitude = fields[FieldLongitude].toDouble(&lngOk);
+        if (!latOk || !lngOk || qAbs(latitude) > 90.0 || qAbs(longitude) > 180.0)
+            continue;
+
+        QByteArray name = fields[FieldName].trimmed();
+        const QByteArray &country = fields[FieldCountry];
+        const QByteArray region = regions.value(country + '.' + fields[FieldAdmin1]);
+        if (!region.isEmpty() && region != name)
+            name += ", " + region;
+        if (!country.isEmpty())
+            name += ", " + country;
+
+        auto offset = nameOffsets.constFind(name);
+        if (offset == nameOffsets.constEnd()) {
+            offset = nameOffsets.insert(name, quint32(strings.size()));
+            strings.append(name);
+        }
+        Place place;
+        place.latitude = qint32(std::llround(latitude * Scale));
+        place.longitude = qint32(std::llround(longitude * Scale));
+        place.nameOffset = offset.value();
+        place.nameLength = quint32(name.size());
+        places.push_back(place);
+        cells.push_back(cellOf(latitude, longitude));
+    }
+    if (places.empty())
+        return fail(QStringLiteral("No populated places in %1").arg(geonamesPath));
+
+    // Раскладка по ячейкам подсчётом: starts[c] - первое место ячейки c
+    const quint32 cellCount = quint32(width) * quint32(height);
+    std::vector<quint32> starts(cellCount + 1, 0);
+    for (quint32 cell : cells)
+        ++starts[cell + 1];
+    for (quint32 c = 0; c < cellCount; ++c)
+        starts[c + 1] += starts[c];
+    std::vector<Place> sorted(places.size());
+    std::vector<quint32> next(starts.begin(), starts.end() - 1);
+    for (size_t i = 0; i < places.size(); ++i)
+        sorted[next[cells[i]]++] = places[i];
+
+    const QByteArray placeBytes(reinterpret_cast<const char *>(sorted.data()),
+                                qsizetype(sorted.size() * sizeof(Place)));
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(placeBytes);
+    hash.addData(strings);
+    quint32 id = 0;
+    std::memcpy(&id, hash.result().constData(), sizeof(id));
+
+    Header header = {};
+    std::memcpy(header.magic, Magic, sizeof(Magic));
+    header.version = Version;
+    header.headerSize = sizeof(Header);
+    header.placeSize = sizeof(Place);
+    header.cellsPerDegree = CellsPerDegree;
+    header.id = id != 0 ? id : 1;   // 0 в каталоге - "без геокодера"
+    header.placeCount = quint64(sorted.size());
+    header.placesOffset = sizeof(Header) + quint64(starts.size()) * sizeof(quint32);
+    header.stringsOffset = header.placesOffset + quint64(placeBytes.size());
+    header.stringsSize = quint64(strings.size());
+
+    QDir().mkpath(QFileInfo(indexPath).absolutePath());
+    QSaveFile out(indexPath);
+    if (!out.open(QIODevice::WriteOnly))
+        return fail(QStringLiteral("Cannot write %1: %2").arg(indexPath, out.errorString()));
+    out.write(reinterpret_cast<const char *>(&header), sizeof(Header));
+    out.write(reinterpret_cast<const char *>(starts.data()), qint64(starts.size() * sizeof(quint32)));
+    out.write(placeBytes);
+    out.write(strings);
+    if (!out.commit())
+        return fail(QStringLiteral("Cannot write %1: %2").arg(indexPath, out.errorString()));
+    return true;
+}
+
+bool ReverseGeocoder::open(const QString &indexPath)
+{
+    static_assert(sizeof(Header) == 64, "gazetteer header layout");
+    static_assert(sizeof(Place) == 16, "gazetteer place layout");
+    close();
+
+    m_file.setFileName(indexPath);
+    if (!m_file.open(QIODevice::ReadOnly))
+        return false;
+    const qint64 fileSize = m_file.size();
+    if (fileSize < qint64(sizeof(Header))) {
+        close();
+        return false;
+    }
+    m_base = m_file.map(0, fileSize);
+    if (!m_base) {
+        close();
+        return false;
+    }
+
+    Header header;
+    std::memcpy(&header, m_base, sizeof(Header));
+    const int cellsPerDegree = int(header.cellsPerDegree);
+    const quint64 cellCount = quint64(360 * 180) * quint64(cellsPerDegree) * quint64(cellsPerDegree);
+    const bool valid = std::memcmp(header.magic, Magic, sizeof(Magic)) == 0
+            && header.version == Version
+            && header.headerSize == sizeof(Header)
+            && header.placeSize == sizeof(Place)
+            && cellsPerDegree > 0 && cellsPerDegree <= 64
+            && header.placesOffset == sizeof(Header) + (cellCount + 1) * sizeof(quint32)
+            && header.stringsOffset == header.placesOffset + header.placeCount * sizeof(Place)
+            && header.stringsOffset + header.stringsSize == quint64(fileSize);
+    if (!valid) {
+        close();
+        return false;
+    }
+
+    m_cells = reinterpret_cast<const quint32 *>(m_base + sizeof(Header));
+    m_places = reinterpret_cast<const Place *>(m_base + header.placesOffset);
+    m_strings = reinterpret_cast<const char *>(m_base + header.stringsOffset);
+    m_placeCount = header.placeCount;
+    m_stringsSize = header.stringsSize;
+    m_cellsPerDegree = cellsPerDegree;
+    m_width = 360 * cellsPerDegree;
+    m_height = 180 * cellsPerDegree;
+    m_id = header.id;
+
+    // Структурная проверка: начала ячеек не убывают, имена внутри пула
+    bool consistent = m_cells[0] == 0 && m_cells[cellCount] == m_placeCount;
+    for (quint64 c = 0; consistent && c < cellCount; ++c)
+        consistent = m_cells[c] <= m_cells[c + 1];
+    for (quint64 i = 0; consistent && i < m_placeCount; ++i)
+        consistent = quint64(m_places[i].nameOffset) + m_places[i].nameLength <= m_stringsSize;
+    if (!consistent) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void ReverseGeocoder::close()
+{
+    if (m_base) {
+        m_file.unmap(m_base);
+        m_base = nullptr;
+    }
+    if (m_file.isOpen())
+        m_file.close();
+    m_cells = nullptr;
+    m_places = nullptr;
+    m_strings = nullptr;
+    m_placeCount = 0;
+    m_stringsSize = 0;
+    m_id = 0;
+}
+
+int ReverseGeocoder::cellX(double longitude) const
+{
+    return qBound(0, int(std::floor((longitude + 180.0) * m_cellsPerDegree)), m_width - 1);
+}
+
+int ReverseGeocoder::cellY(double latitude) const
+{
+    return qBound(0, int(std::floor((latitude + 90.0) * m_cellsPerDegree)), m_height - 1);
+}
+
+int ReverseGeocoder::nearest(double latitude, double longitude, double maxKm) const
+{
+    if (!m_places || !std::isfinite(latitude) || !std::isfinite(longitude))
+        return -1;
+
+    // Расстояние - в градусах широты, долгота сжата косинусом широты точки
+    const double cosLat = qMax(0.01, std::cos(qDegreesToRadians(latitude)));
+    const double cell = 1.0 / m_cellsPerDegree;
+    const double limit = maxKm / KmPerDegree;
+    const qint64 qLat = std::llround(latitude * Scale);
+    const qint64 qLng = std::llround(longitude * Scale);
+    const int cx = cellX(longitude);
+    const int cy = cellY(latitude);
+    const int maxRingY = int(std::ceil(limit * m_cellsPerDegree)) + 1;
+    const int maxRingX = qMin(m_width / 2, int(std::ceil(limit / cosLat * m_cellsPerDegree)) + 1);
+
+    double best = limit * limit;
+    int bestPlace = -1;
+    const auto scan = [&](int x, int y) {
+        if (y < 0 || y >= m_height)
+            return;
+        x = (x % m_width + m_width) % m_width;
+        const quint32 index = quint32(y) * quint32(m_width) + quint32(x);
+        for (quint32 i = m_cells[index]; i < m_cells[index + 1]; ++i) {
+            const Place &p = m_places[i];
+            const double dy = double(p.latitude - qLat) / Scale;
+            double dx = std::abs(double(p.longitude - qLng)) / Scale;
+            if (dx > 180.0)
+                dx = 360.0 - dx;
+            dx *= cosLat;
+            const double d = dx * dx + dy * dy;
+            if (d < best) {
+                best = d;
+                bestPlace = int(i);
+            }
+        }
+    };
+
+    const int maxRing = qMax(maxRingX, maxRingY);
+    for (int r = 0; r <= maxRing; ++r) {
+        // До мест кольца r не меньше r - 1 целых ячеек по одной из осей
+        const double bound = (r - 1) * cell * cosLat;
+        if (r > 1 && bound * bound >= best)
+            break;
+        if (r == 0) {
+            scan(cx, cy);
+            continue;
+        }
+        for (int dx = -qMin(r, maxRingX); dx <= qMin(r, maxRingX); ++dx) {
+            if (r <= maxRingY) {
+                scan(cx + dx, cy - r);
+                scan(cx + dx, cy + r);
+            }
+        }
+        if (r > maxRingX)
+            continue;
+        for (int dy = -qMin(r - 1, maxRingY); dy <= qMin(r - 1, maxRingY); ++dy) {
+            scan(cx - r, cy + dy);
+            scan(cx + r, cy + dy);
+        }
+    }
+    return bestPlace;
+}
+
+QString ReverseGeocoder::placeName(int place) const
+{
+    if (place < 0 || quint64(place) >= m_placeCount)
+        return QString();
+    const Place &p = m_places[place];
+    return QString::fromUtf8(m_strings + p.nameOffset, qsizetype(p.nameLength));
+}
+
+QVector<int> ReverseGeocoder::nearest(const QVector<QPointF> &points, double maxKm) const
+{
+    const int n = int(points.size());
+    QVector<int> result(n, -1);
+    if (!m_places || n == 0)
+        return result;
+
+    QVector<quint32> cells(n);
+    for (int i = 0; i < n; ++i) {
+        const QPointF &p = points[i];
+        cells[i] = std::isfinite(p.x()) && std::isfinite(p.y())
+                ? quint32(cellY(p.y())) * quint32(m_width) + quint32(cellX(p.x()))
+                : 0u;
+    }
+    QVector<int> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&cells](int a, int b) { return cells[a] < cells[b]; });
+
+    // Каждая задача пишет в свои элементы результата
+    int *out = result.data();
+    const int *ids = order.constData();
+    const QPointF *query = points.constData();
+    QThreadPool pool;
+    pool.setMaxThreadCount(qMax(1, QThread::idealThreadCount()));
+    for (int first = 0; first < n; first += BatchChunk) {
+        const int last = qMin(n, first + BatchChunk);
+        pool.start([this, out, ids, query, first, last, maxKm]() {
+            for (int i = first; i < last; ++i) {
+                const int id = ids[i];
+                out[id] = nearest(query[id].y(), query[id].x(), maxKm);
+            }
+        });
+    }
+    pool.waitForDone();
+    return result;
+}
+
+void ReverseGeocoder::resolve(QVector<PhotoInfo> &photos, const QVector<int> &indexes) const
+{
+    if (!m_places)
+        return;
+    // Фото пачки обычно из одной папки - название строится один раз на место
+    int lastPlace = -1;
+    QString lastName;
+    for (int i : indexes) {
+        PhotoInfo &info = photos[i];
+        if (!info.hasGps)
+            continue;
+        const int place = nearest(info.latitude, info.longitude);
+        if (place < 0)
+            continue;
+        if (place != lastPlace) {
+            lastPlace = place;
+            lastName = placeName(place);
+        }
+        info.locationName = lastName;
+    }
+}
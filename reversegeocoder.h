@@ -0,0 +1,77 @@
+#ifndef REVERSEGEOCODER_H
+#define REVERSEGEOCODER_H
+
+#include "photoinfo.h"
+
+#include <QFile>
+#include <QPointF>
+#include <QString>
+#include <QVector>
+
+// Офлайн-геокодер: координаты -> название ближайшего населённого пункта
+// ("Город, регион, страна") из локальной выгрузки GeoNames.
+// Выгрузка (cities500.txt, cities1000.txt, allCountries.txt и т.п.,
+// по желанию с admin1CodesASCII.txt для регионов) один раз компилируется
+// в бинарный индекс, который потом отображается в память целиком:
+//   заголовок | начала ячеек сетки (quint32) | места по ячейкам | пул строк (UTF-8)
+// Сетка равномерная, CellsPerDegree ячеек на градус; ближайшее место ищется
+// кольцами ячеек вокруг точки, пока кольцо не станет дальше найденного.
+// Поиск только читает отображённую память - потокобезопасен.
+class ReverseGeocoder
+{
+public:
+    static constexpr quint32 Version = 1;
+    static constexpr int CellsPerDegree = 4;
+    static constexpr double MaxDistanceKm = 50.0;   // дальше - места нет
+
+    ReverseGeocoder() = default;
+    ~ReverseGeocoder();
+    ReverseGeocoder(const ReverseGeocoder &) = delete;
+    ReverseGeocoder &operator=(const ReverseGeocoder &) = delete;
+
+    // Индекс по умолчанию: GEOPHOTO_GAZETTEER или AppDataLocation/gazetteer.gpg
+    static QString defaultPath();
+    // Выгрузка GeoNames (+ необязательные коды регионов) -> индекс.
+    // Берутся только населённые пункты (класс P).
+    static bool compile(const QString &geonamesPath, const QString &admin1Path,
+                        const QString &indexPath, QString *error = nullptr);
+
+    bool open(const QString &indexPath);
+    void close();
+    bool isOpen() const { return m_places != nullptr; }
+    int placeCount() const { return int(m_placeCount); }
+    // Отпечаток содержимого индекса: им помечаются названия в каталоге фото
+    quint32 id() const { return m_id; }
+
+    // Ближайшее место или -1
+    int nearest(double latitude, double longitude, double maxKm = MaxDistanceKm) const;
+    QString placeName(int place) const;
+
+    // Пакетный поиск, точки - (долгота, широта). Точки упорядочиваются по ячейкам,
+    // чтобы соседние запросы читали одни и те же страницы индекса, и делятся
+    // между потоками. Результат - номера мест в исходном порядке точек
+    QVector<int> nearest(const QVector<QPointF> &points, double maxKm = MaxDistanceKm) const;
+    // Название места для фото из photos[indexes] с GPS; без места название не меняется
+    void resolve(QVector<PhotoInfo> &photos, const QVector<int> &indexes) const;
+
+private:
+    struct Header;
+    struct Place;
+
+    int cellX(double longitude) const;
+    int cellY(double latitude) const;
+
+    QFile m_file;
+    uchar *m_base = nullptr;
+    const quint32 *m_cells = nullptr;   // m_width * m_height + 1 начал
+    const Place *m_places = nullptr;
+    const char *m_strings = nullptr;
+    quint64 m_placeCount = 0;
+    quint64 m_stringsSize = 0;
+    int m_width = 0;
+    int m_height = 0;
+    int m_cellsPerDegree = CellsPerDegree;
+    quint32 m_id = 0;
+};
+
+#endif // REVERSEGEOCODER_H
@@ -0,0 +1,274 @@
+#include "routeindex.h"
+#include "markerclusterer.h"
+#include "tracer.h"
+
+#include <QThread>
+#include <QThreadPool>
+#include <QtMath>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+// Длина градуса широты, км
+constexpr double KmPerDegree = 111.32;
+// Вершин на задачу пула: короткие поездки упрощаются пачками
+constexpr int SimplifyChunk = 4096;
+
+double distanceKm(double lat1, double lng1, double lat2, double lng2)
+{
+    double dLng = std::abs(lng2 - lng1);
+    if (dLng > 180.0)
+        dLng = 360.0 - dLng;
+    const double dx = dLng * std::cos(qDegreesToRadians((lat1 + lat2) / 2.0));
+    const double dy = lat2 - lat1;
+    return std::sqrt(dx * dx + dy * dy) * KmPerDegree;
+}
+
+// Расстояние от точки p до отрезка a-b (поездка может вернуться в начало)
+double segmentDistance(double px, double py, double ax, double ay, double bx, double by)
+{
+    const double dx = bx - ax;
+    const double dy = by - ay;
+    const double length = dx * dx + dy * dy;
+    double t = 0.0;
+    if (length > 0.0)
+        t = qBound(0.0, ((px - ax) * dx + (py - ay) * dy) / length, 1.0);
+    const double ex = px - ax - t * dx;
+    const double ey = py - ay - t * dy;
+    return std::sqrt(ex * ex + ey * ey);
+}
+
+// Douglas-Peucker без рекурсии: значимость вершины - её отклонение от хорды
+// в момент выбора, не больше значимости родителя. Тогда вершины со
+// значимостью больше допуска - ровно результат алгоритма с этим допуском
+void simplify(const double *x, const double *y, double *significance, int count)
+{
+    struct Range
+    {
+        int first;
+        int last;
+        double limit;
+    };
+
+    constexpr double Infinity = std::numeric_limits<double>::infinity();
+    significance[0] = Infinity;
+    significance[count - 1] = Infinity;
+    QVector<Range> stack;
+    stack.append({0, count - 1, Infinity});
+    while (!stack.isEmpty()) {
+        const Range range = stack.takeLast();
+        if (range.last - range.first < 2)
+            continue;
+        int farthest = range.first + 1;
+        double maxDistance = -1.0;
+        for (int i = range.first + 1; i < range.last; ++i) {
+            const double d = segmentDistance(x[i], y[i], x[range.first], y[range.first],
+                                             x[range.last], y[range.last]);
+            if (d > maxDistance) {
+                maxDistance = d;
+                farthest = i;
+            }
+        }
+        const double value = qMin(maxDistance, range.limit);
+        significance[farthest] = value;
+        stack.append({range.first, farthest, value});
+        stack.append({farthest, range.last, value});
+    }
+}
+
+// Допуск уровня в нормированных единицах: мир на уровне z - 256 * 2^z пикселей
+double levelTolerance(int level)
+{
+    return RouteIndex::TolerancePixels / (256.0 * double(1 << level));
+}
+
+} // namespace
+
+void RouteIndex::clear()
+{
+    m_x.clear();
+    m_y.clear();
+    m_time.clear();
+    m_significance.clear();
+    m_tripStart.clear();
+    m_bounds.clear();
+    m_levelVertices.clear();
+    m_levelStart.clear();
+}
+
+int RouteIndex::levelVertexCount(int zoom) const
+{
+    if (m_levelVertices.isEmpty())
+        return 0;
+    return int(m_levelVertices[qBound(0, zoom, MaxLevel)].size());
+}
+
+void RouteIndex::build(const PhotoStore &photos)
+{
+    TraceSpan span("route.build");
+    clear();
+
+    QVector<int> ids;
+    ids.reserve(photos.liveCount());
+    for (int id = 0; id < photos.size(); ++id) {
+        if (!photos.isRemoved(id) && photos.hasGps(id) && photos.taken(id) != PhotoStore::NoTime)
+            ids.append(id);
+    }
+    std::sort(ids.begin(), ids.end(), [&photos](int a, int b) {
+        return photos.taken(a) < photos.taken(b) || (photos.taken(a) == photos.taken(b) && a < b);
+    });
+    span.setValue(ids.size());
+
+    // Нарезка на поездки; поездка из одного фото - не линия
+    m_tripStart.append(0);
+    const auto closeTrip = [this]() {
+        const int first = m_tripStart.last();
+        const int count = int(m_x.size()) - first;
+        if (count < 2) {
+            m_x.resize(first);
+            m_y.resize(first);
+            m_time.resize(first);
+            return;
+        }
+        Bounds bounds{m_x[first], m_y[first], m_x[first], m_y[first]};
+        for (int i = first + 1; i < first + count; ++i) {
+            bounds.minX = qMin(bounds.minX, m_x[i]);
+            bounds.maxX = qMax(bounds.maxX, m_x[i]);
+            bounds.minY = qMin(bounds.minY, m_y[i]);
+            bounds.maxY = qMax(bounds.maxY, m_y[i]);
+        }
+        m_bounds.append(bounds);
+        m_tripStart.append(int(m_x.size()));
+    };
+    m_x.reserve(ids.size());
+    m_y.reserve(ids.size());
+    m_time.reserve(ids.size());
+    int previous = -1;
+    for (int id : std::as_const(ids)) {
+        double x = MarkerClusterer::lngToX(photos.longitude(id));
+        const bool sameTrip = previous >= 0
+                && photos.taken(id) - photos.taken(previous) <= SplitGapMs
+                && distanceKm(photos.latitude(previous), photos.longitude(previous),
+                              photos.latitude(id), photos.longitude(id)) <= SplitDistanceKm;
+        if (!sameTrip) {
+            if (previous >= 0)
+                closeTrip();
+        } else {
+            // Через антимеридиан - к ближайшей копии мира
+            const double last = m_x.last();
+            x -= std::round(x - last);
+        }
+        m_x.append(x);
+        m_y.append(MarkerClusterer::latToY(photos.latitude(id)));
+        m_time.append(photos.taken(id));
+        previous = id;
+    }
+    if (previous >= 0)
+        closeTrip();
+    if (isEmpty())
+        return;
+
+    // Поездки упрощаются параллельно, каждая - в своём диапазоне вершин
+    m_significance.resize(m_x.size());
+    const double *xs = m_x.constData();
+    const double *ys = m_y.constData();
+    double *significance = m_significance.data();
+    const int *starts = m_tripStart.constData();
+    const int trips = tripCount();
+    QThreadPool pool;
+    pool.setMaxThreadCount(qMax(1, QThread::idealThreadCount()));
+    for (int first = 0; first < trips;) {
+        int last = first + 1;
+        while (last < trips && starts[last] - starts[first] < SimplifyChunk)
+            ++last;
+        pool.start([xs, ys, significance, starts, first, last]() {
+            for (int t = first; t < last; ++t)
+                simplify(xs + starts[t], ys + starts[t], significance + starts[t],
+                         starts[t + 1] - starts[t]);
+        });
+        first = last;
+    }
+    pool.waitForDone();
+
+    // Уровни независимы и тоже строятся параллельно
+    m_levelVertices.resize(MaxLevel + 1);
+    m_levelStart.resize(MaxLevel + 1);
+    for (int level = 0; level <= MaxLevel; ++level) {
+        QVector<int> *vertices = &m_levelVertices[level];
+        QVector<int> *levelStart = &m_levelStart[level];
+        pool.start([significance, starts, trips, level, vertices, levelStart]() {
+            const double tolerance = levelTolerance(level);
+            levelStart->reserve(trips + 1);
+            levelStart->append(0);
+            for (int t = 0; t < trips; ++t) {
+                for (int i = starts[t]; i < starts[t + 1]; ++i) {
+                    if (significance[i] > tolerance)
+                        vertices->append(i);
+                }
+                levelStart->append(int(vertices->size()));
+            }
+            vertices->squeeze();
+        });
+    }
+    pool.waitForDone();
+}
+
+void RouteIndex::query(double west, double south, double east, double north, int zoom,
+                       qint64 start, qint64 end, QVector<float> &coords, QVector<int> &lengths) const
+{
+    coords.clear();
+    lengths.clear();
+    if (isEmpty())
+        return;
+
+    const int level = qBound(0, zoom, MaxLevel);
+    const QVector<int> &vertices = m_levelVertices[level];
+    const QVector<int> &levelStart = m_levelStart[level];
+
+    // Окно с запасом в половину размера: небольшой пан не меняет набор линий
+    double x0 = MarkerClusterer::lngToX(west);
+    double x1 = MarkerClusterer::lngToX(east);
+    double y0 = MarkerClusterer::latToY(north);
+    double y1 = MarkerClusterer::latToY(south);
+    const double padX = (x1 - x0) / 2.0;
+    const double padY = (y1 - y0) / 2.0;
+    x0 -= padX;
+    x1 += padX;
+    y0 -= padY;
+    y1 += padY;
+
+    const auto timeLess = [this](int v, qint64 time) { return m_time[v] < time; };
+    for (int t = 0; t < tripCount(); ++t) {
+        const Bounds &b = m_bounds[t];
+        if (b.maxY < y0 || b.minY > y1)
+            continue;
+        if (m_time[m_tripStart[t]] >= end || m_time[m_tripStart[t + 1] - 1] < start)
+            continue;
+        // Копия мира, в которой поездка видна в окне
+        double shift = 0.0;
+        bool visible = false;
+        for (double k : {0.0, -1.0, 1.0}) {
+            if (b.minX + k <= x1 && b.maxX + k >= x0) {
+                shift = k;
+                visible = true;
+                break;
+            }
+        }
+        if (!visible)
+            continue;
+
+        // Вершины поездки идут по времени - период режет их одним отрезком
+        const auto first = std::lower_bound(vertices.cbegin() + levelStart[t],
+                                            vertices.cbegin() + levelStart[t + 1], start, timeLess);
+        const auto last = std::lower_bound(first, vertices.cbegin() + levelStart[t + 1], end, timeLess);
+        if (last - first < 2)
+            continue;
+        for (auto it = first; it != last; ++it) {
+            coords.append(float(MarkerClusterer::yToLat(m_y[*it])));
+            coords.append(float(MarkerClusterer::xToLng(m_x[*it] + shift)));
+        }
+        lengths.append(int(last - first));
+    }
+}
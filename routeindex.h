@@ -0,0 +1,65 @@
+#ifndef ROUTEINDEX_H
+#define ROUTEINDEX_H
+
+#include "photostore.h"
+
+#include <QVector>
+
+// Маршруты поездок: фото с GPS, соединённые в порядке времени съёмки.
+// Последовательность режется на поездки по паузе больше SplitGapMs или
+// скачку дальше SplitDistanceKm (перелёт - не линия через полмира).
+// Вершины хранятся в нормированной проекции Web Mercator, как в
+// MarkerClusterer; долгота разворачивается вдоль поездки, поэтому линия
+// через антимеридиан не тянется через всю карту.
+// Упрощение - Douglas-Peucker, один проход на поездку (поездки параллельно):
+// каждая вершина получает значимость - отклонение, при котором её выбрал
+// алгоритм, не больше значимости родителя. Уровень зума z оставляет
+// вершины со значимостью больше TolerancePixels экранных пикселей этого
+// уровня, так что на каждом зуме это ровно результат Douglas-Peucker
+// с таким допуском. Списки вершин уровней строятся заранее, и странице
+// уходит только уровень текущего зума в пределах окна карты.
+class RouteIndex
+{
+public:
+    static constexpr qint64 SplitGapMs = 6 * 60 * 60 * 1000;
+    static constexpr double SplitDistanceKm = 300.0;
+    static constexpr double TolerancePixels = 1.5;
+    static constexpr int MaxLevel = 18;        // глубже - вершины этого уровня (доли метра)
+
+    // Учитываются неудалённые фото с GPS и временем съёмки
+    void build(const PhotoStore &photos);
+    void clear();
+    bool isEmpty() const { return m_tripStart.size() <= 1; }
+
+    int tripCount() const { return qMax(0, int(m_tripStart.size()) - 1); }
+    int vertexCount() const { return int(m_x.size()); }
+    // Вершин на уровне зума
+    int levelVertexCount(int zoom) const;
+
+    // Линии уровня zoom, задевающие окно (в градусах, долготы могут выходить
+    // за +-180) и отрезанные по времени [start, end): пары (широта, долгота)
+    // в coords, число вершин каждой линии в lengths
+    void query(double west, double south, double east, double north, int zoom,
+               qint64 start, qint64 end, QVector<float> &coords, QVector<int> &lengths) const;
+
+private:
+    struct Bounds
+    {
+        double minX;
+        double minY;
+        double maxX;
+        double maxY;
+    };
+
+    QVector<double> m_x;              // вершины всех поездок подряд
+    QVector<double> m_y;
+    QVector<qint64> m_time;
+    QVector<double> m_significance;
+    QVector<int> m_tripStart;         // tripCount() + 1 начал в m_x
+    QVector<Bounds> m_bounds;
+    // Для уровня: номера вершин по поездкам и tripCount() + 1 начал
+    QVector<QVector<int>> m_levelVertices;
+    QVector<QVector<int>> m_levelStart;
+};
+
+#endif // ROUTEINDEX_H
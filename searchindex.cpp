@@ -0,0 +1,538 @@
+#include "searchindex.h"
+#include "tracer.h"
+
+#include <QDate>
+#include <QDateTime>
+#include <QThread>
+#include <QThreadPool>
+#include <algorithm>
+
+namespace {
+
+// Кусок имён на задачу - ровно один контейнер PhotoSet
+constexpr int ChunkBits = 16;
+constexpr int ChunkSize = 1 << ChunkBits;
+
+// Папка совпала целиком или её путь кончается началом слова до '/'
+enum DirHit : quint8 {
+    DirContains = 1u << 0,
+    DirSuffix = 1u << 1
+};
+
+char16_t fold(QChar c)
+{
+    return c.toCaseFolded().unicode();
+}
+
+// Ключ триграммы - три символа UTF-16 в свёрнутом регистре, 48 бит
+template <typename Function>
+void forEachTrigram(QStringView text, Function function)
+{
+    if (text.size() < 3)
+        return;
+    quint64 key = (quint64(fold(text.at(0))) << 16) | fold(text.at(1));
+    for (qsizetype i = 2; i < text.size(); ++i) {
+        key = ((key << 16) | fold(text.at(i))) & Q_UINT64_C(0xFFFFFFFFFFFF);
+        function(key);
+    }
+}
+
+struct Token
+{
+    QString text;
+    bool quoted = false;
+};
+
+// Слова через пробелы; "в кавычках" - одно слово, и это всегда текст, а не фильтр
+QVector<Token> tokenize(const QString &text)
+{
+    QVector<Token> tokens;
+    Token current;
+    bool inQuotes = false;
+    const auto flush = [&tokens, &current]() {
+        if (!current.text.isEmpty())
+            tokens.append(current);
+        current = Token();
+    };
+    for (const QChar c : text) {
+        if (c == QLatin1Char('"')) {
+            if (inQuotes)
+                flush();
+            else
+                current.quoted = true;
+            inQuotes = !inQuotes;
+            continue;
+        }
+        if (!inQuotes && c.isSpace()) {
+            flush();
+            continue;
+        }
+        current.text.append(c);
+    }
+    flush();
+    return tokens;
+}
+
+// "2023", "2023-05" или "2023-05-01": начало периода и начало следующего, мс
+bool parsePeriod(const QString &text, qint64 &start, qint64 &end)
+{
+    const QStringList parts = text.split(QLatin1Char('-'));
+    if (parts.size() > 3)
+        return false;
+    int numbers[3] = {0, 1, 1};
+    for (int i = 0; i < parts.size(); ++i) {
+        bool ok = false;
+        numbers[i] = parts[i].toInt(&ok);
+        if (!ok)
+            return false;
+    }
+    const QDate first(numbers[0], numbers[1], numbers[2]);
+    if (!first.isValid())
+        return false;
+    const QDate next = parts.size() == 1 ? first.addYears(1)
+                     : parts.size() == 2 ? first.addMonths(1)
+                                         : first.addDays(1);
+    start = first.startOfDay().toMSecsSinceEpoch();
+    end = next.startOfDay().toMSecsSinceEpoch();
+    return true;
+}
+
+// "500k", "5mb", "1.5g", "120000"; множители двоичные
+bool parseSize(QString text, qint64 &bytes)
+{
+    struct Unit
+    {
+        const char *suffix;
+        qint64 factor;
+    };
+    static const Unit units[] = {
+        {"kb", qint64(1) << 10}, {"mb", qint64(1) << 20}, {"gb", qint64(1) << 30},
+        {"k", qint64(1) << 10}, {"m", qint64(1) << 20}, {"g", qint64(1) << 30}, {"b", 1}
+    };
+    text = text.trimmed().toLower();
+    qint64 factor = 1;
+    for (const Unit &unit : units) {
+        if (text.endsWith(QLatin1String(unit.suffix))) {
+            factor = unit.factor;
+            text.chop(int(qstrlen(unit.suffix)));
+            break;
+        }
+    }
+    bool ok = false;
+    const double value = text.toDouble(&ok);
+    if (!ok || value < 0.0)
+        return false;
+    bytes = qint64(value * double(factor));
+    return true;
+}
+
+bool parseDateFilter(const QString &value, SearchQuery &query)
+{
+    qint64 start = std::numeric_limits<qint64>::min();
+    qint64 end = std::numeric_limits<qint64>::max();
+    qint64 unused = 0;
+    const int dots = value.indexOf(QLatin1String(".."));
+    if (dots < 0) {
+        if (!parsePeriod(value, start, end))
+            return false;
+    } else {
+        const QString from = value.left(dots);
+        const QString to = value.mid(dots + 2);
+        if (from.isEmpty() && to.isEmpty())
+            return false;
+        if (!from.isEmpty() && !parsePeriod(from, start, unused))
+            return false;
+        if (!to.isEmpty() && !parsePeriod(to, unused, end))
+            return false;
+    }
+    query.byTime = true;
+    query.takenFrom = start;
+    query.takenTo = end;
+    return true;
+}
+
+bool parseSizeFilter(const QString &value, SearchQuery &query)
+{
+    qint64 minSize = 0;
+    qint64 maxSize = std::numeric_limits<qint64>::max();
+    const int dots = value.indexOf(QLatin1String(".."));
+    if (dots >= 0) {
+        const QString from = value.left(dots);
+        const QString to = value.mid(dots + 2);
+        if ((!from.isEmpty() && !parseSize(from, minSize)) || (!to.isEmpty() && !parseSize(to, maxSize)))
+            return false;
+    } else if (value.startsWith(QLatin1Char('<'))) {
+        const int skip = value.startsWith(QLatin1String("<=")) ? 2 : 1;
+        if (!parseSize(value.mid(skip), maxSize))
+            return false;
+    } else {
+        const int skip = value.startsWith(QLatin1String(">=")) ? 2 : value.startsWith(QLatin1Char('>')) ? 1 : 0;
+        if (!parseSize(value.mid(skip), minSize))
+            return false;
+    }
+    if (minSize > maxSize)
+        return false;
+    query.bySize = true;
+    query.minSize = minSize;
+    query.maxSize = maxSize;
+    return true;
+}
+
+bool parseBoxFilter(const QString &value, SearchQuery &query)
+{
+    const QStringList parts = value.split(QLatin1Char(','));
+    if (parts.size() != 4)
+        return false;
+    double numbers[4];
+    for (int i = 0; i < 4; ++i) {
+        bool ok = false;
+        numbers[i] = parts[i].trimmed().toDouble(&ok);
+        if (!ok)
+            return false;
+    }
+    if (numbers[1] > numbers[3] || numbers[1] < -90.0 || numbers[3] > 90.0
+            || qAbs(numbers[0]) > 180.0 || qAbs(numbers[2]) > 180.0)
+        return false;
+    query.byBox = true;
+    query.west = numbers[0];
+    query.south = numbers[1];
+    query.east = numbers[2];
+    query.north = numbers[3];
+    return true;
+}
+
+bool parseGpsFilter(const QString &value, SearchQuery &query)
+{
+    const QString v = value.toLower();
+    if (v == QLatin1String("yes") || v == QLatin1String("true") || v == QLatin1String("1")
+            || v == QStringLiteral("да")) {
+        query.gps = 1;
+        return true;
+    }
+    if (v == QLatin1String("no") || v == QLatin1String("false") || v == QLatin1String("0")
+            || v == QStringLiteral("нет")) {
+        query.gps = 0;
+        return true;
+    }
+    return false;
+}
+
+} // namespace
+
+bool SearchQuery::isEmpty() const
+{
+    return terms.isEmpty() && !byTime && gps < 0 && extensions.isEmpty() && !bySize && !byBox;
+}
+
+bool SearchQuery::parse(const QString &text, SearchQuery &query, QString *error)
+{
+    SearchQuery result;
+    for (const Token &token : tokenize(text)) {
+        const int colon = token.quoted ? -1 : int(token.text.indexOf(QLatin1Char(':')));
+        const QString key = colon > 0 ? token.text.left(colon).toLower() : QString();
+        const QString value = colon > 0 ? token.text.mid(colon + 1) : QString();
+        bool ok = true;
+        if (key == QLatin1String("date")) {
+            ok = parseDateFilter(value, result);
+        } else if (key == QLatin1String("size")) {
+            ok = parseSizeFilter(value, result);
+        } else if (key == QLatin1String("bbox")) {
+            ok = parseBoxFilter(value, result);
+        } else if (key == QLatin1String("gps")) {
+            ok = parseGpsFilter(value, result);
+        } else if (key == QLatin1String("ext")) {
+            for (QString ext : value.split(QLatin1Char(','), Qt::SkipEmptyParts)) {
+                if (ext.startsWith(QLatin1Char('.')))
+                    ext.remove(0, 1);
+                if (!ext.isEmpty())
+                    result.extensions.append(ext.toLower());
+            }
+            ok = !result.extensions.isEmpty();
+        } else {
+            // Неизвестный ключ (например, "c:") - просто текст
+            result.terms.append(token.text.toCaseFolded());
+        }
+        if (!ok) {
+            if (error)
+                *error = QStringLiteral("bad filter: %1").arg(token.text);
+            return false;
+        }
+    }
+    result.terms.removeDuplicates();
+    result.extensions.removeDuplicates();
+    query = result;
+    return true;
+}
+
+void SearchIndex::clear()
+{
+    m_size = 0;
+    m_live.clear();
+    m_gps.clear();
+    m_extensions.clear();
+    m_location.clear();
+    m_nameGrams.clear();
+    m_dirGrams.clear();
+    m_locationGrams.clear();
+}
+
+void SearchIndex::build(const PhotoStore &photos)
+{
+    TraceSpan span("search.build");
+    clear();
+    m_size = photos.size();
+    if (m_size == 0)
+        return;
+
+    // Имена файлов - кусками по контейнеру, каждый кусок в своей задаче
+    struct Chunk
+    {
+        QHash<quint64, QVector<quint16>> grams;
+        QHash<QString, QVector<quint16>> extensions;
+        QVector<quint16> live;
+        QVector<quint16> gps;
+    };
+    const int chunkCount = (m_size + ChunkSize - 1) / ChunkSize;
+    QVector<Chunk> chunks(chunkCount);
+    m_location.resize(m_size);
+    quint32 *locations = m_location.data();
+    const int size = m_size;
+    QThreadPool pool;
+    pool.setMaxThreadCount(qMax(1, QThread::idealThreadCount()));
+    for (int c = 0; c < chunkCount; ++c) {
+        Chunk *chunk = &chunks[c];
+        pool.start([&photos, chunk, c, locations, size]() {
+            const int first = c << ChunkBits;
+            const int last = qMin(size, first + ChunkSize);
+            QString extension;
+            for (int id = first; id < last; ++id) {
+                locations[id] = photos.locationOf(id);
+                if (photos.isRemoved(id))
+                    continue;
+                const quint16 low = quint16(id - first);
+                chunk->live.append(low);
+                if (photos.hasGps(id))
+                    chunk->gps.append(low);
+                const QStringView name = photos.fileName(id);
+                forEachTrigram(name, [chunk, low](quint64 key) {
+                    QVector<quint16> &list = chunk->grams[key];
+                    if (list.isEmpty() || list.last() != low)
+                        list.append(low);
+                });
+                // Расширения в папке обычно одинаковые - строка не собирается заново
+                const qsizetype dot = name.lastIndexOf(QLatin1Char('.'));
+                if (dot < 0)
+                    continue;
+                const QStringView suffix = name.mid(dot + 1);
+                if (suffix.compare(extension, Qt::CaseInsensitive) != 0)
+                    extension = suffix.toString().toLower();
+                chunk->extensions[extension].append(low);
+            }
+            for (QVector<quint16> &list : chunk->grams)
+                list.squeeze();
+        });
+    }
+
+    // Папки и места интернированы, их немного - пока идут задачи
+    for (int dir = 0; dir < photos.dirCount(); ++dir) {
+        forEachTrigram(photos.dirPath(quint32(dir)), [this, dir](quint64 key) {
+            m_dirGrams[key].append(dir);
+        });
+    }
+    for (int location = 0; location < photos.locationCount(); ++location) {
+        forEachTrigram(photos.location(quint32(location)), [this, location](quint64 key) {
+            m_locationGrams[key].append(location);
+        });
+    }
+    pool.waitForDone();
+
+    // Куски идут по возрастанию ключа контейнера - слияние только дописывает
+    for (int c = 0; c < chunkCount; ++c) {
+        Chunk &chunk = chunks[c];
+        m_live.appendChunk(c, chunk.live);
+        m_gps.appendChunk(c, chunk.gps);
+        for (auto it = chunk.grams.cbegin(); it != chunk.grams.cend(); ++it)
+            m_nameGrams[it.key()].appendChunk(c, it.value());
+        for (auto it = chunk.extensions.cbegin(); it != chunk.extensions.cend(); ++it)
+            m_extensions[it.key()].appendChunk(c, it.value());
+        chunk = Chunk();
+    }
+    span.setValue(m_nameGrams.size());
+}
+
+PhotoSet SearchIndex::lookup(const Postings &postings, QStringView term)
+{
+    QVector<const PhotoSet*> lists;
+    bool missing = false;
+    forEachTrigram(term, [&postings, &lists, &missing](quint64 key) {
+        const auto it = postings.constFind(key);
+        if (it == postings.cend())
+            missing = true;
+        else if (!lists.contains(&it.value()))
+            lists.append(&it.value());
+    });
+    if (missing || lists.isEmpty())
+        return PhotoSet();
+
+    // Пересечение начинается с самого короткого списка и дальше только убывает
+    std::sort(lists.begin(), lists.end(), [](const PhotoSet *a, const PhotoSet *b) {
+        return a->size() < b->size();
+    });
+    PhotoSet result = *lists.first();
+    for (int i = 1; i < lists.size() && !result.isEmpty(); ++i)
+        result = result.intersected(*lists[i]);
+    return result;
+}
+
+PhotoSet SearchIndex::findText(const PhotoStore &photos, const QString &term) const
+{
+    if (term.isEmpty())
+        return m_live;
+
+    // Триграммы дают кандидатов, подстрока проверяется по самому имени;
+    // у слова короче трёх символов триграмм нет - имена перебираются подряд
+    const auto nameHas = [&photos, &term](int id) {
+        return !photos.isRemoved(id) && photos.fileName(id).contains(term, Qt::CaseInsensitive);
+    };
+    PhotoSet result = term.size() >= 3 ? lookup(m_nameGrams, term).filtered(nameHas)
+                                       : m_live.filtered(nameHas);
+
+    const int dirCount = photos.dirCount();
+    QVector<quint8> dirHit(dirCount, 0);
+    bool anyDir = false;
+    const auto markDir = [&photos, &term, &dirHit, &anyDir](int dir) {
+        if (photos.dirPath(quint32(dir)).contains(term, Qt::CaseInsensitive)) {
+            dirHit[dir] |= DirContains;
+            anyDir = true;
+        }
+    };
+    if (term.size() >= 3)
+        lookup(m_dirGrams, term).forEach(markDir);
+    else
+        for (int dir = 0; dir < dirCount; ++dir)
+            markDir(dir);
+
+    // Через границу папки и имени: "2023/06/img_" - хвост пути папки и начало имени
+    const int slash = int(term.lastIndexOf(QLatin1Char('/')));
+    const QStringView tail = slash >= 0 ? QStringView(term).mid(slash + 1) : QStringView();
+    if (slash >= 0) {
+        const QStringView head = QStringView(term).left(slash);
+        for (int dir = 0; dir < dirCount; ++dir) {
+            const QString &path = photos.dirPath(quint32(dir));
+            if (!path.isEmpty() && path.endsWith(head, Qt::CaseInsensitive)) {
+                dirHit[dir] |= DirSuffix;
+                anyDir = true;
+            }
+        }
+    }
+
+    QVector<quint8> locationHit(photos.locationCount(), 0);
+    bool anyLocation = false;
+    const auto markLocation = [&photos, &term, &locationHit, &anyLocation](int location) {
+        if (photos.location(quint32(location)).contains(term, Qt::CaseInsensitive)) {
+            locationHit[location] = 1;
+            anyLocation = true;
+        }
+    };
+    if (term.size() >= 3)
+        lookup(m_locationGrams, term).forEach(markLocation);
+    else
+        for (int location = 0; location < locationHit.size(); ++location)
+            markLocation(location);
+
+    if (!anyDir && !anyLocation)
+        return result;
+
+    // Фото совпавших папок и мест - один проход по столбцам
+    const PhotoSet byPlace = m_live.filtered([&](int id) {
+        if (photos.isRemoved(id))
+            return false;
+        const quint8 hit = dirHit[int(photos.dirOf(id))];
+        if (hit & DirContains)
+            return true;
+        const quint32 location = m_location[id];
+        if (location < quint32(locationHit.size()) && locationHit[int(location)])
+            return true;
+        return (hit & DirSuffix) && photos.fileName(id).startsWith(tail, Qt::CaseInsensitive);
+    });
+    return result.united(byPlace);
+}
+
+PhotoSet SearchIndex::find(const PhotoStore &photos, const SearchQuery &query) const
+{
+    TraceSpan span("search.find");
+
+    // Множества из индекса пересекаются, начиная с самого маленького
+    QVector<PhotoSet> sets;
+    for (const QString &term : query.terms)
+        sets.append(findText(photos, term));
+    if (query.gps == 1)
+        sets.append(m_gps);
+    else if (query.gps == 0)
+        sets.append(m_live.subtracted(m_gps));
+    if (!query.extensions.isEmpty()) {
+        PhotoSet any;
+        for (const QString &extension : query.extensions)
+            any = any.united(m_extensions.value(extension));
+        sets.append(any);
+    }
+    std::sort(sets.begin(), sets.end(), [](const PhotoSet &a, const PhotoSet &b) {
+        return a.size() < b.size();
+    });
+    PhotoSet result = sets.isEmpty() ? m_live : sets.first();
+    for (int i = 1; i < sets.size() && !result.isEmpty(); ++i)
+        result = result.intersected(sets[i]);
+
+    // Время, размер и область - по столбцам, только у оставшихся;
+    // заодно отсеиваются фото, удалённые после построения
+    const bool stale = photos.liveCount() != m_live.size();
+    if (query.byTime || query.bySize || query.byBox || stale) {
+        result = result.filtered([&photos, &query](int id) {
+            if (id >= photos.size() || photos.isRemoved(id))
+                return false;
+            if (query.byTime) {
+                const qint64 taken = photos.taken(id);
+                if (taken == PhotoStore::NoTime || taken < query.takenFrom || taken >= query.takenTo)
+                    return false;
+            }
+            if (query.bySize) {
+                const qint64 size = photos.fileSize(id);
+                if (size < query.minSize || size > query.maxSize)
+                    return false;
+            }
+            if (query.byBox) {
+                if (!photos.hasGps(id))
+                    return false;
+                const double lat = photos.latitude(id);
+                const double lng = photos.longitude(id);
+                if (lat < query.south || lat > query.north)
+                    return false;
+                const bool inside = query.west <= query.east
+                        ? lng >= query.west && lng <= query.east
+                        : lng >= query.west || lng <= query.east;
+                if (!inside)
+                    return false;
+            }
+            return true;
+        });
+    }
+    span.setValue(result.size());
+    return result;
+}
+
+qint64 SearchIndex::memoryUsage() const
+{
+    // Хэш-таблицы Qt - примерно по два указателя на элемент сверх ключа и значения
+    const auto postingsBytes = [](const Postings &postings) {
+        qint64 bytes = qint64(postings.size()) * qint64(sizeof(quint64) + sizeof(PhotoSet) + 2 * sizeof(void*));
+        for (const PhotoSet &set : postings)
+            bytes += set.memoryUsage();
+        return bytes;
+    };
+    qint64 bytes = m_live.memoryUsage() + m_gps.memoryUsage()
+            + qint64(m_location.capacity()) * sizeof(quint32)
+            + postingsBytes(m_nameGrams) + postingsBytes(m_dirGrams) + postingsBytes(m_locationGrams);
+    for (const PhotoSet &set : m_extensions)
+        bytes += set.memoryUsage();
+    return bytes;
+}
@@ -0,0 +1,87 @@
+#ifndef SEARCHINDEX_H
+#define SEARCHINDEX_H
+
+#include "photoset.h"
+#include "photostore.h"
+
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <limits>
+
+// Запрос строки поиска: слова и фильтры вида ключ:значение, все условия сразу.
+//   море "new york"                подстрока пути (папка или имя файла) или места
+//   date:2023  date:2023-05        год, месяц или день съёмки
+//   date:2023-05-01..2023-06-15    период; date:..2019, date:2020.. - открытый
+//   gps:yes  gps:no
+//   ext:heic,jpg
+//   size:>5mb  size:<500k  size:1m..20m   (без знака - не меньше)
+//   bbox:west,south,east,north     градусы; west > east - через антимеридиан
+struct SearchQuery
+{
+    QStringList terms;                 // в свёрнутом регистре (toCaseFolded)
+    bool byTime = false;
+    qint64 takenFrom = std::numeric_limits<qint64>::min();   // [from, to), мс
+    qint64 takenTo = std::numeric_limits<qint64>::max();
+    int gps = -1;                      // -1 - не важно, 0 - без GPS, 1 - с GPS
+    QStringList extensions;            // в нижнем регистре, без точки
+    bool bySize = false;
+    qint64 minSize = 0;
+    qint64 maxSize = std::numeric_limits<qint64>::max();
+    bool byBox = false;
+    double west = -180.0;
+    double south = -90.0;
+    double east = 180.0;
+    double north = 90.0;
+
+    bool isEmpty() const;
+    // false и error - непонятный фильтр
+    static bool parse(const QString &text, SearchQuery &query, QString *error = nullptr);
+};
+
+// Индекс поиска по хранилищу фото.
+// Подстроки ищутся по триграммам: для каждой тройки символов (в свёрнутом
+// регистре) хранится множество фото, в имени файла которых она есть, -
+// PhotoSet по схеме roaring. Кандидаты на слово - пересечение множеств его
+// триграмм от самого короткого, потом подстрока проверяется по самому имени.
+// Папки и места интернированы в PhotoStore, и у них свои триграммы по номерам
+// папок и мест: совпавшая папка или место отдаёт все свои фото одним проходом.
+// Слово с '/' может пересекать границу папки и имени ("2023/06/img_").
+// Расширения, GPS и живые фото - готовые множества; время, размер и область
+// проверяются по столбцам хранилища только у фото, оставшихся после пересечения.
+// Имена индексируются параллельно кусками по 65536 фото - по контейнеру
+// PhotoSet на кусок, поэтому слияние сводится к дописыванию контейнеров.
+// После build() индекс только читается; при изменениях строится заново.
+class SearchIndex
+{
+public:
+    void build(const PhotoStore &photos);
+    void clear();
+    bool isEmpty() const { return m_size == 0; }
+    // Фото в хранилище на момент построения
+    int size() const { return m_size; }
+
+    // Неудалённые фото, подходящие под все условия запроса
+    PhotoSet find(const PhotoStore &photos, const SearchQuery &query) const;
+    // Фото, у которых term (в свёрнутом регистре) - подстрока пути или названия места
+    PhotoSet findText(const PhotoStore &photos, const QString &term) const;
+
+    qint64 memoryUsage() const;
+
+private:
+    using Postings = QHash<quint64, PhotoSet>;
+
+    static PhotoSet lookup(const Postings &postings, QStringView term);
+
+    int m_size = 0;
+    PhotoSet m_live;
+    PhotoSet m_gps;
+    QHash<QString, PhotoSet> m_extensions;
+    QVector<quint32> m_location;       // место каждого фото с учётом переопределений
+    Postings m_nameGrams;              // триграмма имени файла -> фото
+    Postings m_dirGrams;               // триграмма пути папки -> папки
+    Postings m_locationGrams;          // триграмма названия места -> места
+};
+
+#endif // SEARCHINDEX_H
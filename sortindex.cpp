@@ -0,0 +1,282 @@
+#include "sortindex.h"
+#include "tracer.h"
+
+#include <QCollator>
+#include <QCollatorSortKey>
+#include <QThread>
+#include <QThreadPool>
+#include <algorithm>
+#include <limits>
+#include <numeric>
+#include <vector>
+
+namespace {
+
+constexpr quint64 SignBit = quint64(1) << 63;
+
+// Устойчивая LSD-сортировка id по 64-битному ключу, байт за проход.
+// Байты, одинаковые у всех ключей, пропускаются - для рангов и
+// 32-битных значений это два-четыре прохода вместо восьми.
+template <typename KeyFn>
+void radixSort(QVector<int> &ids, KeyFn keyOf)
+{
+    const int n = int(ids.size());
+    if (n < 2)
+        return;
+
+    std::vector<quint64> keys(n);
+    std::vector<quint64> keysTmp(n);
+    std::vector<int> idsTmp(n);
+    quint64 anyBits = 0;
+    quint64 allBits = ~quint64(0);
+    for (int i = 0; i < n; ++i) {
+        keys[i] = keyOf(ids[i]);
+        anyBits |= keys[i];
+        allBits &= keys[i];
+    }
+    const quint64 varying = anyBits ^ allBits;
+
+    int *src = ids.data();
+    int *dst = idsTmp.data();
+    quint64 *srcKeys = keys.data();
+    quint64 *dstKeys = keysTmp.data();
+    for (int shift = 0; shift < 64; shift += 8) {
+        if (((varying >> shift) & 0xFF) == 0)
+            continue;
+        int count[257] = {};
+        for (int i = 0; i < n; ++i)
+            ++count[((srcKeys[i] >> shift) & 0xFF) + 1];
+        for (int b = 0; b < 256; ++b)
+            count[b + 1] += count[b];
+        for (int i = 0; i < n; ++i) {
+            const int pos = count[(srcKeys[i] >> shift) & 0xFF]++;
+            dst[pos] = src[i];
+            dstKeys[pos] = srcKeys[i];
+        }
+        std::swap(src, dst);
+        std::swap(srcKeys, dstKeys);
+    }
+    if (src != ids.data())
+        std::copy(src, src + n, ids.data());
+}
+
+// Позиции строк в порядке QCollator (числа внутри строк - по значению)
+template <typename TextFn>
+QVector<quint32> collationRanks(int count, TextFn textOf)
+{
+    QCollator collator;
+    collator.setNumericMode(true);
+    collator.setCaseSensitivity(Qt::CaseInsensitive);
+
+    // Ключ считается один раз на строку, а не в каждом сравнении
+    std::vector<QCollatorSortKey> keys;
+    keys.reserve(count);
+    for (int i = 0; i < count; ++i)
+        keys.push_back(collator.sortKey(textOf(i)));
+
+    QVector<int> sorted(count);
+    std::iota(sorted.begin(), sorted.end(), 0);
+    std::stable_sort(sorted.begin(), sorted.end(), [&keys](int a, int b) {
+        return keys[a].compare(keys[b]) < 0;
+    });
+
+    QVector<quint32> ranks(count);
+    for (int r = 0; r < count; ++r)
+        ranks[sorted[r]] = quint32(r);
+    return ranks;
+}
+
+} // namespace
+
+void SortIndex::clear()
+{
+    m_photos = nullptr;
+    for (QVector<int> &order : m_orders)
+        order.clear();
+    m_locationRank.clear();
+    m_dirRank.clear();
+    for (QVector<int> &positions : m_positions)
+        positions.clear();
+}
+
+void SortIndex::rankLocations()
+{
+    const PhotoStore *photos = m_photos;
+    m_locationRank = collationRanks(photos->locationCount(),
+                                    [photos](int i) { return photos->location(quint32(i)); });
+}
+
+void SortIndex::rankDirs()
+{
+    const PhotoStore *photos = m_photos;
+    m_dirRank = collationRanks(photos->dirCount(),
+                               [photos](int i) { return photos->dirPath(quint32(i)); });
+}
+
+void SortIndex::build(const PhotoStore &photos)
+{
+    TraceSpan span("sort.build", photos.liveCount());
+    m_photos = &photos;
+    rankLocations();
+    rankDirs();
+    for (QVector<int> &positions : m_positions)
+        positions.clear();
+
+    QVector<int> &byTime = m_orders[ByTime];
+    byTime.clear();
+    byTime.reserve(photos.liveCount());
+    for (int id = 0; id < photos.size(); ++id) {
+        if (!photos.isRemoved(id))
+            byTime.append(id);
+    }
+    sortBy(ByTime);
+
+    // Остальные порядки независимы друг от друга
+    QThreadPool pool;
+    pool.setMaxThreadCount(qMax(1, QThread::idealThreadCount()));
+    for (int key = ByTime + 1; key < KeyCount; ++key) {
+        m_orders[key] = byTime;
+        pool.start([this, key]() { sortBy(Key(key)); });
+    }
+    pool.waitForDone();
+}
+
+void SortIndex::sortBy(Key key)
+{
+    const PhotoStore &photos = *m_photos;
+    QVector<int> &order = m_orders[key];
+
+    switch (key) {
+    case ByTime:
+        // Знаковый ключ: старший бит инвертируется, неизвестное время - в начале
+        radixSort(order, [&photos](int id) { return quint64(photos.taken(id)) ^ SignBit; });
+        break;
+    case ByLocation:
+        radixSort(order, [&](int id) { return quint64(m_locationRank[photos.locationOf(id)]); });
+        break;
+    case ByLatitude:
+        radixSort(order, [&photos](int id) {
+            return quint64(0x7FFFFFFF - qint64(photos.latitudeE7(id)));
+        });
+        break;
+    case BySize:
+        radixSort(order, [&photos](int id) { return ~quint64(photos.fileSize(id)); });
+        break;
+    case ByPath: {
+        radixSort(order, [&](int id) { return quint64(m_dirRank[photos.dirOf(id)]); });
+        // Внутри папки - по имени; папки небольшие, сортировка по участкам
+        auto first = order.begin();
+        while (first != order.end()) {
+            const quint32 dir = photos.dirOf(*first);
+            auto last = std::find_if(first, order.end(),
+                                     [&photos, dir](int id) { return photos.dirOf(id) != dir; });
+            std::sort(first, last, [&photos](int a, int b) {
+                return photos.fileName(a) < photos.fileName(b);
+            });
+            first = last;
+        }
+        break;
+    }
+    case KeyCount:
+        break;
+    }
+}
+
+bool SortIndex::less(Key key, int a, int b) const
+{
+    // Тот же порядок, что даёт build(): второй ключ - время, затем id
+    const PhotoStore &photos = *m_photos;
+    switch (key) {
+    case ByLocation: {
+        const quint32 ra = m_locationRank[photos.locationOf(a)];
+        const quint32 rb = m_locationRank[photos.locationOf(b)];
+        if (ra != rb)
+            return ra < rb;
+        break;
+    }
+    case ByPath: {
+        const quint32 ra = m_dirRank[photos.dirOf(a)];
+        const quint32 rb = m_dirRank[photos.dirOf(b)];
+        if (ra != rb)
+            return ra < rb;
+        const int cmp = photos.fileName(a).compare(photos.fileName(b));
+        if (cmp != 0)
+            return cmp < 0;
+        break;
+    }
+    case ByLatitude:
+        if (photos.latitudeE7(a) != photos.latitudeE7(b))
+            return photos.latitudeE7(a) > photos.latitudeE7(b);
+        break;
+    case BySize:
+        if (photos.fileSize(a) != photos.fileSize(b))
+            return photos.fileSize(a) > photos.fileSize(b);
+        break;
+    case ByTime:
+    case KeyCount:
+        break;
+    }
+    if (photos.taken(a) != photos.taken(b))
+        return photos.taken(a) < photos.taken(b);
+    return a < b;
+}
+
+void SortIndex::update(const PhotoStore &photos, const QVector<int> &changed)
+{
+    TraceSpan span("sort.update", changed.size());
+    if (isEmpty()) {
+        build(photos);
+        return;
+    }
+    m_photos = &photos;
+
+    // Новые места и папки: ранги пересчитываются целиком (их немного),
+    // взаимный порядок прежних при этом не меняется
+    if (m_locationRank.size() != photos.locationCount())
+        rankLocations();
+    if (m_dirRank.size() != photos.dirCount())
+        rankDirs();
+
+    QVector<bool> touched(photos.size(), false);
+    QVector<int> fresh;
+    for (int id : changed) {
+        if (id < 0 || id >= photos.size() || touched[id])
+            continue;
+        touched[id] = true;
+        if (!photos.isRemoved(id))
+            fresh.append(id);
+    }
+
+    for (int key = 0; key < KeyCount; ++key) {
+        m_positions[key].clear();
+        const auto less = [this, key](int a, int b) { return this->less(Key(key), a, b); };
+        QVector<int> &order = m_orders[key];
+        order.removeIf([&touched](int id) { return id < touched.size() && touched[id]; });
+        QVector<int> added = fresh;
+        std::sort(added.begin(), added.end(), less);
+        const int middle = int(order.size());
+        order += added;
+        std::inplace_merge(order.begin(), order.begin() + middle, order.end(), less);
+    }
+}
+
+void SortIndex::sortSubset(Key key, QVector<int> &ids) const
+{
+    // Позиции считаются один раз на порядок и живут до следующего изменения,
+    // так что выборка сортируется за O(k log k), без прохода по всему порядку
+    QVector<int> &positions = m_positions[key];
+    if (positions.isEmpty() && m_photos) {
+        positions.fill(std::numeric_limits<int>::max(), m_photos->size());
+        const QVector<int> &order = m_orders[key];
+        for (int i = 0; i < order.size(); ++i)
+            positions[order[i]] = i;
+    }
+    const auto positionOf = [&positions](int id) {
+        return id >= 0 && id < positions.size() ? positions[id] : std::numeric_limits<int>::max();
+    };
+    std::sort(ids.begin(), ids.end(), [&positionOf](int a, int b) {
+        const int pa = positionOf(a);
+        const int pb = positionOf(b);
+        return pa != pb ? pa < pb : a < b;
+    });
+}
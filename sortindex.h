@@ -0,0 +1,52 @@
+#ifndef SORTINDEX_H
+#define SORTINDEX_H
+
+#include "photostore.h"
+
+#include <QVector>
+
+// Готовые перестановки фото хранилища для всех порядков сортировки,
+// поэтому смена порядка - это выбор массива, а не сортировка.
+// Строятся после сканирования: сначала по времени, остальные от неё -
+// устойчивой поразрядной сортировкой по второму ключу (параллельно),
+// так что при равном ключе фото идут по времени.
+// Строки сравниваются только для мест и папок (их немного) через ключи
+// QCollator; у фото сравниваются целые ранги.
+// Изменения при слежении за папкой вливаются слиянием без перестройки.
+class SortIndex
+{
+public:
+    enum Key {
+        ByTime,       // время съёмки
+        ByLocation,   // название места
+        ByPath,       // папка, затем имя файла
+        ByLatitude,   // с севера на юг
+        BySize,       // сначала крупные файлы
+        KeyCount
+    };
+
+    void build(const PhotoStore &photos);
+    // changed - новые, изменённые и удалённые фото
+    void update(const PhotoStore &photos, const QVector<int> &changed);
+    void clear();
+    bool isEmpty() const { return m_orders[ByTime].isEmpty(); }
+
+    // Все неудалённые фото в порядке key
+    const QVector<int> &order(Key key) const { return m_orders[key]; }
+    // Упорядочить часть фото так же, как в order(key); фото не из индекса - в конце
+    void sortSubset(Key key, QVector<int> &ids) const;
+
+private:
+    void rankLocations();
+    void rankDirs();
+    void sortBy(Key key);
+    bool less(Key key, int a, int b) const;
+
+    const PhotoStore *m_photos = nullptr;
+    QVector<int> m_orders[KeyCount];
+    QVector<quint32> m_locationRank;   // место -> позиция по QCollator
+    QVector<quint32> m_dirRank;        // папка -> позиция полного пути
+    mutable QVector<int> m_positions[KeyCount];   // id -> позиция в порядке, лениво
+};
+
+#endif // SORTINDEX_H
@@ -0,0 +1,289 @@
+#include "spatialindex.h"
+#include "tracer.h"
+
+#include <QThread>
+#include <QThreadPool>
+#include <QtGlobal>
+#include <QtMath>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+// Длина градуса широты, км
+constexpr double KmPerDegree = 111.32;
+}
+
+void SpatialIndex::clear()
+{
+    m_points.clear();
+    m_points.shrink_to_fit();
+    m_extra.clear();
+    m_removed.clear();
+    m_builtCount = 0;
+}
+
+void SpatialIndex::build(const PhotoStore &photos)
+{
+    TraceSpan span("spatial.build", photos.liveCount());
+    m_points.clear();
+    m_extra.clear();
+    m_removed.clear();
+    m_builtCount = int(photos.size());
+    m_points.reserve(photos.liveCount());
+    for (int i = 0; i < photos.size(); ++i) {
+        if (!photos.isRemoved(i))
+            m_points.push_back({photos.longitude(i), photos.latitude(i), i});
+    }
+    if (m_points.empty())
+        return;
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(qMax(1, QThread::idealThreadCount()));
+    sortRange(0, int(m_points.size()) - 1, 0, &pool);
+    pool.waitForDone();
+}
+
+void SpatialIndex::insert(int id, double latitude, double longitude)
+{
+    remove(id);
+    m_extra.push_back({longitude, latitude, id});
+}
+
+void SpatialIndex::remove(int id)
+{
+    for (auto it = m_extra.begin(); it != m_extra.end(); ++it) {
+        if (it->id == id) {
+            m_extra.erase(it);
+            break;
+        }
+    }
+    // Точка в дереве остаётся до перестройки, но в ответы не попадает
+    if (id < m_builtCount)
+        m_removed.insert(id);
+}
+
+const SpatialIndex::Point &SpatialIndex::pointAt(int slot) const
+{
+    const int tree = int(m_points.size());
+    return slot < tree ? m_points[slot] : m_extra[slot - tree];
+}
+
+void SpatialIndex::sortRange(int left, int right, int depth, QThreadPool *pool)
+{
+    if (right - left <= NodeSize)
+        return;
+
+    const int middle = (left + right) / 2;
+    const bool byX = depth % 2 == 0;
+    std::nth_element(m_points.begin() + left, m_points.begin() + middle,
+                     m_points.begin() + right + 1,
+                     [byX](const Point &a, const Point &b) {
+                         return byX ? a.x < b.x : a.y < b.y;
+                     });
+
+    // Половины не пересекаются, поэтому верхние уровни можно сортировать
+    // в разных потоках; ниже ParallelDepth задач хватает на все ядра
+    if (depth < ParallelDepth) {
+        pool->start([this, middle, right, depth, pool]() {
+            sortRange(middle + 1, right, depth + 1, pool);
+        });
+    } else {
+        sortRange(middle + 1, right, depth + 1, pool);
+    }
+    sortRange(left, middle - 1, depth + 1, pool);
+}
+
+void SpatialIndex::collect(double minX, double minY, double maxX, double maxY,
+                           QVector<int> &out, bool positions) const
+{
+    const int tree = int(m_points.size());
+    for (int i = 0; i < int(m_extra.size()); ++i) {
+        const Point &p = m_extra[i];
+        if (p.x >= minX && p.x <= maxX && p.y >= minY && p.y <= maxY)
+            out.append(positions ? tree + i : p.id);
+    }
+    if (m_points.empty())
+        return;
+
+    struct Range { int left; int right; int axis; };
+    Range stack[64];
+    int top = 0;
+    stack[top++] = {0, int(m_points.size()) - 1, 0};
+
+    while (top > 0) {
+        const Range range = stack[--top];
+
+        if (range.right - range.left <= NodeSize) {
+            for (int i = range.left; i <= range.right; ++i) {
+                const Point &p = m_points[i];
+                if (p.x >= minX && p.x <= maxX && p.y >= minY && p.y <= maxY && !isRemoved(p))
+                    out.append(positions ? i : p.id);
+            }
+            continue;
+        }
+
+        const int middle = (range.left + range.right) / 2;
+        const Point &p = m_points[middle];
+        if (p.x >= minX && p.x <= maxX && p.y >= minY && p.y <= maxY && !isRemoved(p))
+            out.append(positions ? middle : p.id);
+
+        const double value = range.axis == 0 ? p.x : p.y;
+        const double low = range.axis == 0 ? minX : minY;
+        const double high = range.axis == 0 ? maxX : maxY;
+        if (low <= value)
+            stack[top++] = {range.left, middle - 1, 1 - range.axis};
+        if (high >= value)
+            stack[top++] = {middle + 1, range.right, 1 - range.axis};
+    }
+}
+
+QVector<int> SpatialIndex::within(double west, double south, double east, double north) const
+{
+    QVector<int> result;
+    if (south > north)
+        std::swap(south, north);
+
+    // Окно карты может быть шире мира или сдвинуто за +-180
+    if (east - west >= 360.0) {
+        collect(-180.0, south, 180.0, north, result);
+        return result;
+    }
+    while (west < -180.0) {
+        west += 360.0;
+        east += 360.0;
+    }
+    while (west > 180.0) {
+        west -= 360.0;
+        east -= 360.0;
+    }
+
+    if (east > 180.0) {
+        collect(west, south, 180.0, north, result);
+        collect(-180.0, south, east - 360.0, north, result);
+    } else if (west > east) {
+        collect(west, south, 180.0, north, result);
+        collect(-180.0, south, east, north, result);
+    } else {
+        collect(west, south, east, north, result);
+    }
+    return result;
+}
+
+void SpatialIndex::consider(const Point &p, double qx, double qy, double scale,
+                            int k, double limit, std::vector<Neighbour> &heap) const
+{
+    const double dx = (p.x - qx) * scale;
+    const double dy = p.y - qy;
+    const double d = dx * dx + dy * dy;
+    if (d > limit || (int(heap.size()) == k && d > heap.front().distance))
+        return;
+    if (int(heap.size()) == k) {
+        std::pop_heap(heap.begin(), heap.end());
+        heap.pop_back();
+    }
+    heap.push_back({d, p.id});
+    std::push_heap(heap.begin(), heap.end());
+}
+
+void SpatialIndex::search(int left, int right, int axis, double qx, double qy, double scale,
+                          int k, double limit, std::vector<Neighbour> &heap) const
+{
+    // Текущая граница: до набора k точек - limit, затем самый дальний кандидат
+    auto bound = [&]() {
+        return int(heap.size()) < k ? limit : qMin(limit, heap.front().distance);
+    };
+
+    if (left > right)
+        return;
+    if (right - left <= NodeSize) {
+        for (int i = left; i <= right; ++i) {
+            if (!isRemoved(m_points[i]))
+                consider(m_points[i], qx, qy, scale, k, limit, heap);
+        }
+        return;
+    }
+
+    // Удалённые и изменённые точки дерева пропускаются; их новые копии в m_extra
+    const int middle = (left + right) / 2;
+    const Point &p = m_points[middle];
+    if (!isRemoved(p))
+        consider(p, qx, qy, scale, k, limit, heap);
+
+    const double diff = axis == 0 ? (qx - p.x) * scale : qy - p.y;
+    if (diff < 0) {
+        search(left, middle - 1, 1 - axis, qx, qy, scale, k, limit, heap);
+        if (diff * diff <= bound())
+            search(middle + 1, right, 1 - axis, qx, qy, scale, k, limit, heap);
+    } else {
+        search(middle + 1, right, 1 - axis, qx, qy, scale, k, limit, heap);
+        if (diff * diff <= bound())
+            search(left, middle - 1, 1 - axis, qx, qy, scale, k, limit, heap);
+    }
+}
+
+QVector<int> SpatialIndex::nearest(double latitude, double longitude, int k, double maxKm) const
+{
+    QVector<int> result;
+    if (k <= 0 || isEmpty())
+        return result;
+
+    // Равнопромежуточная метрика с масштабом долготы по широте запроса:
+    // точна на расстояниях, для которых ищут "соседние" снимки.
+    // Переход через 180-й меридиан не учитывается.
+    const double scale = std::cos(qDegreesToRadians(latitude));
+    const double limit = maxKm < 0
+            ? std::numeric_limits<double>::infinity()
+            : (maxKm / KmPerDegree) * (maxKm / KmPerDegree);
+
+    std::vector<Neighbour> heap;
+    heap.reserve(k + 1);
+    // Добавленные точки первыми - они сразу сужают границу поиска по дереву
+    for (const Point &p : m_extra)
+        consider(p, longitude, latitude, scale, k, limit, heap);
+    search(0, int(m_points.size()) - 1, 0, longitude, latitude, scale, k, limit, heap);
+
+    std::sort_heap(heap.begin(), heap.end());
+    result.reserve(int(heap.size()));
+    for (const Neighbour &n : heap)
+        result.append(n.id);
+    return result;
+}
+
+QVector<int> SpatialIndex::inPolygon(const QVector<QPointF> &polygon) const
+{
+    QVector<int> result;
+    if (polygon.size() < 3)
+        return result;
+
+    double minX = polygon.first().x();
+    double maxX = minX;
+    double minY = polygon.first().y();
+    double maxY = minY;
+    for (const QPointF &v : polygon) {
+        minX = qMin(minX, v.x());
+        maxX = qMax(maxX, v.x());
+        minY = qMin(minY, v.y());
+        maxY = qMax(maxY, v.y());
+    }
+
+    // Кандидаты из описанного прямоугольника, затем правило чётности
+    QVector<int> candidates;
+    collect(minX, minY, maxX, maxY, candidates, true);
+
+    const int count = int(polygon.size());
+    for (int slot : std::as_const(candidates)) {
+        const Point &p = pointAt(slot);
+        bool inside = false;
+        for (int i = 0, j = count - 1; i < count; j = i++) {
+            const QPointF &a = polygon[i];
+            const QPointF &b = polygon[j];
+            if ((a.y() > p.y) != (b.y() > p.y)
+                    && p.x < (b.x() - a.x()) * (p.y - a.y()) / (b.y() - a.y()) + a.x())
+                inside = !inside;
+        }
+        if (inside)
+            result.append(p.id);
+    }
+    return result;
+}
@@ -0,0 +1,81 @@
+#ifndef SPATIALINDEX_H
+#define SPATIALINDEX_H
+
+#include "photostore.h"
+
+#include <QPointF>
+#include <QSet>
+#include <QVector>
+#include <vector>
+
+class QThreadPool;
+
+// Статическое k-d дерево по координатам фото, упакованное в один массив
+// (как в kdbush): в диапазоне [l, r] медиана (l + r) / 2 делит точки
+// по долготе или широте в зависимости от глубины, листья - до NodeSize точек.
+// Строится заново после сканирования; верхние уровни сортируются параллельно.
+// Точечные изменения (слежение за папкой) копятся рядом с деревом:
+// новые точки - в коротком списке с линейным перебором, удалённые -
+// в наборе исключённых id. Когда изменений больше MaxPendingChanges,
+// вызывающий перестраивает индекс целиком.
+// Координаты - градусы, x = долгота, y = широта.
+class SpatialIndex
+{
+public:
+    static constexpr int NodeSize = 64;
+    static constexpr int ParallelDepth = 3;   // до 2^3 параллельных поддеревьев
+    static constexpr int MaxPendingChanges = 8192;
+
+    // Удалённые фото в индекс не попадают
+    void build(const PhotoStore &photos);
+    void clear();
+    bool isEmpty() const { return m_points.empty() && m_extra.empty(); }
+    int size() const { return int(m_points.size() + m_extra.size()) - int(m_removed.size()); }
+
+    // Добавить или переместить точку id без перестройки дерева
+    void insert(int id, double latitude, double longitude);
+    void remove(int id);
+    int pendingChanges() const { return int(m_extra.size() + m_removed.size()); }
+
+    // Прямоугольник в градусах; west > east означает переход через 180-й меридиан
+    QVector<int> within(double west, double south, double east, double north) const;
+    // k ближайших фото по порядку удаления; maxKm < 0 - без ограничения
+    QVector<int> nearest(double latitude, double longitude, int k, double maxKm = -1.0) const;
+    // Выделение произвольным многоугольником (лассо), вершины - (долгота, широта)
+    QVector<int> inPolygon(const QVector<QPointF> &polygon) const;
+
+private:
+    struct Point
+    {
+        double x;
+        double y;
+        int id;
+    };
+
+    struct Neighbour
+    {
+        double distance;
+        int id;
+        bool operator<(const Neighbour &other) const { return distance < other.distance; }
+    };
+
+    void sortRange(int left, int right, int depth, QThreadPool *pool);
+    // positions = true - позиции в m_points вместо id фото
+    void collect(double minX, double minY, double maxX, double maxY, QVector<int> &out,
+                 bool positions = false) const;
+    void search(int left, int right, int axis, double qx, double qy, double scale,
+                int k, double limit, std::vector<Neighbour> &heap) const;
+    void consider(const Point &p, double qx, double qy, double scale,
+                  int k, double limit, std::vector<Neighbour> &heap) const;
+    // Только для точек дерева: m_extra хранит актуальные копии тех же id
+    bool isRemoved(const Point &p) const { return !m_removed.isEmpty() && m_removed.contains(p.id); }
+    // Позиция из collect(): сначала m_points, за ними m_extra
+    const Point &pointAt(int slot) const;
+
+    std::vector<Point> m_points;
+    std::vector<Point> m_extra;   // добавленные после build(), не входят в дерево
+    QSet<int> m_removed;          // id, чьи точки в дереве устарели
+    int m_builtCount = 0;         // id < m_builtCount могут быть в дереве
+};
+
+#endif // SPATIALINDEX_H
@@ -0,0 +1,276 @@
+#include "thumbnailcache.h"
+#include "exifreader.h"
+#include "tracer.h"
+
+#include <QBuffer>
+#include <QCryptographicHash>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <algorithm>
+#include <vector>
+
+namespace {
+
+constexpr int DiskJpegQuality = 85;
+// Переполненный дисковый кэш ужимается до этой доли предела,
+// чтобы чистка не запускалась на каждой следующей записи
+constexpr double DiskTrimRatio = 0.75;
+
+} // namespace
+
+ThumbnailCache::ThumbnailCache(qint64 memoryLimitBytes, qint64 diskLimitBytes)
+    : m_memory(memoryLimitBytes)
+    , m_diskLimit(diskLimitBytes)
+{
+    m_diskDir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation)
+            + QStringLiteral("/thumbnails");
+}
+
+QString ThumbnailCache::memoryKey(const QString &path, const QSize &size)
+{
+    return QStringLiteral("%1x%2|").arg(size.width()).arg(size.height()) + path;
+}
+
+QByteArray ThumbnailCache::diskKey(const QString &path, const QSize &size)
+{
+    // Размер и время изменения берутся из stat: изменённый файл получает новый
+    // ключ, а одинаковые по началу файлы (серии RAW, BMP) - разные
+    const QFileInfo info(path);
+    if (!info.exists())
+        return QByteArray();
+
+    const QByteArray key = info.canonicalFilePath().toUtf8()
+            + '|' + QByteArray::number(info.size())
+            + '|' + QByteArray::number(info.lastModified().toMSecsSinceEpoch())
+            + '|' + QByteArray::number(size.width()) + 'x' + QByteArray::number(size.height());
+    return QCryptographicHash::hash(key, QCryptographicHash::Sha1).toHex();
+}
+
+QString ThumbnailCache::diskPath(const QByteArray &key) const
+{
+    // Разбивка по первым двум символам, чтобы не держать сотни тысяч файлов в одной папке
+    return m_diskDir + QLatin1Char('/') + QString::fromLatin1(key.left(2))
+            + QLatin1Char('/') + QString::fromLatin1(key) + QStringLiteral(".jpg");
+}
+
+QImage ThumbnailCache::cached(const QString &path, const QSize &size) const
+{
+    QMutexLocker locker(&m_mutex);
+    if (const QImage *image = m_memory.object(memoryKey(path, size)))
+        return *image;
+    return QImage();
+}
+
+QImage ThumbnailCache::thumbnail(const QString &path, const QSize &size)
+{
+    TraceSpan span("thumb.load");
+    ++m_requests;
+    const QString key = memoryKey(path, size);
+    {
+        QMutexLocker locker(&m_mutex);
+        if (const QImage *image = m_memory.object(key)) {
+            Tracer::instance().counter("thumb.memoryHits", qint64(++m_memoryHits));
+            return *image;
+        }
+    }
+
+    const QByteArray fileKey = diskKey(path, size);
+    if (fileKey.isEmpty()) {
+        ++m_failures;
+        return QImage();
+    }
+
+    const QString file = diskPath(fileKey);
+    QImage image;
+    if (QFile::exists(file) && image.load(file, "JPG")) {
+        Tracer::instance().counter("thumb.diskHits", qint64(++m_diskHits));
+        remember(key, image);
+        return image;
+    }
+
+    image = embeddedPreview(path, size);
+    if (!image.isNull()) {
+        Tracer::instance().counter("thumb.exifHits", qint64(++m_exifHits));
+    } else {
+        image = decodeScaled(path, size);
+        if (!image.isNull()) {
+            Tracer::instance().counter("thumb.decodes", qint64(++m_decodes));
+        } else {
+            image = embeddedPreview(path, size, true);
+            if (image.isNull()) {
+                ++m_failures;
+                return QImage();
+            }
+            Tracer::instance().counter("thumb.exifHits", qint64(++m_exifHits));
+        }
+    }
+
+    QDir().mkpath(QFileInfo(file).absolutePath());
+    QSaveFile out(file);
+    if (out.open(QIODevice::WriteOnly) && image.save(&out, "JPG", DiskJpegQuality)) {
+        const qint64 written = out.size();
+        if (out.commit()) {
+            // Первая запись за сеанс заодно подсчитывает занятое место
+            const qint64 usage = m_diskBytes.load() < 0 ? -1 : (m_diskBytes += written);
+            if (usage < 0 || usage > m_diskLimit)
+                trimDisk();
+        }
+    }
+
+    remember(key, image);
+    return image;
+}
+
+void ThumbnailCache::trimDisk()
+{
+    // Чистит один поток, остальные продолжают писать
+    if (!m_trimMutex.tryLock())
+        return;
+    TraceSpan span("thumb.trim");
+
+    struct Entry
+    {
+        qint64 modified;
+        qint64 size;
+        QString path;
+    };
+    std::vector<Entry> entries;
+    qint64 total = 0;
+    QDirIterator it(m_diskDir, {QStringLiteral("*.jpg")}, QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        it.next();
+        const QFileInfo info = it.fileInfo();
+        entries.push_back({info.lastModified().toMSecsSinceEpoch(), info.size(), info.filePath()});
+        total += info.size();
+    }
+
+    if (total > m_diskLimit) {
+        std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) {
+            return a.modified < b.modified;
+        });
+        const qint64 target = qint64(double(m_diskLimit) * DiskTrimRatio);
+        int removed = 0;
+        for (const Entry &entry : entries) {
+            if (total <= target)
+                break;
+            if (QFile::remove(entry.path)) {
+                total -= entry.size;
+                ++removed;
+            }
+        }
+        span.setValue(removed);
+    }
+    m_diskBytes = total;
+    m_trimMutex.unlock();
+}
+
+QImage ThumbnailCache::embeddedPreview(const QString &path, const QSize &size, bool allowSmaller)
+{
+    TraceSpan span("thumb.exif");
+    ExifData exif;
+    if (!ExifReader::read(path, exif) || exif.thumbnailOffset < 0 || exif.thumbnailLength <= 0)
+        return QImage();
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return QImage();
+
+    // Встроенное превью обычно 160x120: для иконок хватает, для превью - нет.
+    // Тогда пробуется крупное (RAW, HEIF, CR3); оно декодируется сразу уменьшенным.
+    const qint64 offsets[] = {exif.thumbnailOffset, exif.previewOffset};
+    const qint64 lengths[] = {exif.thumbnailLength, exif.previewLength};
+    QImage smaller;
+    for (int i = 0; i < 2; ++i) {
+        if (offsets[i] < 0 || lengths[i] <= 0 || !file.seek(offsets[i]))
+            continue;
+        QByteArray bytes = file.read(lengths[i]);
+        QBuffer buffer(&bytes);
+        QImageReader reader(&buffer, "JPG");
+        const QSize full = reader.size();
+        if (!full.isValid())
+            continue;
+        const QSize fit = full.scaled(size, Qt::KeepAspectRatio);
+        if (full.width() < fit.width() || full.height() < fit.height()) {
+            if (allowSmaller)
+                smaller = reader.read();
+            continue;
+        }
+        reader.setScaledSize(fit);
+        const QImage image = reader.read();
+        if (!image.isNull())
+            return image;
+    }
+    return smaller;
+}
+
+QImage ThumbnailCache::decodeScaled(const QString &path, const QSize &size)
+{
+    QImageReader reader(path);
+    const QSize full = reader.size();
+    if (full.isValid()) {
+        const QSize fit = full.scaled(size, Qt::KeepAspectRatio);
+        // Для JPEG уменьшение делается при декодировании (масштабирование DCT)
+        if (fit.width() < full.width())
+            reader.setScaledSize(fit);
+    }
+
+    QImage image;
+    {
+        TraceSpan span("thumb.decode");
+        image = reader.read();
+    }
+    if (image.isNull())
+        return QImage();
+    if (image.width() > size.width() || image.height() > size.height()) {
+        TraceSpan span("thumb.scale");
+        image = image.scaled(size, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    }
+    return image;
+}
+
+void ThumbnailCache::remember(const QString &key, const QImage &image)
+{
+    QMutexLocker locker(&m_mutex);
+    m_memory.insert(key, new QImage(image), qMax<qsizetype>(1, image.sizeInBytes()));
+}
+
+ThumbnailCache::Stats ThumbnailCache::stats() const
+{
+    Stats s;
+    {
+        QMutexLocker locker(&m_mutex);
+        s.memoryBytes = m_memory.totalCost();
+        s.memoryLimit = m_memory.maxCost();
+        s.memoryEntries = int(m_memory.size());
+    }
+    s.requests = m_requests;
+    s.memoryHits = m_memoryHits;
+    s.diskHits = m_diskHits;
+    s.exifHits = m_exifHits;
+    s.decodes = m_decodes;
+    s.failures = m_failures;
+    return s;
+}
+
+void ThumbnailCache::clearMemory()
+{
+    QMutexLocker locker(&m_mutex);
+    m_memory.clear();
+}
+
+void ThumbnailCache::forget(const QString &path)
+{
+    QMutexLocker locker(&m_mutex);
+    const QList<QString> keys = m_memory.keys();
+    for (const QString &key : keys) {
+        const int bar = int(key.indexOf(QLatin1Char('|')));
+        if (key.size() - bar - 1 == path.size() && key.endsWith(path))
+            m_memory.remove(key);
+    }
+}
@@ -0,0 +1,83 @@
+#ifndef THUMBNAILCACHE_H
+#define THUMBNAILCACHE_H
+
+#include <QByteArray>
+#include <QCache>
+#include <QImage>
+#include <QMutex>
+#include <QSize>
+#include <QString>
+#include <atomic>
+
+// Сервис миниатюр: LRU в памяти (ограничен по байтам) + дисковый кэш,
+// адресуемый по каноническому пути, размеру и времени изменения файла;
+// при переполнении дискового кэша удаляются самые старые миниатюры. Если в файле есть встроенное JPEG-превью
+// достаточного размера (EXIF, у RAW, HEIF и CR3 - ещё и крупное), берётся оно;
+// иначе декодирование идёт сразу в уменьшенный размер через
+// QImageReader::setScaledSize. Форматы, которые Qt не декодирует (RAW, HEIF
+// без плагина), в крайнем случае получают и превью меньше запрошенного.
+// Потокобезопасен: может вызываться из пула потоков.
+class ThumbnailCache
+{
+public:
+    struct Stats
+    {
+        qint64 memoryBytes = 0;
+        qint64 memoryLimit = 0;
+        int memoryEntries = 0;
+        quint64 requests = 0;
+        quint64 memoryHits = 0;
+        quint64 diskHits = 0;
+        quint64 exifHits = 0;   // взято встроенное превью
+        quint64 decodes = 0;    // пришлось декодировать файл
+        quint64 failures = 0;
+
+        double hitRate() const
+        {
+            return requests == 0 ? 0.0 : double(memoryHits + diskHits) / double(requests);
+        }
+    };
+
+    explicit ThumbnailCache(qint64 memoryLimitBytes = 96 * 1024 * 1024,
+                            qint64 diskLimitBytes = 512 * 1024 * 1024);
+
+    // Миниатюра, вписанная в size с сохранением пропорций; null при ошибке
+    QImage thumbnail(const QString &path, const QSize &size);
+    // Только уже готовые миниатюры из памяти, без обращения к диску
+    QImage cached(const QString &path, const QSize &size) const;
+
+    Stats stats() const;
+    void clearMemory();
+    // Файл изменился: убрать его миниатюры всех размеров из памяти
+    // (ключ дискового кэша включает время изменения, устаревших записей он не отдаёт)
+    void forget(const QString &path);
+    QString diskCacheDir() const { return m_diskDir; }
+
+    // Встроенное JPEG-превью, вписанное в size; allowSmaller - годится
+    // и меньшее (без увеличения), если крупнее в файле нет
+    static QImage embeddedPreview(const QString &path, const QSize &size, bool allowSmaller = false);
+
+private:
+    static QString memoryKey(const QString &path, const QSize &size);
+    static QByteArray diskKey(const QString &path, const QSize &size);
+    QString diskPath(const QByteArray &key) const;
+    static QImage decodeScaled(const QString &path, const QSize &size);
+    void remember(const QString &key, const QImage &image);
+    void trimDisk();
+
+    mutable QMutex m_mutex;
+    QCache<QString, QImage> m_memory;
+    QString m_diskDir;
+    qint64 m_diskLimit = 0;
+    std::atomic<qint64> m_diskBytes{-1};   // -1 - ещё не подсчитано
+    QMutex m_trimMutex;
+
+    std::atomic<quint64> m_requests{0};
+    std::atomic<quint64> m_memoryHits{0};
+    std::atomic<quint64> m_diskHits{0};
+    std::atomic<quint64> m_exifHits{0};
+    std::atomic<quint64> m_decodes{0};
+    std::atomic<quint64> m_failures{0};
+};
+
+#endif // THUMBNAILCACHE_H
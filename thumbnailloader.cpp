@@ -0,0 +1,131 @@
+#include "thumbnailloader.h"
+#include "thumbnailcache.h"
+#include "tracer.h"
+
+#include <QMutexLocker>
+#include <QThread>
+
+ThumbnailLoader::ThumbnailLoader(ThumbnailCache *cache, QObject *parent, int maxThreads)
+    : QObject(parent)
+    , m_cache(cache)
+{
+    m_pool.setMaxThreadCount(maxThreads > 0 ? maxThreads
+                                            : qBound(1, QThread::idealThreadCount() / 2, 4));
+}
+
+ThumbnailLoader::~ThumbnailLoader()
+{
+    clear();
+    m_pool.waitForDone();
+}
+
+void ThumbnailLoader::request(int key, const QString &path, const QSize &size, Priority priority)
+{
+    QMutexLocker locker(&m_mutex);
+
+    // Уже декодируется то же самое: дождаться этой задачи, а не начинать вторую.
+    // Тот же ключ с другим путём или размером - это другая картинка
+    auto running = m_running.find(key);
+    if (running != m_running.end() && running->path == path && running->size == size) {
+        running->requeued = true;
+        return;
+    }
+
+    auto it = m_queued.find(key);
+    if (it != m_queued.end()) {
+        // Уже в очереди видимых - ничего не делаем; предзагрузку повышаем
+        if (it.value() == Visible || priority == Prefetch)
+            return;
+        it.value() = Visible;
+    } else {
+        m_queued.insert(key, priority);
+    }
+
+    if (priority == Visible) {
+        m_visible.push_back({key, path, size, m_generation});
+        while (int(m_visible.size()) > MaxVisibleQueue) {
+            // Самые старые запросы относятся к строкам, которые уже прокручены
+            m_queued.remove(m_visible.front().key);
+            m_visible.pop_front();
+        }
+    } else {
+        if (int(m_prefetch.size()) >= MaxPrefetchQueue) {
+            m_queued.remove(key);
+            return;
+        }
+        m_prefetch.push_back({key, path, size, m_generation});
+    }
+    Tracer::instance().counter("thumb.queue", qint64(m_queued.size()));
+
+    if (m_workers < m_pool.maxThreadCount()) {
+        ++m_workers;
+        m_pool.start([this]() { drain(); });
+    }
+}
+
+void ThumbnailLoader::clear()
+{
+    QMutexLocker locker(&m_mutex);
+    ++m_generation;
+    m_visible.clear();
+    m_prefetch.clear();
+    m_queued.clear();
+    for (Running &running : m_running)
+        running.requeued = false;
+}
+
+void ThumbnailLoader::forget(int key)
+{
+    QMutexLocker locker(&m_mutex);
+    m_running.remove(key);
+}
+
+int ThumbnailLoader::queued() const
+{
+    QMutexLocker locker(&m_mutex);
+    return int(m_queued.size());
+}
+
+bool ThumbnailLoader::takeJob(Job &job)
+{
+    QMutexLocker locker(&m_mutex);
+    for (;;) {
+        if (!m_visible.empty()) {
+            job = m_visible.back();
+            m_visible.pop_back();
+        } else if (!m_prefetch.empty()) {
+            job = m_prefetch.front();
+            m_prefetch.pop_front();
+        } else {
+            --m_workers;
+            return false;
+        }
+        // Ключ мог быть вытеснен или уже обработан через другую очередь
+        if (m_queued.remove(job.key)) {
+            job.ticket = ++m_tickets;
+            m_running.insert(job.key, {job.path, job.size, job.ticket});
+            Tracer::instance().counter("thumb.queue", qint64(m_queued.size()));
+            return true;
+        }
+    }
+}
+
+void ThumbnailLoader::drain()
+{
+    Job job;
+    while (takeJob(job)) {
+        const QImage image = m_cache->thumbnail(job.path, job.size);
+        int generation = job.generation;
+        {
+            QMutexLocker locker(&m_mutex);
+            auto running = m_running.find(job.key);
+            // Для ключа уже начата более новая задача - этот результат устарел
+            if (running == m_running.end() || running->ticket != job.ticket)
+                continue;
+            if (running->requeued)
+                generation = m_generation;
+            m_running.erase(running);
+        }
+        emit loaded(generation, job.key, image);
+    }
+}
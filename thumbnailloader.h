@@ -0,0 +1,84 @@
+#ifndef THUMBNAILLOADER_H
+#define THUMBNAILLOADER_H
+
+#include <QHash>
+#include <QImage>
+#include <QMutex>
+#include <QObject>
+#include <QSize>
+#include <QString>
+#include <QThreadPool>
+#include <atomic>
+#include <deque>
+
+class ThumbnailCache;
+
+// Асинхронная загрузка миниатюр через ThumbnailCache.
+// Две очереди: видимые строки обслуживаются первыми и в обратном порядке
+// (последний запрос - текущее положение прокрутки), предзагрузка - после них.
+// Устаревшие видимые запросы вытесняются, когда очередь переполняется.
+// Повторный запрос ключа, который уже загружается с тем же путём и размером,
+// не ставит вторую задачу: результат текущей придёт с новым поколением.
+// Если путь или размер другие (ключи после reset(), изменённый файл), ставится
+// новая задача, а результат старой отбрасывается.
+class ThumbnailLoader : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Priority { Visible, Prefetch };
+
+    static constexpr int MaxVisibleQueue = 256;
+    static constexpr int MaxPrefetchQueue = 512;
+
+    // maxThreads <= 0 - половина ядер, но не больше 4
+    explicit ThumbnailLoader(ThumbnailCache *cache, QObject *parent = nullptr, int maxThreads = 0);
+    ~ThumbnailLoader() override;
+
+    void request(int key, const QString &path, const QSize &size, Priority priority);
+    // Отбрасывает очередь; результаты задач, уже начатых до вызова,
+    // приходят со старым поколением и должны игнорироваться
+    void clear();
+    // Файл ключа изменился: результат уже начатой задачи отбрасывается,
+    // следующий request() ставит новую
+    void forget(int key);
+    int queued() const;
+    int generation() const { return m_generation; }
+
+signals:
+    void loaded(int generation, int key, const QImage &image);
+
+private:
+    struct Job
+    {
+        int key;
+        QString path;
+        QSize size;
+        int generation;
+        quint64 ticket = 0;        // номер запуска, выдаётся в takeJob()
+    };
+
+    struct Running
+    {
+        QString path;
+        QSize size;
+        quint64 ticket = 0;
+        bool requeued = false;     // запрошен снова после clear()
+    };
+
+    bool takeJob(Job &job);
+    void drain();
+
+    ThumbnailCache *m_cache = nullptr;
+    QThreadPool m_pool;
+    mutable QMutex m_mutex;
+    std::deque<Job> m_visible;
+    std::deque<Job> m_prefetch;
+    QHash<int, Priority> m_queued;
+    QHash<int, Running> m_running; // последняя начатая задача по каждому ключу
+    quint64 m_tickets = 0;
+    int m_workers = 0;
+    std::atomic<int> m_generation{0};
+};
+
+#endif // THUMBNAILLOADER_H
@@ -0,0 +1,109 @@
+#include "tilestore.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+TileStore::TileStore(const QString &root, qint64 hotCacheBytes)
+    : m_root(root)
+    , m_hot(hotCacheBytes)
+{
+}
+
+QString TileStore::defaultRoot()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation)
+            + QStringLiteral("/tiles");
+}
+
+bool TileStore::isValid(int z, int x, int y)
+{
+    if (z < 0 || z > MaxZoom)
+        return false;
+    const qint64 n = qint64(1) << z;
+    return x >= 0 && y >= 0 && x < n && y < n;
+}
+
+QString TileStore::tilePath(int z, int x, int y) const
+{
+    return QStringLiteral("%1/%2/%3/%4.png").arg(m_root).arg(z).arg(x).arg(y);
+}
+
+bool TileStore::cached(int z, int x, int y, QByteArray &data) const
+{
+    if (!isValid(z, x, y))
+        return false;
+
+    QMutexLocker locker(&m_mutex);
+    if (const QByteArray *tile = m_hot.object(key(z, x, y))) {
+        ++m_requests;
+        ++m_hotHits;
+        data = *tile;
+        return true;
+    }
+    return false;
+}
+
+bool TileStore::read(int z, int x, int y, QByteArray &data)
+{
+    if (!isValid(z, x, y))
+        return false;
+    if (cached(z, x, y, data))
+        return true;
+
+    ++m_requests;
+    QFile file(tilePath(z, x, y));
+    if (!file.open(QIODevice::ReadOnly)) {
+        ++m_misses;
+        return false;
+    }
+    data = file.readAll();
+    if (data.isEmpty()) {
+        ++m_misses;
+        return false;
+    }
+
+    ++m_diskHits;
+    remember(key(z, x, y), data);
+    return true;
+}
+
+bool TileStore::write(int z, int x, int y, const QByteArray &data)
+{
+    if (!isValid(z, x, y) || data.isEmpty())
+        return false;
+
+    remember(key(z, x, y), data);
+
+    const QString path = tilePath(z, x, y);
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    QSaveFile out(path);
+    if (!out.open(QIODevice::WriteOnly) || out.write(data) != data.size() || !out.commit())
+        return false;
+    ++m_writes;
+    return true;
+}
+
+void TileStore::remember(quint64 tileKey, const QByteArray &data)
+{
+    QMutexLocker locker(&m_mutex);
+    m_hot.insert(tileKey, new QByteArray(data), qMax<qsizetype>(1, data.size()));
+}
+
+TileStore::Stats TileStore::stats() const
+{
+    Stats s;
+    {
+        QMutexLocker locker(&m_mutex);
+        s.hotBytes = m_hot.totalCost();
+    }
+    s.requests = m_requests;
+    s.hotHits = m_hotHits;
+    s.diskHits = m_diskHits;
+    s.misses = m_misses;
+    s.writes = m_writes;
+    return s;
+}
@@ -0,0 +1,65 @@
+#ifndef TILESTORE_H
+#define TILESTORE_H
+
+#include <QByteArray>
+#include <QCache>
+#include <QMutex>
+#include <QString>
+#include <atomic>
+
+// Локальное хранилище тайлов карты в раскладке OSM: <root>/<z>/<x>/<y>.png
+// (внутри может быть и JPEG - формат определяется по содержимому).
+// Горячие тайлы держатся в памяти (LRU по байтам). Потокобезопасно:
+// чтение и запись выполняются из пула потоков обработчика схемы.
+class TileStore
+{
+public:
+    static constexpr int MaxZoom = 22;
+
+    struct Stats
+    {
+        quint64 requests = 0;
+        quint64 hotHits = 0;
+        quint64 diskHits = 0;
+        quint64 misses = 0;
+        quint64 writes = 0;
+        qint64 hotBytes = 0;
+    };
+
+    explicit TileStore(const QString &root = defaultRoot(),
+                       qint64 hotCacheBytes = 64 * 1024 * 1024);
+
+    static QString defaultRoot();
+    static bool isValid(int z, int x, int y);
+
+    QString root() const { return m_root; }
+    QString tilePath(int z, int x, int y) const;
+
+    // Только из памяти, без обращения к диску (для ответа без пула потоков)
+    bool cached(int z, int x, int y, QByteArray &data) const;
+    // Из памяти или с диска; false - тайла нет
+    bool read(int z, int x, int y, QByteArray &data);
+    // Сохранение тайла, полученного из сети (write-through)
+    bool write(int z, int x, int y, const QByteArray &data);
+
+    Stats stats() const;
+
+private:
+    static quint64 key(int z, int x, int y)
+    {
+        return (quint64(z) << 58) | (quint64(x) << 29) | quint64(y);
+    }
+    void remember(quint64 tileKey, const QByteArray &data);
+
+    QString m_root;
+    mutable QMutex m_mutex;
+    QCache<quint64, QByteArray> m_hot;
+
+    mutable std::atomic<quint64> m_requests{0};
+    mutable std::atomic<quint64> m_hotHits{0};
+    std::atomic<quint64> m_diskHits{0};
+    std::atomic<quint64> m_misses{0};
+    std::atomic<quint64> m_writes{0};
+};
+
+#endif // TILESTORE_H
@@ -0,0 +1,216 @@
+#include "timeindex.h"
+
+#include "photostore.h"
+
+#include <QDateTime>
+
+namespace {
+
+// Значения m_dayOfId, кроме юлианского дня
+constexpr qint32 NotIndexed = -1;
+constexpr qint32 Undated = -2;
+
+} // namespace
+
+void TimeIndex::clear()
+{
+    *this = TimeIndex();
+}
+
+qint64 TimeIndex::keyOf(Resolution resolution, qint64 julianDay)
+{
+    switch (resolution) {
+    case Day:
+        return julianDay;
+    case Month: {
+        const QDate date = QDate::fromJulianDay(julianDay);
+        return qint64(date.year()) * 12 + date.month() - 1;
+    }
+    case Year:
+        return QDate::fromJulianDay(julianDay).year();
+    case ResolutionCount:
+        break;
+    }
+    return 0;
+}
+
+qint64 TimeIndex::dayOf(qint64 taken)
+{
+    if (taken >= m_cachedStart && taken < m_cachedEnd)
+        return m_cachedDay;
+
+    const QDate date = QDateTime::fromMSecsSinceEpoch(taken).date();
+    if (!date.isValid() || date.year() < MinYear || date.year() > MaxYear)
+        return -1;
+    // Границы берутся от полуночи, а не через 24 часа - из-за перехода на летнее время
+    m_cachedDay = date.toJulianDay();
+    m_cachedStart = date.startOfDay().toMSecsSinceEpoch();
+    m_cachedEnd = date.addDays(1).startOfDay().toMSecsSinceEpoch();
+    return m_cachedDay;
+}
+
+void TimeIndex::extend(Resolution resolution, qint64 key)
+{
+    Level &level = m_levels[resolution];
+    const qint64 count = level.counts.size();
+    if (count == 0) {
+        level.first = key;
+        level.counts.append(0);
+    } else if (key < level.first) {
+        level.counts.insert(0, int(level.first - key), 0);
+    } else if (key >= level.first + count) {
+        level.counts.resize(int(key - level.first + 1));
+    } else {
+        return;
+    }
+
+    if (resolution == Day) {
+        if (count == 0)
+            m_dayIds.resize(1);
+        else if (key < level.first)
+            m_dayIds.insert(0, int(level.first - key), QVector<int>());
+        else
+            m_dayIds.resize(level.counts.size());
+    }
+    level.first = qMin(level.first, key);
+    level.dirty = true;
+}
+
+void TimeIndex::adjust(qint64 julianDay, int delta)
+{
+    for (int r = 0; r < ResolutionCount; ++r) {
+        const Resolution resolution = Resolution(r);
+        const qint64 key = keyOf(resolution, julianDay);
+        if (delta > 0)
+            extend(resolution, key);
+        Level &level = m_levels[r];
+        level.counts[int(key - level.first)] += delta;
+        level.dirty = true;
+    }
+}
+
+void TimeIndex::insert(int id, qint64 taken)
+{
+    if (id < 0)
+        return;
+    remove(id);
+    if (id >= m_dayOfId.size())
+        m_dayOfId.resize(qMax(id + 1, int(m_dayOfId.size()) * 2), NotIndexed);
+
+    const qint64 day = taken == PhotoStore::NoTime ? -1 : dayOf(taken);
+    if (day < 0) {
+        m_dayOfId[id] = Undated;
+        ++m_undated;
+        return;
+    }
+    adjust(day, +1);
+    m_dayIds[int(day - m_levels[Day].first)].append(id);
+    m_dayOfId[id] = qint32(day);
+    ++m_size;
+}
+
+void TimeIndex::remove(int id)
+{
+    if (id < 0 || id >= m_dayOfId.size())
+        return;
+    const qint32 day = m_dayOfId[id];
+    if (day == NotIndexed)
+        return;
+    m_dayOfId[id] = NotIndexed;
+    if (day == Undated) {
+        --m_undated;
+        return;
+    }
+    // Опустевшие крайние корзины остаются: шкала не прыгает при слежении
+    m_dayIds[int(day - m_levels[Day].first)].removeOne(id);
+    adjust(day, -1);
+    --m_size;
+}
+
+QDate TimeIndex::bucketFirstDay(Resolution resolution, int bucket) const
+{
+    const qint64 key = m_levels[resolution].first + bucket;
+    switch (resolution) {
+    case Day:
+        return QDate::fromJulianDay(key);
+    case Month:
+        return QDate(int(key / 12), int(key % 12) + 1, 1);
+    case Year:
+        return QDate(int(key), 1, 1);
+    case ResolutionCount:
+        break;
+    }
+    return QDate();
+}
+
+QDate TimeIndex::bucketLastDay(Resolution resolution, int bucket) const
+{
+    const QDate first = bucketFirstDay(resolution, bucket);
+    switch (resolution) {
+    case Day:
+        return first;
+    case Month:
+        return first.addMonths(1).addDays(-1);
+    case Year:
+        return QDate(first.year(), 12, 31);
+    case ResolutionCount:
+        break;
+    }
+    return QDate();
+}
+
+int TimeIndex::bucketOf(Resolution resolution, const QDate &date) const
+{
+    return int(keyOf(resolution, date.toJulianDay()) - m_levels[resolution].first);
+}
+
+int TimeIndex::count(Resolution resolution, int bucket) const
+{
+    const QVector<int> &counts = m_levels[resolution].counts;
+    return bucket >= 0 && bucket < counts.size() ? counts[bucket] : 0;
+}
+
+const QVector<int> &TimeIndex::prefix(Resolution resolution) const
+{
+    const Level &level = m_levels[resolution];
+    if (level.dirty || level.prefix.size() != level.counts.size() + 1) {
+        level.prefix.resize(level.counts.size() + 1);
+        level.prefix[0] = 0;
+        for (int i = 0; i < level.counts.size(); ++i)
+            level.prefix[i + 1] = level.prefix[i] + level.counts[i];
+        level.dirty = false;
+    }
+    return level.prefix;
+}
+
+int TimeIndex::count(Resolution resolution, int first, int last) const
+{
+    first = qMax(first, 0);
+    last = qMin(last, bucketCount(resolution) - 1);
+    if (first > last)
+        return 0;
+    const QVector<int> &sums = prefix(resolution);
+    return sums[last + 1] - sums[first];
+}
+
+QVector<int> TimeIndex::photosBetween(const QDate &first, const QDate &last) const
+{
+    QVector<int> ids;
+    if (!first.isValid() || !last.isValid() || isEmpty())
+        return ids;
+    const int from = qMax(bucketOf(Day, first), 0);
+    const int to = qMin(bucketOf(Day, last), bucketCount(Day) - 1);
+    if (from > to)
+        return ids;
+    ids.reserve(count(Day, from, to));
+    for (int day = from; day <= to; ++day)
+        ids += m_dayIds[day];
+    return ids;
+}
+
+int TimeIndex::countBetween(const QDate &first, const QDate &last) const
+{
+    if (!first.isValid() || !last.isValid() || isEmpty())
+        return 0;
+    return count(Day, bucketOf(Day, first), bucketOf(Day, last));
+}
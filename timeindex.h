@@ -0,0 +1,79 @@
+#ifndef TIMEINDEX_H
+#define TIMEINDEX_H
+
+#include <QDate>
+#include <QVector>
+
+// Индекс фото по дню съёмки (местная дата) для шкалы времени.
+// Дни образуют сплошной массив от первого до последнего, в каждом - список id,
+// так что выборка диапазона стоит O(дней + результатов) без прохода по всем фото.
+// Для дня, месяца и года хранятся счётчики и (лениво) их префиксные суммы:
+// число фото в любом диапазоне корзин - O(1), гистограмма - O(корзин).
+// Обновляется по одному фото, пока идёт сканирование или слежение за папкой.
+// Даты вне [MinYear, MaxYear] (сброшенные часы камеры) считаются неизвестными,
+// чтобы одно такое фото не растягивало шкалу на века.
+class TimeIndex
+{
+public:
+    static constexpr int MinYear = 1900;
+    static constexpr int MaxYear = 2100;
+
+    enum Resolution {
+        Day,
+        Month,
+        Year,
+        ResolutionCount
+    };
+
+    void clear();
+    // Повторная вставка того же id переносит его; время NoTime - фото без даты
+    void insert(int id, qint64 taken);
+    void remove(int id);
+
+    bool isEmpty() const { return m_size == 0; }
+    int size() const { return m_size; }
+    int undatedCount() const { return m_undated; }
+
+    // Корзины сплошные: от корзины первого фото до корзины последнего
+    int bucketCount(Resolution resolution) const { return int(m_levels[resolution].counts.size()); }
+    QDate bucketFirstDay(Resolution resolution, int bucket) const;
+    QDate bucketLastDay(Resolution resolution, int bucket) const;
+    // Корзина, в которую попадает дата (может быть за пределами [0, bucketCount))
+    int bucketOf(Resolution resolution, const QDate &date) const;
+    int count(Resolution resolution, int bucket) const;
+    // Фото в корзинах [first, last], границы обрезаются
+    int count(Resolution resolution, int first, int last) const;
+
+    // Фото, снятые с first по last включительно (по дням, без сортировки)
+    QVector<int> photosBetween(const QDate &first, const QDate &last) const;
+    int countBetween(const QDate &first, const QDate &last) const;
+
+private:
+    struct Level
+    {
+        qint64 first = 0;              // ключ корзины 0
+        QVector<int> counts;
+        mutable QVector<int> prefix;   // prefix[i] - сумма counts[0..i)
+        mutable bool dirty = false;
+    };
+
+    static qint64 keyOf(Resolution resolution, qint64 julianDay);
+    // -1 - дата вне [MinYear, MaxYear]
+    qint64 dayOf(qint64 taken);
+    void extend(Resolution resolution, qint64 key);
+    void adjust(qint64 julianDay, int delta);
+    const QVector<int> &prefix(Resolution resolution) const;
+
+    Level m_levels[ResolutionCount];
+    QVector<QVector<int>> m_dayIds;    // параллельно m_levels[Day].counts
+    QVector<qint32> m_dayOfId;         // id -> юлианский день или NotIndexed/Undated
+    int m_size = 0;
+    int m_undated = 0;
+
+    // Фото одной папки обычно сняты в один день - граница дня кэшируется
+    qint64 m_cachedStart = 1;
+    qint64 m_cachedEnd = 0;
+    qint64 m_cachedDay = 0;
+};
+
+#endif // TIMEINDEX_H
@@ -0,0 +1,222 @@
+#include "timelinewidget.h"
+
+#include <QFont>
+#include <QMouseEvent>
+#include <QPainter>
+#include <QToolTip>
+
+namespace {
+
+constexpr int Margin = 6;
+constexpr int LabelHeight = 16;
+
+} // namespace
+
+TimelineWidget::TimelineWidget(const TimeIndex *index, QWidget *parent)
+    : QWidget(parent)
+    , m_index(index)
+{
+    setMouseTracking(true);
+    setCursor(Qt::CrossCursor);
+    setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Fixed);
+}
+
+QSize TimelineWidget::sizeHint() const
+{
+    return QSize(480, 96);
+}
+
+QSize TimelineWidget::minimumSizeHint() const
+{
+    return QSize(160, 72);
+}
+
+void TimelineWidget::setResolution(TimeIndex::Resolution resolution)
+{
+    if (m_resolution == resolution)
+        return;
+    // Диапазон хранится в днях и при смене масштаба не меняется
+    m_resolution = resolution;
+    m_dragStart = -1;
+    update();
+}
+
+void TimelineWidget::clearRange()
+{
+    m_first = QDate();
+    m_last = QDate();
+    m_dragStart = -1;
+    update();
+}
+
+void TimelineWidget::refresh()
+{
+    update();
+}
+
+QRect TimelineWidget::plotRect() const
+{
+    return rect().adjusted(Margin, Margin, -Margin, -Margin - LabelHeight);
+}
+
+int TimelineWidget::columnCount() const
+{
+    return qMin(m_index->bucketCount(m_resolution), qMax(1, plotRect().width()));
+}
+
+int TimelineWidget::columnAt(int x) const
+{
+    const QRect plot = plotRect();
+    const int columns = columnCount();
+    const qint64 column = qint64(x - plot.left()) * columns / qMax(1, plot.width());
+    return int(qBound<qint64>(0, column, columns - 1));
+}
+
+void TimelineWidget::columnBuckets(int column, int &first, int &last) const
+{
+    const qint64 buckets = m_index->bucketCount(m_resolution);
+    const int columns = columnCount();
+    first = int(column * buckets / columns);
+    last = int((column + 1) * buckets / columns) - 1;
+}
+
+QString TimelineWidget::bucketLabel(int bucket) const
+{
+    const QDate day = m_index->bucketFirstDay(m_resolution, bucket);
+    switch (m_resolution) {
+    case TimeIndex::Day:
+        return day.toString(QStringLiteral("dd.MM.yyyy"));
+    case TimeIndex::Month:
+        return day.toString(QStringLiteral("MM.yyyy"));
+    case TimeIndex::Year:
+    case TimeIndex::ResolutionCount:
+        break;
+    }
+    return day.toString(QStringLiteral("yyyy"));
+}
+
+void TimelineWidget::selectColumns(int from, int to)
+{
+    int first, last, unused;
+    columnBuckets(qMin(from, to), first, unused);
+    columnBuckets(qMax(from, to), unused, last);
+    m_first = m_index->bucketFirstDay(m_resolution, first);
+    m_last = m_index->bucketLastDay(m_resolution, last);
+    update();
+}
+
+void TimelineWidget::paintEvent(QPaintEvent *)
+{
+    QPainter painter(this);
+    painter.fillRect(rect(), QColor(15, 19, 27));
+    painter.setPen(QColor(31, 37, 50));
+    painter.drawRect(rect().adjusted(0, 0, -1, -1));
+
+    QFont font = painter.font();
+    font.setPointSizeF(8.0);
+    painter.setFont(font);
+
+    const QRect plot = plotRect();
+    const int buckets = m_index->bucketCount(m_resolution);
+    if (buckets == 0 || m_index->isEmpty()) {
+        painter.setPen(QColor("#b6bdc9"));
+        painter.drawText(rect(), Qt::AlignCenter, tr("Нет снимков с датой"));
+        return;
+    }
+
+    // Счётчики столбиков - разности префиксных сумм, O(1) на столбик
+    const int columns = columnCount();
+    QVector<int> counts(columns);
+    int maxCount = 1;
+    for (int c = 0; c < columns; ++c) {
+        int first, last;
+        columnBuckets(c, first, last);
+        counts[c] = m_index->count(m_resolution, first, last);
+        maxCount = qMax(maxCount, counts[c]);
+    }
+
+    const bool ranged = hasRange();
+    const int selFirst = ranged ? m_index->bucketOf(m_resolution, m_first) : 0;
+    const int selLast = ranged ? m_index->bucketOf(m_resolution, m_last) : 0;
+    const double step = double(plot.width()) / columns;
+
+    painter.setPen(Qt::NoPen);
+    for (int c = 0; c < columns; ++c) {
+        int first, last;
+        columnBuckets(c, first, last);
+        const bool selected = ranged && last >= selFirst && first <= selLast;
+        const int left = plot.left() + int(c * step);
+        const int right = plot.left() + int((c + 1) * step);
+        if (selected)
+            painter.fillRect(QRect(left, plot.top(), qMax(1, right - left), plot.height()), QColor(36, 50, 69));
+        if (counts[c] == 0)
+            continue;
+        const int height = qMax(1, int(double(counts[c]) / maxCount * plot.height()));
+        const int width = qMax(1, right - left - (step >= 4.0 ? 1 : 0));
+        painter.fillRect(QRect(left, plot.bottom() - height + 1, width, height),
+                         !ranged || selected ? QColor("#3ba9ff") : QColor(58, 70, 88));
+    }
+
+    const QRect labels(plot.left(), plot.bottom() + 2, plot.width(), LabelHeight);
+    painter.setPen(QColor("#b6bdc9"));
+    painter.drawText(labels, Qt::AlignLeft | Qt::AlignVCenter, bucketLabel(0));
+    painter.drawText(labels, Qt::AlignRight | Qt::AlignVCenter, bucketLabel(buckets - 1));
+    if (ranged) {
+        painter.setPen(QColor("#e9ecf2"));
+        painter.drawText(labels, Qt::AlignCenter,
+                         tr("%1 - %2: %3 фото")
+                             .arg(m_first.toString(QStringLiteral("dd.MM.yyyy")),
+                                  m_last.toString(QStringLiteral("dd.MM.yyyy")))
+                             .arg(m_index->countBetween(m_first, m_last)));
+    }
+}
+
+void TimelineWidget::mousePressEvent(QMouseEvent *event)
+{
+    if (event->button() != Qt::LeftButton || m_index->bucketCount(m_resolution) == 0) {
+        QWidget::mousePressEvent(event);
+        return;
+    }
+    m_dragStart = columnAt(int(event->position().x()));
+    selectColumns(m_dragStart, m_dragStart);
+}
+
+void TimelineWidget::mouseMoveEvent(QMouseEvent *event)
+{
+    if (m_index->bucketCount(m_resolution) == 0)
+        return;
+    const int column = columnAt(int(event->position().x()));
+    if (m_dragStart >= 0) {
+        selectColumns(m_dragStart, column);
+        return;
+    }
+
+    int first, last;
+    columnBuckets(column, first, last);
+    const QString label = first == last
+            ? bucketLabel(first)
+            : tr("%1 - %2").arg(bucketLabel(first), bucketLabel(last));
+    QToolTip::showText(event->globalPosition().toPoint(),
+                       tr("%1: %2 фото").arg(label).arg(m_index->count(m_resolution, first, last)),
+                       this);
+}
+
+void TimelineWidget::mouseReleaseEvent(QMouseEvent *event)
+{
+    if (event->button() != Qt::LeftButton || m_dragStart < 0) {
+        QWidget::mouseReleaseEvent(event);
+        return;
+    }
+    m_dragStart = -1;
+    emit rangeChanged(m_first, m_last);
+}
+
+void TimelineWidget::mouseDoubleClickEvent(QMouseEvent *event)
+{
+    if (event->button() != Qt::LeftButton) {
+        QWidget::mouseDoubleClickEvent(event);
+        return;
+    }
+    clearRange();
+    emit rangeChanged(QDate(), QDate());
+}
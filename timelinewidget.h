@@ -0,0 +1,64 @@
+#ifndef TIMELINEWIDGET_H
+#define TIMELINEWIDGET_H
+
+#include "timeindex.h"
+
+#include <QDate>
+#include <QWidget>
+
+// Гистограмма числа фото по дням, месяцам или годам под картой.
+// Протяжка мышью выбирает диапазон корзин, двойной щелчок снимает его.
+// Столбики берутся из счётчиков TimeIndex: если корзин больше, чем пикселей,
+// в один столбик сводится несколько корзин по префиксным суммам,
+// так что отрисовка стоит O(ширины), а не O(фото).
+class TimelineWidget : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit TimelineWidget(const TimeIndex *index, QWidget *parent = nullptr);
+
+    TimeIndex::Resolution resolution() const { return m_resolution; }
+    void setResolution(TimeIndex::Resolution resolution);
+
+    QDate rangeFirst() const { return m_first; }
+    QDate rangeLast() const { return m_last; }
+    bool hasRange() const { return m_first.isValid(); }
+    void clearRange();
+
+    // Индекс изменился - перерисовать
+    void refresh();
+
+    QSize sizeHint() const override;
+    QSize minimumSizeHint() const override;
+
+signals:
+    // Недействительные даты - диапазон снят
+    void rangeChanged(const QDate &first, const QDate &last);
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void mousePressEvent(QMouseEvent *event) override;
+    void mouseMoveEvent(QMouseEvent *event) override;
+    void mouseReleaseEvent(QMouseEvent *event) override;
+    void mouseDoubleClickEvent(QMouseEvent *event) override;
+
+private:
+    QRect plotRect() const;
+    // Столбиков не больше, чем пикселей по ширине
+    int columnCount() const;
+    // Столбик под координатой x (обрезается до [0, columnCount))
+    int columnAt(int x) const;
+    // Корзины [first, last], сведённые в столбик column
+    void columnBuckets(int column, int &first, int &last) const;
+    QString bucketLabel(int bucket) const;
+    void selectColumns(int from, int to);
+
+    const TimeIndex *m_index = nullptr;
+    TimeIndex::Resolution m_resolution = TimeIndex::Month;
+    QDate m_first;                 // выбранный диапазон, по дням
+    QDate m_last;
+    int m_dragStart = -1;          // столбик, с которого началась протяжка
+};
+
+#endif // TIMELINEWIDGET_H
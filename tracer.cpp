@@ -0,0 +1,226 @@
+#include "tracer.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QThread>
+#include <algorithm>
+#include <chrono>
+
+std::atomic<bool> Tracer::s_enabled{false};
+
+// Кольцо потока возвращается трассировщику, когда поток завершается
+struct TracerThreadSlot
+{
+    Tracer::Buffer *buffer = nullptr;
+    ~TracerThreadSlot()
+    {
+        if (buffer)
+            Tracer::instance().retire(buffer);
+    }
+};
+
+namespace {
+
+thread_local TracerThreadSlot t_slot;
+
+void appendJsonString(QByteArray &out, const QByteArray &text)
+{
+    out.append('"');
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out.append('\\');
+            out.append(c);
+        } else if (uchar(c) < 0x20) {
+            out.append(' ');
+        } else {
+            out.append(c);
+        }
+    }
+    out.append('"');
+}
+
+// Микросекунды с долями: формат Chrome принимает дробные ts и dur
+void appendMicros(QByteArray &out, qint64 nanos)
+{
+    out.append(QByteArray::number(double(nanos) / 1000.0, 'f', 3));
+}
+
+} // namespace
+
+Tracer &Tracer::instance()
+{
+    static Tracer tracer;
+    return tracer;
+}
+
+qint64 Tracer::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+QString Tracer::environmentPath()
+{
+    return qEnvironmentVariable("GEOPHOTO_TRACE");
+}
+
+void Tracer::setEnabled(bool enabled)
+{
+    if (enabled && !isEnabled())
+        clear();
+    s_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+void Tracer::clear()
+{
+    QMutexLocker locker(&m_mutex);
+    for (const auto &buffer : std::as_const(m_buffers))
+        buffer->head.store(0, std::memory_order_release);
+    m_origin.store(now(), std::memory_order_relaxed);
+}
+
+Tracer::Buffer *Tracer::threadBuffer()
+{
+    if (t_slot.buffer)
+        return t_slot.buffer;
+
+    QThread *thread = QThread::currentThread();
+    QString name = thread ? thread->objectName() : QString();
+    if (QCoreApplication::instance() && thread == QCoreApplication::instance()->thread())
+        name = QStringLiteral("Main");
+
+    QMutexLocker locker(&m_mutex);
+    // Потоки временных пулов приходят и уходят: сначала переиспользуется
+    // кольцо завершённого потока, новое выделяется, только если таких нет
+    std::shared_ptr<Buffer> buffer;
+    const auto it = std::find_if(m_buffers.cbegin(), m_buffers.cend(),
+                                 [](const std::shared_ptr<Buffer> &b) { return b->retired; });
+    if (it != m_buffers.cend()) {
+        buffer = *it;
+        buffer->head.store(0, std::memory_order_release);
+        buffer->retired = false;
+    } else if (m_buffers.size() < MaxBuffers) {
+        buffer = std::make_shared<Buffer>();
+        buffer->events.reset(new Event[BufferCapacity]);
+        m_buffers.append(buffer);
+    } else {
+        return nullptr;
+    }
+    buffer->tid = m_nextTid++;
+    buffer->threadName = name.isEmpty() ? QStringLiteral("Thread %1").arg(buffer->tid) : name;
+    t_slot.buffer = buffer.get();
+    return t_slot.buffer;
+}
+
+void Tracer::retire(Buffer *buffer)
+{
+    QMutexLocker locker(&m_mutex);
+    buffer->retired = true;
+}
+
+void Tracer::append(const Event &event)
+{
+    Buffer *buffer = threadBuffer();
+    if (!buffer)
+        return;
+    // Пишет только поток-владелец; head публикует событие для выгрузки
+    const quint64 head = buffer->head.load(std::memory_order_relaxed);
+    buffer->events[head & (BufferCapacity - 1)] = event;
+    buffer->head.store(head + 1, std::memory_order_release);
+}
+
+void Tracer::complete(const char *name, qint64 start, qint64 duration, qint64 value)
+{
+    if (!isEnabled())
+        return;
+    append({name, start, qMax<qint64>(0, duration), value});
+}
+
+void Tracer::counter(const char *name, qint64 value)
+{
+    if (!isEnabled())
+        return;
+    append({name, now(), -1, value});
+}
+
+int Tracer::eventCount() const
+{
+    QMutexLocker locker(&m_mutex);
+    qint64 count = 0;
+    for (const auto &buffer : m_buffers)
+        count += qMin<quint64>(buffer->head.load(std::memory_order_acquire), BufferCapacity);
+    return int(count);
+}
+
+QByteArray Tracer::chromeJson() const
+{
+    QMutexLocker locker(&m_mutex);
+    const qint64 origin = m_origin.load(std::memory_order_relaxed);
+
+    QByteArray out;
+    out.append("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    out.append("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":");
+    appendJsonString(out, QCoreApplication::applicationName().toUtf8());
+    out.append("}}");
+
+    QVector<Event> events;
+    for (const auto &buffer : m_buffers) {
+        // Копия кольца; всё, что поток перезаписал за это время, отбрасывается
+        const quint64 before = buffer->head.load(std::memory_order_acquire);
+        const quint64 first = before > quint64(BufferCapacity) ? before - BufferCapacity : 0;
+        events.clear();
+        events.reserve(int(before - first));
+        for (quint64 i = first; i < before; ++i)
+            events.append(buffer->events[i & (BufferCapacity - 1)]);
+        const quint64 after = buffer->head.load(std::memory_order_acquire);
+        const quint64 valid = after > quint64(BufferCapacity) ? after - BufferCapacity : 0;
+        const int skip = int(qMin<quint64>(events.size(), valid > first ? valid - first : 0));
+        if (after < before)
+            continue;   // кольцо сброшено во время выгрузки
+
+        const QByteArray tid = QByteArray::number(buffer->tid);
+        out.append(",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":");
+        out.append(tid);
+        out.append(",\"args\":{\"name\":");
+        appendJsonString(out, buffer->threadName.toUtf8());
+        out.append("}}");
+
+        for (int i = skip; i < events.size(); ++i) {
+            const Event &e = events[i];
+            if (e.start < origin)
+                continue;
+            out.append(",\n{\"name\":");
+            appendJsonString(out, QByteArray(e.name));
+            out.append(e.duration < 0 ? ",\"ph\":\"C\",\"ts\":" : ",\"ph\":\"X\",\"ts\":");
+            appendMicros(out, e.start - origin);
+            if (e.duration >= 0) {
+                out.append(",\"dur\":");
+                appendMicros(out, e.duration);
+            }
+            out.append(",\"pid\":1,\"tid\":");
+            out.append(tid);
+            if (e.value != NoValue) {
+                out.append(",\"args\":{\"value\":");
+                out.append(QByteArray::number(e.value));
+                out.append('}');
+            }
+            out.append('}');
+        }
+    }
+    out.append("\n]}\n");
+    return out;
+}
+
+bool Tracer::writeChromeJson(const QString &path, QString *error) const
+{
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly) || file.write(chromeJson()) < 0 || !file.commit()) {
+        if (error)
+            *error = file.errorString();
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,126 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <QByteArray>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+#include <atomic>
+#include <limits>
+#include <memory>
+
+// Встроенная трассировка горячих путей с выгрузкой в формат Chrome/Perfetto
+// (chrome://tracing, ui.perfetto.dev).
+// Каждый поток пишет в своё кольцо на BufferCapacity событий без блокировок:
+// событие - указатель на имя-литерал, время начала и длительность в нс
+// (steady_clock) и необязательное значение; старые события затираются.
+// Пока запись выключена, отрезок стоит одну проверку атомарного флага.
+// Выгрузка копирует кольца под мьютексом списка и отбрасывает события,
+// которые поток успел перезаписать во время копирования.
+class Tracer
+{
+public:
+    static constexpr int BufferCapacity = 1 << 15;
+    static constexpr int MaxBuffers = 256;        // живых колец; кольца завершённых потоков переиспользуются
+    static constexpr qint64 NoValue = std::numeric_limits<qint64>::min();
+
+    static Tracer &instance();
+    static bool isEnabled() { return s_enabled.load(std::memory_order_relaxed); }
+    // Монотонное время, нс
+    static qint64 now();
+    // GEOPHOTO_TRACE: файл, куда сохранить трассу при выходе (пусто - не писать)
+    static QString environmentPath();
+
+    // Включение сбрасывает уже записанное
+    void setEnabled(bool enabled);
+    void clear();
+
+    // Отрезок [start, start + duration); value попадает в args
+    void complete(const char *name, qint64 start, qint64 duration, qint64 value = NoValue);
+    // Значение счётчика в текущий момент
+    void counter(const char *name, qint64 value);
+
+    int eventCount() const;
+    QByteArray chromeJson() const;
+    bool writeChromeJson(const QString &path, QString *error = nullptr) const;
+
+private:
+    struct Event
+    {
+        const char *name;
+        qint64 start;
+        qint64 duration;       // < 0 - счётчик
+        qint64 value;
+    };
+
+    struct Buffer
+    {
+        std::unique_ptr<Event[]> events;
+        std::atomic<quint64> head{0};
+        int tid = 0;
+        QString threadName;
+        bool retired = false;
+    };
+
+    friend struct TracerThreadSlot;
+
+    Tracer() = default;
+    Buffer *threadBuffer();
+    void append(const Event &event);
+    void retire(Buffer *buffer);
+
+    static std::atomic<bool> s_enabled;
+
+    mutable QMutex m_mutex;
+    QVector<std::shared_ptr<Buffer>> m_buffers;
+    std::atomic<qint64> m_origin{0};
+    int m_nextTid = 1;
+};
+
+// Отрезок на время жизни объекта:  TraceSpan span("exif.read");
+class TraceSpan
+{
+public:
+    explicit TraceSpan(const char *name, qint64 value = Tracer::NoValue)
+        : m_name(name)
+        , m_value(value)
+        , m_start(Tracer::isEnabled() ? Tracer::now() : -1)
+    {
+    }
+    ~TraceSpan()
+    {
+        if (m_start >= 0)
+            Tracer::instance().complete(m_name, m_start, Tracer::now() - m_start, m_value);
+    }
+    TraceSpan(const TraceSpan &) = delete;
+    TraceSpan &operator=(const TraceSpan &) = delete;
+
+    void setValue(qint64 value) { m_value = value; }
+
+private:
+    const char *m_name;
+    qint64 m_value;
+    qint64 m_start;
+};
+
+// Накопительный счётчик (прочитанные байты, попадания в кэш):
+// сумма ведётся всегда, в трассу значение пишется только при записи
+class TraceCounter
+{
+public:
+    explicit TraceCounter(const char *name) : m_name(name) {}
+
+    void add(qint64 delta)
+    {
+        const qint64 total = m_total.fetch_add(delta, std::memory_order_relaxed) + delta;
+        if (Tracer::isEnabled())
+            Tracer::instance().counter(m_name, total);
+    }
+    qint64 total() const { return m_total.load(std::memory_order_relaxed); }
+
+private:
+    const char *m_name;
+    std::atomic<qint64> m_total{0};
+};
+
+#endif // TRACER_H
@@ -0,0 +1,414 @@
+#include "tracklog.h"
+#include "tracer.h"
+
+#include <QDate>
+#include <QFile>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+#include <QThreadPool>
+#include <QXmlStreamReader>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace {
+
+constexpr qint64 UnixEpochJulianDay = 2440588;
+constexpr qint64 MsPerDay = 24 * 3600 * 1000;
+
+bool digits(QStringView text, int pos, int count, int &value)
+{
+    if (pos + count > text.size())
+        return false;
+    value = 0;
+    for (int i = 0; i < count; ++i) {
+        const char16_t c = text[pos + i].unicode();
+        if (c < u'0' || c > u'9')
+            return false;
+        value = value * 10 + (c - u'0');
+    }
+    return true;
+}
+
+qint64 epochMs(int year, int month, int day, int hour, int minute, int second, int ms)
+{
+    const QDate date(year, month, day);
+    if (!date.isValid() || hour > 23 || minute > 59 || second > 60)
+        return std::numeric_limits<qint64>::min();
+    return (date.toJulianDay() - UnixEpochJulianDay) * MsPerDay
+            + ((hour * 60 + minute) * 60 + second) * 1000 + ms;
+}
+
+// xsd:dateTime из GPX: "2023-05-01T12:34:56[.sss][Z|+hh:mm]" без QDateTime,
+// которое на миллионах точек стоит заметно дороже. Без зоны - UTC
+bool parseIsoTime(QStringView text, qint64 &out)
+{
+    text = text.trimmed();
+    int year, month, day, hour, minute, second;
+    if (!digits(text, 0, 4, year) || !digits(text, 5, 2, month) || !digits(text, 8, 2, day)
+            || !digits(text, 11, 2, hour) || !digits(text, 14, 2, minute)
+            || !digits(text, 17, 2, second))
+        return false;
+
+    int pos = 19;
+    int ms = 0;
+    if (pos < text.size() && text[pos] == QLatin1Char('.')) {
+        int scale = 100;
+        for (++pos; pos < text.size() && text[pos].isDigit(); ++pos) {
+            ms += (text[pos].unicode() - '0') * scale;
+            scale /= 10;
+        }
+    }
+
+    qint64 zone = 0;
+    if (pos < text.size() && (text[pos] == QLatin1Char('+') || text[pos] == QLatin1Char('-'))) {
+        int zh, zm = 0;
+        if (!digits(text, pos + 1, 2, zh))
+            return false;
+        digits(text, pos + 4, 2, zm);
+        zone = (zh * 60 + zm) * 60000;
+        if (text[pos] == QLatin1Char('-'))
+            zone = -zone;
+    }
+
+    const qint64 local = epochMs(year, month, day, hour, minute, second, ms);
+    if (local == std::numeric_limits<qint64>::min())
+        return false;
+    out = local - zone;
+    return true;
+}
+
+// NMEA: ddmm.mmmm / dddmm.mmmm и полушарие
+bool nmeaCoord(const char *text, int length, char hemisphere, double &out)
+{
+    if (length <= 0)
+        return false;
+    bool ok = false;
+    const double value = QByteArray::fromRawData(text, length).toDouble(&ok);
+    if (!ok)
+        return false;
+    const double degrees = std::floor(value / 100.0);
+    out = degrees + (value - degrees * 100.0) / 60.0;
+    if (hemisphere == 'S' || hemisphere == 'W')
+        out = -out;
+    return hemisphere == 'N' || hemisphere == 'S' || hemisphere == 'E' || hemisphere == 'W';
+}
+
+int hexDigit(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    return -1;
+}
+
+void finishSegment(QVector<TrackLog::Point> &points, QVector<QVector<TrackLog::Point>> &segments)
+{
+    if (points.isEmpty())
+        return;
+    const auto byTime = [](const TrackLog::Point &a, const TrackLog::Point &b) {
+        return a.time < b.time;
+    };
+    if (!std::is_sorted(points.cbegin(), points.cend(), byTime))
+        std::stable_sort(points.begin(), points.end(), byTime);
+    segments.append(points);
+    points.clear();
+}
+
+double wrapLongitude(double longitude)
+{
+    if (longitude > 180.0)
+        return longitude - 360.0;
+    if (longitude < -180.0)
+        return longitude + 360.0;
+    return longitude;
+}
+
+} // namespace
+
+void TrackLog::clear()
+{
+    m_segments.clear();
+}
+
+qint64 TrackLog::pointCount() const
+{
+    qint64 count = 0;
+    for (const auto &segment : m_segments)
+        count += segment.size();
+    return count;
+}
+
+bool TrackLog::parseGpx(QIODevice *device, QVector<QVector<Point>> &segments, QString *error)
+{
+    QXmlStreamReader xml(device);
+    QVector<Point> points;
+    Point point = {};
+    bool inPoint = false;
+    bool hasTime = false;
+
+    while (!xml.atEnd()) {
+        switch (xml.readNext()) {
+        case QXmlStreamReader::StartElement: {
+            const QStringView name = xml.name();
+            if (name == QLatin1String("trkpt") || name == QLatin1String("rtept")) {
+                const QXmlStreamAttributes attributes = xml.attributes();
+                bool okLat = false, okLon = false;
+                point.latitude = attributes.value(QLatin1String("lat")).toDouble(&okLat);
+                point.longitude = attributes.value(QLatin1String("lon")).toDouble(&okLon);
+                inPoint = okLat && okLon && std::abs(point.latitude) <= 90.0
+                        && std::abs(point.longitude) <= 180.0;
+                hasTime = false;
+            } else if (inPoint && name == QLatin1String("time")) {
+                hasTime = parseIsoTime(xml.readElementText(), point.time);
+            }
+            break;
+        }
+        case QXmlStreamReader::EndElement: {
+            const QStringView name = xml.name();
+            if (name == QLatin1String("trkpt") || name == QLatin1String("rtept")) {
+                if (inPoint && hasTime)
+                    points.append(point);
+                inPoint = false;
+            } else if (name == QLatin1String("trkseg") || name == QLatin1String("rte")) {
+                finishSegment(points, segments);
+            }
+            break;
+        }
+        default:
+            break;
+        }
+    }
+    finishSegment(points, segments);
+
+    if (xml.hasError()) {
+        if (error)
+            *error = QStringLiteral("line %1: %2").arg(xml.lineNumber()).arg(xml.errorString());
+        return false;
+    }
+    return true;
+}
+
+bool TrackLog::parseNmea(QIODevice *device, QVector<QVector<Point>> &segments, QString *error)
+{
+    // Берутся только RMC: в них есть и дата, и время, и признак достоверности.
+    // В GGA даты нет, а связывать их с датой соседних RMC ненадёжно у полуночи
+    QVector<Point> points;
+    char line[512];
+    constexpr int MaxFields = 16;
+    const char *field[MaxFields];
+    int fieldLength[MaxFields];
+
+    for (;;) {
+        qint64 length = device->readLine(line, sizeof(line));
+        if (length < 0)
+            break;
+        while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r'))
+            --length;
+        if (length < 7 || line[0] != '$')
+            continue;
+
+        // Контрольная сумма "*hh" необязательна, но если есть - проверяется
+        qint64 end = length;
+        if (const char *star = static_cast<const char *>(std::memchr(line, '*', size_t(length)))) {
+            end = star - line;
+            if (end + 3 != length)
+                continue;
+            const int high = hexDigit(line[end + 1]);
+            const int low = hexDigit(line[end + 2]);
+            quint8 sum = 0;
+            for (qint64 i = 1; i < end; ++i)
+                sum ^= quint8(line[i]);
+            if (high < 0 || low < 0 || sum != quint8(high * 16 + low))
+                continue;
+        }
+
+        int count = 0;
+        qint64 start = 1;
+        for (qint64 i = 1; i <= end && count < MaxFields; ++i) {
+            if (i == end || line[i] == ',') {
+                field[count] = line + start;
+                fieldLength[count] = int(i - start);
+                ++count;
+                start = i + 1;
+            }
+        }
+        // $xxRMC,hhmmss.ss,A,ddmm.mm,N,dddmm.mm,E,скорость,курс,ddmmyy,...
+        if (count < 10 || fieldLength[0] != 5 || std::memcmp(field[0] + 2, "RMC", 3) != 0)
+            continue;
+        if (fieldLength[2] != 1 || field[2][0] != 'A' || fieldLength[1] < 6 || fieldLength[9] != 6)
+            continue;
+
+        const QString time = QString::fromLatin1(field[1], fieldLength[1]);
+        const QString date = QString::fromLatin1(field[9], 6);
+        int hour, minute, second, day, month, year;
+        if (!digits(time, 0, 2, hour) || !digits(time, 2, 2, minute) || !digits(time, 4, 2, second)
+                || !digits(date, 0, 2, day) || !digits(date, 2, 2, month) || !digits(date, 4, 2, year))
+            continue;
+        int ms = 0;
+        if (fieldLength[1] > 7 && field[1][6] == '.')
+            ms = int(std::lround(QByteArray::fromRawData(field[1] + 6, fieldLength[1] - 6).toDouble() * 1000.0));
+
+        Point point;
+        point.time = epochMs(year < 80 ? 2000 + year : 1900 + year, month, day, hour, minute, second, ms);
+        if (point.time == std::numeric_limits<qint64>::min()
+                || fieldLength[4] != 1 || fieldLength[6] != 1
+                || !nmeaCoord(field[3], fieldLength[3], field[4][0], point.latitude)
+                || !nmeaCoord(field[5], fieldLength[5], field[6][0], point.longitude))
+            continue;
+        points.append(point);
+    }
+    finishSegment(points, segments);
+
+    // readLine() возвращает -1 и в конце файла, и при ошибке чтения
+    if (!device->atEnd()) {
+        if (error)
+            *error = device->errorString();
+        return false;
+    }
+    return true;
+}
+
+bool TrackLog::load(const QStringList &paths, QString *error)
+{
+    TraceSpan span("track.load", paths.size());
+    QVector<QVector<QVector<Point>>> loaded(paths.size());
+    QStringList errors;
+    QMutex mutex;
+
+    // Файл на поток: разбор журнала - в основном чтение и разбор текста
+    QThreadPool pool;
+    pool.setMaxThreadCount(qBound(1, QThread::idealThreadCount(), int(paths.size())));
+    for (int i = 0; i < paths.size(); ++i) {
+        pool.start([&, i]() {
+            QFile file(paths[i]);
+            QString message;
+            bool ok = file.open(QIODevice::ReadOnly);
+            if (!ok) {
+                message = file.errorString();
+            } else {
+                // GPX - XML; всё остальное читается как NMEA
+                const QByteArray head = file.peek(512);
+                if (head.contains("<?xml") || head.contains("<gpx"))
+                    ok = parseGpx(&file, loaded[i], &message);
+                else
+                    ok = parseNmea(&file, loaded[i], &message);
+            }
+            if (!ok) {
+                QMutexLocker locker(&mutex);
+                errors.append(QStringLiteral("%1: %2").arg(paths[i], message));
+            }
+        });
+    }
+    pool.waitForDone();
+
+    for (const auto &segments : std::as_const(loaded))
+        m_segments += segments;
+    span.setValue(pointCount());
+
+    if (!errors.isEmpty()) {
+        if (error)
+            *error = errors.join(QLatin1Char('\n'));
+        return false;
+    }
+    return true;
+}
+
+QVector<int> TrackLog::geotag(QVector<PhotoInfo> &photos, const QVector<int> &indexes) const
+{
+    QVector<int> tagged;
+    if (m_segments.isEmpty() || indexes.isEmpty())
+        return tagged;
+
+    struct Query
+    {
+        qint64 time;   // UTC
+        int index;
+    };
+    QVector<Query> queries;
+    queries.reserve(indexes.size());
+    for (int index : indexes) {
+        const QDateTime &timestamp = photos[index].timestamp;
+        if (timestamp.isValid())
+            queries.append({timestamp.toMSecsSinceEpoch() + m_clockOffset, index});
+    }
+    std::sort(queries.begin(), queries.end(), [](const Query &a, const Query &b) {
+        return a.time < b.time;
+    });
+
+    struct Match
+    {
+        qint64 distance = std::numeric_limits<qint64>::max();   // до ближайшей точки, мс
+        double latitude = 0.0;
+        double longitude = 0.0;
+    };
+    QVector<Match> best(queries.size());
+
+    const auto pointBefore = [](qint64 t, const Point &p) { return t < p.time; };
+    for (const QVector<Point> &segment : m_segments) {
+        const qint64 first = segment.first().time - m_maxGap;
+        const qint64 last = segment.last().time + m_maxGap;
+        auto q = std::lower_bound(queries.cbegin(), queries.cend(), first,
+                                  [](const Query &query, qint64 t) { return query.time < t; });
+
+        // Слияние: указатель по отрезку только растёт; журнал намного плотнее
+        // пачки фото, поэтому к следующему фото - двоичным поиском от текущей точки
+        auto p = segment.cbegin();
+        for (; q != queries.cend() && q->time <= last; ++q) {
+            const qint64 t = q->time;
+            p = std::upper_bound(p, segment.cend(), t, pointBefore);
+            // p - первая точка позже t
+            Match match;
+            if (p == segment.cbegin()) {
+                match = {p->time - t, p->latitude, p->longitude};
+            } else if (p == segment.cend()) {
+                const Point &a = *(p - 1);
+                match = {t - a.time, a.latitude, a.longitude};
+            } else {
+                const Point &a = *(p - 1);
+                const Point &b = *p;
+                match.distance = qMin(t - a.time, b.time - t);
+                if (b.time - a.time <= m_maxGap) {
+                    const double f = double(t - a.time) / double(b.time - a.time);
+                    double dl = b.longitude - a.longitude;
+                    if (dl > 180.0)
+                        dl -= 360.0;
+                    else if (dl < -180.0)
+                        dl += 360.0;
+                    match.latitude = a.latitude + f * (b.latitude - a.latitude);
+                    match.longitude = wrapLongitude(a.longitude + f * dl);
+                } else {
+                    // Разрыв в журнале (прибор выключался) - ближайшая точка
+                    const Point &near = t - a.time <= b.time - t ? a : b;
+                    match.latitude = near.latitude;
+                    match.longitude = near.longitude;
+                }
+            }
+            // Следующее фото не раньше этого: поиск продолжается от точки перед t
+            if (p != segment.cbegin())
+                --p;
+
+            Match &current = best[int(q - queries.cbegin())];
+            if (match.distance <= m_maxGap && match.distance < current.distance)
+                current = match;
+        }
+    }
+
+    for (int i = 0; i < queries.size(); ++i) {
+        if (best[i].distance == std::numeric_limits<qint64>::max())
+            continue;
+        PhotoInfo &info = photos[queries[i].index];
+        info.latitude = best[i].latitude;
+        info.longitude = best[i].longitude;
+        info.hasGps = true;
+        info.gpsFromTrack = true;
+        tagged.append(queries[i].index);
+    }
+    std::sort(tagged.begin(), tagged.end());
+    return tagged;
+}
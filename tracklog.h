@@ -0,0 +1,61 @@
+#ifndef TRACKLOG_H
+#define TRACKLOG_H
+
+#include "photoinfo.h"
+
+#include <QIODevice>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+// Журналы GPS-треков (GPX, NMEA 0183) для привязки фото без GPS в EXIF.
+// Файлы разбираются потоково (QXmlStreamReader / построчно) и параллельно,
+// по файлу на поток, поэтому журналы в гигабайты не раскрываются в дерево.
+// Каждый отрезок трека (trkseg, NMEA-файл) хранится отдельно, точки по времени.
+// Привязка - слияние отсортированных по времени фото с точками каждого отрезка:
+// положение интерполируется между соседними точками, если между ними
+// не больше maxGap; из нескольких отрезков берётся тот, где ближайшая
+// точка ближе по времени.
+// Время точек - UTC; время фото - из EXIF в часовом поясе системы, поэтому
+// поправка часов камеры прибавляется к нему: UTC = время фото + clockOffset.
+class TrackLog
+{
+public:
+    static constexpr qint64 DefaultMaxGapMs = 5 * 60 * 1000;
+
+    struct Point
+    {
+        qint64 time;       // мс от эпохи, UTC
+        double latitude;
+        double longitude;
+    };
+
+    // Загрузка всех файлов; формат определяется по содержимому.
+    // При ошибке в любом файле возвращает false, загруженное остаётся
+    bool load(const QStringList &paths, QString *error = nullptr);
+    void clear();
+    bool isEmpty() const { return m_segments.isEmpty(); }
+    int segmentCount() const { return int(m_segments.size()); }
+    qint64 pointCount() const;
+
+    void setClockOffset(qint64 ms) { m_clockOffset = ms; }
+    qint64 clockOffset() const { return m_clockOffset; }
+    void setMaxGap(qint64 ms) { m_maxGap = qMax<qint64>(0, ms); }
+    qint64 maxGap() const { return m_maxGap; }
+
+    // Отрезки добавляются в segments; точки без времени пропускаются
+    static bool parseGpx(QIODevice *device, QVector<QVector<Point>> &segments, QString *error = nullptr);
+    static bool parseNmea(QIODevice *device, QVector<QVector<Point>> &segments, QString *error = nullptr);
+
+    // Привязка photos[indexes] по времени съёмки. Привязанные фото получают
+    // hasGps и gpsFromTrack; возвращаются их номера в photos.
+    // Потокобезопасно (только чтение)
+    QVector<int> geotag(QVector<PhotoInfo> &photos, const QVector<int> &indexes) const;
+
+private:
+    QVector<QVector<Point>> m_segments;
+    qint64 m_clockOffset = 0;
+    qint64 m_maxGap = DefaultMaxGapMs;
+};
+
+#endif // TRACKLOG_H